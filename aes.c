@@ -0,0 +1,293 @@
+/**
+ * @file
+ * AES-128-CBC segment encryption implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// Built with -DNO_AES_NI, blocks always go through the tables, so "make check" covers them too.
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(NO_AES_NI)
+#include <wmmintrin.h>
+#define AES_NI 1
+#endif
+
+#include "aes.h"
+
+/**
+ * The S-box, and the round tables combining it with the column mixing, one
+ * per byte position, built once on first use.
+ */
+static unsigned char sbox[256];
+static uint32_t tables[4][256];
+static int hardware;
+static pthread_once_t prepared = PTHREAD_ONCE_INIT;
+
+static inline uint32_t ror32(uint32_t value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+static inline unsigned char rol8(unsigned char value, int bits) {
+    return (unsigned char) ((value << bits) | (value >> (8 - bits)));
+}
+
+/**
+ * Big endian reads and writes, whatever the host order.
+ */
+static inline uint32_t read32(const unsigned char *p) {
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+static inline void write32(unsigned char *p, uint32_t value) {
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+}
+
+/**
+ * Used to build the S-box, walking the multiplicative group of GF(2^8) with
+ * the generator 3 and its inverse at once, then the round tables.
+ */
+static void prepare(void) {
+    unsigned char p = 1, q = 1, s, doubled;
+    int i;
+
+    do {
+        p = p ^ (p << 1) ^ (p & 0x80 ? 0x1B : 0);
+        q ^= q << 1;
+        q ^= q << 2;
+        q ^= q << 4;
+        if (q & 0x80) {
+            q ^= 0x09;
+        }
+        sbox[p] = q ^ rol8(q, 1) ^ rol8(q, 2) ^ rol8(q, 3) ^ rol8(q, 4) ^ 0x63;
+    } while (p != 1);
+    sbox[0] = 0x63;
+
+    for (i = 0; i < 256; i++) {
+        s = sbox[i];
+        doubled = (unsigned char) ((s << 1) ^ (s & 0x80 ? 0x1B : 0));
+        tables[0][i] = (uint32_t) doubled << 24 | (uint32_t) s << 16 | (uint32_t) s << 8 | (unsigned char) (doubled ^ s);
+        tables[1][i] = ror32(tables[0][i], 8);
+        tables[2][i] = ror32(tables[0][i], 16);
+        tables[3][i] = ror32(tables[0][i], 24);
+    }
+
+#ifdef AES_NI
+    hardware = __builtin_cpu_supports("aes") != 0;
+#endif
+}
+
+/**
+ * Used to tell whether blocks are encrypted with the AES-NI instructions.
+ *
+ * @return int 1 when they are, 0 when the lookup tables are used.
+ */
+int aesHardware(void) {
+    pthread_once(&prepared, prepare);
+
+    return hardware;
+}
+
+/**
+ * Used to start encrypting a segment.
+ *
+ * @param AES_CBC *aes the cipher.
+ * @param const unsigned char *key the key, AES_KEY_SIZE bytes.
+ * @param const unsigned char *iv the initialization vector, AES_BLOCK_SIZE bytes.
+ */
+void aesCbcInit(AES_CBC *aes, const unsigned char *key, const unsigned char *iv) {
+    static const unsigned char rcon[AES_ROUNDS] = {0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36};
+    uint32_t *w = aes->words, temp;
+    int i;
+
+    pthread_once(&prepared, prepare);
+
+    for (i = 0; i < 4; i++) {
+        w[i] = read32(key + 4 * i);
+    }
+    for (i = 4; i < 4 * (AES_ROUNDS + 1); i++) {
+        temp = w[i - 1];
+        if (!(i % 4)) {
+            temp = ((uint32_t) sbox[(temp >> 16) & 0xFF] << 24 | (uint32_t) sbox[(temp >> 8) & 0xFF] << 16
+                    | (uint32_t) sbox[temp & 0xFF] << 8 | sbox[temp >> 24]) ^ (uint32_t) rcon[i / 4 - 1] << 24;
+        }
+        w[i] = w[i - 4] ^ temp;
+    }
+
+    for (i = 0; i < 4 * (AES_ROUNDS + 1); i++) {
+        write32(aes->roundKeys[i / 4] + 4 * (i % 4), w[i]);
+    }
+
+    memcpy(aes->chain, iv, AES_BLOCK_SIZE);
+    aes->fill = 0;
+}
+
+/**
+ * Used to encrypt blocks with the lookup tables.
+ */
+static void encryptTables(AES_CBC *aes, const unsigned char *in, unsigned char *out, size_t blocks) {
+    const uint32_t *w;
+    uint32_t s0, s1, s2, s3, t0, t1, t2, t3;
+    int round;
+
+    s0 = read32(aes->chain);
+    s1 = read32(aes->chain + 4);
+    s2 = read32(aes->chain + 8);
+    s3 = read32(aes->chain + 12);
+
+    for (; blocks; blocks--, in += AES_BLOCK_SIZE, out += AES_BLOCK_SIZE) {
+        w = aes->words;
+        s0 ^= read32(in) ^ w[0];
+        s1 ^= read32(in + 4) ^ w[1];
+        s2 ^= read32(in + 8) ^ w[2];
+        s3 ^= read32(in + 12) ^ w[3];
+
+        for (round = 1; round < AES_ROUNDS; round++) {
+            w += 4;
+            t0 = tables[0][s0 >> 24] ^ tables[1][(s1 >> 16) & 0xFF] ^ tables[2][(s2 >> 8) & 0xFF] ^ tables[3][s3 & 0xFF] ^ w[0];
+            t1 = tables[0][s1 >> 24] ^ tables[1][(s2 >> 16) & 0xFF] ^ tables[2][(s3 >> 8) & 0xFF] ^ tables[3][s0 & 0xFF] ^ w[1];
+            t2 = tables[0][s2 >> 24] ^ tables[1][(s3 >> 16) & 0xFF] ^ tables[2][(s0 >> 8) & 0xFF] ^ tables[3][s1 & 0xFF] ^ w[2];
+            t3 = tables[0][s3 >> 24] ^ tables[1][(s0 >> 16) & 0xFF] ^ tables[2][(s1 >> 8) & 0xFF] ^ tables[3][s2 & 0xFF] ^ w[3];
+            s0 = t0;
+            s1 = t1;
+            s2 = t2;
+            s3 = t3;
+        }
+
+        // The last round does not mix the columns.
+        w += 4;
+        t0 = ((uint32_t) sbox[s0 >> 24] << 24 | (uint32_t) sbox[(s1 >> 16) & 0xFF] << 16 | (uint32_t) sbox[(s2 >> 8) & 0xFF] << 8 | sbox[s3 & 0xFF]) ^ w[0];
+        t1 = ((uint32_t) sbox[s1 >> 24] << 24 | (uint32_t) sbox[(s2 >> 16) & 0xFF] << 16 | (uint32_t) sbox[(s3 >> 8) & 0xFF] << 8 | sbox[s0 & 0xFF]) ^ w[1];
+        t2 = ((uint32_t) sbox[s2 >> 24] << 24 | (uint32_t) sbox[(s3 >> 16) & 0xFF] << 16 | (uint32_t) sbox[(s0 >> 8) & 0xFF] << 8 | sbox[s1 & 0xFF]) ^ w[2];
+        t3 = ((uint32_t) sbox[s3 >> 24] << 24 | (uint32_t) sbox[(s0 >> 16) & 0xFF] << 16 | (uint32_t) sbox[(s1 >> 8) & 0xFF] << 8 | sbox[s2 & 0xFF]) ^ w[3];
+        s0 = t0;
+        s1 = t1;
+        s2 = t2;
+        s3 = t3;
+
+        write32(out, s0);
+        write32(out + 4, s1);
+        write32(out + 8, s2);
+        write32(out + 12, s3);
+    }
+
+    write32(aes->chain, s0);
+    write32(aes->chain + 4, s1);
+    write32(aes->chain + 8, s2);
+    write32(aes->chain + 12, s3);
+}
+
+#ifdef AES_NI
+/**
+ * Used to encrypt blocks with the AES-NI instructions. CBC chains the blocks,
+ * so they are encrypted one after the other.
+ */
+__attribute__((target("aes,sse2")))
+static void encryptHardware(AES_CBC *aes, const unsigned char *in, unsigned char *out, size_t blocks) {
+    __m128i keys[AES_ROUNDS + 1], block;
+    int round;
+
+    for (round = 0; round <= AES_ROUNDS; round++) {
+        keys[round] = _mm_loadu_si128((const __m128i *) aes->roundKeys[round]);
+    }
+
+    block = _mm_loadu_si128((const __m128i *) aes->chain);
+    for (; blocks; blocks--, in += AES_BLOCK_SIZE, out += AES_BLOCK_SIZE) {
+        block = _mm_xor_si128(block, _mm_loadu_si128((const __m128i *) in));
+        block = _mm_xor_si128(block, keys[0]);
+        for (round = 1; round < AES_ROUNDS; round++) {
+            block = _mm_aesenc_si128(block, keys[round]);
+        }
+        block = _mm_aesenclast_si128(block, keys[AES_ROUNDS]);
+        _mm_storeu_si128((__m128i *) out, block);
+    }
+    _mm_storeu_si128((__m128i *) aes->chain, block);
+}
+#endif
+
+static void encrypt(AES_CBC *aes, const unsigned char *in, unsigned char *out, size_t blocks) {
+#ifdef AES_NI
+    if (hardware) {
+        encryptHardware(aes, in, out, blocks);
+        return;
+    }
+#endif
+    encryptTables(aes, in, out, blocks);
+}
+
+/**
+ * Used to encrypt the next bytes of a segment. Only whole blocks are written,
+ * the bytes left are held until the next call.
+ *
+ * @param AES_CBC *aes the cipher.
+ * @param const unsigned char *in the bytes.
+ * @param size_t size the number of bytes.
+ * @param unsigned char *out receives the encrypted blocks, size + AES_BLOCK_SIZE bytes at most, apart from the bytes.
+ * @return size_t the number of bytes written to out.
+ */
+size_t aesCbcUpdate(AES_CBC *aes, const unsigned char *in, size_t size, unsigned char *out) {
+    size_t written = 0, taken, blocks;
+
+    if (aes->fill) {
+        taken = AES_BLOCK_SIZE - aes->fill < size ? AES_BLOCK_SIZE - aes->fill : size;
+        memcpy(aes->pending + aes->fill, in, taken);
+        aes->fill += taken;
+        in += taken;
+        size -= taken;
+
+        if (aes->fill < AES_BLOCK_SIZE) {
+            return 0;
+        }
+        encrypt(aes, aes->pending, out, 1);
+        written = AES_BLOCK_SIZE;
+        aes->fill = 0;
+    }
+
+    blocks = size / AES_BLOCK_SIZE;
+    if (blocks) {
+        encrypt(aes, in, out + written, blocks);
+        written += blocks * AES_BLOCK_SIZE;
+    }
+
+    aes->fill = size % AES_BLOCK_SIZE;
+    memcpy(aes->pending, in + blocks * AES_BLOCK_SIZE, aes->fill);
+
+    return written;
+}
+
+/**
+ * Used to end a segment with its padded last block. The padding always adds
+ * a block, a whole one when the segment ends on a block boundary.
+ *
+ * @param AES_CBC *aes the cipher.
+ * @param unsigned char *out receives the last block, AES_BLOCK_SIZE bytes.
+ * @return size_t the number of bytes written to out, AES_BLOCK_SIZE.
+ */
+size_t aesCbcFinal(AES_CBC *aes, unsigned char *out) {
+    memset(aes->pending + aes->fill, AES_BLOCK_SIZE - aes->fill, AES_BLOCK_SIZE - aes->fill);
+    encrypt(aes, aes->pending, out, 1);
+    aes->fill = 0;
+
+    return AES_BLOCK_SIZE;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,56 @@
+/**
+ * @file
+ * AES-128-CBC segment encryption prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * AES-128 in CBC mode, with PKCS#7 padding, as HLS expects of METHOD=AES-128
+ * segments. Segments are encrypted as they are written, in the chunks the
+ * muxer flushes, whatever their sizes: a partial block is held until the next
+ * chunk completes it, and the padding is added once the segment is complete.
+ * Blocks are encrypted with the AES-NI instructions when the processor has
+ * them, with lookup tables otherwise. It expects <stdint.h> and <stddef.h> to
+ * be included first.
+ */
+#define AES_BLOCK_SIZE 16
+#define AES_KEY_SIZE 16
+#define AES_ROUNDS 10
+
+typedef struct aes_cbc {
+    /**
+     * @var unsigned char roundKeys the expanded key, in the byte order the AES-NI instructions use.
+     * @var uint32_t words the expanded key, as big endian words for the lookup tables.
+     */
+    unsigned char roundKeys[AES_ROUNDS + 1][AES_BLOCK_SIZE];
+    uint32_t words[4 * (AES_ROUNDS + 1)];
+
+    /**
+     * @var unsigned char chain the last encrypted block, the initialization vector at first.
+     * @var unsigned char pending the start of a block not complete yet.
+     */
+    unsigned char chain[AES_BLOCK_SIZE],
+                  pending[AES_BLOCK_SIZE];
+    unsigned int fill;
+} AES_CBC;
+
+int aesHardware(void);
+void aesCbcInit(AES_CBC *, const unsigned char *, const unsigned char *);
+size_t aesCbcUpdate(AES_CBC *, const unsigned char *, size_t, unsigned char *);
+size_t aesCbcFinal(AES_CBC *, unsigned char *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
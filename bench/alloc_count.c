@@ -0,0 +1,151 @@
+/**
+ * @file
+ * Allocation counter, preloaded into the benchmarked segmenter.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * Counts the heap allocations of a process, by wrapping the glibc allocator
+ * entry points. Loaded with LD_PRELOAD, it writes its counts at exit to the
+ * file named by BENCH_ALLOC_OUTPUT, as
+ * "allocations=<n> frees=<n> bytes=<n> outside_libav=<n>", the last one
+ * counting the allocations not called from the libav libraries, which are the
+ * segmenter's own and those of the C library functions it calls.
+ */
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <link.h>
+
+#define ALLOC_COUNT_MAX_RANGES 32
+
+extern void *__libc_malloc(size_t);
+extern void *__libc_calloc(size_t, size_t);
+extern void *__libc_realloc(void *, size_t);
+extern void *__libc_memalign(size_t, size_t);
+extern void __libc_free(void *);
+
+static atomic_ullong allocations,
+                     frees,
+                     bytes,
+                     outsideLibav;
+
+/**
+ * The loaded segments of the libav libraries, found once they are all loaded.
+ */
+static struct {
+    uintptr_t start,
+              end;
+} ranges[ALLOC_COUNT_MAX_RANGES];
+static int rangesCount;
+
+static int findRanges(struct dl_phdr_info *info, size_t size, void *data) {
+    int i;
+
+    if (!strstr(info->dlpi_name, "/libav")) {
+        return 0;
+    }
+
+    for (i = 0; i < info->dlpi_phnum && rangesCount < ALLOC_COUNT_MAX_RANGES; i++) {
+        if (info->dlpi_phdr[i].p_type == PT_LOAD) {
+            ranges[rangesCount].start = info->dlpi_addr + info->dlpi_phdr[i].p_vaddr;
+            ranges[rangesCount].end = ranges[rangesCount].start + info->dlpi_phdr[i].p_memsz;
+            ++rangesCount;
+        }
+    }
+
+    return 0;
+}
+
+__attribute__((constructor)) static void start(void) {
+    dl_iterate_phdr(findRanges, NULL);
+}
+
+static void count(size_t size, void *caller) {
+    uintptr_t address = (uintptr_t) caller;
+    int i;
+
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&bytes, size, memory_order_relaxed);
+
+    for (i = 0; i < rangesCount && (address < ranges[i].start || address >= ranges[i].end); i++);
+    if (i == rangesCount) {
+        atomic_fetch_add_explicit(&outsideLibav, 1, memory_order_relaxed);
+    }
+}
+
+void *malloc(size_t size) {
+    count(size, __builtin_return_address(0));
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t members, size_t size) {
+    count(members * size, __builtin_return_address(0));
+    return __libc_calloc(members, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+    count(size, __builtin_return_address(0));
+    return __libc_realloc(pointer, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    count(size, __builtin_return_address(0));
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    count(size, __builtin_return_address(0));
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size) {
+    count(size, __builtin_return_address(0));
+    *pointer = __libc_memalign(alignment, size);
+    return *pointer ? 0 : ENOMEM;
+}
+
+void free(void *pointer) {
+    if (pointer) {
+        atomic_fetch_add_explicit(&frees, 1, memory_order_relaxed);
+    }
+    __libc_free(pointer);
+}
+
+/**
+ * Used to write the counts, once the program is done.
+ */
+__attribute__((destructor)) static void report(void) {
+    const char *path = getenv("BENCH_ALLOC_OUTPUT");
+    FILE *fp;
+
+    if (!path || !(fp = fopen(path, "w"))) {
+        return;
+    }
+
+    fprintf(fp, "allocations=%llu frees=%llu bytes=%llu outside_libav=%llu\n", (unsigned long long) atomic_load(&allocations),
+            (unsigned long long) atomic_load(&frees), (unsigned long long) atomic_load(&bytes),
+            (unsigned long long) atomic_load(&outsideLibav));
+    fclose(fp);
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,700 @@
+/**
+ * @file
+ * End-to-end segmenter benchmark.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * Runs the segmenter over synthetic inputs from tsgen, in each of its modes,
+ * and writes one JSON line per case: wall and CPU time, throughput, peak
+ * resident memory, read and write system calls, context switches, page faults
+ * and heap allocations (counted by alloc_count.so, when it is found). The
+ * inputs are deterministic, so lines of two runs compare case by case. The
+ * steady state case checks that, past startup, the segmenter allocates nothing
+ * per packet or per segment, besides what libav allocates. The reuse cases
+ * run the segmenter a first time with other cue points, then keep what they
+ * can of that run, and check where the playlist marks discontinuities.
+ */
+#define _GNU_SOURCE
+#define _XOPEN_SOURCE 700
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+#define BENCH_MAX_ARGUMENTS 32
+#define BENCH_MAX_PATH 1024
+
+/**
+ * Seconds between two cue points of the cue points file case.
+ */
+#define BENCH_CUE_PERIOD 3.3
+
+/**
+ * Cue points of the previous run of the reuse cases, one moved from theirs.
+ */
+#define BENCH_PREVIOUS_CUES "[7,19,29,41,53]"
+
+typedef struct bench_case {
+    const char *name,
+            /**
+             * @var const char *input tsgen options, besides the duration and bitrate.
+             * @var const char *options segmenter options.
+             * @var const char *cues the cue points argument.
+             * @var const char *window the segment window size, NULL for none.
+             */
+            *input,
+            *options,
+            *cues,
+            *window;
+    /**
+     * @var int cuesFile whether a cue points file is written and given with --cues.
+     * @var int steadyState whether the case is also run over the first half of its input,
+     * so what the second half took is told apart from the startup.
+     */
+    int cuesFile,
+        steadyState;
+    /**
+     * @var const char *previous the tsgen options of the input of a previous run, whose segments
+     * are kept with --reuse, NULL for none.
+     * @var int seamless whether the kept segments join the written ones with no discontinuity.
+     */
+    const char *previous;
+    int seamless;
+} BENCH_CASE;
+
+static const BENCH_CASE cases[] = {
+    {"plain", "", "", "[]", NULL, 0, 0},
+    {"cues", "", "", "[7,19,23,41,53]", NULL, 0, 0},
+    {"cues_file", "", "", "[]", NULL, 1, 0},
+    {"window", "", "", "[]", "6", 0, 0},
+    {"window_file_pool", "", "--file-pool", "[]", "6", 0, 0},
+    {"size_cap", "", "--max-bytes=1000000", "[]", "6", 0, 0},
+    {"long_gop", "--gop=250", "", "[]", NULL, 0, 0},
+    {"pts_wrap", "--pts-start=8589000000", "", "[]", NULL, 0, 0},
+    {"discontinuity", "--discontinuity=20", "", "[]", NULL, 0, 0},
+    {"video_only", "--streams=video", "", "[]", NULL, 0, 0},
+    {"audio_only", "--streams=audio", "", "[]", NULL, 0, 0},
+    {"encrypted", "", "--encrypt --key-rotation=10", "[]", "6", 0, 0},
+    {"steady_state", "", "", "[]", "6", 1, 1},
+    {"reuse", "", "", "[7,19,23,41,53]", NULL, 0, 0, "", 1},
+    {"reuse_reencoded", "", "", "[7,19,23,41,53]", NULL, 0, 0, "--seed=2", 0}
+};
+
+#define BENCH_CASES (int) (sizeof (cases) / sizeof (cases[0]))
+
+typedef struct bench_options {
+    const char *segmenter,
+            *tsgen,
+            *allocCounter,
+            *only,
+            *output;
+    double duration,
+           segmentDuration;
+    long bitrate;
+    int keep;
+} BENCH_OPTIONS;
+
+/**
+ * What a run of the segmenter took.
+ */
+typedef struct bench_result {
+    int status;
+    double seconds;
+    struct rusage usage;
+    unsigned long long readSyscalls,
+                       writeSyscalls,
+                       allocations,
+                       allocatedBytes,
+                       outsideLibav,
+                       segments,
+                       packets,
+                       interleaveForced;
+} BENCH_RESULT;
+
+static struct option longOptions[] = {
+    {"segmenter", required_argument, NULL, 's'},
+    {"tsgen", required_argument, NULL, 'g'},
+    {"alloc-counter", required_argument, NULL, 'a'},
+    {"duration", required_argument, NULL, 'd'},
+    {"segment-duration", required_argument, NULL, 'D'},
+    {"bitrate", required_argument, NULL, 'b'},
+    {"case", required_argument, NULL, 'c'},
+    {"output", required_argument, NULL, 'o'},
+    {"keep", no_argument, NULL, 'k'},
+    {NULL, 0, NULL, 0}
+};
+
+/**
+ * Used to print the usage, and exit.
+ *
+ * @param const char *program the program name.
+ */
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n"
+            "Options:\n"
+            "  --segmenter=<path>          defaults to ./segmenter\n"
+            "  --tsgen=<path>              defaults to bench/tsgen\n"
+            "  --alloc-counter=<path>      defaults to bench/alloc_count.so, allocations are not counted without it\n"
+            "  --duration=<seconds>        input duration, defaults to 60\n"
+            "  --segment-duration=<s>      defaults to 4\n"
+            "  --bitrate=<bits per second> input video bitrate, defaults to 4000000\n"
+            "  --case=<name>               run this case only\n"
+            "  --output=<file>             the JSON lines, defaults to the standard output\n"
+            "  --keep                      keep the inputs and outputs in the work directory\n", program);
+    exit(1);
+}
+
+/**
+ * Used to split options given as one string, in place.
+ *
+ * @return int the arguments count after it.
+ */
+static int splitArguments(char *options, char **argv, int argc) {
+    char *save = NULL, *token;
+
+    for (token = strtok_r(options, " ", &save); token && argc < BENCH_MAX_ARGUMENTS - 8; token = strtok_r(NULL, " ", &save)) {
+        argv[argc++] = token;
+    }
+
+    return argc;
+}
+
+/**
+ * Used to run a program until it ends, and measure it.
+ *
+ * @param char **argv the program and its arguments, NULL terminated.
+ * @param const char *log the file its output goes to.
+ * @param const char *allocOutput the file the allocation counts go to, NULL not to count them.
+ * @param const char *allocCounter the allocation counter library.
+ * @param BENCH_RESULT *result receives the measures.
+ * @return int 0 when it could be run, -1 otherwise.
+ */
+static int run(char **argv, const char *log, const char *allocOutput, const char *allocCounter, BENCH_RESULT *result) {
+    struct timespec start, end;
+    siginfo_t info;
+    char path[BENCH_MAX_PATH], line[256];
+    FILE *fp;
+    pid_t pid;
+    int fd;
+
+    memset(result, 0, sizeof (BENCH_RESULT));
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pid = fork();
+    if (pid < 0) {
+        return -1;
+    }
+
+    if (!pid) {
+        fd = open(log, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            dup2(fd, STDOUT_FILENO);
+            dup2(fd, STDERR_FILENO);
+            close(fd);
+        }
+        if (allocOutput) {
+            setenv("LD_PRELOAD", allocCounter, 1);
+            setenv("BENCH_ALLOC_OUTPUT", allocOutput, 1);
+        }
+        execv(argv[0], argv);
+        _exit(127);
+    }
+
+    // Left unreaped until its system calls counts are read.
+    if (waitid(P_PID, pid, &info, WEXITED | WNOWAIT) < 0) {
+        return -1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    result->seconds = end.tv_sec - start.tv_sec + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    snprintf(path, sizeof (path), "/proc/%d/io", pid);
+    if ((fp = fopen(path, "r"))) {
+        while (fgets(line, sizeof (line), fp)) {
+            sscanf(line, "syscr: %llu", &result->readSyscalls);
+            sscanf(line, "syscw: %llu", &result->writeSyscalls);
+        }
+        fclose(fp);
+    }
+
+    if (wait4(pid, &result->status, 0, &result->usage) < 0) {
+        return -1;
+    }
+    result->status = WIFEXITED(result->status) ? WEXITSTATUS(result->status) : 128 + WTERMSIG(result->status);
+
+    if (allocOutput && (fp = fopen(allocOutput, "r"))) {
+        if (fscanf(fp, "allocations=%llu frees=%*u bytes=%llu outside_libav=%llu", &result->allocations, &result->allocatedBytes,
+                &result->outsideLibav) != 3) {
+            result->allocations = result->allocatedBytes = result->outsideLibav = 0;
+        }
+        fclose(fp);
+    }
+
+    return 0;
+}
+
+/**
+ * Used to find the first input with the same tsgen options, among the inputs
+ * of the cases, then those of their previous runs.
+ *
+ * @return int the input, which names its file.
+ */
+static int firstInput(const char *tsgen) {
+    int first;
+
+    for (first = 0; first < 2 * BENCH_CASES; first++) {
+        if (first < BENCH_CASES ? !strcmp(cases[first].input, tsgen)
+                : cases[first - BENCH_CASES].previous && !strcmp(cases[first - BENCH_CASES].previous, tsgen)) {
+            break;
+        }
+    }
+
+    return first;
+}
+
+/**
+ * Used to generate the input of a case, or of its previous run, unless an
+ * earlier one is the same.
+ *
+ * @param int previous whether it is the input of the previous run.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int generateInput(const BENCH_OPTIONS *options, const char *workdir, int index, int previous, double seconds, char *input) {
+    char *argv[BENCH_MAX_ARGUMENTS], duration[64], bitrate[64], output[BENCH_MAX_PATH + 16], log[BENCH_MAX_PATH], *copy;
+    const char *tsgen = previous ? cases[index].previous : cases[index].input;
+    BENCH_RESULT result;
+    int argc = 0, first, ret;
+
+    first = firstInput(tsgen);
+    snprintf(input, BENCH_MAX_PATH, "%s/input-%d-%g.ts", workdir, first, seconds);
+    if (!access(input, R_OK)) {
+        return 0;
+    }
+
+    snprintf(duration, sizeof (duration), "--duration=%g", seconds);
+    snprintf(bitrate, sizeof (bitrate), "--bitrate=%ld", options->bitrate);
+    snprintf(output, sizeof (output), "--output=%s", input);
+    snprintf(log, sizeof (log), "%s/input-%d-%g.log", workdir, first, seconds);
+
+    copy = strdup(tsgen);
+    if (!copy) {
+        return -1;
+    }
+
+    argv[argc++] = (char *) options->tsgen;
+    argv[argc++] = duration;
+    argv[argc++] = bitrate;
+    argc = splitArguments(copy, argv, argc);
+    argv[argc++] = output;
+    argv[argc] = NULL;
+
+    ret = run(argv, log, NULL, NULL, &result);
+    free(copy);
+
+    if (ret < 0 || result.status) {
+        fprintf(stderr, "{\"error\" : \"Could not generate the input of case %s, see %s.\"}\n", cases[index].name, log);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to write a cue points file, a cue point every BENCH_CUE_PERIOD seconds.
+ *
+ * @return int 0 on success, -1 otherwise.
+ */
+static int writeCues(const char *path, double duration) {
+    FILE *fp = fopen(path, "w");
+    double time;
+
+    if (!fp) {
+        return -1;
+    }
+
+    for (time = BENCH_CUE_PERIOD; time < duration; time += BENCH_CUE_PERIOD) {
+        fprintf(fp, "%.3f\n", time);
+    }
+
+    return fclose(fp);
+}
+
+/**
+ * Used to read a counter from the metrics the segmenter exported.
+ *
+ * @param const char *path the metrics file.
+ * @param const char *name the counter, with the opening brace of its labels.
+ */
+static unsigned long long readCounter(const char *path, const char *name) {
+    unsigned long long value = 0;
+    char line[512];
+    FILE *fp = fopen(path, "r");
+
+    if (!fp) {
+        return 0;
+    }
+
+    while (fgets(line, sizeof (line), fp)) {
+        if (!strncmp(line, name, strlen(name))) {
+            sscanf(strchr(line, '}') + 1, "%llu", &value);
+        }
+    }
+    fclose(fp);
+
+    return value;
+}
+
+/**
+ * Used to run the segmenter over the input of a case.
+ *
+ * @param const char *input the input.
+ * @param const char *directory the directory the outputs go to.
+ * @param int previous whether it is the previous run of the case, cut on BENCH_PREVIOUS_CUES, whose manifest the case reuses.
+ * @param int counted whether the allocations are counted.
+ * @param BENCH_RESULT *result receives the measures.
+ * @return int 0 when it could be run, -1 otherwise.
+ */
+static int runSegmenter(const BENCH_OPTIONS *options, const BENCH_CASE *benchCase, const char *input, const char *directory,
+        int previous, int counted, BENCH_RESULT *result) {
+    char *argv[BENCH_MAX_ARGUMENTS], *copy, prefix[BENCH_MAX_PATH + 8], playlist[BENCH_MAX_PATH + 16], log[BENCH_MAX_PATH + 16],
+         allocOutput[BENCH_MAX_PATH + 16], metrics[BENCH_MAX_PATH + 32], cues[BENCH_MAX_PATH + 16], segmentDuration[64],
+         manifest[BENCH_MAX_PATH + 32], reuse[BENCH_MAX_PATH + 32];
+    int argc = 0, ret;
+
+    if (mkdir(directory, 0755) < 0 && errno != EEXIST) {
+        return -1;
+    }
+    snprintf(prefix, sizeof (prefix), "%s/seg", directory);
+    snprintf(playlist, sizeof (playlist), "%s/index.m3u8", directory);
+    snprintf(log, sizeof (log), "%s/%s.log", directory, previous ? "previous" : "segmenter");
+    snprintf(allocOutput, sizeof (allocOutput), "%s/alloc.txt", directory);
+    snprintf(metrics, sizeof (metrics), "--metrics=%s/%s.prom", directory, previous ? "previous" : "metrics");
+    snprintf(segmentDuration, sizeof (segmentDuration), "%g", options->segmentDuration);
+    snprintf(manifest, sizeof (manifest), "--manifest=%s/%s", directory, previous ? "previous.manifest" : "manifest");
+    snprintf(reuse, sizeof (reuse), "--reuse=%s/previous.manifest", directory);
+
+    copy = strdup(benchCase->options);
+    if (!copy) {
+        return -1;
+    }
+
+    argv[argc++] = (char *) options->segmenter;
+    argv[argc++] = metrics;
+    if (benchCase->cuesFile) {
+        snprintf(cues, sizeof (cues), "%s/cues.txt", directory);
+        if (writeCues(cues, options->duration) < 0) {
+            free(copy);
+            return -1;
+        }
+        snprintf(cues, sizeof (cues), "--cues=%s/cues.txt", directory);
+        argv[argc++] = cues;
+    }
+    if (benchCase->previous) {
+        argv[argc++] = manifest;
+    }
+    if (benchCase->previous && !previous) {
+        argv[argc++] = reuse;
+    }
+    argc = splitArguments(copy, argv, argc);
+    argv[argc++] = (char *) input;
+    argv[argc++] = segmentDuration;
+    argv[argc++] = previous ? BENCH_PREVIOUS_CUES : (char *) benchCase->cues;
+    argv[argc++] = prefix;
+    argv[argc++] = playlist;
+    argv[argc++] = "/";
+    if (benchCase->window) {
+        argv[argc++] = (char *) benchCase->window;
+    }
+    argv[argc] = NULL;
+
+    ret = run(argv, log, counted ? allocOutput : NULL, options->allocCounter, result);
+    free(copy);
+    if (ret < 0) {
+        return -1;
+    }
+    result->segments = readCounter(metrics + 10, "segmenter_segments_total{");
+    result->packets = readCounter(metrics + 10, "segmenter_packets_total{");
+    result->interleaveForced = readCounter(metrics + 10, "segmenter_interleave_forced_delta_total{")
+        + readCounter(metrics + 10, "segmenter_interleave_forced_bytes_total{");
+
+    if (result->status) {
+        fprintf(stderr, "{\"error\" : \"Case %s exited with %d, see %s.\"}\n", benchCase->name, result->status, log);
+    }
+
+    return 0;
+}
+
+/**
+ * Used to check that a case was interleaved within its budgets. The inputs are
+ * well interleaved, timestamps wraps and discontinuities included, so no
+ * packet should have been written before its turn.
+ *
+ * @return int 0 on success, 1 otherwise.
+ */
+static int checkInterleaving(const BENCH_CASE *benchCase, const BENCH_RESULT *result) {
+    if (result->interleaveForced) {
+        fprintf(stderr, "{\"error\" : \"Case %s wrote %llu packets before their turn, past the interleaving budgets.\"}\n",
+                benchCase->name, result->interleaveForced);
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to check how a case kept the segments of its previous run: some were
+ * kept, and the playlist marks discontinuities where they join the segments
+ * written only when the previous run muxed another encoding of the input.
+ *
+ * @return int 0 on success, 1 otherwise.
+ */
+static int checkJoins(const BENCH_CASE *benchCase, const char *directory) {
+    char path[BENCH_MAX_PATH + 32], line[512];
+    unsigned int kept = 0, discontinuities = 0;
+    FILE *fp;
+
+    snprintf(path, sizeof (path), "%s/segmenter.log", directory);
+    if ((fp = fopen(path, "r"))) {
+        while (fgets(line, sizeof (line), fp)) {
+            sscanf(line, "{\"info\" : \"Kept %u", &kept);
+        }
+        fclose(fp);
+    }
+
+    snprintf(path, sizeof (path), "%s/index.m3u8", directory);
+    if ((fp = fopen(path, "r"))) {
+        while (fgets(line, sizeof (line), fp)) {
+            discontinuities += !strcmp(line, "#EXT-X-DISCONTINUITY\n");
+        }
+        fclose(fp);
+    }
+
+    if (!kept) {
+        fprintf(stderr, "{\"error\" : \"Case %s kept no segment of its previous run.\"}\n", benchCase->name);
+        return 1;
+    }
+    if ((discontinuities == 0) != benchCase->seamless) {
+        fprintf(stderr, "{\"error\" : \"Case %s kept %u segments, and marked %u discontinuities where %s were expected.\"}\n",
+                benchCase->name, kept, discontinuities, benchCase->seamless ? "none" : "some");
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to run one case, and write its line.
+ *
+ * @return int 0 on success, 1 when the interleaving, steady state or joins check failed, -1 when the case could not be run.
+ */
+static int runCase(const BENCH_OPTIONS *options, const char *workdir, int index, FILE *out) {
+    const BENCH_CASE *benchCase = &cases[index];
+    char input[BENCH_MAX_PATH], directory[BENCH_MAX_PATH + 8];
+    BENCH_RESULT result, half;
+    struct stat info;
+    unsigned long long segments, packets, outside, all;
+    int counted = !access(options->allocCounter, R_OK);
+
+    snprintf(directory, sizeof (directory), "%s/%s", workdir, benchCase->name);
+    if (benchCase->previous && (generateInput(options, workdir, index, 1, options->duration, input) < 0
+            || runSegmenter(options, benchCase, input, directory, 1, 0, &result) < 0 || result.status)) {
+        return -1;
+    }
+
+    if (generateInput(options, workdir, index, 0, options->duration, input) < 0 || stat(input, &info) < 0) {
+        return -1;
+    }
+
+    if (runSegmenter(options, benchCase, input, directory, 0, counted, &result) < 0) {
+        return -1;
+    }
+
+    fprintf(out, "{\"case\" : \"%s\", \"status\" : %d, \"input_seconds\" : %g, \"input_bytes\" : %lld, \"seconds\" : %.3f,"
+            " \"mb_per_second\" : %.2f, \"realtime_factor\" : %.1f, \"user_seconds\" : %.3f, \"system_seconds\" : %.3f,"
+            " \"peak_rss_kb\" : %ld, \"read_syscalls\" : %llu, \"write_syscalls\" : %llu, \"voluntary_switches\" : %ld,"
+            " \"involuntary_switches\" : %ld, \"minor_faults\" : %ld, \"allocations\" : ",
+            benchCase->name, result.status, options->duration, (long long) info.st_size, result.seconds,
+            info.st_size / 1048576.0 / result.seconds, options->duration / result.seconds,
+            result.usage.ru_utime.tv_sec + result.usage.ru_utime.tv_usec / 1e6,
+            result.usage.ru_stime.tv_sec + result.usage.ru_stime.tv_usec / 1e6,
+            result.usage.ru_maxrss, result.readSyscalls, result.writeSyscalls, result.usage.ru_nvcsw,
+            result.usage.ru_nivcsw, result.usage.ru_minflt);
+    if (counted) {
+        fprintf(out, "%llu, \"allocated_bytes\" : %llu", result.allocations, result.allocatedBytes);
+    } else {
+        fprintf(out, "null, \"allocated_bytes\" : null");
+    }
+    fprintf(out, ", \"segments\" : %llu, \"interleave_forced\" : %llu", result.segments, result.interleaveForced);
+
+    if (!benchCase->steadyState || !counted) {
+        fprintf(out, "}\n");
+        fflush(out);
+        if (benchCase->previous && checkJoins(benchCase, directory)) {
+            return 1;
+        }
+        return checkInterleaving(benchCase, &result);
+    }
+
+    // The same input cut short, what the full run took beyond it is the steady state.
+    snprintf(directory, sizeof (directory), "%s/%s-half", workdir, benchCase->name);
+    if (generateInput(options, workdir, index, 0, options->duration / 2, input) < 0
+            || runSegmenter(options, benchCase, input, directory, 0, counted, &half) < 0) {
+        fprintf(out, "}\n");
+        return -1;
+    }
+
+    segments = result.segments - half.segments;
+    packets = result.packets - half.packets;
+    outside = result.outsideLibav - half.outsideLibav;
+    all = result.allocations - half.allocations;
+    fprintf(out, ", \"steady_segments\" : %llu, \"steady_packets\" : %llu, \"steady_allocations\" : %llu,"
+            " \"steady_allocations_outside_libav\" : %llu, \"libav_allocations_per_packet\" : %.2f}\n",
+            segments, packets, all, outside, packets ? (double) (all - outside) / packets : 0);
+    fflush(out);
+
+    if (!segments || result.status || half.status) {
+        fprintf(stderr, "{\"error\" : \"Case %s cut no segment past the first half of its input.\"}\n", benchCase->name);
+        return 1;
+    }
+    if (outside) {
+        fprintf(stderr, "{\"error\" : \"Case %s allocated %llu times over %llu segments and %llu packets past startup.\"}\n",
+                benchCase->name, outside, segments, packets);
+        return 1;
+    }
+
+    return checkInterleaving(benchCase, &result);
+}
+
+/**
+ * Used to remove the work directory, entry by entry.
+ */
+static int removeEntry(const char *path, const struct stat *info, int flag, struct FTW *ftw) {
+    return remove(path);
+}
+
+int main(int argc, char **argv) {
+    BENCH_OPTIONS options;
+    char workdir[] = "/tmp/segmenter-bench-XXXXXX", *check;
+    FILE *out = stdout;
+    int opt, i, ret, failed = 0, ran = 0;
+
+    memset(&options, 0, sizeof (options));
+    options.segmenter = "./segmenter";
+    options.tsgen = "bench/tsgen";
+    options.allocCounter = "bench/alloc_count.so";
+    options.duration = 60;
+    options.segmentDuration = 4;
+    options.bitrate = 4000000;
+
+    while ((opt = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 's':
+                options.segmenter = optarg;
+                break;
+            case 'g':
+                options.tsgen = optarg;
+                break;
+            case 'a':
+                options.allocCounter = optarg;
+                break;
+            case 'd':
+                options.duration = strtod(optarg, &check);
+                if (check == optarg || *check || options.duration <= 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'D':
+                options.segmentDuration = strtod(optarg, &check);
+                if (check == optarg || *check || options.segmentDuration <= 0) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'b':
+                options.bitrate = strtol(optarg, &check, 10);
+                if (check == optarg || *check || options.bitrate < 10000) {
+                    usage(argv[0]);
+                }
+                break;
+            case 'c':
+                options.only = optarg;
+                break;
+            case 'o':
+                options.output = optarg;
+                break;
+            case 'k':
+                options.keep = 1;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    // The library is preloaded from the case directories.
+    if ((check = realpath(options.allocCounter, NULL))) {
+        options.allocCounter = check;
+    }
+
+    if (!mkdtemp(workdir)) {
+        fprintf(stderr, "{\"error\" : \"Could not create the work directory.\"}\n");
+        return 1;
+    }
+
+    if (options.output && !(out = fopen(options.output, "w"))) {
+        fprintf(stderr, "{\"error\" : \"Could not open the output (%s).\"}\n", options.output);
+        return 1;
+    }
+
+    for (i = 0; i < BENCH_CASES; i++) {
+        if (options.only && strcmp(options.only, cases[i].name)) {
+            continue;
+        }
+        ++ran;
+        ret = runCase(&options, workdir, i, out);
+        if (ret < 0) {
+            fprintf(stderr, "{\"error\" : \"Could not run case %s.\"}\n", cases[i].name);
+        }
+        failed |= ret != 0;
+    }
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    if (options.keep) {
+        fprintf(stderr, "{\"info\" : \"Inputs and outputs kept in %s.\"}\n", workdir);
+    } else {
+        nftw(workdir, removeEntry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+
+    if (!ran) {
+        fprintf(stderr, "{\"error\" : \"No case named %s.\"}\n", options.only);
+        return 1;
+    }
+
+    return failed;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,794 @@
+/**
+ * @file
+ * Known answer checks.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * Checks the segment encryption against FIPS-197 and SP 800-38A (with the
+ * PKCS#7 padding), SHA-256 against FIPS 180-4 and the lengths around its
+ * padding, XXH64 against the reference values, and the gzip playlist by
+ * inflating each version with zlib. Inputs are fed whole, then in uneven
+ * chunks, as the muxer flushes them. "make check" builds it twice, with the
+ * AES-NI and SHA-NI paths, and without them (-DNO_AES_NI -DNO_SHA_NI). Also
+ * feeds the control FIFO, the SCTE-35 scanner and the cue points loader valid
+ * and malformed input, and checks the marks of the input feed and when a ring
+ * fed by its caller lets the demuxer go on. Writes one JSON line per check,
+ * and exits with 1 when any failed.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "../aes.h"
+#include "../digest.h"
+#include "../gzip_playlist.h"
+#include "../control.h"
+#include "../scte35.h"
+#include "../cue_loader.h"
+#include "../readahead.h"
+#include "../input_feed.h"
+
+/**
+ * Chunk sizes inputs are fed in, in turn.
+ */
+static const size_t chunks[] = {1, 7, 16, 31, 64, 5, 200};
+
+#define CHECK_CHUNKS (int) (sizeof (chunks) / sizeof (chunks[0]))
+#define CHECK_MAX_OUTPUT 4096
+
+#define CHECK_WAIT_STEPS 2000
+#define CHECK_PMT_PID 0x100
+#define CHECK_SCTE35_PID 0x101
+#define CHECK_VIDEO_PID 0x100
+#define CHECK_AUDIO_PID 0x101
+#define CHECK_FEED_PACKETS 8
+#define CHECK_RING_SIZE 1024
+#define CUES_MATCH(content, expected, end) \
+    cuesMatch(content, sizeof (content) - 1, expected, sizeof (expected) / sizeof (expected[0]), end)
+#define CUES_NONE(content, end) cuesMatch(content, sizeof (content) - 1, NULL, 0, end)
+
+static int failures,
+           savedStderr = -1;
+
+/**
+ * Used to report one check.
+ */
+static void report(const char *name, const char *path, int passed) {
+    printf("{\"check\" : \"%s\", \"path\" : \"%s\", \"result\" : \"%s\"}\n", name, path, passed ? "pass" : "fail");
+    failures += !passed;
+}
+
+/**
+ * Used to hide the errors reported on the malformed inputs fed on purpose, and bring them back.
+ */
+static void quiet(int on) {
+    int null;
+
+    fflush(stderr);
+    if (on && savedStderr < 0) {
+        null = open("/dev/null", O_WRONLY);
+        savedStderr = dup(2);
+        if (null >= 0) {
+            dup2(null, 2);
+            close(null);
+        }
+    } else if (!on && savedStderr >= 0) {
+        dup2(savedStderr, 2);
+        close(savedStderr);
+        savedStderr = -1;
+    }
+}
+
+/**
+ * Used to decode a hexadecimal string.
+ *
+ * @return size_t the bytes decoded.
+ */
+static size_t unhex(const char *hex, unsigned char *out) {
+    size_t i, length = strlen(hex) / 2;
+    unsigned int byte;
+
+    for (i = 0; i < length; i++) {
+        sscanf(hex + 2 * i, "%2x", &byte);
+        out[i] = (unsigned char) byte;
+    }
+
+    return length;
+}
+
+/**
+ * Used to encrypt a message, whole or in chunks, padding included, and compare it with the expected ciphertext.
+ */
+static int aesMatches(const char *key, const char *iv, const unsigned char *message, size_t size, const char *expected, int chunked) {
+    unsigned char keyBytes[AES_KEY_SIZE], ivBytes[AES_BLOCK_SIZE], out[CHECK_MAX_OUTPUT], want[CHECK_MAX_OUTPUT];
+    size_t length = 0, offset, chunk;
+    AES_CBC aes;
+    int i = 0;
+
+    unhex(key, keyBytes);
+    unhex(iv, ivBytes);
+    aesCbcInit(&aes, keyBytes, ivBytes);
+
+    for (offset = 0; offset < size; offset += chunk) {
+        chunk = chunked ? chunks[i++ % CHECK_CHUNKS] : size;
+        if (chunk > size - offset) {
+            chunk = size - offset;
+        }
+        length += aesCbcUpdate(&aes, message + offset, chunk, out + length);
+    }
+    length += aesCbcFinal(&aes, out + length);
+
+    return length == unhex(expected, want) && !memcmp(out, want, length);
+}
+
+static void checkAes(const char *path) {
+    unsigned char message[64];
+    size_t size;
+    int chunked;
+
+    for (chunked = 0; chunked < 2; chunked++) {
+        // FIPS-197 appendix C.1: a single block with a zero IV is the block cipher itself, the padding block follows.
+        size = unhex("00112233445566778899aabbccddeeff", message);
+        report(chunked ? "aes_fips197_chunked" : "aes_fips197", path, aesMatches("000102030405060708090a0b0c0d0e0f",
+                "00000000000000000000000000000000", message, size,
+                "69c4e0d86a7b0430d8cdb78070b4c55a9e978e6d16b086570ef794ef97984232", chunked));
+
+        // SP 800-38A F.2.1, four whole blocks, then a whole padding block.
+        size = unhex("6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+                "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710", message);
+        report(chunked ? "aes_sp800_38a_chunked" : "aes_sp800_38a", path, aesMatches("2b7e151628aed2a6abf7158809cf4f3c",
+                "000102030405060708090a0b0c0d0e0f", message, size,
+                "7649abac8119b246cee98e9b12e9197d5086cb9b507219ee95db113a917678b2"
+                "73bed6b8e3c1743b7116e69e222295163ff1caa1681fac09120eca307586e1a7"
+                "8cb82807230e1321d3fae00d18cc2012", chunked));
+
+        // The same key and IV, a partial last block padded up.
+        size = unhex("6bc1bee22e409f96e93d7e117393172aae2d8a57", message);
+        report(chunked ? "aes_padding_chunked" : "aes_padding", path, aesMatches("2b7e151628aed2a6abf7158809cf4f3c",
+                "000102030405060708090a0b0c0d0e0f", message, size,
+                "7649abac8119b246cee98e9b12e9197d2e013f890472d82217b17f45f6e7f539", chunked));
+    }
+}
+
+/**
+ * Used to hash a message, whole or in chunks, and compare it with the expected digest.
+ */
+static int shaMatches(const unsigned char *message, size_t size, const char *expected, int chunked) {
+    unsigned char digest[SHA256_SIZE], want[SHA256_SIZE];
+    size_t offset, chunk;
+    SHA256 sha;
+    int i = 0;
+
+    sha256Init(&sha);
+    for (offset = 0; offset < size; offset += chunk) {
+        chunk = chunked ? chunks[i++ % CHECK_CHUNKS] : size;
+        if (chunk > size - offset) {
+            chunk = size - offset;
+        }
+        sha256Update(&sha, message + offset, chunk);
+    }
+    sha256Final(&sha, digest);
+    unhex(expected, want);
+
+    return !memcmp(digest, want, SHA256_SIZE);
+}
+
+static void checkSha256(const char *path) {
+    static const struct {
+        const char *name,
+                   *message;
+        size_t repeat;
+        const char *digest;
+    } vectors[] = {
+        {"sha256_empty", "", 0, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+        {"sha256_abc", "abc", 1, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+        {"sha256_448_bits", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 1,
+            "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+        // The length still fits the block at 55 bytes, not at 56, and a whole block is padded with another one.
+        {"sha256_55_bytes", "a", 55, "9f4390f8d30c2dd92ec9f095b65e2b9ae9b0a925a5258e241c9f1e910f734318"},
+        {"sha256_56_bytes", "a", 56, "b35439a4ac6f0948b6d6f9e3c6af0f5f590ce20f1bde7090ef7970686ec6738a"},
+        {"sha256_63_bytes", "a", 63, "7d3e74a05d7db15bce4ad9ec0658ea98e3f06eeecf16b4c6fff2da457ddc2f34"},
+        {"sha256_64_bytes", "a", 64, "ffe054fe7ae0cb6dc65c3af9b61d5209f439851db43d0ba5997337df154668eb"},
+        {"sha256_million_a", "a", 1000000, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0"}
+    };
+    unsigned char *message;
+    char name[64];
+    size_t i, size, length;
+    int chunked;
+
+    for (i = 0; i < sizeof (vectors) / sizeof (vectors[0]); i++) {
+        length = strlen(vectors[i].message);
+        size = length * vectors[i].repeat;
+        message = malloc(size + 1);
+        if (!message) {
+            report(vectors[i].name, path, 0);
+            continue;
+        }
+        for (size = 0; size < length * vectors[i].repeat; size += length) {
+            memcpy(message + size, vectors[i].message, length);
+        }
+
+        for (chunked = 0; chunked < 2; chunked++) {
+            snprintf(name, sizeof (name), "%s%s", vectors[i].name, chunked ? "_chunked" : "");
+            report(name, path, shaMatches(message, size, vectors[i].digest, chunked));
+        }
+        free(message);
+    }
+}
+
+static void checkXxh64(void) {
+    static const struct {
+        const char *name;
+        size_t size;
+        uint64_t seed,
+                 digest;
+    } vectors[] = {
+        {"xxh64_empty", 0, 0, 0xEF46DB3751D8E999ULL},
+        {"xxh64_empty_seed", 0, 1, 0xD5AFBA1336A3BE4BULL},
+        {"xxh64_a", 1, 0, 0xD24EC4F1A98C6E5BULL},
+        {"xxh64_abc", 3, 0, 0x44BC2CF5AD770999ULL},
+        // Past the 32 bytes stripes, with 8, 4 and 1 byte tails, then stripes only.
+        {"xxh64_35_bytes", 35, 0, 0xF1911D891BECAD9FULL},
+        {"xxh64_1024_bytes", 1024, 0, 0x6F3914F18FE4DF57ULL},
+        {"xxh64_1024_bytes_seed", 1024, 0x9E3779B97F4A7C15ULL, 0x22D0F4503BCDA26AULL}
+    };
+    unsigned char message[1024];
+    char name[64];
+    size_t i, offset, chunk;
+    int chunked, c;
+    XXH64 xxh;
+
+    for (i = 0; i < sizeof (vectors) / sizeof (vectors[0]); i++) {
+        if (vectors[i].size == 35) {
+            memcpy(message, "abcdefghijklmnopqrstuvwxyz012345678", 35);
+        } else if (vectors[i].size == 1024) {
+            for (offset = 0; offset < 1024; offset++) {
+                message[offset] = (unsigned char) offset;
+            }
+        } else {
+            memcpy(message, "abc", vectors[i].size);
+        }
+
+        for (chunked = 0; chunked < 2; chunked++) {
+            xxh64Init(&xxh, vectors[i].seed);
+            for (offset = 0, c = 0; offset < vectors[i].size; offset += chunk) {
+                chunk = chunked ? chunks[c++ % CHECK_CHUNKS] : vectors[i].size;
+                if (chunk > vectors[i].size - offset) {
+                    chunk = vectors[i].size - offset;
+                }
+                xxh64Update(&xxh, message + offset, chunk);
+            }
+            snprintf(name, sizeof (name), "%s%s", vectors[i].name, chunked ? "_chunked" : "");
+            report(name, "c", xxh64Digest(&xxh) == vectors[i].digest);
+        }
+    }
+}
+
+/**
+ * Used to inflate a published gzip version, and compare it with the playlist.
+ */
+static int gzipMatches(const GZIP_PLAYLIST *gzip, const char *playlist, size_t size) {
+    unsigned char out[CHECK_MAX_OUTPUT * 4];
+    z_stream stream;
+    int ret;
+
+    memset(&stream, 0, sizeof (stream));
+    if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) {
+        return 0;
+    }
+    stream.next_in = gzip->data;
+    stream.avail_in = gzip->published;
+    stream.next_out = out;
+    stream.avail_out = sizeof (out);
+    ret = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+
+    // The whole version, trailer included, is one complete gzip member.
+    return ret == Z_STREAM_END && !stream.avail_in && stream.total_out == size && !memcmp(out, playlist, size);
+}
+
+static void checkGzip(void) {
+    char playlist[CHECK_MAX_OUTPUT * 4];
+    size_t size = 0;
+    GZIP_PLAYLIST gzip;
+    int i, passed = 1;
+
+    if (gzipPlaylistInit(&gzip) < 0) {
+        report("gzip_appends", "zlib", 0);
+        return;
+    }
+
+    // A growing playlist, appended to, then restarted once the appends outgrow the whole compression.
+    size = snprintf(playlist, sizeof (playlist), "#EXTM3U\n#EXT-X-TARGETDURATION:10\n#EXT-X-MEDIA-SEQUENCE:1\n");
+    for (i = 1; i <= 200 && passed; i++) {
+        size += snprintf(playlist + size, sizeof (playlist) - size, "#EXTINF:10,\nhttp://example.com/seg-%d.ts\n", i);
+        passed = gzipPlaylistUpdate(&gzip, playlist, size) == 0 && gzipMatches(&gzip, playlist, size);
+    }
+    report("gzip_appends", "zlib", passed && gzip.appends && gzip.rebuilds > 1);
+
+    // A version that is not an extension of the previous one restarts the stream.
+    size = snprintf(playlist, sizeof (playlist), "#EXTM3U\n#EXT-X-TARGETDURATION:11\n#EXT-X-MEDIA-SEQUENCE:2\n");
+    report("gzip_rewrite", "zlib", gzipPlaylistUpdate(&gzip, playlist, size) == 0 && gzipMatches(&gzip, playlist, size));
+
+    // The same version again appends nothing, and is still whole.
+    report("gzip_unchanged", "zlib", gzipPlaylistUpdate(&gzip, playlist, size) == 0 && gzipMatches(&gzip, playlist, size));
+
+    gzipPlaylistDestroy(&gzip);
+}
+
+/**
+ * Used to write a string to a file descriptor.
+ *
+ * @return int 1 when it was written whole, 0 otherwise.
+ */
+static int writeText(int fd, const char *text) {
+    return write(fd, text, strlen(text)) == (ssize_t) strlen(text);
+}
+
+static void checkControl(void) {
+    static const CUE_COMMAND expected[] = {{1000, 0, 0}, {1000, 0, 1}, {5, 1, 0}, {2000, 0, 0}, {0, 0, 0}};
+    char directory[] = "/tmp/check-XXXXXX", path[64], line[CONTROL_MAX_LINE * 2];
+    CUE_COMMAND commands[16];
+    CONTROL control;
+    int fd, count = 0, i, passed;
+
+    if (!mkdtemp(directory)) {
+        report("control_commands", "c", 0);
+        return;
+    }
+    snprintf(path, sizeof (path), "%s/control", directory);
+
+    quiet(1);
+    if (controlStart(&control, path) < 0 || (fd = open(path, O_WRONLY | O_NONBLOCK)) < 0) {
+        quiet(0);
+        report("control_commands", "c", 0);
+        rmdir(directory);
+        return;
+    }
+
+    // Valid commands, blank lines and comments, then malformed ones, each dropped on its own.
+    passed = writeText(fd, "at 1000\n  pts 90000\r\nin 5\n\n# at 3\n");
+    passed &= writeText(fd, "bogus 5\nat -1\nat 12x\nat\natx 5\n");
+
+    // A line longer than the buffer is dropped whole, with the command past the buffer at its end.
+    memset(line, 'x', CONTROL_MAX_LINE);
+    strcpy(line + CONTROL_MAX_LINE, "at 99\nat 2000\nat 0\n");
+    passed &= writeText(fd, line);
+
+    // The last command marks the end of the ones written.
+    for (i = 0; i < CHECK_WAIT_STEPS && passed && count < 16; i++) {
+        if (!controlReceive(&control, &commands[count])) {
+            usleep(1000);
+            continue;
+        }
+        if (commands[count++].time == 0) {
+            break;
+        }
+    }
+
+    close(fd);
+    controlStop(&control);
+    quiet(0);
+    unlink(path);
+    rmdir(directory);
+
+    passed &= count == sizeof (expected) / sizeof (expected[0]);
+    for (i = 0; i < count && passed; i++) {
+        passed = commands[i].time == expected[i].time && commands[i].relative == expected[i].relative
+            && commands[i].input == expected[i].input;
+    }
+    report("control_commands", "c", passed);
+}
+
+/**
+ * Used to append the MPEG-2 CRC to a section.
+ *
+ * @return int the section size, CRC included.
+ */
+static int sectionWithCrc(uint8_t *section, int size) {
+    uint32_t crc = 0xFFFFFFFF;
+    int i, bit;
+
+    for (i = 0; i < size; i++) {
+        crc ^= (uint32_t) section[i] << 24;
+        for (bit = 0; bit < 8; bit++) {
+            crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+    for (i = 0; i < 4; i++) {
+        section[size + i] = (uint8_t) (crc >> (24 - 8 * i));
+    }
+
+    return size + 4;
+}
+
+/**
+ * Used to wrap a section in a transport stream packet, starting a payload, stuffed up to its end.
+ */
+static void sectionPacket(uint8_t *packet, int pid, const uint8_t *section, int size) {
+    memset(packet, 0xFF, SCTE35_TS_PACKET_SIZE);
+    packet[0] = 0x47;
+    packet[1] = 0x40 | (pid >> 8);
+    packet[2] = pid & 0xFF;
+    packet[3] = 0x10;
+    packet[4] = 0;
+    memcpy(packet + 5, section, size);
+}
+
+/**
+ * Used to write a 33 bits time after 7 bits of flags.
+ */
+static void writeTime(uint8_t *data, int flags, long long time) {
+    data[0] = flags | (int) ((time >> 32) & 0x01);
+    data[1] = (time >> 24) & 0xFF;
+    data[2] = (time >> 16) & 0xFF;
+    data[3] = (time >> 8) & 0xFF;
+    data[4] = time & 0xFF;
+}
+
+/**
+ * Used to scan a PAT, a PMT listing the SCTE-35 PID, then a splice_info_section, in uneven chunks.
+ *
+ * @param SCTE35 *scte35 the scanner.
+ * @param int type the splice command type.
+ * @param const uint8_t *command the splice command.
+ * @param int length the command length.
+ * @param long long adjustment the PTS adjustment.
+ * @param int corrupt 1 to break the section CRC.
+ */
+static void scanSplice(SCTE35 *scte35, int type, const uint8_t *command, int length, long long adjustment, int corrupt) {
+    static const uint8_t pat[] = {0x00, 0xB0, 0x0D, 0x00, 0x01, 0xC1, 0x00, 0x00,
+        0x00, 0x01, 0xE0 | (CHECK_PMT_PID >> 8), CHECK_PMT_PID & 0xFF};
+    static const uint8_t pmt[] = {0x02, 0xB0, 0x12, 0x00, 0x01, 0xC1, 0x00, 0x00, 0xE1, 0x00, 0xF0, 0x00,
+        SCTE35_STREAM_TYPE, 0xE0 | (CHECK_SCTE35_PID >> 8), CHECK_SCTE35_PID & 0xFF, 0xF0, 0x00};
+    uint8_t stream[SCTE35_TS_PACKET_SIZE * 3], section[SCTE35_TS_PACKET_SIZE];
+    int size, offset, chunk, i = 0;
+
+    memcpy(section, pat, sizeof (pat));
+    sectionPacket(stream, 0, section, sectionWithCrc(section, sizeof (pat)));
+    memcpy(section, pmt, sizeof (pmt));
+    sectionPacket(stream + SCTE35_TS_PACKET_SIZE, CHECK_PMT_PID, section, sectionWithCrc(section, sizeof (pmt)));
+
+    // Protocol version 0, clear, no tier, then the command and an empty descriptors loop.
+    size = 14 + length + 2;
+    section[0] = 0xFC;
+    section[1] = 0x30 | ((size + 4 - 3) >> 8);
+    section[2] = (size + 4 - 3) & 0xFF;
+    section[3] = 0;
+    writeTime(section + 4, 0x00, adjustment);
+    section[9] = 0;
+    section[10] = 0xFF;
+    section[11] = 0xF0 | (length >> 8);
+    section[12] = length & 0xFF;
+    section[13] = type;
+    memcpy(section + 14, command, length);
+    section[14 + length] = 0xF0;
+    section[15 + length] = 0;
+    size = sectionWithCrc(section, size);
+    section[size - 1] ^= corrupt;
+    sectionPacket(stream + 2 * SCTE35_TS_PACKET_SIZE, CHECK_SCTE35_PID, section, size);
+
+    scte35Init(scte35);
+    for (offset = 0; offset < (int) sizeof (stream); offset += chunk) {
+        chunk = chunks[i++ % CHECK_CHUNKS];
+        if (chunk > (int) sizeof (stream) - offset) {
+            chunk = sizeof (stream) - offset;
+        }
+        scte35Scan(scte35, stream + offset, chunk);
+    }
+}
+
+/**
+ * Used to compare the splices detected, and the errors counted, with the expected ones.
+ */
+static int splicesMatch(SCTE35 *scte35, const SCTE35_SPLICE *expected, int count, unsigned long long errors) {
+    SCTE35_SPLICE splice;
+    int i;
+
+    if (scte35->sections != 1 || scte35->errors != errors) {
+        return 0;
+    }
+    for (i = 0; i < count; i++) {
+        if (!scte35Receive(scte35, &splice) || splice.pts != expected[i].pts || splice.duration != expected[i].duration) {
+            return 0;
+        }
+    }
+
+    return !scte35Receive(scte35, &splice);
+}
+
+static void checkScte35(void) {
+    static const SCTE35_SPLICE program = {901000, 2700000}, immediate = {-1, 2700000}, component = {450000, 0},
+                               wrapped = {99, 0};
+    uint8_t command[64];
+    SCTE35 scte35;
+
+    // splice_insert, event 1, out of network, program splice mode, with a time and a duration.
+    memcpy(command, "\x00\x00\x00\x01\x7F\xE0", 6);
+    writeTime(command + 6, 0xFE, 900000);
+    writeTime(command + 11, 0xFE, 2700000);
+    memcpy(command + 16, "\x00\x01\x00\x00", 4);
+    scanSplice(&scte35, 0x05, command, 20, 1000, 0);
+    report("scte35_program", "c", splicesMatch(&scte35, &program, 1, 0));
+
+    // The same section, its CRC broken.
+    scanSplice(&scte35, 0x05, command, 20, 1000, 1);
+    report("scte35_bad_crc", "c", splicesMatch(&scte35, NULL, 0, 1));
+
+    // The same event, cancelled.
+    command[4] = 0xFF;
+    scanSplice(&scte35, 0x05, command, 20, 1000, 0);
+    report("scte35_cancelled", "c", splicesMatch(&scte35, NULL, 0, 0));
+
+    // Program splice mode, its time cut short by the command length.
+    command[4] = 0x7F;
+    scanSplice(&scte35, 0x05, command, 8, 1000, 0);
+    report("scte35_truncated", "c", splicesMatch(&scte35, NULL, 0, 1));
+
+    // Component splice mode, immediate: two tags without times, then the duration.
+    memcpy(command, "\x00\x00\x00\x02\x7F\xB0\x02\x01\x02", 9);
+    writeTime(command + 9, 0xFE, 2700000);
+    memcpy(command + 14, "\x00\x02\x00\x00", 4);
+    scanSplice(&scte35, 0x05, command, 18, 1000, 0);
+    report("scte35_component_immediate", "c", splicesMatch(&scte35, &immediate, 1, 0));
+
+    // Component splice mode with times, the first component gives the splice time.
+    memcpy(command, "\x00\x00\x00\x03\x7F\x80\x02\x01", 8);
+    writeTime(command + 8, 0xFE, 449000);
+    command[13] = 0x02;
+    writeTime(command + 14, 0xFE, 500000);
+    memcpy(command + 19, "\x00\x03\x00\x00", 4);
+    scanSplice(&scte35, 0x05, command, 23, 1000, 0);
+    report("scte35_component", "c", splicesMatch(&scte35, &component, 1, 0));
+
+    // The same components, the second time missing.
+    scanSplice(&scte35, 0x05, command, 16, 1000, 0);
+    report("scte35_component_truncated", "c", splicesMatch(&scte35, NULL, 0, 1));
+
+    // A time signal, its time wrapping past 33 bits with the adjustment.
+    writeTime(command, 0xFE, 0x1FFFFFFFFLL);
+    scanSplice(&scte35, 0x06, command, 5, 100, 0);
+    report("scte35_time_signal_wrap", "c", splicesMatch(&scte35, &wrapped, 1, 0));
+
+    // A time signal without a time carries no splice.
+    command[0] = 0x7F;
+    scanSplice(&scte35, 0x06, command, 1, 100, 0);
+    report("scte35_time_signal_empty", "c", splicesMatch(&scte35, NULL, 0, 0));
+}
+
+/**
+ * Used to load a cue points file, and compare the cue points read, and how the reading ended, with the expected ones.
+ *
+ * @param const char *content the file content.
+ * @param size_t size the content size.
+ * @param const unsigned int *expected the cue points expected, in milliseconds.
+ * @param int count the cue points count.
+ * @param int end the last cueLoaderNext() result expected, -1 for an error, 0 for the end of the file.
+ * @return int 1 when they match, 0 otherwise.
+ */
+static int cuesMatch(const char *content, size_t size, const unsigned int *expected, int count, int end) {
+    char path[] = "/tmp/check-cues-XXXXXX";
+    unsigned int time;
+    CUE_LOADER loader;
+    int fd, i, ret = 1, passed;
+
+    fd = mkstemp(path);
+    if (fd < 0) {
+        return 0;
+    }
+    passed = write(fd, content, size) == (ssize_t) size;
+    close(fd);
+
+    quiet(1);
+    if (passed && cueLoaderOpen(&loader, path) == 0) {
+        for (i = 0; passed && (ret = cueLoaderNext(&loader, &time)) > 0; i++) {
+            passed = i < count && time == expected[i];
+        }
+        passed &= i == count && ret == end;
+        cueLoaderClose(&loader);
+    } else {
+        // A file that can not be opened is expected only as an error, before any cue point.
+        passed &= !count && end < 0;
+    }
+    quiet(0);
+    unlink(path);
+
+    return passed;
+}
+
+static void checkCueLoader(void) {
+    static const unsigned int text[] = {500, 1000, 2500, 3125, 10000, 4294967295U}, first[] = {5000}, binaryFirst[] = {500},
+                              binary[] = {500, 1500, 129500};
+
+    // Comments, blank lines, whitespace, and 0 to 3 decimals on either side of the point.
+    report("cue_loader_text", "c", CUES_MATCH("# breaks\n\n.5\n  1\r\n\t2.5\n3.125 \n10.\n4294967.295\n", text, 0));
+    report("cue_loader_point_only", "c", CUES_NONE(".\n", -1) && CUES_MATCH("5\n.\n", first, -1));
+    report("cue_loader_not_a_time", "c", CUES_MATCH("5\n1.2.3\n", first, -1) && CUES_MATCH("5\nabc\n", first, -1) &&
+            CUES_MATCH("5\n-1\n", first, -1) && CUES_MATCH("5\n6 7\n", first, -1));
+    report("cue_loader_out_of_order", "c", CUES_MATCH("5\n4\n", first, -1) && CUES_MATCH("5\n5.000\n", first, -1));
+    report("cue_loader_too_large", "c", CUES_MATCH("5\n4294967.296\n", first, -1) &&
+            CUES_MATCH("5\n99999999999999999999\n", first, -1));
+    report("cue_loader_line_too_long", "c", CUES_MATCH("5\n1000000000000000000000000000000000000000000000000000000000000000000\n",
+            first, -1));
+
+    // Deltas from the previous cue point, as 7 bits groups, the lowest first.
+    report("cue_loader_binary", "c", CUES_MATCH("CUEB\x01\xF4\x03\xE8\x07\x80\xE8\x07", binary, 0));
+    report("cue_loader_binary_truncated", "c", CUES_MATCH("CUEB\x01\xF4\x03\xE8", binaryFirst, -1) &&
+            CUES_NONE("CUEB\x01", 0));
+    report("cue_loader_binary_duplicate", "c", CUES_MATCH("CUEB\x01\xF4\x03\x00", binaryFirst, -1));
+    report("cue_loader_binary_too_large", "c", CUES_NONE("CUEB\x01\xFF\xFF\xFF\xFF\x7F", -1) &&
+            CUES_NONE("CUEB\x01\xFF\xFF\xFF\xFF\x8F\x01", -1));
+    report("cue_loader_binary_version", "c", CUES_NONE("CUEB\x02\xF4\x03", -1) && CUES_NONE("CUEX\x01", -1));
+}
+
+/**
+ * Used to write a TS packet, 0xFF filled.
+ *
+ * @param uint8_t *packet the packet.
+ * @param int pid its PID.
+ * @param int start whether it starts a payload unit.
+ * @param int stuffing the adaptation field length, -1 for none.
+ * @param const uint8_t *payload the first payload bytes.
+ * @param int size their count.
+ */
+static void feedPacket(uint8_t *packet, int pid, int start, int stuffing, const uint8_t *payload, int size) {
+    int offset = 4;
+
+    memset(packet, 0xFF, INPUT_FEED_TS_PACKET_SIZE);
+    packet[0] = 0x47;
+    packet[1] = (start ? 0x40 : 0) | (pid >> 8);
+    packet[2] = pid & 0xFF;
+    packet[3] = stuffing >= 0 ? 0x30 : 0x10;
+    if (stuffing >= 0) {
+        packet[4] = stuffing;
+        offset += 1 + stuffing;
+    }
+    memcpy(packet + offset, payload, size);
+}
+
+/**
+ * Used to feed a stream whole or in chunks, and keep the last mark.
+ *
+ * @return int64_t the last mark, -1 when none, -2 when a chunk returned a mark that is not one of the expected ones.
+ */
+static int64_t feedMarks(const uint8_t *stream, int size, int chunked, int64_t first, int64_t last) {
+    INPUT_FEED feed;
+    int64_t marked = -1, mark;
+    int offset, chunk, i = 0;
+
+    inputFeedInit(&feed);
+    for (offset = 0; offset < size; offset += chunk) {
+        chunk = chunked ? (int) chunks[i++ % CHECK_CHUNKS] : size;
+        if (chunk > size - offset) {
+            chunk = size - offset;
+        }
+        mark = inputFeedMark(&feed, stream + offset, chunk);
+        if (mark >= 0 && marked != -2) {
+            marked = mark == first || mark == last ? mark : -2;
+        }
+    }
+    inputFeedDestroy(&feed);
+
+    return marked;
+}
+
+static void checkInputFeed(void) {
+    static const uint8_t pat[] = {0x00, 0x00, 0xB0, 0x0D}, pes[] = {0x00, 0x00, 0x01, 0xE0}, data[] = {0x00, 0x00, 0x01, 0xC0};
+    uint8_t stream[3 + CHECK_FEED_PACKETS * INPUT_FEED_TS_PACKET_SIZE], *packets = stream + 3;
+    int size = CHECK_FEED_PACKETS * INPUT_FEED_TS_PACKET_SIZE;
+
+    // The first PES of each PID completes none, neither do sections, continuations, nor errored packets.
+    feedPacket(packets, 0, 1, -1, pat, sizeof (pat));
+    feedPacket(packets + 188, CHECK_VIDEO_PID, 1, -1, pes, sizeof (pes));
+    feedPacket(packets + 2 * 188, CHECK_VIDEO_PID, 0, -1, pes, sizeof (pes));
+    feedPacket(packets + 3 * 188, CHECK_AUDIO_PID, 1, 7, data, sizeof (data));
+    feedPacket(packets + 4 * 188, CHECK_VIDEO_PID, 1, -1, pes, sizeof (pes));
+    feedPacket(packets + 5 * 188, CHECK_AUDIO_PID, 1, 0, data, sizeof (data));
+    feedPacket(packets + 6 * 188, CHECK_VIDEO_PID, 1, -1, pes, sizeof (pes));
+    packets[6 * 188 + 1] |= 0x80;
+    feedPacket(packets + 7 * 188, CHECK_AUDIO_PID, 1, 182, data, sizeof (data));
+
+    report("input_feed_marks", "whole", feedMarks(packets, size, 0, 4 * 188, 5 * 188) == 5 * 188);
+    report("input_feed_marks", "chunked", feedMarks(packets, size, 1, 4 * 188, 5 * 188) == 5 * 188);
+    report("input_feed_marks", "none", feedMarks(packets, 4 * 188, 1, -1, -1) == -1);
+
+    // Bytes before the first sync byte are skipped, and counted in the offsets.
+    memset(stream, 0, 3);
+    report("input_feed_resync", "chunked", feedMarks(stream, size + 3, 1, 3 + 4 * 188, 3 + 5 * 188) == 3 + 5 * 188);
+}
+
+/**
+ * Used to feed bytes to a ring, as the supervisor poller does.
+ *
+ * @return int 1 when they all fit in one piece, 0 otherwise.
+ */
+static int fillRing(READAHEAD *readahead, size_t size, int64_t mark) {
+    size_t room;
+    uint8_t *space = readaheadSpace(readahead, &room);
+
+    if (!space || room < size) {
+        return 0;
+    }
+    memset(space, 0x47, size);
+    readaheadFilled(readahead, size, 0, mark);
+
+    return 1;
+}
+
+static void checkReadahead(void) {
+    READAHEAD readahead;
+    uint8_t buffer[CHECK_RING_SIZE];
+    size_t room;
+    int passed;
+
+    if (readaheadInit(&readahead, CHECK_RING_SIZE) < 0) {
+        report("readahead_fed", "c", 0);
+        return;
+    }
+
+    // Unread bytes of the demuxer count as buffered.
+    passed = !readaheadPending(&readahead, 512, 0) && fillRing(&readahead, 100, -1) && !readaheadPending(&readahead, 512, 0)
+             && readaheadPending(&readahead, 512, 412) && readaheadPending(&readahead, 100, 0);
+    report("readahead_fed_bytes", "c", passed);
+
+    // A mark counts until the demuxer got past it.
+    passed = fillRing(&readahead, 100, 150) && readaheadPending(&readahead, 512, 0) && readaheadRead(&readahead, buffer, 150) == 150
+             && readaheadPending(&readahead, 512, 0) && readaheadPending(&readahead, 512, 1) && readaheadRead(&readahead, buffer, 1) == 1
+             && !readaheadPending(&readahead, 512, 0);
+    report("readahead_fed_mark", "c", passed);
+
+    // A full ring gives no room, in two pieces once it wraps, and lets the demuxer go on, as does the end of the input.
+    passed = fillRing(&readahead, CHECK_RING_SIZE - 200, -1) && fillRing(&readahead, 151, -1) && readaheadSpace(&readahead, &room) == NULL
+             && readaheadPending(&readahead, 2 * CHECK_RING_SIZE, 0) && readahead.overflows == 1
+             && readaheadRead(&readahead, buffer, CHECK_RING_SIZE) == CHECK_RING_SIZE && fillRing(&readahead, 49, -1)
+             && readaheadRead(&readahead, buffer, CHECK_RING_SIZE) == 49 && !readaheadPending(&readahead, 512, 0);
+    readaheadFilled(&readahead, 0, 0, -1);
+    passed &= readaheadPending(&readahead, 512, 0) && readaheadSpace(&readahead, &room) == NULL
+              && readaheadRead(&readahead, buffer, CHECK_RING_SIZE) == 0;
+    report("readahead_fed_full", "c", passed);
+
+    readaheadStop(&readahead);
+}
+
+int main(void) {
+    checkAes(aesHardware() ? "aes-ni" : "tables");
+    checkSha256(sha256Hardware() ? "sha-ni" : "c");
+    checkXxh64();
+    checkGzip();
+    checkControl();
+    checkScte35();
+    checkCueLoader();
+    checkInputFeed();
+    checkReadahead();
+
+    if (failures) {
+        fflush(stdout);
+        fprintf(stderr, "{\"error\" : \"%d checks failed.\"}\n", failures);
+    }
+
+    return failures ? 1 : 0;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,476 @@
+/**
+ * @file
+ * Cue points planning and linked list microbenchmarks.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * Times the list operations cue points are handled with, the cue points files
+ * parsing, and the plan, over 10 to 1M cue points and segmentation bases of
+ * 1 to 10 seconds. Writes one JSON line per benchmark and size: the time per
+ * operation, and the heap allocations and peak heap bytes of the code under
+ * test, counted by wrapping the allocator at link time
+ * (-Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free).
+ */
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <limits.h>
+#include <malloc.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "../linked_list.h"
+#include "../cue_plan.h"
+#include "../cue_loader.h"
+
+/**
+ * Cue points are spread from 1 to 15 seconds apart, 8 seconds on average, less
+ * for the largest counts so the last one stays within 32 bits of milliseconds.
+ */
+#define MICROBENCH_MIN_GAP 1000
+#define MICROBENCH_MAX_GAP 15000
+
+/**
+ * Lookups walk the list, the number of them is cut so each benchmark stays
+ * around this many node visits.
+ */
+#define MICROBENCH_VISITS 200000000ULL
+
+/**
+ * The whole plan is only built up front up to this many cue points, as cue
+ * points files are planned a few at a time.
+ */
+#define MICROBENCH_MAX_PLANNED 100000
+#define MICROBENCH_LOOKAHEAD 16
+
+/**
+ * Cue points merged out of order, each walking the plan from its head.
+ */
+#define MICROBENCH_MAX_UNORDERED 1000
+
+static const unsigned int sizes[] = {10, 100, 1000, 10000, 100000, 1000000};
+static const unsigned int bases[] = {1000, 2000, 4000, 6000, 10000};
+
+#define MICROBENCH_SIZES (int) (sizeof (sizes) / sizeof (sizes[0]))
+#define MICROBENCH_BASES (int) (sizeof (bases) / sizeof (bases[0]))
+
+extern void *__real_malloc(size_t);
+extern void *__real_calloc(size_t, size_t);
+extern void *__real_realloc(void *, size_t);
+extern void __real_free(void *);
+
+/**
+ * Heap usage of the code under test, since the last measureStart().
+ */
+static unsigned long long allocations;
+static long long heapBytes,
+                 peakHeapBytes,
+                 startHeapBytes;
+
+typedef struct measure {
+    struct timespec start;
+    unsigned long long allocations;
+} MEASURE;
+
+static void trackAllocation(void *pointer) {
+    if (pointer) {
+        ++allocations;
+        heapBytes += malloc_usable_size(pointer);
+        if (heapBytes > peakHeapBytes) {
+            peakHeapBytes = heapBytes;
+        }
+    }
+}
+
+void *__wrap_malloc(size_t size) {
+    void *pointer = __real_malloc(size);
+
+    trackAllocation(pointer);
+    return pointer;
+}
+
+void *__wrap_calloc(size_t members, size_t size) {
+    void *pointer = __real_calloc(members, size);
+
+    trackAllocation(pointer);
+    return pointer;
+}
+
+void *__wrap_realloc(void *pointer, size_t size) {
+    if (pointer) {
+        heapBytes -= malloc_usable_size(pointer);
+    }
+    pointer = __real_realloc(pointer, size);
+    trackAllocation(pointer);
+
+    return pointer;
+}
+
+void __wrap_free(void *pointer) {
+    if (pointer) {
+        heapBytes -= malloc_usable_size(pointer);
+    }
+    __real_free(pointer);
+}
+
+static void measureStart(MEASURE *measure) {
+    measure->allocations = allocations;
+    startHeapBytes = peakHeapBytes = heapBytes;
+    clock_gettime(CLOCK_MONOTONIC, &measure->start);
+}
+
+/**
+ * Used to write the line of one benchmark.
+ *
+ * @param FILE *out the destination.
+ * @param MEASURE *measure the measure, started before the benchmark ran.
+ * @param const char *name the benchmark.
+ * @param unsigned int entries the cue points count.
+ * @param unsigned int base the segmentation base in milliseconds, 0 when it does not apply.
+ * @param unsigned long long ops the operations done.
+ * @param const char *extra more fields, without their leading comma, NULL for none.
+ */
+static void measureEnd(FILE *out, MEASURE *measure, const char *name, unsigned int entries, unsigned int base,
+        unsigned long long ops, const char *extra) {
+    struct timespec end;
+    double nanoseconds;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    nanoseconds = (end.tv_sec - measure->start.tv_sec) * 1e9 + (end.tv_nsec - measure->start.tv_nsec);
+
+    fprintf(out, "{\"benchmark\" : \"%s\", \"entries\" : %u, \"base\" : %.0f, \"ops\" : %llu, \"ns_per_op\" : %.1f,"
+            " \"total_ms\" : %.3f, \"allocations\" : %llu, \"peak_bytes\" : %lld%s%s}\n",
+            name, entries, base / 1000.0, ops, ops ? nanoseconds / ops : 0, nanoseconds / 1e6,
+            allocations - measure->allocations, peakHeapBytes - startHeapBytes, extra ? ", " : "", extra ? extra : "");
+    fflush(out);
+}
+
+/**
+ * Used to draw the next number of a seeded generator, the same from run to run.
+ */
+static unsigned int nextRandom(unsigned long long *state) {
+    *state = *state * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (unsigned int) (*state >> 33);
+}
+
+/**
+ * Used to make the cue points times, ascending, in milliseconds.
+ */
+static unsigned int *makeCues(unsigned int entries) {
+    unsigned int *cues = __real_malloc(sizeof (unsigned int) * entries), i, time = 0, maxGap = MICROBENCH_MAX_GAP;
+    unsigned long long state = entries;
+
+    if ((unsigned long long) entries * (MICROBENCH_MIN_GAP + maxGap) / 2 > UINT_MAX / 10 * 9) {
+        maxGap = UINT_MAX / 10 * 9 / entries * 2 - MICROBENCH_MIN_GAP;
+    }
+
+    for (i = 0; cues && i < entries; i++) {
+        time += MICROBENCH_MIN_GAP + nextRandom(&state) % (maxGap - MICROBENCH_MIN_GAP + 1);
+        cues[i] = time;
+    }
+
+    return cues;
+}
+
+/**
+ * Used to release a list and its nodes.
+ */
+static void destroyList(LIST *list) {
+    deleteList(list);
+    free(list);
+}
+
+/**
+ * List operations: appending, lookups by id and by position, sorting, and
+ * finding duplicates among sorted neighbours, the way cue points arguments are
+ * checked.
+ */
+static void benchList(FILE *out, const unsigned int *cues, unsigned int entries) {
+    unsigned long long state = 42, lookups, i, duplicates = 0;
+    char extra[64];
+    LIST *list;
+    NODE *node;
+    MEASURE measure;
+
+    measureStart(&measure);
+    list = createList((void *) "Cue Points", 1, 0);
+    for (i = 0; i < entries; i++) {
+        append(list, createNode(cues[i], NULL));
+    }
+    measureEnd(out, &measure, "list_append", entries, 0, entries, NULL);
+
+    lookups = MICROBENCH_VISITS / entries < entries ? MICROBENCH_VISITS / entries : entries;
+    if (!lookups) {
+        lookups = 1;
+    }
+
+    measureStart(&measure);
+    for (i = 0; i < lookups; i++) {
+        if (!listFindById(list, cues[nextRandom(&state) % entries])) {
+            fprintf(stderr, "{\"error\" : \"Lookup failed.\"}\n");
+        }
+    }
+    measureEnd(out, &measure, "list_find_by_id", entries, 0, lookups, NULL);
+
+    measureStart(&measure);
+    for (i = 0; i < lookups; i++) {
+        getNth(list, nextRandom(&state) % entries);
+    }
+    measureEnd(out, &measure, "list_get_nth", entries, 0, lookups, NULL);
+
+    // Shuffled ids, with a duplicate every 100 entries, as mistyped lists have.
+    for (node = list->head, i = 0; node; node = node->next, i++) {
+        node->id = i % 100 == 99 ? cues[i - 1] : cues[nextRandom(&state) % entries];
+    }
+
+    measureStart(&measure);
+    sortById(list, ASC);
+    measureEnd(out, &measure, "list_sort", entries, 0, entries, NULL);
+
+    measureStart(&measure);
+    for (node = list->head; node; node = node->next) {
+        duplicates += node->next && node->next->id == node->id;
+    }
+    snprintf(extra, sizeof (extra), "\"duplicates\" : %llu", duplicates);
+    measureEnd(out, &measure, "list_dedupe", entries, 0, entries, extra);
+
+    measureStart(&measure);
+    destroyList(list);
+    measureEnd(out, &measure, "list_delete", entries, 0, entries, NULL);
+}
+
+/**
+ * Cue points files parsing, in the text and binary formats.
+ */
+static void benchParse(FILE *out, const unsigned int *cues, unsigned int entries, const char *directory) {
+    char textPath[1024], binaryPath[1024];
+    CUE_LOADER loader;
+    MEASURE measure;
+    FILE *fp;
+    unsigned int i, time, previous = 0, delta;
+    unsigned long long read;
+
+    snprintf(textPath, sizeof (textPath), "%s/cues.txt", directory);
+    snprintf(binaryPath, sizeof (binaryPath), "%s/cues.bin", directory);
+
+    fp = fopen(textPath, "w");
+    for (i = 0; fp && i < entries; i++) {
+        fprintf(fp, "%u.%03u\n", cues[i] / 1000, cues[i] % 1000);
+    }
+    if (!fp || fclose(fp)) {
+        return;
+    }
+
+    fp = fopen(binaryPath, "wb");
+    if (!fp) {
+        return;
+    }
+    fwrite(CUE_LOADER_MAGIC, 1, 4, fp);
+    fputc(CUE_LOADER_VERSION, fp);
+    for (i = 0; i < entries; previous = cues[i++]) {
+        for (delta = cues[i] - previous; delta >= 0x80; delta >>= 7) {
+            fputc(0x80 | (delta & 0x7F), fp);
+        }
+        fputc(delta, fp);
+    }
+    if (fclose(fp)) {
+        return;
+    }
+
+    measureStart(&measure);
+    read = 0;
+    if (!cueLoaderOpen(&loader, textPath)) {
+        while (cueLoaderNext(&loader, &time) > 0) {
+            ++read;
+        }
+        cueLoaderClose(&loader);
+    }
+    measureEnd(out, &measure, "parse_text", entries, 0, read, NULL);
+
+    measureStart(&measure);
+    read = 0;
+    if (!cueLoaderOpen(&loader, binaryPath)) {
+        while (cueLoaderNext(&loader, &time) > 0) {
+            ++read;
+        }
+        cueLoaderClose(&loader);
+    }
+    measureEnd(out, &measure, "parse_binary", entries, 0, read, NULL);
+
+    remove(textPath);
+    remove(binaryPath);
+}
+
+/**
+ * Used to cut every planned boundary in turn, as the segmenter does with key
+ * frames on each boundary, planning the next cue points as they are reached
+ * when they are streamed.
+ *
+ * @return unsigned long long the segments cut.
+ */
+static unsigned long long cutAll(CUE_PLAN *plan, const unsigned int *cues, unsigned int entries, unsigned int *next) {
+    unsigned long long segments = 0;
+    NODE *cue;
+
+    while (plan->boundaries->head) {
+        cue = cuePlanAdvance(plan, plan->start + plan->boundaries->head->id);
+        if (cue) {
+            cuePlanRecycle(plan, cue);
+        }
+        ++segments;
+
+        while (*next < entries && plan->cues->length < MICROBENCH_LOOKAHEAD) {
+            cuePlanInsert(plan, cues[(*next)++]);
+        }
+    }
+
+    return segments;
+}
+
+/**
+ * Plan building and consumption, with every cue point planned up front as
+ * with the cue points argument, streamed as with a cue points file, and merged
+ * out of order as live cue points may be.
+ */
+static void benchPlan(FILE *out, const unsigned int *cues, unsigned int entries, unsigned int base) {
+    unsigned long long segments, state = base;
+    unsigned int next, i, *shuffled, swap, j;
+    char extra[64];
+    CUE_PLAN plan;
+    MEASURE measure;
+
+    if (entries <= MICROBENCH_MAX_PLANNED) {
+        measureStart(&measure);
+        cuePlanInit(&plan, base);
+        for (i = 0; i < entries; i++) {
+            cuePlanInsert(&plan, cues[i]);
+        }
+        snprintf(extra, sizeof (extra), "\"boundaries\" : %u", plan.boundaries->length);
+        measureEnd(out, &measure, "plan_insert", entries, base, entries, extra);
+
+        measureStart(&measure);
+        next = entries;
+        segments = cutAll(&plan, cues, entries, &next);
+        cuePlanDestroy(&plan);
+        measureEnd(out, &measure, "plan_advance", entries, base, segments, NULL);
+    }
+
+    measureStart(&measure);
+    cuePlanInit(&plan, base);
+    for (next = 0; next < entries && next < MICROBENCH_LOOKAHEAD; next++) {
+        cuePlanInsert(&plan, cues[next]);
+    }
+    segments = cutAll(&plan, cues, entries, &next);
+    cuePlanDestroy(&plan);
+    snprintf(extra, sizeof (extra), "\"segments\" : %llu", segments);
+    measureEnd(out, &measure, "plan_streamed", entries, base, entries, extra);
+
+    if (entries > MICROBENCH_MAX_UNORDERED) {
+        return;
+    }
+
+    shuffled = __real_malloc(sizeof (unsigned int) * entries);
+    if (!shuffled) {
+        return;
+    }
+    memcpy(shuffled, cues, sizeof (unsigned int) * entries);
+    for (i = entries - 1; i > 0; i--) {
+        j = nextRandom(&state) % (i + 1);
+        swap = shuffled[i];
+        shuffled[i] = shuffled[j];
+        shuffled[j] = swap;
+    }
+
+    measureStart(&measure);
+    cuePlanInit(&plan, base);
+    for (i = 0; i < entries; i++) {
+        cuePlanInsert(&plan, shuffled[i]);
+    }
+    cuePlanDestroy(&plan);
+    measureEnd(out, &measure, "plan_insert_unordered", entries, base, entries, NULL);
+
+    __real_free(shuffled);
+}
+
+static struct option longOptions[] = {
+    {"max-entries", required_argument, NULL, 'm'},
+    {"output", required_argument, NULL, 'o'},
+    {NULL, 0, NULL, 0}
+};
+
+int main(int argc, char **argv) {
+    const char *directory = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+    unsigned long maxEntries = 1000000;
+    unsigned int *cues;
+    struct rusage usage;
+    FILE *out = stdout;
+    char *check;
+    int opt, size, base;
+
+    while ((opt = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'm':
+                maxEntries = strtoul(optarg, &check, 10);
+                if (check == optarg || *check) {
+                    fprintf(stderr, "Maximum entries (%s) invalid\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'o':
+                if (!(out = fopen(optarg, "w"))) {
+                    fprintf(stderr, "{\"error\" : \"Could not open the output (%s).\"}\n", optarg);
+                    return 1;
+                }
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [--max-entries=<count>] [--output=<file>]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    for (size = 0; size < MICROBENCH_SIZES && sizes[size] <= maxEntries; size++) {
+        cues = makeCues(sizes[size]);
+        if (!cues) {
+            fprintf(stderr, "{\"error\" : \"Could not allocate %u cue points.\"}\n", sizes[size]);
+            return 1;
+        }
+
+        benchList(out, cues, sizes[size]);
+        benchParse(out, cues, sizes[size], directory);
+        for (base = 0; base < MICROBENCH_BASES; base++) {
+            benchPlan(out, cues, sizes[size], bases[base]);
+        }
+
+        __real_free(cues);
+    }
+
+    getrusage(RUSAGE_SELF, &usage);
+    fprintf(stderr, "{\"info\" : \"Peak RSS %ld KB.\"}\n", usage.ru_maxrss);
+
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    return 0;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
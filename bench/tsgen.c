@@ -0,0 +1,709 @@
+/**
+ * @file
+ * Deterministic synthetic MPEG-TS generator.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * Writes an MPEG-TS stream that decodes, without any media to start from:
+ *     video    H.264 baseline, IDR frames of gray I_PCM macroblocks, P frames
+ *              of skipped macroblocks, padded with filler data to the bitrate.
+ *     audio    MPEG-1 layer II, 48 kHz mono at 128 kb/s, silent frames.
+ * Frame sizes vary around the bitrate from a seeded generator, so the same
+ * options always give the same bytes. Timestamps may start close to the 33 bits
+ * wrap, and jump forward on discontinuities flagged in the adaptation field.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <getopt.h>
+
+#define TS_PACKET_SIZE 188
+#define TSGEN_PMT_PID 0x1000
+#define TSGEN_VIDEO_PID 0x100
+#define TSGEN_AUDIO_PID 0x101
+#define TSGEN_PTS_MASK ((1LL << 33) - 1)
+
+/**
+ * Layer II frames of 1152 samples, in bytes and in 90 kHz ticks.
+ */
+#define TSGEN_AUDIO_FRAME_SIZE 384
+#define TSGEN_AUDIO_FRAME_TICKS 2160
+
+/**
+ * How far the program clock runs ahead of the presentation times, in 90 kHz ticks.
+ */
+#define TSGEN_PCR_DELAY 63000
+
+/**
+ * How far timestamps jump on a discontinuity, in 90 kHz ticks (10 minutes).
+ */
+#define TSGEN_DISCONTINUITY_JUMP 54000000LL
+
+enum Tsgen_Stream {
+    TSGEN_PAT,
+    TSGEN_PMT,
+    TSGEN_VIDEO,
+    TSGEN_AUDIO,
+    TSGEN_STREAMS
+};
+
+typedef struct tsgen_options {
+    double duration,
+           fps,
+           discontinuity;
+    long bitrate;
+    int gop,
+        width,
+        height,
+        video,
+        audio;
+    long long ptsStart;
+    unsigned long long seed;
+    const char *output;
+} TSGEN_OPTIONS;
+
+typedef struct tsgen {
+    TSGEN_OPTIONS options;
+    FILE *out;
+
+    /**
+     * @var int continuity the continuity counter of each PID.
+     * @var int discontinuous whether the next packet of each PID is flagged as a discontinuity.
+     * @var long long offset the timestamps offset, grown by each discontinuity.
+     */
+    int continuity[TSGEN_STREAMS],
+        discontinuous[TSGEN_STREAMS];
+    long long offset;
+    double nextDiscontinuity;
+    unsigned long long random;
+
+    unsigned char *frame,
+                  *rbsp;
+    size_t frameSize;
+    unsigned long long packets;
+} TSGEN;
+
+/**
+ * Bits written most significant first, for the H.264 headers.
+ */
+typedef struct bits {
+    unsigned char *data;
+    size_t position;
+} BITS;
+
+static struct option longOptions[] = {
+    {"duration", required_argument, NULL, 'd'},
+    {"fps", required_argument, NULL, 'f'},
+    {"gop", required_argument, NULL, 'g'},
+    {"bitrate", required_argument, NULL, 'b'},
+    {"size", required_argument, NULL, 'z'},
+    {"streams", required_argument, NULL, 's'},
+    {"pts-start", required_argument, NULL, 'p'},
+    {"discontinuity", required_argument, NULL, 'D'},
+    {"seed", required_argument, NULL, 'r'},
+    {"output", required_argument, NULL, 'o'},
+    {NULL, 0, NULL, 0}
+};
+
+/**
+ * Used to print the usage, and exit.
+ *
+ * @param const char *program the program name.
+ */
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options]\n"
+            "Options:\n"
+            "  --duration=<seconds>        stream duration, defaults to 60\n"
+            "  --fps=<frames per second>   video frame rate, defaults to 25\n"
+            "  --gop=<frames>              frames from one IDR frame to the next, defaults to 50\n"
+            "  --bitrate=<bits per second> video bitrate, defaults to 4000000\n"
+            "  --size=<width>x<height>     video size, multiples of 16, defaults to 160x96\n"
+            "  --streams=<av|video|audio>  streams written, defaults to av\n"
+            "  --pts-start=<90 kHz ticks>  first presentation time, close to 8589934592 to wrap, defaults to 0\n"
+            "  --discontinuity=<seconds>   jump the timestamps on the first IDR frame after every such period\n"
+            "  --seed=<number>             frame sizes seed, defaults to 1\n"
+            "  --output=<file>             defaults to the standard output\n", program);
+    exit(1);
+}
+
+/**
+ * Used to parse the options.
+ *
+ * @return int 0 on success, -1 on invalid options.
+ */
+static int parseArguments(int argc, char **argv, TSGEN_OPTIONS *options) {
+    char *check;
+    int opt;
+
+    memset(options, 0, sizeof (TSGEN_OPTIONS));
+    options->duration = 60;
+    options->fps = 25;
+    options->gop = 50;
+    options->bitrate = 4000000;
+    options->width = 160;
+    options->height = 96;
+    options->video = options->audio = 1;
+    options->seed = 1;
+
+    while ((opt = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'd':
+                options->duration = strtod(optarg, &check);
+                if (check == optarg || *check || options->duration <= 0) {
+                    fprintf(stderr, "Duration (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'f':
+                options->fps = strtod(optarg, &check);
+                if (check == optarg || *check || options->fps < 1 || options->fps > 120) {
+                    fprintf(stderr, "Frame rate (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'g':
+                options->gop = strtol(optarg, &check, 10);
+                if (check == optarg || *check || options->gop < 1) {
+                    fprintf(stderr, "GOP length (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'b':
+                options->bitrate = strtol(optarg, &check, 10);
+                if (check == optarg || *check || options->bitrate < 10000) {
+                    fprintf(stderr, "Bitrate (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'z':
+                if (sscanf(optarg, "%dx%d", &options->width, &options->height) != 2 || options->width < 16 || options->height < 16 ||
+                        options->width % 16 || options->height % 16 || options->width > 1920 || options->height > 1088) {
+                    fprintf(stderr, "Size (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 's':
+                options->video = !strcmp(optarg, "av") || !strcmp(optarg, "video");
+                options->audio = !strcmp(optarg, "av") || !strcmp(optarg, "audio");
+                if (!options->video && !options->audio) {
+                    fprintf(stderr, "Streams (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'p':
+                options->ptsStart = strtoll(optarg, &check, 10);
+                if (check == optarg || *check || options->ptsStart < 0 || options->ptsStart > TSGEN_PTS_MASK) {
+                    fprintf(stderr, "First presentation time (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'D':
+                options->discontinuity = strtod(optarg, &check);
+                if (check == optarg || *check || options->discontinuity <= 0) {
+                    fprintf(stderr, "Discontinuity period (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'r':
+                options->seed = strtoull(optarg, &check, 10);
+                if (check == optarg || *check) {
+                    fprintf(stderr, "Seed (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'o':
+                options->output = optarg;
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    return optind == argc ? 0 : -1;
+}
+
+/**
+ * Used to draw the next number of the frame sizes generator, in [0, 1).
+ */
+static double nextRandom(TSGEN *gen) {
+    gen->random = gen->random * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (double) (gen->random >> 11) / (double) (1ULL << 53);
+}
+
+/**
+ * Used to compute the MPEG-2 CRC of the PSI sections.
+ */
+static uint32_t crc32(const unsigned char *data, int length) {
+    uint32_t crc = 0xFFFFFFFF;
+    int bit;
+
+    while (length--) {
+        crc ^= (uint32_t) *data++ << 24;
+        for (bit = 0; bit < 8; bit++) {
+            crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+/**
+ * Used to write the packets of one payload unit, a PES packet or a PSI section,
+ * padding the last packet with adaptation field stuffing.
+ *
+ * @param TSGEN *gen the generator.
+ * @param int stream the stream, giving the PID and continuity counter.
+ * @param const unsigned char *data the payload unit.
+ * @param size_t length its length.
+ * @param long long pcr the program clock carried by the first packet, -1 for none.
+ * @param int randomAccess whether the unit starts on a key frame.
+ * @return int 0 on success, -1 on write errors.
+ */
+static int writeUnit(TSGEN *gen, int stream, const unsigned char *data, size_t length, long long pcr, int randomAccess) {
+    static const int pids[TSGEN_STREAMS] = {0, TSGEN_PMT_PID, TSGEN_VIDEO_PID, TSGEN_AUDIO_PID};
+    unsigned char packet[TS_PACKET_SIZE], *p;
+    int first = 1, flags, minimum, payload, adaptation;
+
+    while (length) {
+        flags = 0;
+        if (first) {
+            flags = (gen->discontinuous[stream] ? 0x80 : 0) | (randomAccess ? 0x40 : 0) | (pcr >= 0 ? 0x10 : 0);
+            gen->discontinuous[stream] = 0;
+        }
+
+        // The adaptation field holds its flags and the clock, then stuffing up to the payload.
+        minimum = flags ? 1 + (flags & 0x10 ? 6 : 0) : 0;
+        if (!flags && length >= 184) {
+            payload = 184;
+            adaptation = -1;
+        } else {
+            payload = length < (size_t) (183 - minimum) ? (int) length : 183 - minimum;
+            adaptation = 183 - payload;
+        }
+
+        p = packet;
+        *p++ = 0x47;
+        *p++ = (first ? 0x40 : 0) | pids[stream] >> 8;
+        *p++ = pids[stream] & 0xFF;
+        *p++ = (adaptation >= 0 ? 0x30 : 0x10) | gen->continuity[stream];
+        gen->continuity[stream] = (gen->continuity[stream] + 1) & 0x0F;
+
+        if (adaptation >= 0) {
+            *p++ = adaptation;
+            if (adaptation) {
+                *p++ = flags;
+                if (flags & 0x10) {
+                    pcr &= TSGEN_PTS_MASK;
+                    *p++ = pcr >> 25;
+                    *p++ = pcr >> 17;
+                    *p++ = pcr >> 9;
+                    *p++ = pcr >> 1;
+                    *p++ = (pcr & 1) << 7 | 0x7E;
+                    *p++ = 0;
+                }
+                memset(p, 0xFF, packet + 4 + 1 + adaptation - p);
+                p = packet + 4 + 1 + adaptation;
+            }
+        }
+
+        memcpy(p, data, payload);
+        data += payload;
+        length -= payload;
+        first = 0;
+
+        if (fwrite(packet, TS_PACKET_SIZE, 1, gen->out) != 1) {
+            return -1;
+        }
+        ++gen->packets;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to write the program association and program map tables.
+ *
+ * @return int 0 on success, -1 on write errors.
+ */
+static int writeTables(TSGEN *gen) {
+    unsigned char section[64], *p;
+    uint32_t crc;
+    int pcrPid = gen->options.video ? TSGEN_VIDEO_PID : TSGEN_AUDIO_PID;
+
+    // Pointer field, then the PAT with program 1.
+    p = section;
+    *p++ = 0;
+    *p++ = 0x00;
+    *p++ = 0xB0;
+    *p++ = 13;
+    *p++ = 0x00; *p++ = 0x01;
+    *p++ = 0xC1;
+    *p++ = 0x00; *p++ = 0x00;
+    *p++ = 0x00; *p++ = 0x01;
+    *p++ = 0xE0 | TSGEN_PMT_PID >> 8; *p++ = TSGEN_PMT_PID & 0xFF;
+    crc = crc32(section + 1, p - section - 1);
+    *p++ = crc >> 24; *p++ = crc >> 16; *p++ = crc >> 8; *p++ = crc;
+    if (writeUnit(gen, TSGEN_PAT, section, p - section, -1, 0) < 0) {
+        return -1;
+    }
+
+    p = section;
+    *p++ = 0;
+    *p++ = 0x02;
+    *p++ = 0xB0;
+    *p++ = 13 + 5 * (gen->options.video + gen->options.audio);
+    *p++ = 0x00; *p++ = 0x01;
+    *p++ = 0xC1;
+    *p++ = 0x00; *p++ = 0x00;
+    *p++ = 0xE0 | pcrPid >> 8; *p++ = pcrPid & 0xFF;
+    *p++ = 0xF0; *p++ = 0x00;
+    if (gen->options.video) {
+        *p++ = 0x1B;
+        *p++ = 0xE0 | TSGEN_VIDEO_PID >> 8; *p++ = TSGEN_VIDEO_PID & 0xFF;
+        *p++ = 0xF0; *p++ = 0x00;
+    }
+    if (gen->options.audio) {
+        *p++ = 0x03;
+        *p++ = 0xE0 | TSGEN_AUDIO_PID >> 8; *p++ = TSGEN_AUDIO_PID & 0xFF;
+        *p++ = 0xF0; *p++ = 0x00;
+    }
+    crc = crc32(section + 1, p - section - 1);
+    *p++ = crc >> 24; *p++ = crc >> 16; *p++ = crc >> 8; *p++ = crc;
+
+    return writeUnit(gen, TSGEN_PMT, section, p - section, -1, 0);
+}
+
+/**
+ * Used to write a PES packet header, with a presentation time only.
+ *
+ * @return size_t the header length.
+ */
+static size_t pesHeader(unsigned char *p, int streamId, size_t payload, long long pts) {
+    size_t length = payload + 8;
+
+    pts &= TSGEN_PTS_MASK;
+    p[0] = 0x00;
+    p[1] = 0x00;
+    p[2] = 0x01;
+    p[3] = streamId;
+    // Video PES packets may leave their length unbounded.
+    p[4] = length > 0xFFFF ? 0 : length >> 8;
+    p[5] = length > 0xFFFF ? 0 : length & 0xFF;
+    p[6] = 0x80;
+    p[7] = 0x80;
+    p[8] = 5;
+    p[9] = 0x21 | (pts >> 29 & 0x0E);
+    p[10] = pts >> 22;
+    p[11] = (pts >> 14 & 0xFE) | 1;
+    p[12] = pts >> 7;
+    p[13] = (pts << 1 & 0xFE) | 1;
+
+    return 14;
+}
+
+static void putBits(BITS *bits, unsigned int value, int count) {
+    while (count--) {
+        if (!(bits->position & 7)) {
+            bits->data[bits->position >> 3] = 0;
+        }
+        if (value >> count & 1) {
+            bits->data[bits->position >> 3] |= 0x80 >> (bits->position & 7);
+        }
+        ++bits->position;
+    }
+}
+
+static void putUe(BITS *bits, unsigned int value) {
+    int length = 0;
+
+    while ((value + 1) >> (length + 1)) {
+        ++length;
+    }
+    putBits(bits, 0, length);
+    putBits(bits, value + 1, length + 1);
+}
+
+static void putSe(BITS *bits, int value) {
+    putUe(bits, value > 0 ? 2 * value - 1 : -2 * value);
+}
+
+static void putTrailing(BITS *bits) {
+    putBits(bits, 1, 1);
+    while (bits->position & 7) {
+        putBits(bits, 0, 1);
+    }
+}
+
+/**
+ * Used to append a NAL unit to the frame, with its start code and emulation prevention.
+ *
+ * @return size_t the frame length after it.
+ */
+static size_t putNal(unsigned char *frame, size_t position, int header, const unsigned char *rbsp, size_t length) {
+    size_t i;
+    int zeros = 0;
+
+    frame[position++] = 0;
+    frame[position++] = 0;
+    frame[position++] = 0;
+    frame[position++] = 1;
+    frame[position++] = header;
+
+    for (i = 0; i < length; i++) {
+        if (zeros >= 2 && rbsp[i] <= 3) {
+            frame[position++] = 3;
+            zeros = 0;
+        }
+        frame[position++] = rbsp[i];
+        zeros = rbsp[i] ? 0 : zeros + 1;
+    }
+
+    return position;
+}
+
+/**
+ * Used to build one video access unit, an access unit delimiter, the parameter
+ * sets before IDR frames, the slice, and filler data up to the target size.
+ *
+ * @param TSGEN *gen the generator.
+ * @param long long index the frame number.
+ * @param int idr whether it is an IDR frame.
+ * @param size_t target the size to pad the frame to.
+ * @return size_t the access unit length.
+ */
+static size_t buildFrame(TSGEN *gen, long long index, int idr, size_t target) {
+    int widthMbs = gen->options.width / 16, heightMbs = gen->options.height / 16, mb;
+    int frameNum = (index % gen->options.gop) & 0x0F;
+    size_t length = 0;
+    BITS bits;
+
+    bits.data = gen->rbsp;
+
+    bits.position = 0;
+    putBits(&bits, idr ? 0 : 1, 3);
+    putTrailing(&bits);
+    length = putNal(gen->frame, length, 0x09, gen->rbsp, bits.position / 8);
+
+    if (idr) {
+        bits.position = 0;
+        putBits(&bits, 66, 8);
+        putBits(&bits, 0xC0, 8);
+        putBits(&bits, 30, 8);
+        putUe(&bits, 0);
+        putUe(&bits, 0);
+        putUe(&bits, 2);
+        putUe(&bits, 1);
+        putBits(&bits, 0, 1);
+        putUe(&bits, widthMbs - 1);
+        putUe(&bits, heightMbs - 1);
+        putBits(&bits, 1, 1);
+        putBits(&bits, 1, 1);
+        putBits(&bits, 0, 1);
+        putBits(&bits, 0, 1);
+        putTrailing(&bits);
+        length = putNal(gen->frame, length, 0x67, gen->rbsp, bits.position / 8);
+
+        bits.position = 0;
+        putUe(&bits, 0);
+        putUe(&bits, 0);
+        putBits(&bits, 0, 1);
+        putBits(&bits, 0, 1);
+        putUe(&bits, 0);
+        putUe(&bits, 0);
+        putUe(&bits, 0);
+        putBits(&bits, 0, 1);
+        putBits(&bits, 0, 2);
+        putSe(&bits, 0);
+        putSe(&bits, 0);
+        putSe(&bits, 0);
+        putBits(&bits, 1, 1);
+        putBits(&bits, 0, 1);
+        putBits(&bits, 0, 1);
+        putTrailing(&bits);
+        length = putNal(gen->frame, length, 0x68, gen->rbsp, bits.position / 8);
+    }
+
+    // Slice header, frame numbers count from the IDR frame.
+    bits.position = 0;
+    putUe(&bits, 0);
+    putUe(&bits, idr ? 7 : 5);
+    putUe(&bits, 0);
+    putBits(&bits, frameNum, 4);
+    if (idr) {
+        putUe(&bits, (index / gen->options.gop) & 1);
+        putBits(&bits, 0, 1);
+        putBits(&bits, 0, 1);
+    } else {
+        putBits(&bits, 0, 1);
+        putBits(&bits, 0, 1);
+        putBits(&bits, 0, 1);
+    }
+    putSe(&bits, 0);
+    putUe(&bits, 1);
+
+    // Gray I_PCM macroblocks, or every macroblock skipped.
+    if (idr) {
+        for (mb = 0; mb < widthMbs * heightMbs; mb++) {
+            putUe(&bits, 25);
+            while (bits.position & 7) {
+                putBits(&bits, 0, 1);
+            }
+            memset(gen->rbsp + bits.position / 8, 0x80, 384);
+            bits.position += 384 * 8;
+        }
+    } else {
+        putUe(&bits, widthMbs * heightMbs);
+    }
+    putTrailing(&bits);
+    length = putNal(gen->frame, length, idr ? 0x65 : 0x41, gen->rbsp, bits.position / 8);
+
+    // Filler data, its payload bytes are all 0xFF.
+    if (length + 6 < target && target <= gen->frameSize) {
+        memset(gen->rbsp, 0xFF, target - length - 6);
+        gen->rbsp[target - length - 6] = 0x80;
+        length = putNal(gen->frame, length, 0x0C, gen->rbsp, target - length - 5);
+    }
+
+    return length;
+}
+
+/**
+ * Used to jump the timestamps once a discontinuity period is over, on a frame
+ * every stream may restart from.
+ *
+ * @param TSGEN *gen the generator.
+ * @param double time the frame time, before any jump.
+ */
+static void discontinuity(TSGEN *gen, double time) {
+    if (!gen->options.discontinuity || time < gen->nextDiscontinuity) {
+        return;
+    }
+
+    if (gen->nextDiscontinuity > 0) {
+        gen->offset += TSGEN_DISCONTINUITY_JUMP;
+        gen->discontinuous[TSGEN_VIDEO] = gen->discontinuous[TSGEN_AUDIO] = 1;
+    }
+    gen->nextDiscontinuity += gen->options.discontinuity;
+}
+
+/**
+ * Used to write the stream, frames interleaved by presentation time.
+ *
+ * @return int 0 on success, -1 on write errors.
+ */
+static int generate(TSGEN *gen) {
+    const TSGEN_OPTIONS *options = &gen->options;
+    unsigned char audio[14 + TSGEN_AUDIO_FRAME_SIZE];
+    long long videoFrames = options->video ? (long long) (options->duration * options->fps) : 0,
+              audioFrames = options->audio ? (long long) (options->duration * 90000 / TSGEN_AUDIO_FRAME_TICKS) : 0,
+              video = 0, sound = 0, pts;
+    double videoTime, audioTime, average = options->bitrate / 8.0 / options->fps;
+    size_t length, header;
+    int idr;
+
+    // Silent layer II frames: the header, then no bit allocated to any subband.
+    memset(audio, 0, sizeof (audio));
+    audio[14] = 0xFF;
+    audio[15] = 0xFD;
+    audio[16] = 0x84;
+    audio[17] = 0xC0;
+
+    while (video < videoFrames || sound < audioFrames) {
+        videoTime = video < videoFrames ? video / options->fps : 1e300;
+        audioTime = sound < audioFrames ? sound * TSGEN_AUDIO_FRAME_TICKS / 90000.0 : 1e300;
+
+        if (videoTime <= audioTime) {
+            idr = video % options->gop == 0;
+
+            if (idr) {
+                discontinuity(gen, videoTime);
+            }
+            if (idr && writeTables(gen) < 0) {
+                return -1;
+            }
+
+            pts = options->ptsStart + TSGEN_PCR_DELAY + gen->offset + (long long) (videoTime * 90000 + 0.5);
+            length = buildFrame(gen, video, idr, (size_t) (average * (idr ? 3 : 0.5 + nextRandom(gen))));
+            header = pesHeader(gen->frame - 14, 0xE0, length, pts);
+            if (writeUnit(gen, TSGEN_VIDEO, gen->frame - header, length + header, pts - TSGEN_PCR_DELAY, idr) < 0) {
+                return -1;
+            }
+            ++video;
+        } else {
+            if (!options->video) {
+                discontinuity(gen, audioTime);
+                if (sound % 40 == 0 && writeTables(gen) < 0) {
+                    return -1;
+                }
+            }
+
+            pts = options->ptsStart + TSGEN_PCR_DELAY + gen->offset + sound * TSGEN_AUDIO_FRAME_TICKS;
+            pesHeader(audio, 0xC0, TSGEN_AUDIO_FRAME_SIZE, pts);
+            if (writeUnit(gen, TSGEN_AUDIO, audio, sizeof (audio), options->video ? -1 : pts - TSGEN_PCR_DELAY, 1) < 0) {
+                return -1;
+            }
+            ++sound;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    TSGEN gen;
+    unsigned char *buffer;
+    int ret;
+
+    memset(&gen, 0, sizeof (gen));
+    if (parseArguments(argc, argv, &gen.options) < 0) {
+        usage(argv[0]);
+    }
+    gen.random = gen.options.seed;
+
+    // Room for the PCM macroblocks and three times the average frame, the PES header goes before the frame.
+    gen.frameSize = (size_t) gen.options.width * gen.options.height * 3 / 2 * 2 + (size_t) (gen.options.bitrate / 8.0 / gen.options.fps * 3) + 4096;
+    buffer = malloc(14 + gen.frameSize * 2);
+    gen.rbsp = malloc(gen.frameSize);
+    if (!buffer || !gen.rbsp) {
+        fprintf(stderr, "{\"error\" : \"Could not allocate the frame buffers.\"}\n");
+        return 1;
+    }
+    gen.frame = buffer + 14;
+
+    gen.out = gen.options.output ? fopen(gen.options.output, "wb") : stdout;
+    if (!gen.out) {
+        fprintf(stderr, "{\"error\" : \"Could not open the output (%s).\"}\n", gen.options.output);
+        return 1;
+    }
+
+    ret = generate(&gen);
+    if (fclose(gen.out) != 0 || ret < 0) {
+        fprintf(stderr, "{\"error\" : \"Could not write the stream.\"}\n");
+        return 1;
+    }
+
+    fprintf(stderr, "{\"info\" : \"Generated %llu packets.\"}\n", gen.packets);
+
+    free(buffer);
+    free(gen.rbsp);
+
+    return 0;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,459 @@
+/**
+ * @file
+ * MPEG-TS over UDP and RTP sender.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * Replays an MPEG-TS file over UDP, as is or in RTP, paced to a bitrate, to
+ * test the UDP and RTP inputs on loopback or on a network. Datagrams due
+ * within the same millisecond go out with one sendmmsg() call. Losses,
+ * reordering and duplicates can be injected, from a seeded generator, so the
+ * jitter buffer and the counters of the receiving side can be checked.
+ */
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <getopt.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define TS_PACKET_SIZE 188
+#define UDPSEND_BATCH 64
+#define UDPSEND_MAX_PACKETS 7
+#define UDPSEND_RTP_HEADER 12
+#define UDPSEND_RTP_MP2T 33
+#define UDPSEND_SSRC 0x5345474DU
+
+typedef struct udpsend_options {
+    const char *input,
+               *host,
+               *port;
+    long bitrate;
+    int rtp,
+        packets,
+        loop,
+        ttl,
+        loss,
+        reorder,
+        duplicate;
+    unsigned long long seed;
+} UDPSEND_OPTIONS;
+
+typedef struct udpsend {
+    UDPSEND_OPTIONS options;
+    FILE *in;
+    int fd;
+    struct sockaddr_storage address;
+    socklen_t addressLength;
+
+    /**
+     * The batch being built, each datagram in its own buffer.
+     */
+    struct mmsghdr messages[UDPSEND_BATCH];
+    struct iovec vectors[UDPSEND_BATCH];
+    unsigned char buffers[UDPSEND_BATCH][UDPSEND_RTP_HEADER + UDPSEND_MAX_PACKETS * TS_PACKET_SIZE];
+    int count;
+
+    uint16_t sequence;
+    unsigned long long random,
+                       datagrams,
+                       bytes,
+                       dropped,
+                       reordered,
+                       duplicated;
+    struct timespec start;
+} UDPSEND;
+
+static struct option longOptions[] = {
+    {"input", required_argument, NULL, 'i'},
+    {"destination", required_argument, NULL, 'd'},
+    {"bitrate", required_argument, NULL, 'b'},
+    {"rtp", no_argument, NULL, 'r'},
+    {"packets", required_argument, NULL, 'p'},
+    {"loop", required_argument, NULL, 'l'},
+    {"ttl", required_argument, NULL, 't'},
+    {"loss", required_argument, NULL, 'L'},
+    {"reorder", required_argument, NULL, 'R'},
+    {"duplicate", required_argument, NULL, 'D'},
+    {"seed", required_argument, NULL, 's'},
+    {NULL, 0, NULL, 0}
+};
+
+/**
+ * Used to print the usage, and exit.
+ *
+ * @param const char *program the program name.
+ */
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s --destination=<host>:<port> [options]\n"
+            "Options:\n"
+            "  --input=<file>              the MPEG-TS file, defaults to the standard input\n"
+            "  --bitrate=<bits per second> the sending rate, of the TS bytes, defaults to 4000000, 0 as fast as possible\n"
+            "  --rtp                       send RTP datagrams (payload type 33), instead of bare TS ones\n"
+            "  --packets=<count>           TS packets per datagram, up to 7, defaults to 7\n"
+            "  --loop=<count>              times the input is sent, defaults to 1, 0 forever\n"
+            "  --ttl=<hops>                multicast time to live, defaults to 1\n"
+            "  --loss=<per mille>          datagrams dropped, defaults to 0\n"
+            "  --reorder=<per mille>       datagrams swapped with the next one, defaults to 0\n"
+            "  --duplicate=<per mille>     datagrams sent twice, defaults to 0\n"
+            "  --seed=<number>             injected errors seed, defaults to 1\n", program);
+    exit(1);
+}
+
+/**
+ * Used to read a per mille option.
+ *
+ * @return int 0 on success, -1 when it is invalid.
+ */
+static int perMille(const char *value, int *result) {
+    char *check;
+
+    *result = strtol(value, &check, 10);
+
+    return check == value || *check || *result < 0 || *result > 1000 ? -1 : 0;
+}
+
+/**
+ * Used to parse the options.
+ *
+ * @return int 0 on success, -1 on invalid options.
+ */
+static int parseArguments(int argc, char **argv, UDPSEND_OPTIONS *options) {
+    static char host[256];
+    char *check, *colon;
+    int opt;
+
+    memset(options, 0, sizeof (UDPSEND_OPTIONS));
+    options->bitrate = 4000000;
+    options->packets = UDPSEND_MAX_PACKETS;
+    options->loop = 1;
+    options->ttl = 1;
+    options->seed = 1;
+
+    while ((opt = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'i':
+                options->input = optarg;
+                break;
+            case 'd':
+                colon = strrchr(optarg, ':');
+                if (!colon || colon == optarg || colon - optarg >= sizeof (host) || !colon[1]) {
+                    fprintf(stderr, "Destination (%s) invalid, <host>:<port>\n", optarg);
+                    return -1;
+                }
+                snprintf(host, sizeof (host), "%.*s", (int) (colon - optarg), optarg);
+                options->host = host;
+                options->port = colon + 1;
+                break;
+            case 'b':
+                options->bitrate = strtol(optarg, &check, 10);
+                if (check == optarg || *check || options->bitrate < 0) {
+                    fprintf(stderr, "Bitrate (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'r':
+                options->rtp = 1;
+                break;
+            case 'p':
+                options->packets = strtol(optarg, &check, 10);
+                if (check == optarg || *check || options->packets < 1 || options->packets > UDPSEND_MAX_PACKETS) {
+                    fprintf(stderr, "Packets per datagram (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'l':
+                options->loop = strtol(optarg, &check, 10);
+                if (check == optarg || *check || options->loop < 0) {
+                    fprintf(stderr, "Loop count (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 't':
+                options->ttl = strtol(optarg, &check, 10);
+                if (check == optarg || *check || options->ttl < 1 || options->ttl > 255) {
+                    fprintf(stderr, "Time to live (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'L':
+                if (perMille(optarg, &options->loss) < 0) {
+                    fprintf(stderr, "Loss (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'R':
+                if (perMille(optarg, &options->reorder) < 0) {
+                    fprintf(stderr, "Reordering (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'D':
+                if (perMille(optarg, &options->duplicate) < 0) {
+                    fprintf(stderr, "Duplication (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 's':
+                options->seed = strtoull(optarg, &check, 10);
+                if (check == optarg || *check) {
+                    fprintf(stderr, "Seed (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    return optind == argc && options->host ? 0 : -1;
+}
+
+/**
+ * Used to draw the next pseudo random number, below 1000 (xorshift64).
+ */
+static int draw(UDPSEND *send) {
+    send->random ^= send->random << 13;
+    send->random ^= send->random >> 7;
+    send->random ^= send->random << 17;
+
+    return (int) (send->random % 1000);
+}
+
+/**
+ * Used to open the socket, and resolve the destination.
+ *
+ * @return int 0 on success, -1 otherwise.
+ */
+static int openSocket(UDPSEND *send) {
+    struct addrinfo hints, *address = NULL;
+    int ttl = send->options.ttl, size = 4 * 1024 * 1024;
+
+    memset(&hints, 0, sizeof (hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    if (getaddrinfo(send->options.host, send->options.port, &hints, &address) || !address) {
+        fprintf(stderr, "{\"error\" : \"Could not resolve the destination (%s:%s).\"}\n", send->options.host, send->options.port);
+        return -1;
+    }
+
+    memcpy(&send->address, address->ai_addr, address->ai_addrlen);
+    send->addressLength = address->ai_addrlen;
+    freeaddrinfo(address);
+
+    send->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (send->fd < 0) {
+        return -1;
+    }
+    setsockopt(send->fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof (ttl));
+    setsockopt(send->fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof (size));
+
+    return 0;
+}
+
+/**
+ * Used to send the batch built so far.
+ *
+ * @return int 0 on success, -1 otherwise.
+ */
+static int flush(UDPSEND *send) {
+    int sent = 0, ret;
+
+    while (sent < send->count) {
+        ret = sendmmsg(send->fd, send->messages + sent, send->count - sent, 0);
+        if (ret < 0) {
+            if (errno == EINTR || errno == ENOBUFS || errno == EAGAIN) {
+                continue;
+            }
+            return -1;
+        }
+        sent += ret;
+    }
+    send->count = 0;
+
+    return 0;
+}
+
+/**
+ * Used to add a datagram to the batch, with the injected errors.
+ *
+ * @return int 0 on success, -1 otherwise.
+ */
+static int queue(UDPSEND *send, const unsigned char *packets, int size) {
+    unsigned char *datagram;
+    struct iovec swap;
+    struct timespec now;
+    uint32_t timestamp;
+    int offset = 0, copies, i;
+
+    if (send->count + 2 > UDPSEND_BATCH && flush(send) < 0) {
+        return -1;
+    }
+
+    copies = send->options.duplicate && draw(send) < send->options.duplicate ? 2 : 1;
+    send->duplicated += copies - 1;
+
+    datagram = send->buffers[send->count];
+    if (send->options.rtp) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        timestamp = (uint32_t) ((now.tv_sec - send->start.tv_sec) * 90000LL + (now.tv_nsec - send->start.tv_nsec) / 100000LL * 9);
+        datagram[0] = 0x80;
+        datagram[1] = UDPSEND_RTP_MP2T;
+        datagram[2] = send->sequence >> 8;
+        datagram[3] = send->sequence & 0xFF;
+        datagram[4] = timestamp >> 24;
+        datagram[5] = timestamp >> 16;
+        datagram[6] = timestamp >> 8;
+        datagram[7] = timestamp & 0xFF;
+        datagram[8] = UDPSEND_SSRC >> 24;
+        datagram[9] = (UDPSEND_SSRC >> 16) & 0xFF;
+        datagram[10] = (UDPSEND_SSRC >> 8) & 0xFF;
+        datagram[11] = UDPSEND_SSRC & 0xFF;
+        offset = UDPSEND_RTP_HEADER;
+    }
+    ++send->sequence;
+    memcpy(datagram + offset, packets, size);
+
+    send->bytes += size;
+
+    // A lost datagram still takes its sequence number.
+    if (send->options.loss && draw(send) < send->options.loss) {
+        ++send->dropped;
+        return 0;
+    }
+    send->datagrams += copies;
+
+    for (i = 0; i < copies; i++) {
+        if (i) {
+            memcpy(send->buffers[send->count], datagram, offset + size);
+        }
+        send->vectors[send->count].iov_base = send->buffers[send->count];
+        send->vectors[send->count].iov_len = offset + size;
+        ++send->count;
+    }
+
+    // Swapped with the one before, so it arrives late.
+    if (send->options.reorder && send->count > copies && draw(send) < send->options.reorder) {
+        swap = send->vectors[send->count - 1];
+        send->vectors[send->count - 1] = send->vectors[send->count - 1 - copies];
+        send->vectors[send->count - 1 - copies] = swap;
+        ++send->reordered;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to wait until the bytes sent so far are due, at the bitrate. The
+ * batch is sent first when waiting longer than a millisecond.
+ *
+ * @return int 0 on success, -1 otherwise.
+ */
+static int pace(UDPSEND *send) {
+    struct timespec due, now;
+    double seconds;
+
+    if (!send->options.bitrate) {
+        return 0;
+    }
+
+    seconds = send->bytes * 8.0 / send->options.bitrate;
+    due.tv_sec = send->start.tv_sec + (time_t) seconds;
+    due.tv_nsec = send->start.tv_nsec + (long) ((seconds - (time_t) seconds) * 1e9);
+    if (due.tv_nsec >= 1000000000) {
+        ++due.tv_sec;
+        due.tv_nsec -= 1000000000;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if ((due.tv_sec - now.tv_sec) * 1e9 + (due.tv_nsec - now.tv_nsec) < 1e6) {
+        return 0;
+    }
+
+    if (flush(send) < 0) {
+        return -1;
+    }
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) == EINTR);
+
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    UDPSEND send;
+    unsigned char packets[UDPSEND_MAX_PACKETS * TS_PACKET_SIZE];
+    size_t size;
+    int i, pass;
+
+    memset(&send, 0, sizeof (send));
+    if (parseArguments(argc, argv, &send.options) < 0) {
+        usage(argv[0]);
+    }
+    send.random = send.options.seed ? send.options.seed : 1;
+
+    if (send.options.loop != 1 && !send.options.input) {
+        fprintf(stderr, "{\"error\" : \"Only a file input can be looped.\"}\n");
+        return 1;
+    }
+
+    send.in = send.options.input ? fopen(send.options.input, "rb") : stdin;
+    if (!send.in || openSocket(&send) < 0) {
+        fprintf(stderr, "{\"error\" : \"Could not open the input or the socket.\"}\n");
+        return 1;
+    }
+
+    for (i = 0; i < UDPSEND_BATCH; i++) {
+        send.messages[i].msg_hdr.msg_name = &send.address;
+        send.messages[i].msg_hdr.msg_namelen = send.addressLength;
+        send.messages[i].msg_hdr.msg_iov = &send.vectors[i];
+        send.messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &send.start);
+
+    for (pass = 0; !send.options.loop || pass < send.options.loop; pass++) {
+        if (pass) {
+            rewind(send.in);
+        }
+
+        while ((size = fread(packets, TS_PACKET_SIZE, send.options.packets, send.in)) > 0) {
+            if (queue(&send, packets, size * TS_PACKET_SIZE) < 0 || pace(&send) < 0) {
+                fprintf(stderr, "{\"error\" : \"Could not send (%d).\"}\n", errno);
+                return 1;
+            }
+        }
+    }
+
+    if (flush(&send) < 0) {
+        fprintf(stderr, "{\"error\" : \"Could not send (%d).\"}\n", errno);
+        return 1;
+    }
+
+    fprintf(stderr, "{\"info\" : \"Sent %llu datagrams, of %llu bytes, dropped %llu, reordered %llu, duplicated %llu.\"}\n",
+            send.datagrams, send.bytes, send.dropped, send.reordered, send.duplicated);
+
+    return 0;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
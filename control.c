@@ -0,0 +1,215 @@
+/**
+ * @file
+ * Live control channel implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "control.h"
+
+/**
+ * Used to parse one command line, and queue it.
+ *
+ * @param CONTROL *control the control channel.
+ * @param char *line the command line.
+ */
+static void handleCommand(CONTROL *control, char *line) {
+    char verb[8], *end;
+    long long value;
+    unsigned int head = atomic_load_explicit(&control->head, memory_order_relaxed);
+    CUE_COMMAND *command;
+    int offset;
+
+    while (*line == ' ' || *line == '\t') {
+        ++line;
+    }
+    if (!*line || *line == '#') {
+        return;
+    }
+
+    if (sscanf(line, "%7s %n", verb, &offset) != 1 || (value = strtoll(line + offset, &end, 10)) < 0 ||
+            end == line + offset || (*end && *end != ' ' && *end != '\t' && *end != '\r') ||
+            (strcmp(verb, "at") && strcmp(verb, "pts") && strcmp(verb, "in"))) {
+        fprintf(stderr, "{\"error\" : \"Invalid control command (%s).\"}\n", line);
+        return;
+    }
+
+    if (head - atomic_load_explicit(&control->tail, memory_order_acquire) == CONTROL_QUEUE_SIZE) {
+        fprintf(stderr, "{\"error\" : \"Control queue full, command (%s) dropped.\"}\n", line);
+        return;
+    }
+
+    command = &control->commands[head % CONTROL_QUEUE_SIZE];
+    command->relative = !strcmp(verb, "in");
+    command->input = !strcmp(verb, "pts");
+    command->time = !strcmp(verb, "pts") ? value / 90 : value;
+
+    // Publishes the command before the session can see the new head.
+    atomic_store_explicit(&control->head, head + 1, memory_order_release);
+}
+
+/**
+ * Control thread, reads the commands until it is woken up to stop.
+ */
+static void *controlThread(void *opaque) {
+    CONTROL *control = opaque;
+    struct pollfd fds[2];
+    char buffer[CONTROL_MAX_LINE + 1], *line, *newline;
+    int length = 0, discarding = 0;
+    ssize_t size;
+
+    fds[0].fd = control->fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = control->wakeFds[0];
+    fds[1].events = POLLIN;
+
+    for (;;) {
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+
+        size = read(control->fd, buffer + length, CONTROL_MAX_LINE - length);
+        if (size <= 0) {
+            continue;
+        }
+        length += size;
+        buffer[length] = '\0';
+        line = buffer;
+
+        // The rest of a line too long is dropped up to its end, it is not a command of its own.
+        if (discarding) {
+            newline = strchr(buffer, '\n');
+            if (!newline) {
+                length = 0;
+                continue;
+            }
+            line = newline + 1;
+            discarding = 0;
+        }
+
+        for (; (newline = strchr(line, '\n')); line = newline + 1) {
+            *newline = '\0';
+            handleCommand(control, line);
+        }
+
+        length -= line - buffer;
+        memmove(buffer, line, length);
+
+        // A line longer than the buffer can not be a valid command.
+        if (length == CONTROL_MAX_LINE) {
+            fprintf(stderr, "{\"error\" : \"Control command too long, dropped.\"}\n");
+            length = 0;
+            discarding = 1;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Used to open the control FIFO, creating it when needed, and start reading it.
+ *
+ * @param CONTROL *control the control channel.
+ * @param const char *path the FIFO path.
+ * @return int 0 on success, -1 otherwise.
+ */
+int controlStart(CONTROL *control, const char *path) {
+    struct stat info;
+
+    memset(control, 0, sizeof (CONTROL));
+    atomic_init(&control->head, 0);
+    atomic_init(&control->tail, 0);
+
+    if (mkfifo(path, 0660) < 0 && errno != EEXIST) {
+        return -1;
+    }
+
+    // Opened for writing too, so the FIFO does not hang up between writers.
+    control->fd = open(path, O_RDWR | O_NONBLOCK);
+    if (control->fd < 0) {
+        return -1;
+    }
+    if (fstat(control->fd, &info) < 0 || !S_ISFIFO(info.st_mode) || pipe(control->wakeFds) < 0) {
+        close(control->fd);
+        return -1;
+    }
+
+    if (pthread_create(&control->thread, NULL, controlThread, control)) {
+        close(control->fd);
+        close(control->wakeFds[0]);
+        close(control->wakeFds[1]);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to take the next queued command, without blocking.
+ *
+ * @param CONTROL *control the control channel.
+ * @param CUE_COMMAND *command receives the command.
+ * @return int 1 when a command was taken, 0 when the queue is empty.
+ */
+int controlReceive(CONTROL *control, CUE_COMMAND *command) {
+    unsigned int tail = atomic_load_explicit(&control->tail, memory_order_relaxed);
+
+    if (tail == atomic_load_explicit(&control->head, memory_order_acquire)) {
+        return 0;
+    }
+
+    *command = control->commands[tail % CONTROL_QUEUE_SIZE];
+    atomic_store_explicit(&control->tail, tail + 1, memory_order_release);
+
+    return 1;
+}
+
+/**
+ * Used to stop reading the control FIFO. The FIFO is left in place, for the next run.
+ *
+ * @param CONTROL *control the control channel.
+ */
+void controlStop(CONTROL *control) {
+    char wake = 0;
+
+    if (write(control->wakeFds[1], &wake, 1) < 0) {
+        fprintf(stderr, "{\"error\" : \"Could not wake up the control thread.\"}\n");
+    }
+    pthread_join(control->thread, NULL);
+
+    close(control->fd);
+    close(control->wakeFds[0]);
+    close(control->wakeFds[1]);
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,63 @@
+/**
+ * @file
+ * Live control channel prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * A control channel reads cue point commands from a FIFO, one per line, on a
+ * thread of its own:
+ *     at <milliseconds>    a cue point at this output time.
+ *     pts <ticks>          a cue point at this 90 kHz presentation timestamp.
+ *     in <milliseconds>    a cue point this long after the current output time.
+ * Commands reach the session through a single producer, single consumer ring,
+ * so the remux loop only does an atomic load per packet. It expects
+ * <pthread.h> and <stdatomic.h> to be included first.
+ */
+#define CONTROL_QUEUE_SIZE 256
+#define CONTROL_MAX_LINE 256
+
+/**
+ * @var long long time the cue point time, in milliseconds.
+ * @var int relative whether it is relative to the current output time.
+ * @var int input whether it is an input timestamp, which the output time may be rebased from.
+ */
+typedef struct cue_command {
+    long long time;
+    int relative,
+        input;
+} CUE_COMMAND;
+
+typedef struct control {
+    int fd,
+        wakeFds[2];
+    pthread_t thread;
+
+    /**
+     * @var atomic_uint head the next command written, only moved by the control thread.
+     * @var atomic_uint tail the next command read, only moved by the session.
+     */
+    CUE_COMMAND commands[CONTROL_QUEUE_SIZE];
+    atomic_uint head,
+                tail;
+} CONTROL;
+
+int controlStart(CONTROL *, const char *);
+int controlReceive(CONTROL *, CUE_COMMAND *);
+void controlStop(CONTROL *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
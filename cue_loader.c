@@ -0,0 +1,192 @@
+/**
+ * @file
+ * Streaming cue points loader implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+
+#include "cue_loader.h"
+
+/**
+ * Used to open a cue points file, and tell its format.
+ *
+ * @param CUE_LOADER *loader the loader.
+ * @param const char *path the file path, "-" for the standard input.
+ * @return int 0 on success, -1 otherwise.
+ */
+int cueLoaderOpen(CUE_LOADER *loader, const char *path) {
+    char magic[4];
+    int c;
+
+    memset(loader, 0, sizeof (CUE_LOADER));
+    loader->path = path;
+    loader->last = -1;
+
+    loader->file = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    if (!loader->file) {
+        fprintf(stderr, "{\"error\" : \"Could not open cue points file (%s).\"}\n", path);
+        return -1;
+    }
+
+    // Text lines never start with the first letter of the magic.
+    c = getc(loader->file);
+    if (c != CUE_LOADER_MAGIC[0]) {
+        if (c != EOF) {
+            ungetc(c, loader->file);
+        }
+        return 0;
+    }
+
+    magic[0] = c;
+    if (fread(magic + 1, 1, 3, loader->file) != 3 || memcmp(magic, CUE_LOADER_MAGIC, 4) || getc(loader->file) != CUE_LOADER_VERSION) {
+        fprintf(stderr, "{\"error\" : \"Cue points file (%s) has an unknown format.\"}\n", path);
+        cueLoaderClose(loader);
+        return -1;
+    }
+    loader->binary = 1;
+
+    return 0;
+}
+
+/**
+ * Used to read the next text cue point, in milliseconds.
+ *
+ * @return int 1 when one was read, 0 at the end of the file, -1 on invalid lines.
+ */
+static int nextText(CUE_LOADER *loader, unsigned long long *time) {
+    char line[CUE_LOADER_MAX_LINE], *c, *start;
+    int decimals;
+
+    while (fgets(line, sizeof (line), loader->file)) {
+        ++loader->line;
+        if (!strchr(line, '\n') && !feof(loader->file)) {
+            fprintf(stderr, "{\"error\" : \"Cue points file (%s) line %llu is too long.\"}\n", loader->path, loader->line);
+            return -1;
+        }
+
+        for (c = line; *c == ' ' || *c == '\t'; c++);
+        if (*c == '#' || *c == '\n' || *c == '\r' || !*c) {
+            continue;
+        }
+
+        // Parsed by hand, as floating point seconds would not give exact milliseconds.
+        for (*time = 0, start = c; *c >= '0' && *c <= '9' && *time <= UINT_MAX; c++) {
+            *time = *time * 10 + (*c - '0');
+        }
+        *time *= 1000;
+        decimals = 0;
+
+        if (*c == '.') {
+            for (++c; *c >= '0' && *c <= '9' && decimals < 3; c++, decimals++) {
+                *time += (*c - '0') * (decimals == 0 ? 100 : decimals == 1 ? 10 : 1);
+            }
+        }
+
+        // At least one digit, before or after the point.
+        for (; *c == ' ' || *c == '\t' || *c == '\r' || *c == '\n'; c++);
+        if (*c || *time > UINT_MAX || (!decimals && (*start < '0' || *start > '9'))) {
+            fprintf(stderr, "{\"error\" : \"Cue points file (%s) line %llu is not a time in seconds, with up to 3 decimals.\"}\n",
+                    loader->path, loader->line);
+            return -1;
+        }
+
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to read the next binary cue point, in milliseconds.
+ *
+ * @return int 1 when one was read, 0 at the end of the file, -1 on truncated or invalid entries.
+ */
+static int nextBinary(CUE_LOADER *loader, unsigned long long *time) {
+    unsigned long long delta = 0;
+    int c, shift;
+
+    for (shift = 0; (c = getc_unlocked(loader->file)) != EOF; shift += 7) {
+        if (shift > 28) {
+            break;
+        }
+        delta |= (unsigned long long) (c & 0x7F) << shift;
+        if (!(c & 0x80)) {
+            *time = (loader->last < 0 ? 0 : loader->last) + delta;
+            if (*time > UINT_MAX) {
+                break;
+            }
+            return 1;
+        }
+    }
+
+    if (c == EOF && !shift) {
+        return 0;
+    }
+
+    fprintf(stderr, "{\"error\" : \"Cue points file (%s) entry %llu is truncated or too large.\"}\n", loader->path, loader->count + 1);
+    return -1;
+}
+
+/**
+ * Used to read the next cue point, checking it comes after the previous one.
+ *
+ * @param CUE_LOADER *loader the loader.
+ * @param unsigned int *time receives the cue point time, in milliseconds.
+ * @return int 1 when one was read, 0 at the end of the file, -1 on errors.
+ */
+int cueLoaderNext(CUE_LOADER *loader, unsigned int *time) {
+    unsigned long long value;
+    int ret;
+
+    if (!loader->file) {
+        return 0;
+    }
+
+    ret = loader->binary ? nextBinary(loader, &value) : nextText(loader, &value);
+    if (ret <= 0) {
+        return ret;
+    }
+
+    if ((long long) value <= loader->last) {
+        fprintf(stderr, "{\"error\" : \"Cue points file (%s) %s %llu (%llu ms) is %s.\"}\n", loader->path, loader->binary ? "entry" : "line",
+                loader->binary ? loader->count + 1 : loader->line, value, (long long) value == loader->last ? "a duplicate" : "out of order");
+        return -1;
+    }
+
+    loader->last = value;
+    ++loader->count;
+    *time = (unsigned int) value;
+
+    return 1;
+}
+
+/**
+ * Used to close the cue points file.
+ *
+ * @param CUE_LOADER *loader the loader.
+ */
+void cueLoaderClose(CUE_LOADER *loader) {
+    if (loader->file && loader->file != stdin) {
+        fclose(loader->file);
+    }
+    loader->file = NULL;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,56 @@
+/**
+ * @file
+ * Streaming cue points loader prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * The loader reads cue points one at a time from a file or the standard input,
+ * so only the ones about to be planned are held in memory. Two formats are
+ * accepted, told apart by their first bytes:
+ *     text      one time in seconds per line, with up to 3 decimals ("90.250"),
+ *               blank lines and lines starting with "#" are skipped.
+ *     binary    "CUEB", a version byte (1), then the distance in milliseconds of
+ *               each cue point from the previous one (from 0 for the first), as
+ *               unsigned LEB128 varints.
+ * Cue points must be strictly ascending, which is checked as they are read.
+ * It expects <stdio.h> to be included first.
+ */
+#define CUE_LOADER_MAGIC "CUEB"
+#define CUE_LOADER_VERSION 1
+#define CUE_LOADER_MAX_LINE 64
+
+typedef struct cue_loader {
+    FILE *file;
+    const char *path;
+    int binary;
+
+    /**
+     * @var unsigned long long count cue points read so far.
+     * @var unsigned long long line the text lines read so far.
+     * @var long long last the last cue point read, -1 before the first one.
+     */
+    unsigned long long count,
+                       line;
+    long long last;
+} CUE_LOADER;
+
+int cueLoaderOpen(CUE_LOADER *, const char *);
+int cueLoaderNext(CUE_LOADER *, unsigned int *);
+void cueLoaderClose(CUE_LOADER *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,239 @@
+/**
+ * @file
+ * Cue points boundary plan implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <stdlib.h>
+
+#include "linked_list.h"
+#include "cue_plan.h"
+
+/**
+ * Used to prepare an empty plan.
+ *
+ * @param CUE_PLAN *plan the plan.
+ * @param unsigned int base the segmentation base.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+int cuePlanInit(CUE_PLAN *plan, unsigned int base) {
+    plan->cues = createList((void *) "Cue Points", 1, 0);
+    plan->boundaries = createList((void *) "Boundaries", 1, 0);
+    plan->spare = createList((void *) "Spare", 1, 0);
+    plan->base = base ? base : 1;
+    plan->start = plan->end = 0;
+
+    if (!plan->cues || !plan->boundaries || !plan->spare) {
+        cuePlanDestroy(plan);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to get a node, a spare one when there is any.
+ *
+ * @return NODE * the node, NULL on allocation failure.
+ */
+static NODE *planNode(CUE_PLAN *plan, unsigned int id, void *data) {
+    NODE *node;
+
+    if (!plan->spare->tail) {
+        return createNode(id, data);
+    }
+
+    node = detachNode(plan->spare, plan->spare->tail);
+    node->id = id;
+    node->data = data;
+
+    return node;
+}
+
+/**
+ * Used to add a cue point to the plan. Cue points after the plan extend it,
+ * others split the boundary they fall in, found from the head, which is the
+ * segment being written.
+ *
+ * @param CUE_PLAN *plan the plan.
+ * @param unsigned int time the cue point time.
+ * @return int 0 when added, 1 when it is already cut or planned, -1 on allocation failure.
+ */
+int cuePlanInsert(CUE_PLAN *plan, unsigned int time) {
+    NODE *boundary = NULL, *cue, *node, *last;
+    unsigned int position = plan->start, gap;
+
+    if (time <= plan->start) {
+        return 1;
+    }
+
+    if (time < plan->end) {
+        for (boundary = plan->boundaries->head; position + boundary->id < time; boundary = boundary->next) {
+            position += boundary->id;
+        }
+        if (position + boundary->id == time && boundary->data) {
+            return 1;
+        }
+    } else if (time == plan->end && plan->boundaries->tail) {
+        boundary = plan->boundaries->tail;
+        position = plan->end - boundary->id;
+        if (boundary->data) {
+            return 1;
+        }
+    }
+
+    // Nodes are taken before the plan is changed, so an allocation failure leaves it as it was.
+    if (!(cue = planNode(plan, time, NULL))) {
+        return -1;
+    }
+
+    // A boundary on the segmentation base becomes a cue point one.
+    if (boundary && position + boundary->id == time) {
+        boundary->data = append(plan->cues, cue);
+
+        return 0;
+    }
+
+    if (boundary) {
+        if (!(node = planNode(plan, position + boundary->id - time, boundary->data))) {
+            cuePlanRecycle(plan, cue);
+            return -1;
+        }
+
+        append(plan->cues, cue);
+        insertAfter(plan->boundaries, boundary, node);
+        boundary->id = time - position;
+        boundary->data = cue;
+
+        return 0;
+    }
+
+    last = plan->boundaries->tail;
+    for (gap = time - plan->end; ; gap -= plan->base) {
+        if (!(node = planNode(plan, gap > plan->base ? plan->base : gap, gap > plan->base ? NULL : cue))) {
+            // The boundaries already appended are given back with the cue point.
+            while (plan->boundaries->tail != last) {
+                cuePlanRecycle(plan, detachNode(plan->boundaries, plan->boundaries->tail));
+            }
+            cuePlanRecycle(plan, cue);
+            return -1;
+        }
+        append(plan->boundaries, node);
+
+        if (gap <= plan->base) {
+            break;
+        }
+    }
+
+    append(plan->cues, cue);
+    plan->end = time;
+
+    return 0;
+}
+
+/**
+ * Used to check whether the segment being written is due to be cut.
+ *
+ * @param CUE_PLAN *plan the plan.
+ * @param unsigned int now the current time.
+ * @return int 1 when it is due, 0 when it is not, -1 when nothing is planned anymore.
+ */
+int cuePlanDue(CUE_PLAN *plan, unsigned int now) {
+    if (!plan->boundaries->head) {
+        return -1;
+    }
+
+    return now >= plan->start + plan->boundaries->head->id;
+}
+
+/**
+ * Used to consume the boundaries up to a cut. The cut may land after the
+ * planned boundary, on the next key frame, the following boundaries keep their
+ * planned times. The cue points reached leave the plan, so it only holds the
+ * pending ones.
+ *
+ * @param CUE_PLAN *plan the plan.
+ * @param unsigned int now the time of the cut.
+ * @return NODE * the last cue point the cut reached, owned by the caller until it is
+ * recycled, NULL when none.
+ */
+NODE *cuePlanAdvance(CUE_PLAN *plan, unsigned int now) {
+    NODE *boundary, *cue = NULL;
+
+    while ((boundary = plan->boundaries->head) && plan->start + boundary->id <= now) {
+        plan->start += boundary->id;
+        if (boundary->data) {
+            // Cue points reached by the same cut collapse into the last one.
+            if (cue) {
+                cuePlanRecycle(plan, cue);
+            }
+            cue = detachNode(plan->cues, boundary->data);
+        }
+        cuePlanRecycle(plan, detachNode(plan->boundaries, boundary));
+    }
+
+    if (boundary && now > plan->start) {
+        boundary->id -= now - plan->start;
+    }
+
+    if (now > plan->start) {
+        plan->start = now;
+    }
+    if (plan->end < plan->start) {
+        plan->end = plan->start;
+    }
+
+    return cue;
+}
+
+/**
+ * Used to give a node back to the plan, to be reused.
+ *
+ * @param CUE_PLAN *plan the plan.
+ * @param NODE *node the node, detached from any list.
+ */
+void cuePlanRecycle(CUE_PLAN *plan, NODE *node) {
+    node->data = NULL;
+    append(plan->spare, node);
+}
+
+/**
+ * Used to release a plan.
+ *
+ * @param CUE_PLAN *plan the plan.
+ */
+void cuePlanDestroy(CUE_PLAN *plan) {
+    if (plan->cues) {
+        deleteList(plan->cues);
+        free(plan->cues);
+        plan->cues = NULL;
+    }
+
+    if (plan->boundaries) {
+        deleteList(plan->boundaries);
+        free(plan->boundaries);
+        plan->boundaries = NULL;
+    }
+
+    if (plan->spare) {
+        deleteList(plan->spare);
+        free(plan->spare);
+        plan->spare = NULL;
+    }
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,60 @@
+/**
+ * @file
+ * Cue points boundary plan prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * The plan holds the segment boundaries still to come: the time between the
+ * last cut and each cue point is split in segments of at most the segmentation
+ * base, the last one ending on the cue point. Times are in milliseconds of the
+ * output timeline. Boundaries are consumed from the head as segments are cut,
+ * and cue points are merged in place, by splitting the boundary they fall in,
+ * so the plan is never rebuilt. Consumed nodes are kept aside and reused, so
+ * once the plan has grown to its largest, it allocates nothing more. It expects
+ * "linked_list.h" to be included first.
+ */
+
+typedef struct cue_plan {
+    /**
+     * @var LIST *cues the pending cue points, the id is the time.
+     * @var LIST *boundaries the planned segments, the id is the duration, and the data
+     * the cue point the segment ends on, NULL for a segment cut on the segmentation base.
+     * @var LIST *spare the consumed nodes, reused by the next boundaries and cue points.
+     */
+    LIST *cues,
+         *boundaries,
+         *spare;
+
+    /**
+     * @var unsigned int base the segmentation base.
+     * @var unsigned int start the time of the last cut, where the first boundary starts.
+     * @var unsigned int end the time the last boundary ends.
+     */
+    unsigned int base,
+                 start,
+                 end;
+} CUE_PLAN;
+
+int cuePlanInit(CUE_PLAN *, unsigned int);
+int cuePlanInsert(CUE_PLAN *, unsigned int);
+int cuePlanDue(CUE_PLAN *, unsigned int);
+NODE *cuePlanAdvance(CUE_PLAN *, unsigned int);
+void cuePlanRecycle(CUE_PLAN *, NODE *);
+void cuePlanDestroy(CUE_PLAN *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
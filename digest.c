@@ -0,0 +1,468 @@
+/**
+ * @file
+ * Content digests implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+// Built with -DNO_SHA_NI, blocks are always compressed in C, so "make check" covers it too.
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(NO_SHA_NI)
+#include <immintrin.h>
+#define SHA_NI 1
+#endif
+
+#include "digest.h"
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static inline uint64_t rotl64(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+/**
+ * Little endian reads, whatever the host order.
+ */
+static inline uint64_t read64(const unsigned char *p) {
+    return (uint64_t) p[0] | (uint64_t) p[1] << 8 | (uint64_t) p[2] << 16 | (uint64_t) p[3] << 24
+            | (uint64_t) p[4] << 32 | (uint64_t) p[5] << 40 | (uint64_t) p[6] << 48 | (uint64_t) p[7] << 56;
+}
+
+static inline uint32_t read32(const unsigned char *p) {
+    return (uint32_t) p[0] | (uint32_t) p[1] << 8 | (uint32_t) p[2] << 16 | (uint32_t) p[3] << 24;
+}
+
+static inline uint64_t round64(uint64_t accumulator, uint64_t input) {
+    accumulator += input * XXH_PRIME64_2;
+    accumulator = rotl64(accumulator, 31);
+
+    return accumulator * XXH_PRIME64_1;
+}
+
+static inline uint64_t merge64(uint64_t accumulator, uint64_t value) {
+    accumulator ^= round64(0, value);
+
+    return accumulator * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+/**
+ * Used to start a digest.
+ *
+ * @param XXH64 *xxh the digest.
+ * @param uint64_t seed the seed, 0 unless digests are meant to differ.
+ */
+void xxh64Init(XXH64 *xxh, uint64_t seed) {
+    memset(xxh, 0, sizeof (XXH64));
+    xxh->seed = seed;
+    xxh->state[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+    xxh->state[1] = seed + XXH_PRIME64_2;
+    xxh->state[2] = seed;
+    xxh->state[3] = seed - XXH_PRIME64_1;
+}
+
+/**
+ * Used to add bytes to a digest, stripes of 32 bytes are consumed in place,
+ * only the bytes left over are buffered.
+ *
+ * @param XXH64 *xxh the digest.
+ * @param const void *data the bytes.
+ * @param size_t size the bytes count.
+ */
+void xxh64Update(XXH64 *xxh, const void *data, size_t size) {
+    const unsigned char *p = data, *end = p + size;
+    size_t copied;
+
+    xxh->length += size;
+
+    if (xxh->fill) {
+        copied = 32 - xxh->fill < size ? 32 - xxh->fill : size;
+        memcpy(xxh->buffer + xxh->fill, p, copied);
+        xxh->fill += copied;
+        p += copied;
+        if (xxh->fill < 32) {
+            return;
+        }
+
+        xxh->state[0] = round64(xxh->state[0], read64(xxh->buffer));
+        xxh->state[1] = round64(xxh->state[1], read64(xxh->buffer + 8));
+        xxh->state[2] = round64(xxh->state[2], read64(xxh->buffer + 16));
+        xxh->state[3] = round64(xxh->state[3], read64(xxh->buffer + 24));
+        xxh->fill = 0;
+    }
+
+    for (; end - p >= 32; p += 32) {
+        xxh->state[0] = round64(xxh->state[0], read64(p));
+        xxh->state[1] = round64(xxh->state[1], read64(p + 8));
+        xxh->state[2] = round64(xxh->state[2], read64(p + 16));
+        xxh->state[3] = round64(xxh->state[3], read64(p + 24));
+    }
+
+    if (p < end) {
+        memcpy(xxh->buffer, p, end - p);
+        xxh->fill = end - p;
+    }
+}
+
+/**
+ * Used to get the digest of the bytes added so far, more may be added after.
+ *
+ * @param const XXH64 *xxh the digest.
+ * @return uint64_t the digest.
+ */
+uint64_t xxh64Digest(const XXH64 *xxh) {
+    const unsigned char *p = xxh->buffer, *end = p + xxh->fill;
+    uint64_t hash;
+
+    if (xxh->length >= 32) {
+        hash = rotl64(xxh->state[0], 1) + rotl64(xxh->state[1], 7) + rotl64(xxh->state[2], 12) + rotl64(xxh->state[3], 18);
+        hash = merge64(hash, xxh->state[0]);
+        hash = merge64(hash, xxh->state[1]);
+        hash = merge64(hash, xxh->state[2]);
+        hash = merge64(hash, xxh->state[3]);
+    } else {
+        hash = xxh->seed + XXH_PRIME64_5;
+    }
+    hash += xxh->length;
+
+    for (; end - p >= 8; p += 8) {
+        hash ^= round64(0, read64(p));
+        hash = rotl64(hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+    }
+    if (end - p >= 4) {
+        hash ^= (uint64_t) read32(p) * XXH_PRIME64_1;
+        hash = rotl64(hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        hash ^= *p * XXH_PRIME64_5;
+        hash = rotl64(hash, 11) * XXH_PRIME64_1;
+    }
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME64_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+/**
+ * Used to hash a whole file.
+ *
+ * @param const char *path the file path.
+ * @param long long *size receives the file size.
+ * @param uint64_t *digest receives the digest, with a 0 seed.
+ * @return int 0 on success, -1 when it can not be read.
+ */
+int xxh64File(const char *path, long long *size, uint64_t *digest) {
+    unsigned char buffer[65536];
+    XXH64 xxh;
+    FILE *fp;
+    size_t read;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        return -1;
+    }
+
+    xxh64Init(&xxh, 0);
+    while ((read = fread(buffer, 1, sizeof (buffer), fp)) > 0) {
+        xxh64Update(&xxh, buffer, read);
+    }
+
+    if (ferror(fp)) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    *size = xxh.length;
+    *digest = xxh64Digest(&xxh);
+
+    return 0;
+}
+
+static const uint32_t sha256K[64] = {
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5,
+    0xD807AA98, 0x12835B01, 0x243185BE, 0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174,
+    0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA, 0x5CB0A9DC, 0x76F988DA,
+    0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967,
+    0x27B70A85, 0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85,
+    0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3, 0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070,
+    0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F, 0x682E6FF3,
+    0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2
+};
+
+static int shaHardware;
+static pthread_once_t shaChecked = PTHREAD_ONCE_INIT;
+
+static void checkSha(void) {
+#ifdef SHA_NI
+    shaHardware = __builtin_cpu_supports("sha") && __builtin_cpu_supports("sse4.1");
+#endif
+}
+
+static inline uint32_t ror32(uint32_t value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+static inline uint32_t read32be(const unsigned char *p) {
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+/**
+ * Used to compress blocks in plain C.
+ */
+static void sha256Blocks(uint32_t *state, const unsigned char *p, size_t blocks) {
+    uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+    int i;
+
+    for (; blocks; blocks--, p += 64) {
+        for (i = 0; i < 16; i++) {
+            w[i] = read32be(p + 4 * i);
+        }
+        for (; i < 64; i++) {
+            w[i] = (ror32(w[i - 2], 17) ^ ror32(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7]
+                    + (ror32(w[i - 15], 7) ^ ror32(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+        }
+
+        a = state[0];
+        b = state[1];
+        c = state[2];
+        d = state[3];
+        e = state[4];
+        f = state[5];
+        g = state[6];
+        h = state[7];
+
+        for (i = 0; i < 64; i++) {
+            t1 = h + (ror32(e, 6) ^ ror32(e, 11) ^ ror32(e, 25)) + ((e & f) ^ (~e & g)) + sha256K[i] + w[i];
+            t2 = (ror32(a, 2) ^ ror32(a, 13) ^ ror32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef SHA_NI
+/**
+ * Used to compress blocks with the SHA-NI instructions, four rounds at a time,
+ * the state kept as the ABEF and CDGH halves they work on.
+ */
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256BlocksHardware(uint32_t *state, const unsigned char *p, size_t blocks) {
+    const __m128i order = _mm_set_epi64x(0x0C0D0E0F08090A0BULL, 0x0405060700010203ULL);
+    __m128i abef, cdgh, savedAbef, savedCdgh, message[4], words, tmp;
+    int group;
+
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) state), 0xB1);
+    cdgh = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) (state + 4)), 0x1B);
+    abef = _mm_alignr_epi8(tmp, cdgh, 8);
+    cdgh = _mm_blend_epi16(cdgh, tmp, 0xF0);
+
+    for (; blocks; blocks--, p += 64) {
+        savedAbef = abef;
+        savedCdgh = cdgh;
+
+        for (group = 0; group < 16; group++) {
+            if (group < 4) {
+                message[group] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (p + 16 * group)), order);
+            } else {
+                // The words 16 back, 15 back, 7 back and 2 back, the oldest group is replaced.
+                tmp = _mm_sha256msg1_epu32(message[group % 4], message[(group + 1) % 4]);
+                tmp = _mm_add_epi32(tmp, _mm_alignr_epi8(message[(group + 3) % 4], message[(group + 2) % 4], 4));
+                message[group % 4] = _mm_sha256msg2_epu32(tmp, message[(group + 3) % 4]);
+            }
+
+            words = _mm_add_epi32(message[group % 4], _mm_loadu_si128((const __m128i *) (sha256K + 4 * group)));
+            cdgh = _mm_sha256rnds2_epu32(cdgh, abef, words);
+            abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(words, 0x0E));
+        }
+
+        abef = _mm_add_epi32(abef, savedAbef);
+        cdgh = _mm_add_epi32(cdgh, savedCdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(abef, 0x1B);
+    cdgh = _mm_shuffle_epi32(cdgh, 0xB1);
+    _mm_storeu_si128((__m128i *) state, _mm_blend_epi16(tmp, cdgh, 0xF0));
+    _mm_storeu_si128((__m128i *) (state + 4), _mm_alignr_epi8(cdgh, tmp, 8));
+}
+#endif
+
+static void compress(uint32_t *state, const unsigned char *p, size_t blocks) {
+#ifdef SHA_NI
+    if (shaHardware) {
+        sha256BlocksHardware(state, p, blocks);
+        return;
+    }
+#endif
+    sha256Blocks(state, p, blocks);
+}
+
+/**
+ * Used to tell whether blocks are compressed with the SHA-NI instructions.
+ *
+ * @return int 1 when they are, 0 otherwise.
+ */
+int sha256Hardware(void) {
+    pthread_once(&shaChecked, checkSha);
+
+    return shaHardware;
+}
+
+/**
+ * Used to start a digest.
+ *
+ * @param SHA256 *sha the digest.
+ */
+void sha256Init(SHA256 *sha) {
+    static const uint32_t initial[8] = {
+        0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19
+    };
+
+    pthread_once(&shaChecked, checkSha);
+    memcpy(sha->state, initial, sizeof (initial));
+    sha->length = 0;
+    sha->fill = 0;
+}
+
+/**
+ * Used to add bytes to a digest, whole blocks are compressed in place, only
+ * the bytes left over are buffered.
+ *
+ * @param SHA256 *sha the digest.
+ * @param const void *data the bytes.
+ * @param size_t size the bytes count.
+ */
+void sha256Update(SHA256 *sha, const void *data, size_t size) {
+    const unsigned char *p = data;
+    size_t copied;
+
+    sha->length += size;
+
+    if (sha->fill) {
+        copied = 64 - sha->fill < size ? 64 - sha->fill : size;
+        memcpy(sha->buffer + sha->fill, p, copied);
+        sha->fill += copied;
+        p += copied;
+        size -= copied;
+        if (sha->fill < 64) {
+            return;
+        }
+        compress(sha->state, sha->buffer, 1);
+        sha->fill = 0;
+    }
+
+    if (size >= 64) {
+        compress(sha->state, p, size / 64);
+        p += size & ~(size_t) 63;
+        size &= 63;
+    }
+
+    memcpy(sha->buffer, p, size);
+    sha->fill = size;
+}
+
+/**
+ * Used to end a digest.
+ *
+ * @param SHA256 *sha the digest, to be started again before it is reused.
+ * @param unsigned char *digest receives the digest, SHA256_SIZE bytes.
+ */
+void sha256Final(SHA256 *sha, unsigned char *digest) {
+    uint64_t bits = sha->length * 8;
+    int i;
+
+    sha->buffer[sha->fill++] = 0x80;
+    if (sha->fill > 56) {
+        memset(sha->buffer + sha->fill, 0, 64 - sha->fill);
+        compress(sha->state, sha->buffer, 1);
+        sha->fill = 0;
+    }
+    memset(sha->buffer + sha->fill, 0, 56 - sha->fill);
+    for (i = 0; i < 8; i++) {
+        sha->buffer[56 + i] = bits >> (56 - 8 * i);
+    }
+    compress(sha->state, sha->buffer, 1);
+
+    for (i = 0; i < 32; i++) {
+        digest[i] = sha->state[i / 4] >> (24 - 8 * (i % 4));
+    }
+}
+
+/**
+ * Used to hash a whole file.
+ *
+ * @param const char *path the file path.
+ * @param long long *size receives the file size.
+ * @param unsigned char *digest receives the digest, SHA256_SIZE bytes.
+ * @return int 0 on success, -1 when it can not be read.
+ */
+int sha256File(const char *path, long long *size, unsigned char *digest) {
+    unsigned char buffer[65536];
+    SHA256 sha;
+    FILE *fp;
+    size_t read;
+
+    fp = fopen(path, "rb");
+    if (!fp) {
+        return -1;
+    }
+
+    sha256Init(&sha);
+    while ((read = fread(buffer, 1, sizeof (buffer), fp)) > 0) {
+        sha256Update(&sha, buffer, read);
+    }
+
+    if (ferror(fp)) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    *size = sha.length;
+    sha256Final(&sha, digest);
+
+    return 0;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
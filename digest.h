@@ -0,0 +1,59 @@
+/**
+ * @file
+ * Content digests prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * XXH64, fast enough to hash segments as they are written, it tells whether a
+ * segment changed, it does not protect against tampering. It expects
+ * <stdint.h> and <stddef.h> to be included first.
+ */
+typedef struct xxh64 {
+    uint64_t state[4];
+    uint64_t length;
+    unsigned char buffer[32];
+    unsigned int fill;
+    uint64_t seed;
+} XXH64;
+
+void xxh64Init(XXH64 *, uint64_t);
+void xxh64Update(XXH64 *, const void *, size_t);
+uint64_t xxh64Digest(const XXH64 *);
+int xxh64File(const char *, long long *, uint64_t *);
+
+/**
+ * SHA-256, for integrity checks that have to hold against tampering. Blocks
+ * are compressed with the SHA-NI instructions when the processor has them,
+ * in plain C otherwise.
+ */
+#define SHA256_SIZE 32
+
+typedef struct sha256 {
+    uint32_t state[8];
+    uint64_t length;
+    unsigned char buffer[64];
+    unsigned int fill;
+} SHA256;
+
+int sha256Hardware(void);
+void sha256Init(SHA256 *);
+void sha256Update(SHA256 *, const void *, size_t);
+void sha256Final(SHA256 *, unsigned char *);
+int sha256File(const char *, long long *, unsigned char *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
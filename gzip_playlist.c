@@ -0,0 +1,148 @@
+/**
+ * @file
+ * Precompressed playlist implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "gzip_playlist.h"
+
+/**
+ * Used to prepare a compressed playlist, with a gzip wrapped deflate stream.
+ *
+ * @param GZIP_PLAYLIST *gzip the compressed playlist.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+int gzipPlaylistInit(GZIP_PLAYLIST *gzip) {
+    memset(gzip, 0, sizeof (GZIP_PLAYLIST));
+
+    // A window of 2^15, plus 16 for the gzip header and trailer.
+    if (deflateInit2(&gzip->stream, GZIP_PLAYLIST_LEVEL, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to make room for more compressed bytes, and the tail after them.
+ *
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int reserve(GZIP_PLAYLIST *gzip, size_t size) {
+    unsigned char *data;
+    size_t capacity = gzip->capacity ? gzip->capacity : 4096;
+
+    if (gzip->size + size + GZIP_PLAYLIST_TAIL_SIZE <= gzip->capacity) {
+        return 0;
+    }
+
+    while (capacity < gzip->size + size + GZIP_PLAYLIST_TAIL_SIZE) {
+        capacity *= 2;
+    }
+
+    data = realloc(gzip->data, capacity);
+    if (!data) {
+        return -1;
+    }
+    gzip->data = data;
+    gzip->capacity = capacity;
+
+    return 0;
+}
+
+/**
+ * Used to compress a new version of the playlist. When the bytes compressed
+ * so far are the start of it, as their CRC tells, the rest is appended to the
+ * retained stream, otherwise it is compressed whole.
+ *
+ * @param GZIP_PLAYLIST *gzip the compressed playlist, data holds the version to publish, published bytes long.
+ * @param const char *playlist the playlist.
+ * @param size_t size the playlist size.
+ * @return int 0 on success, -1 otherwise.
+ */
+int gzipPlaylistUpdate(GZIP_PLAYLIST *gzip, const char *playlist, size_t size) {
+    z_stream *stream = &gzip->stream;
+    unsigned long total;
+    int ret;
+
+    if (gzip->consumed && gzip->consumed <= size && gzip->size - gzip->rebuilt <= gzip->rebuilt
+            && crc32(0, (const Bytef *) playlist, gzip->consumed) == stream->adler) {
+        ++gzip->appends;
+    } else {
+        if (deflateReset(stream) != Z_OK) {
+            return -1;
+        }
+        gzip->size = gzip->consumed = gzip->rebuilt = 0;
+        ++gzip->rebuilds;
+    }
+
+    // Flushed to a byte boundary, so the tail may follow, and the next lines be appended after it is dropped.
+    stream->next_in = (Bytef *) playlist + gzip->consumed;
+    stream->avail_in = size - gzip->consumed;
+    if (stream->avail_in || !gzip->size) {
+        do {
+            if (reserve(gzip, deflateBound(stream, stream->avail_in) + 16) < 0) {
+                return -1;
+            }
+            stream->next_out = gzip->data + gzip->size;
+            stream->avail_out = gzip->capacity - gzip->size - GZIP_PLAYLIST_TAIL_SIZE;
+
+            ret = deflate(stream, Z_SYNC_FLUSH);
+            if (ret != Z_OK && ret != Z_BUF_ERROR) {
+                return -1;
+            }
+            gzip->size = stream->next_out - gzip->data;
+        } while (stream->avail_in || !stream->avail_out);
+    }
+    if (!gzip->consumed) {
+        gzip->rebuilt = gzip->size;
+    }
+    gzip->consumed = size;
+
+    // An empty final block with fixed codes, then the CRC and size of the whole playlist.
+    total = stream->total_in;
+    gzip->data[gzip->size] = 0x03;
+    gzip->data[gzip->size + 1] = 0x00;
+    gzip->data[gzip->size + 2] = stream->adler;
+    gzip->data[gzip->size + 3] = stream->adler >> 8;
+    gzip->data[gzip->size + 4] = stream->adler >> 16;
+    gzip->data[gzip->size + 5] = stream->adler >> 24;
+    gzip->data[gzip->size + 6] = total;
+    gzip->data[gzip->size + 7] = total >> 8;
+    gzip->data[gzip->size + 8] = total >> 16;
+    gzip->data[gzip->size + 9] = total >> 24;
+    gzip->published = gzip->size + GZIP_PLAYLIST_TAIL_SIZE;
+
+    return 0;
+}
+
+/**
+ * Used to release a compressed playlist.
+ *
+ * @param GZIP_PLAYLIST *gzip the compressed playlist.
+ */
+void gzipPlaylistDestroy(GZIP_PLAYLIST *gzip) {
+    deflateEnd(&gzip->stream);
+    free(gzip->data);
+    gzip->data = NULL;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,72 @@
+/**
+ * @file
+ * Precompressed playlist prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * The gzip variant of a playlist, published next to it, so it is served as
+ * is instead of compressed on each request. A playlist that only grows, as a
+ * playlist without a window does, is compressed incrementally: the deflate
+ * stream is kept from one version to the next, and only the lines added are
+ * compressed, then flushed to a byte boundary. Each published version is the
+ * retained stream followed by an empty final block and the gzip trailer,
+ * which are not kept. A version that is not an extension of the previous one
+ * (a window playlist, a new target duration) restarts the stream. Lines
+ * flushed one version at a time compress less well than a whole playlist, so
+ * the stream is also restarted once what was appended outgrows what was
+ * compressed whole: the versions stay at most about twice their best size,
+ * and the restarts, further and further apart, keep the work per version
+ * constant on average. It expects <zlib.h> to be included first.
+ */
+
+/**
+ * The empty final block and the trailer closing each published version.
+ */
+#define GZIP_PLAYLIST_TAIL_SIZE 10
+#define GZIP_PLAYLIST_LEVEL 6
+
+typedef struct gzip_playlist {
+    z_stream stream;
+
+    /**
+     * @var unsigned char *data the retained stream, followed by room for the tail.
+     * @var size_t size the retained stream size.
+     * @var size_t published the size of the version published, with its tail.
+     * @var size_t consumed the playlist bytes compressed into the retained stream.
+     * @var size_t rebuilt the retained stream size when it was last compressed whole.
+     */
+    unsigned char *data;
+    size_t size,
+           capacity,
+           published,
+           consumed,
+           rebuilt;
+
+    /**
+     * @var unsigned long long appends versions compressed as an extension of the previous one.
+     * @var unsigned long long rebuilds versions compressed whole.
+     */
+    unsigned long long appends,
+                       rebuilds;
+} GZIP_PLAYLIST;
+
+int gzipPlaylistInit(GZIP_PLAYLIST *);
+int gzipPlaylistUpdate(GZIP_PLAYLIST *, const char *, size_t);
+void gzipPlaylistDestroy(GZIP_PLAYLIST *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
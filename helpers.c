@@ -20,6 +20,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 /**
  * Used to compare between two strings.
@@ -58,4 +59,30 @@ char *replaceString(char *search, char *replace, char *subject) {
     return buffer;
 }
 
+/**
+ * Used to read the monotonic clock, for measuring elapsed times.
+ *
+ * @return double milliseconds since an arbitrary, fixed point.
+ */
+double getMonotonicMilliseconds(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+/**
+ * Used to read the wall clock, for dating the output.
+ *
+ * @return double milliseconds since the epoch.
+ */
+double getWallClockMilliseconds(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
 // vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -20,5 +20,7 @@
 
 int findString(void *, void *);
 char *replaceString(char *, char *, char *);
+double getMonotonicMilliseconds(void);
+double getWallClockMilliseconds(void);
 
 // vim:sw=4:tw=4:ts=4:ai:expandtab
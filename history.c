@@ -0,0 +1,157 @@
+/**
+ * @file
+ * Segment history ring implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "history.h"
+
+/**
+ * Used to prepare an empty history.
+ *
+ * @param HISTORY *history the history.
+ * @param unsigned int capacity the segments kept, the window size, 0 for all of them.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+int historyInit(HISTORY *history, unsigned int capacity) {
+    memset(history, 0, sizeof (HISTORY));
+    history->bounded = capacity > 0;
+    history->capacity = capacity ? capacity : HISTORY_INITIAL_CAPACITY;
+
+    history->entries = calloc(history->capacity, sizeof (HISTORY_ENTRY));
+    if (!history->entries) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to get a segment of the history.
+ *
+ * @param HISTORY *history the history.
+ * @param unsigned int index the segment position, 0 for the oldest.
+ * @return HISTORY_ENTRY * the segment, NULL past the newest.
+ */
+HISTORY_ENTRY *historyAt(HISTORY *history, unsigned int index) {
+    if (index >= history->count) {
+        return NULL;
+    }
+
+    return &history->entries[(history->first + index) % history->capacity];
+}
+
+/**
+ * Used to double the capacity of an unbounded history, its segments moved to
+ * the start of the new entries.
+ *
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int grow(HISTORY *history) {
+    HISTORY_ENTRY *entries = calloc(history->capacity * 2, sizeof (HISTORY_ENTRY));
+    unsigned int i;
+
+    if (!entries) {
+        return -1;
+    }
+
+    for (i = 0; i < history->capacity; i++) {
+        entries[i] = history->entries[(history->first + i) % history->capacity];
+    }
+
+    free(history->entries);
+    history->entries = entries;
+    history->first = 0;
+    history->capacity *= 2;
+
+    return 0;
+}
+
+/**
+ * Used to add the newest segment. Its slot comes without markers, keeping the
+ * markers buffer of the segment it held before.
+ *
+ * @param HISTORY *history the history.
+ * @return HISTORY_ENTRY * the segment, NULL when a bounded history is full, or on allocation failure.
+ */
+HISTORY_ENTRY *historyAppend(HISTORY *history) {
+    HISTORY_ENTRY *entry;
+
+    if (history->count == history->capacity && (history->bounded || grow(history) < 0)) {
+        return NULL;
+    }
+
+    entry = &history->entries[(history->first + history->count++) % history->capacity];
+    entry->duration = 0;
+    entry->marked = 0;
+
+    return entry;
+}
+
+/**
+ * Used to drop the oldest segment, its slot is reused by the next one added.
+ *
+ * @param HISTORY *history the history.
+ */
+void historyDropOldest(HISTORY *history) {
+    if (!history->count) {
+        return;
+    }
+
+    history->first = (history->first + 1) % history->capacity;
+    --history->count;
+}
+
+/**
+ * Used to get the markers buffer of a segment, allocated the first time its
+ * slot needs one.
+ *
+ * @param HISTORY_ENTRY *entry the segment.
+ * @return char * the buffer, HISTORY_MARKERS_SIZE bytes, NULL on allocation failure.
+ */
+char *historyMarkers(HISTORY_ENTRY *entry) {
+    if (!entry->markers) {
+        entry->markers = malloc(HISTORY_MARKERS_SIZE);
+    }
+
+    return entry->markers;
+}
+
+/**
+ * Used to release a history.
+ *
+ * @param HISTORY *history the history.
+ */
+void historyDestroy(HISTORY *history) {
+    unsigned int i;
+
+    if (!history->entries) {
+        return;
+    }
+
+    for (i = 0; i < history->capacity; i++) {
+        free(history->entries[i].markers);
+    }
+    free(history->entries);
+    history->entries = NULL;
+    history->count = 0;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
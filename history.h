@@ -0,0 +1,67 @@
+/**
+ * @file
+ * Segment history ring prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * The history holds the segments listed in the playlist, the oldest first, in
+ * a ring of entries allocated once. With a window, its capacity is the window
+ * size, so the memory and the work per boundary stay the same however long a
+ * channel runs; without one, it doubles as the playlist grows. Each slot keeps
+ * its markers buffer from one segment to the next. It expects <stddef.h> to be
+ * included first.
+ */
+
+/**
+ * Size of the ad markers written after a segment ending on a cue point.
+ */
+#define HISTORY_MARKERS_SIZE 512
+#define HISTORY_INITIAL_CAPACITY 64
+
+typedef struct history_entry {
+    /**
+     * @var unsigned int duration the segment duration, in milliseconds.
+     * @var char *markers the ad markers written after the segment, HISTORY_MARKERS_SIZE bytes.
+     * @var int marked whether the segment ends on a cue point, and has markers.
+     */
+    unsigned int duration;
+    char *markers;
+    int marked;
+} HISTORY_ENTRY;
+
+typedef struct history {
+    HISTORY_ENTRY *entries;
+
+    /**
+     * @var unsigned int first the slot of the oldest segment.
+     * @var int bounded whether the capacity is fixed, the oldest segment has to be dropped to add one.
+     */
+    unsigned int capacity,
+                 first,
+                 count;
+    int bounded;
+} HISTORY;
+
+int historyInit(HISTORY *, unsigned int);
+HISTORY_ENTRY *historyAt(HISTORY *, unsigned int);
+HISTORY_ENTRY *historyAppend(HISTORY *);
+void historyDropOldest(HISTORY *);
+char *historyMarkers(HISTORY_ENTRY *);
+void historyDestroy(HISTORY *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
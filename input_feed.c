@@ -0,0 +1,141 @@
+/**
+ * @file
+ * Input feed implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "input_feed.h"
+
+/**
+ * Used to tell whether a packet is a mark, and remember the PES it starts.
+ *
+ * @param INPUT_FEED *feed the feed.
+ * @param const uint8_t *packet the packet.
+ * @return int 1 when the demuxer hands a frame out at the packet, 0 otherwise.
+ */
+static int markPacket(INPUT_FEED *feed, const uint8_t *packet) {
+    int pid = ((packet[1] & 0x1F) << 8) | packet[2], offset = 4;
+
+    // Errored packets, no payload unit start, or no payload.
+    if ((packet[1] & 0x80) || !(packet[1] & 0x40) || !(packet[3] & 0x10)) {
+        return 0;
+    }
+    if (packet[3] & 0x20) {
+        offset += 1 + packet[4];
+    }
+    if (offset + 3 > INPUT_FEED_TS_PACKET_SIZE || packet[offset] || packet[offset + 1] || packet[offset + 2] != 1) {
+        return 0;
+    }
+
+    if (!feed->started[pid]) {
+        feed->started[pid] = 1;
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * Used to prepare a feed.
+ *
+ * @param INPUT_FEED *feed the feed.
+ */
+void inputFeedInit(INPUT_FEED *feed) {
+    memset(feed, 0, sizeof (INPUT_FEED));
+    pthread_mutex_init(&feed->lock, NULL);
+}
+
+/**
+ * Used to scan the bytes fed, in input order. Aligned packets are scanned in
+ * place, only the packets split between reads are copied.
+ *
+ * @param INPUT_FEED *feed the feed.
+ * @param const uint8_t *data the bytes.
+ * @param int size the bytes count.
+ * @return int64_t the offset in the input of the last mark, -1 when the bytes complete none.
+ */
+int64_t inputFeedMark(INPUT_FEED *feed, const uint8_t *data, int size) {
+    const uint8_t *start = data, *sync;
+    int64_t marked = -1;
+    int copied, fill;
+
+    while (size > 0) {
+        if (feed->packetFill) {
+            fill = feed->packetFill;
+            copied = INPUT_FEED_TS_PACKET_SIZE - fill;
+            if (copied > size) {
+                copied = size;
+            }
+            memcpy(feed->packet + fill, data, copied);
+            feed->packetFill += copied;
+
+            if (feed->packetFill == INPUT_FEED_TS_PACKET_SIZE) {
+                if (markPacket(feed, feed->packet)) {
+                    marked = feed->offset + (data - start) - fill;
+                }
+                feed->packetFill = 0;
+            }
+            data += copied;
+            size -= copied;
+            continue;
+        }
+
+        // Resynchronize on the next sync byte.
+        if (*data != 0x47) {
+            sync = memchr(data, 0x47, size);
+            if (!sync) {
+                data += size;
+                break;
+            }
+            size -= sync - data;
+            data = sync;
+        }
+
+        if (size < INPUT_FEED_TS_PACKET_SIZE) {
+            memcpy(feed->packet, data, size);
+            feed->packetFill = size;
+            data += size;
+            break;
+        }
+
+        if (markPacket(feed, data)) {
+            marked = feed->offset + (data - start);
+        }
+        data += INPUT_FEED_TS_PACKET_SIZE;
+        size -= INPUT_FEED_TS_PACKET_SIZE;
+    }
+
+    feed->offset += data - start;
+
+    return marked;
+}
+
+/**
+ * Used to release a feed.
+ *
+ * @param INPUT_FEED *feed the feed.
+ */
+void inputFeedDestroy(INPUT_FEED *feed) {
+    pthread_mutex_destroy(&feed->lock);
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
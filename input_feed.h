@@ -0,0 +1,53 @@
+/**
+ * @file
+ * Input feed prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * The feed reads the input of a supervised channel into its ring, apart from
+ * the worker demuxing it, and marks the TS packets the demuxer hands a frame
+ * out at: those starting a PES (a payload unit start whose payload opens with
+ * 00 00 01) on a PID a PES already started on, as the demuxer holds the PES in
+ * progress until the next one starts. A worker demuxing up to a mark does not
+ * wait for input. It expects <stdint.h> and <pthread.h> to be included first.
+ */
+#define INPUT_FEED_TS_PACKET_SIZE 188
+#define INPUT_FEED_TS_PIDS 8192
+
+typedef struct input_feed {
+    /**
+     * @var pthread_mutex_t lock held while the input is read, so its counters are copied whole.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * @var int64_t offset the bytes scanned so far.
+     * @var uint8_t packet a packet split between two reads, packetFill bytes of it.
+     * @var unsigned char started whether a PES started on each PID.
+     */
+    int64_t offset;
+    uint8_t packet[INPUT_FEED_TS_PACKET_SIZE];
+    int packetFill;
+    unsigned char started[INPUT_FEED_TS_PIDS];
+} INPUT_FEED;
+
+void inputFeedInit(INPUT_FEED *);
+int64_t inputFeedMark(INPUT_FEED *, const uint8_t *, int);
+void inputFeedDestroy(INPUT_FEED *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,419 @@
+/**
+ * @file
+ * Bounded packet interleaver implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "libavformat/avformat.h"
+
+#include "metrics.h"
+#include "interleaver.h"
+
+/**
+ * Used to prepare an interleaver, and allocate its arena and slots.
+ *
+ * @param INTERLEAVER *il the interleaver.
+ * @param AVFormatContext *oc the muxer packets are written to.
+ * @param int streams the streams interleaved, a single one is written straight through.
+ * @param long size the arena size, in bytes.
+ * @param long maxDelta the widest span of timestamps queued, in milliseconds.
+ * @param int flush how packets are written before their turn, an enum Interleaver_Flush.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+int interleaverInit(INTERLEAVER *il, AVFormatContext *oc, int streams, long size, long maxDelta, int flush) {
+    int stream;
+
+    memset(il, 0, sizeof (INTERLEAVER));
+    il->oc = oc;
+    il->streams = streams;
+    il->flush = flush;
+    il->maxDelta = (int64_t) maxDelta * 1000;
+
+    for (stream = 0; stream < INTERLEAVER_MAX_STREAMS; stream++) {
+        il->heads[stream] = il->tails[stream] = -1;
+        il->lastDts[stream] = AV_NOPTS_VALUE;
+    }
+
+    if (streams < 2) {
+        return 0;
+    }
+
+    il->size = size;
+    il->capacity = size / INTERLEAVER_SLOT_BYTES;
+    il->arena = malloc(il->size);
+    il->slots = malloc(il->capacity * sizeof (INTERLEAVER_SLOT));
+    if (!il->arena || !il->slots) {
+        interleaverDestroy(il);
+        return -1;
+    }
+
+    // Touched once, so the ceiling is resident from the start, not found short of at the worst time.
+    memset(il->arena, 0, il->size);
+
+    return 0;
+}
+
+/**
+ * Used to find room for a packet, after the last one queued, or at the start
+ * of the arena when it does not fit before its end. The held bytes never
+ * reach start again, so start == end only when nothing is held.
+ *
+ * @return int the slot, -1 when the arena or the slots are full.
+ */
+static int take(INTERLEAVER *il, size_t size, size_t *offset) {
+    if (il->used == il->capacity) {
+        return -1;
+    }
+
+    if (!il->used) {
+        il->start = il->end = 0;
+    }
+
+    if (il->end >= il->start && il->size - il->end >= size) {
+        *offset = il->end;
+    } else if (il->end >= il->start && il->start > size) {
+        *offset = 0;
+    } else if (il->end < il->start && il->start - il->end > size) {
+        *offset = il->end;
+    } else {
+        return -1;
+    }
+
+    return (il->first + il->used) % il->capacity;
+}
+
+/**
+ * Used to give back the bytes and the slots of the packets written, from the
+ * first one queued.
+ */
+static void reclaim(INTERLEAVER *il) {
+    while (il->used && il->slots[il->first].written) {
+        il->start = il->slots[il->first].end;
+        il->first = (il->first + 1) % il->capacity;
+        --il->used;
+    }
+
+    if (!il->used) {
+        il->start = il->end = 0;
+    }
+}
+
+/**
+ * Used to find the stream whose first packet queued has the lowest timestamp.
+ *
+ * @return int the stream, -1 when nothing is queued.
+ */
+static int lowest(const INTERLEAVER *il) {
+    int stream, found = -1;
+
+    for (stream = 0; stream < il->streams; stream++) {
+        if (il->heads[stream] >= 0 && (found < 0 || il->slots[il->heads[stream]].dts < il->slots[il->heads[found]].dts)) {
+            found = stream;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * Used to find the highest timestamp queued, that of the last packet of a
+ * stream, as each stream is queued in timestamp order.
+ *
+ * @return int64_t the timestamp, meaningless when nothing is queued.
+ */
+static int64_t newest(const INTERLEAVER *il) {
+    int64_t found = INT64_MIN;
+    int stream;
+
+    for (stream = 0; stream < il->streams; stream++) {
+        if (il->tails[stream] >= 0 && il->slots[il->tails[stream]].dts > found) {
+            found = il->slots[il->tails[stream]].dts;
+        }
+    }
+
+    return found;
+}
+
+/**
+ * Used to write the first packet queued of a stream.
+ *
+ * @return int the av_write_frame() result.
+ */
+static int write_head(INTERLEAVER *il, int stream) {
+    INTERLEAVER_SLOT *slot = &il->slots[il->heads[stream]];
+    int ret;
+
+    il->heads[stream] = slot->next;
+    if (il->heads[stream] < 0) {
+        il->tails[stream] = -1;
+    }
+    --il->packets;
+
+    metricsElapsed(&il->latency, slot->queued);
+    ret = av_write_frame(il->oc, &slot->packet);
+
+    slot->written = 1;
+    reclaim(il);
+
+    return ret;
+}
+
+/**
+ * Used to keep the first failure of several writes, over an end requested by
+ * the muxer.
+ */
+static int merge(int ret, int write) {
+    return write && ret >= 0 ? write : ret;
+}
+
+/**
+ * Used to write packets before their turn, the lowest timestamp, or the whole
+ * queue, by the flush policy.
+ *
+ * @param unsigned long long *forced counts the packets written.
+ */
+static int force(INTERLEAVER *il, unsigned long long *forced) {
+    int ret = 0;
+
+    do {
+        ret = merge(ret, write_head(il, lowest(il)));
+        ++*forced;
+    } while (il->flush == INTERLEAVER_FLUSH_ALL && il->packets);
+
+    return ret;
+}
+
+/**
+ * Used to check whether every stream has a packet queued.
+ */
+static int ready(const INTERLEAVER *il) {
+    int stream;
+
+    for (stream = 0; stream < il->streams; stream++) {
+        if (il->heads[stream] < 0) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * Used to set where the timestamps of a stream wrap, a jump from within the
+ * maximum delta of it back to 0 is taken as a wrap.
+ *
+ * @param INTERLEAVER *il the interleaver.
+ * @param int stream the stream, below the streams count.
+ * @param int64_t wrap the wrap, in AV_TIME_BASE units, 0 when its timestamps do not wrap.
+ */
+void interleaverWrap(INTERLEAVER *il, int stream, int64_t wrap) {
+    il->wraps[stream] = wrap;
+}
+
+/**
+ * Used to check whether a timestamp is within the maximum delta of another.
+ */
+static int near(const INTERLEAVER *il, int64_t dts, int64_t other) {
+    return dts >= other - il->maxDelta && dts <= other + il->maxDelta;
+}
+
+/**
+ * Used to take the jump of a stream out of its timestamps, when it is a wrap
+ * or a discontinuity. A stream jumping back next to the others had a gap, it
+ * goes on as it is.
+ *
+ * @param int64_t dts the timestamp, its stream offset added.
+ * @return int64_t the timestamp, with the new offset.
+ */
+static int64_t unjump(INTERLEAVER *il, int stream, int64_t dts) {
+    int64_t last = il->lastDts[stream], raw = dts - il->offsets[stream];
+    int other;
+
+    if (il->wraps[stream] && last - il->offsets[stream] >= il->wraps[stream] - il->maxDelta && raw <= il->maxDelta) {
+        il->offsets[stream] += il->wraps[stream];
+        return dts + il->wraps[stream];
+    }
+
+    if (il->pending[stream] && near(il, dts + il->jump, last)) {
+        il->pending[stream] = 0;
+        il->offsets[stream] += il->jump;
+        return dts + il->jump;
+    }
+
+    for (other = 0; other < il->streams; other++) {
+        if (other != stream && il->lastDts[other] != AV_NOPTS_VALUE && near(il, dts, il->lastDts[other])) {
+            return dts;
+        }
+    }
+
+    // Every stream is expected to jump as much, in turn.
+    il->jump = last - dts;
+    for (other = 0; other < il->streams; other++) {
+        il->pending[other] = other != stream;
+    }
+    il->offsets[stream] += il->jump;
+
+    return last;
+}
+
+/**
+ * Used to queue a packet, and write those whose turn came, or that went over
+ * the budgets. The packet is copied, it may be freed on return.
+ *
+ * @param INTERLEAVER *il the interleaver.
+ * @param AVPacket *packet the packet.
+ * @param int stream the stream it is interleaved as, below the streams count.
+ * @param int64_t dts its timestamp, AV_NOPTS_VALUE to take the last one of its stream.
+ * @return int 0 on success, negative when a packet could not be written, positive when the muxer requested the end.
+ */
+int interleaverWrite(INTERLEAVER *il, AVPacket *packet, int stream, int64_t dts) {
+    INTERLEAVER_SLOT *slot;
+    size_t offset;
+    long bytes;
+    int index, ret = 0;
+
+    if (dts == AV_NOPTS_VALUE) {
+        dts = il->lastDts[stream];
+    } else {
+        if (il->lastDts[stream] != AV_NOPTS_VALUE) {
+            dts += il->offsets[stream];
+
+            // A wrap or a discontinuity would hold the other streams back, or let them all through, until they jumped too.
+            if (!near(il, dts, il->lastDts[stream])) {
+                dts = unjump(il, stream, dts);
+            }
+        }
+        il->lastDts[stream] = dts;
+    }
+
+    // Alone, a stream needs no interleaving, and there is no telling where a packet goes before the first timestamp of its stream.
+    if (il->streams < 2 || dts == AV_NOPTS_VALUE) {
+        return av_write_frame(il->oc, packet);
+    }
+
+    while ((index = take(il, packet->size, &offset)) < 0) {
+        // Larger than the whole arena, it follows what was queued straight away.
+        if (!il->packets) {
+            ++il->forcedBytes;
+            return merge(ret, av_write_frame(il->oc, packet));
+        }
+        ret = merge(ret, force(il, &il->forcedBytes));
+    }
+
+    slot = &il->slots[index];
+    slot->packet = *packet;
+    slot->packet.data = il->arena + offset;
+    slot->packet.destruct = NULL;
+    memcpy(slot->packet.data, packet->data, packet->size);
+    slot->dts = dts;
+    slot->queued = metricsNow();
+    slot->end = offset + packet->size;
+    slot->next = -1;
+    slot->written = 0;
+
+    if (il->tails[stream] >= 0) {
+        il->slots[il->tails[stream]].next = index;
+    } else {
+        il->heads[stream] = index;
+    }
+    il->tails[stream] = index;
+    il->end = slot->end;
+    ++il->used;
+    ++il->packets;
+
+    bytes = interleaverBytes(il);
+    if (bytes > il->peakBytes) {
+        il->peakBytes = bytes;
+    }
+
+    while (ready(il)) {
+        ret = merge(ret, write_head(il, lowest(il)));
+    }
+
+    // A stream missing or lagging holds the others back no longer than the maximum delta.
+    while (il->packets && newest(il) - il->slots[il->heads[lowest(il)]].dts > il->maxDelta) {
+        ret = merge(ret, force(il, &il->forcedDelta));
+    }
+
+    return ret;
+}
+
+/**
+ * Used to write every packet queued, in timestamp order, before the trailer.
+ *
+ * @param INTERLEAVER *il the interleaver.
+ * @return int 0 on success, negative when a packet could not be written, positive when the muxer requested the end.
+ */
+int interleaverFlush(INTERLEAVER *il) {
+    int ret = 0;
+
+    while (il->packets) {
+        ret = merge(ret, write_head(il, lowest(il)));
+    }
+
+    return ret;
+}
+
+/**
+ * Used to get the arena bytes held, the packets queued and those written
+ * behind one still queued, and the end of the arena skipped when wrapping.
+ *
+ * @param const INTERLEAVER *il the interleaver.
+ * @return long the bytes.
+ */
+long interleaverBytes(const INTERLEAVER *il) {
+    if (!il->used) {
+        return 0;
+    }
+
+    return il->end > il->start ? il->end - il->start : il->size - il->start + il->end;
+}
+
+/**
+ * Used to get the span of the timestamps queued, the latency the interleaving
+ * adds to the output.
+ *
+ * @param const INTERLEAVER *il the interleaver.
+ * @return int64_t the span, in AV_TIME_BASE units.
+ */
+int64_t interleaverSpan(const INTERLEAVER *il) {
+    int stream = lowest(il);
+
+    return stream < 0 ? 0 : newest(il) - il->slots[il->heads[stream]].dts;
+}
+
+/**
+ * Used to release an interleaver, what is still queued is dropped.
+ *
+ * @param INTERLEAVER *il the interleaver.
+ */
+void interleaverDestroy(INTERLEAVER *il) {
+    free(il->arena);
+    free(il->slots);
+    il->arena = NULL;
+    il->slots = NULL;
+    il->used = il->capacity = 0;
+    il->packets = 0;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
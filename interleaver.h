@@ -0,0 +1,133 @@
+/**
+ * @file
+ * Bounded packet interleaver prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * The interleaver puts the video and audio packets in timestamp order before
+ * they reach the muxer, as av_interleaved_write_frame() does, within budgets
+ * known up front: a packet is held until every stream has one queued, then the
+ * lowest timestamp is written first. Packets are copied into an arena, used as
+ * a ring, and described by a fixed array of slots, both allocated once, so
+ * nothing is allocated per packet and the memory held never grows past the
+ * arena. When the queue spans more than the maximum delta (a stream missing or
+ * lagging), or a packet does not fit in the arena or the slots, packets are
+ * written before their turn, by the flush policy: the lowest timestamp until
+ * the queue is back within its budgets, or the whole queue. Timestamps are in
+ * AV_TIME_BASE units. A stream whose timestamps jump further than the maximum
+ * delta is unwrapped when it was within the maximum delta of its wrap, goes on
+ * as it is when it jumped back next to the other streams (a gap, as an audio
+ * dropout), and is otherwise ordered as if it went on from where it was, a
+ * discontinuity the other streams take the same way once they jump by as much.
+ * The packets themselves are left untouched. It expects <stdio.h>, <stdint.h>,
+ * <time.h>, "libavformat/avformat.h" and "metrics.h" to be included first.
+ */
+#define INTERLEAVER_MAX_STREAMS 2
+#define INTERLEAVER_DEFAULT_BYTES (4 * 1024 * 1024)
+#define INTERLEAVER_MIN_BYTES 65536
+#define INTERLEAVER_DEFAULT_DELTA 2000
+
+/**
+ * Arena bytes per slot, the slots run out first for packets smaller than this
+ * on average.
+ */
+#define INTERLEAVER_SLOT_BYTES 512
+
+enum Interleaver_Flush {
+    INTERLEAVER_FLUSH_LOWEST,
+    INTERLEAVER_FLUSH_ALL
+};
+
+/**
+ * A packet copied into the arena, from offset end - packet.size to end.
+ */
+typedef struct interleaver_slot {
+    AVPacket packet;
+    int64_t dts;
+    uint64_t queued;
+    size_t end;
+
+    /**
+     * @var int next the next slot of the same stream, -1 for none.
+     * @var int written whether it was written, its bytes are given back once the slots before it are.
+     */
+    int next,
+        written;
+} INTERLEAVER_SLOT;
+
+typedef struct interleaver {
+    AVFormatContext *oc;
+    int streams,
+        flush;
+    int64_t maxDelta;
+
+    /**
+     * @var uint8_t *arena size bytes, those from start to end are held, wrapping around.
+     */
+    uint8_t *arena;
+    size_t size,
+           start,
+           end;
+
+    /**
+     * @var INTERLEAVER_SLOT *slots capacity slots, used of them from first, in queuing order.
+     * @var int heads the first slot queued of each stream, -1 for none.
+     */
+    INTERLEAVER_SLOT *slots;
+    int capacity,
+        first,
+        used,
+        heads[INTERLEAVER_MAX_STREAMS],
+        tails[INTERLEAVER_MAX_STREAMS];
+
+    /**
+     * @var int64_t lastDts the last timestamp of each stream, for packets without one, AV_NOPTS_VALUE before the first.
+     * @var int64_t offsets added to the timestamps of each stream, taking its wraps and discontinuities out.
+     * @var int64_t wraps where the timestamps of each stream wrap, 0 when they do not.
+     * @var int64_t jump the offset of the last discontinuity, for the streams that did not jump yet.
+     * @var int pending whether each stream is still to jump by it.
+     */
+    int64_t lastDts[INTERLEAVER_MAX_STREAMS],
+            offsets[INTERLEAVER_MAX_STREAMS],
+            wraps[INTERLEAVER_MAX_STREAMS],
+            jump;
+    int pending[INTERLEAVER_MAX_STREAMS];
+
+    /**
+     * @var long packets the packets queued.
+     * @var long peakBytes the most arena bytes held at once.
+     * @var unsigned long long forcedDelta packets written before their turn, past the maximum delta.
+     * @var unsigned long long forcedBytes packets written before their turn, out of arena or slots.
+     * @var METRICS_HISTOGRAM latency the time packets were held, in nanoseconds.
+     */
+    long packets,
+         peakBytes;
+    unsigned long long forcedDelta,
+                       forcedBytes;
+    METRICS_HISTOGRAM latency;
+} INTERLEAVER;
+
+int interleaverInit(INTERLEAVER *, AVFormatContext *, int, long, long, int);
+void interleaverWrap(INTERLEAVER *, int, int64_t);
+int interleaverWrite(INTERLEAVER *, AVPacket *, int, int64_t);
+int interleaverFlush(INTERLEAVER *);
+long interleaverBytes(const INTERLEAVER *);
+int64_t interleaverSpan(const INTERLEAVER *);
+void interleaverDestroy(INTERLEAVER *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -408,6 +408,17 @@ void checkList(LIST *list){
  * @param NODE *node pointer to the node.
  */
 void removeNode(LIST *list, NODE *node) {
+    free(detachNode(list, node));
+}
+
+/**
+ * Used to unlink a specific node from a list, without freeing it.
+ *
+ * @param LIST *list pointer to the list.
+ * @param NODE *node pointer to the node.
+ * @return NODE * the node, owned by the caller.
+ */
+NODE *detachNode(LIST *list, NODE *node) {
     if (node->prev == NULL) {
         list->head = node->next;
     } else {
@@ -419,7 +430,10 @@ void removeNode(LIST *list, NODE *node) {
     } else {
         node->next->prev = node->prev;
     }
-    free(node);
+    --list->length;
+
+    node->next = node->prev = NULL;
+    return node;
 }
 
 /**
@@ -517,50 +531,66 @@ NODE *mergeSort(NODE *headOriginal) {
 }
 
 /**
- * Used to split the list into two lists.
+ * Used to split the list into two lists, the nodes at odd positions leaving
+ * for the returned one. Done in a loop, as long lists would exhaust the stack.
  *
- * @param LIST *list pointer to the list.
  * @param NODE *splitRefrence pointer to the split reference node.
  * @return NODE * pointer to the splitting node.
  */
 NODE *split(NODE *splitRefrence) {
+    NODE *even = splitRefrence, *odd, *splittedList;
+
     if (splitRefrence == NULL || splitRefrence->next == NULL) return NULL;
 
     // Assign splittedList to split location
-    NODE *splittedList = splitRefrence->next;
+    splittedList = odd = splitRefrence->next;
 
     // Move double steps
-    splitRefrence->next = splitRefrence->next->next;
-
-    // Keep splitting the nodes
-    splittedList->next = split(splittedList->next);
+    while (odd) {
+        even->next = odd->next;
+        even = even->next;
+        if (!even) {
+            break;
+        }
+        odd->next = even->next;
+        odd = odd->next;
+    }
 
     return splittedList;
 }
 
 /**
- * Used to merge two sorted lists.
+ * Used to merge two sorted lists, in a loop for the same reason, linking the
+ * previous nodes as it goes.
  *
  * @param NODE *list1 pointer to the first node at list1.
  * @param NODE *list2 pointer the first node at list2.
  * @return NODE * pointer to the first node at merged list.
  */
 NODE *merge(NODE *list1, NODE *list2) {
-    if (list1 == NULL) return list2;
-    if (list2 == NULL) return list1;
-
-    // 'id' is the variable we're sorting on
-    if (list1->id < list2->id) {
-        list2->prev = list1;
-        list1->next = merge(list1->next, list2);
-
-        return list1;
-    }// end if
-    else {
-        list1->prev = list2;
-        list2->next = merge(list1, list2->next);
-        return list2;
-    } // end else
+    NODE head, *tail = &head, **taken;
+
+    head.next = NULL;
+
+    while (list1 && list2) {
+        // 'id' is the variable we're sorting on, equal ids take the second list first.
+        taken = list1->id < list2->id ? &list1 : &list2;
+
+        tail->next = *taken;
+        (*taken)->prev = tail;
+        tail = *taken;
+        *taken = (*taken)->next;
+    }
+
+    tail->next = list1 ? list1 : list2;
+    if (tail->next) {
+        tail->next->prev = tail;
+    }
+    if (head.next) {
+        head.next->prev = NULL;
+    }
+
+    return head.next;
 }
 
 /**
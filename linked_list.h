@@ -105,6 +105,8 @@ NODE *merge(NODE *, NODE *);
 
 void removeNode(LIST *, NODE *);
 
+NODE *detachNode(LIST *, NODE *);
+
 void deleteList(LIST *);
 
 void printNode(NODE *);
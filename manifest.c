@@ -0,0 +1,151 @@
+/**
+ * @file
+ * Segment manifest implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <inttypes.h>
+
+#include "manifest.h"
+
+/**
+ * Used to read a previous manifest.
+ *
+ * @param MANIFEST *manifest receives the segments.
+ * @param const char *path the manifest path.
+ * @return int 0 on success, -1 when it can not be read, or is invalid.
+ */
+int manifestLoad(MANIFEST *manifest, const char *path) {
+    char line[128];
+    MANIFEST_ENTRY entry, *entries;
+    unsigned int capacity = 0, lines = 1;
+    FILE *fp;
+
+    memset(manifest, 0, sizeof (MANIFEST));
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        fprintf(stderr, "{\"error\" : \"Could not open the segments manifest (%s).\"}\n", path);
+        return -1;
+    }
+
+    if (!fgets(line, sizeof (line), fp) || strncmp(line, MANIFEST_VERSION, strlen(MANIFEST_VERSION))) {
+        fprintf(stderr, "{\"error\" : \"Segments manifest (%s) has an unknown format.\"}\n", path);
+        fclose(fp);
+        return -1;
+    }
+
+    while (fgets(line, sizeof (line), fp)) {
+        ++lines;
+        memset(&entry, 0, sizeof (MANIFEST_ENTRY));
+
+        // Sequences follow each other, and so do the cuts.
+        if (sscanf(line, "%u %u %u %lld %" SCNx64, &entry.sequence, &entry.start, &entry.end, &entry.size, &entry.digest) != 5
+                || (manifest->count && (entry.sequence != manifest->entries[manifest->count - 1].sequence + 1
+                    || entry.start <= manifest->entries[manifest->count - 1].start))) {
+            fprintf(stderr, "{\"error\" : \"Segments manifest (%s) line %u is invalid.\"}\n", path, lines);
+            manifestDestroy(manifest);
+            fclose(fp);
+            return -1;
+        }
+
+        if (manifest->count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            entries = realloc(manifest->entries, capacity * sizeof (MANIFEST_ENTRY));
+            if (!entries) {
+                fprintf(stderr, "{\"error\" : \"Can not allocate the segments manifest.\"}\n");
+                manifestDestroy(manifest);
+                fclose(fp);
+                return -1;
+            }
+            manifest->entries = entries;
+        }
+        manifest->entries[manifest->count++] = entry;
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+/**
+ * Used to find the previous segment with the same cut, segments are matched
+ * in order, so the search resumes where the last one stopped.
+ *
+ * @param MANIFEST *manifest the manifest.
+ * @param unsigned int start the time the segment starts at, in milliseconds.
+ * @param unsigned int end the time it is planned to end at, in milliseconds.
+ * @return MANIFEST_ENTRY * the segment, NULL when none matches.
+ */
+MANIFEST_ENTRY *manifestMatch(MANIFEST *manifest, unsigned int start, unsigned int end) {
+    MANIFEST_ENTRY *entry;
+
+    while (manifest->next < manifest->count && manifest->entries[manifest->next].start < start) {
+        ++manifest->next;
+    }
+
+    if (manifest->next == manifest->count) {
+        return NULL;
+    }
+
+    entry = &manifest->entries[manifest->next];
+
+    return entry->start == start && entry->end == end ? entry : NULL;
+}
+
+/**
+ * Used to find a previous segment by its sequence number.
+ *
+ * @param MANIFEST *manifest the manifest.
+ * @param unsigned int sequence the sequence number.
+ * @return MANIFEST_ENTRY * the segment, NULL when there was none.
+ */
+MANIFEST_ENTRY *manifestEntry(MANIFEST *manifest, unsigned int sequence) {
+    if (!manifest->count || sequence < manifest->entries[0].sequence || sequence - manifest->entries[0].sequence >= manifest->count) {
+        return NULL;
+    }
+
+    return &manifest->entries[sequence - manifest->entries[0].sequence];
+}
+
+/**
+ * Used to write the line of a segment.
+ *
+ * @param FILE *fp the manifest being written.
+ * @param const MANIFEST_ENTRY *entry the segment.
+ * @return int 0 on success, -1 otherwise.
+ */
+int manifestWrite(FILE *fp, const MANIFEST_ENTRY *entry) {
+    return fprintf(fp, "%u %u %u %lld %016" PRIx64 "\n", entry->sequence, entry->start, entry->end, entry->size, entry->digest) < 0 ? -1 : 0;
+}
+
+/**
+ * Used to release a manifest.
+ *
+ * @param MANIFEST *manifest the manifest.
+ */
+void manifestDestroy(MANIFEST *manifest) {
+    free(manifest->entries);
+    manifest->entries = NULL;
+    manifest->count = manifest->next = 0;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,63 @@
+/**
+ * @file
+ * Segment manifest prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * The manifest lists the segments of a run with what decided their cuts, so a
+ * later run with other cue points keeps the segments whose cuts are the same.
+ * A segment is cut on the first key frame at or after its planned end, so the
+ * same input cut from the same start towards the same planned end gives the
+ * same segment. One line per segment, after a version line:
+ *     <sequence> <start ms> <planned end ms> <size> <xxh64 digest, hexadecimal>
+ * It expects <stdio.h> and <stdint.h> to be included first.
+ */
+#define MANIFEST_VERSION "#SEGMENTS-MANIFEST:1"
+
+enum Manifest_State {
+    MANIFEST_UNCLAIMED,
+    MANIFEST_CLAIMED,
+    MANIFEST_STASHED
+};
+
+typedef struct manifest_entry {
+    unsigned int sequence,
+                 start,
+                 end;
+    long long size;
+    uint64_t digest;
+    enum Manifest_State state;
+} MANIFEST_ENTRY;
+
+typedef struct manifest {
+    /**
+     * @var MANIFEST_ENTRY *entries the segments, by sequence and start time.
+     * @var unsigned int next the first entry a later segment may match.
+     */
+    MANIFEST_ENTRY *entries;
+    unsigned int count,
+                 next;
+} MANIFEST;
+
+int manifestLoad(MANIFEST *, const char *);
+MANIFEST_ENTRY *manifestMatch(MANIFEST *, unsigned int, unsigned int);
+MANIFEST_ENTRY *manifestEntry(MANIFEST *, unsigned int);
+int manifestWrite(FILE *, const MANIFEST_ENTRY *);
+void manifestDestroy(MANIFEST *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
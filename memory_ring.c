@@ -0,0 +1,321 @@
+/**
+ * @file
+ * In-memory segment ring implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include "memory_ring.h"
+
+/**
+ * Used to allocate a buffer, owned by its first holder.
+ *
+ * @param size_t capacity the initial capacity.
+ * @return RING_BUFFER * the buffer, NULL on allocation failure.
+ */
+static RING_BUFFER *createBuffer(size_t capacity) {
+    RING_BUFFER *buffer;
+
+    if (!(buffer = calloc(1, sizeof (RING_BUFFER)))) return NULL;
+
+    if (!(buffer->data = malloc(capacity))) {
+        free(buffer);
+        return NULL;
+    }
+
+    buffer->capacity = capacity;
+    buffer->references = 1;
+
+    return buffer;
+}
+
+/**
+ * Used to drop a reference to a buffer, the ring lock must be held.
+ *
+ * @param RING_BUFFER *buffer the buffer.
+ */
+static void dropBuffer(RING_BUFFER *buffer) {
+    if (buffer && !--buffer->references) {
+        free(buffer->data);
+        free(buffer);
+    }
+}
+
+/**
+ * Used to get a buffer of at least the given capacity in place of a held one,
+ * keeping its content. The ring lock must be held.
+ *
+ * @param RING_BUFFER **holder the holder of the buffer.
+ * @param size_t capacity the needed capacity.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+static int reserveBuffer(RING_BUFFER **holder, size_t capacity) {
+    RING_BUFFER *buffer = *holder, *grown;
+    unsigned char *data;
+    size_t grownCapacity = buffer->capacity;
+
+    if (capacity <= buffer->capacity) {
+        return 0;
+    }
+
+    while (grownCapacity < capacity) {
+        grownCapacity *= 2;
+    }
+
+    // Nobody else reads it, it can move.
+    if (buffer->references == 1) {
+        if (!(data = realloc(buffer->data, grownCapacity))) return -1;
+
+        buffer->data = data;
+        buffer->capacity = grownCapacity;
+        return 0;
+    }
+
+    // Readers keep the old copy until they are done with it.
+    if (!(grown = createBuffer(grownCapacity))) return -1;
+
+    memcpy(grown->data, buffer->data, buffer->size);
+    grown->size = buffer->size;
+
+    dropBuffer(buffer);
+    *holder = grown;
+
+    return 0;
+}
+
+/**
+ * Used to prepare a ring.
+ *
+ * @param MEMORY_RING *ring the ring.
+ * @param int count the slots count.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+int ringInit(MEMORY_RING *ring, int count) {
+    int i;
+
+    memset(ring, 0, sizeof (MEMORY_RING));
+
+    if (!(ring->slots = calloc(count, sizeof (RING_SLOT)))) return -1;
+    ring->count = count;
+
+    for (i = 0; i < count; i++) {
+        if (!(ring->slots[i].buffer = createBuffer(MEMORY_RING_INITIAL_CAPACITY))) {
+            ringDestroy(ring);
+            return -1;
+        }
+    }
+
+    if (!(ring->playlist = createBuffer(4096))) {
+        ringDestroy(ring);
+        return -1;
+    }
+
+    pthread_mutex_init(&ring->lock, NULL);
+
+    return 0;
+}
+
+/**
+ * Used to release a ring, once nobody reads from it anymore.
+ *
+ * @param MEMORY_RING *ring the ring.
+ */
+void ringDestroy(MEMORY_RING *ring) {
+    int i;
+
+    for (i = 0; i < ring->count; i++) {
+        dropBuffer(ring->slots[i].buffer);
+    }
+    dropBuffer(ring->playlist);
+    free(ring->slots);
+
+    if (ring->count) {
+        pthread_mutex_destroy(&ring->lock);
+    }
+    memset(ring, 0, sizeof (MEMORY_RING));
+}
+
+/**
+ * Used to start writing a segment, in the slot of the oldest one.
+ *
+ * @param MEMORY_RING *ring the ring.
+ * @param unsigned int sequence the segment sequence number.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+int ringOpenSegment(MEMORY_RING *ring, unsigned int sequence) {
+    RING_SLOT *slot = &ring->slots[sequence % ring->count];
+    RING_BUFFER *buffer;
+    int ret = 0;
+
+    pthread_mutex_lock(&ring->lock);
+
+    slot->sequence = sequence;
+    slot->complete = 0;
+
+    if (slot->buffer->references == 1) {
+        slot->buffer->size = 0;
+    } else if ((buffer = createBuffer(slot->buffer->capacity))) {
+        dropBuffer(slot->buffer);
+        slot->buffer = buffer;
+    } else {
+        ret = -1;
+    }
+
+    pthread_mutex_unlock(&ring->lock);
+
+    return ret;
+}
+
+/**
+ * Used to append bytes to the segment being written.
+ *
+ * @param MEMORY_RING *ring the ring.
+ * @param unsigned int sequence the segment sequence number.
+ * @param const uint8_t *data the bytes.
+ * @param int size the bytes count.
+ * @return int size on success, -1 on allocation failure.
+ */
+int ringWrite(MEMORY_RING *ring, unsigned int sequence, const uint8_t *data, int size) {
+    RING_SLOT *slot = &ring->slots[sequence % ring->count];
+    int ret = size;
+
+    pthread_mutex_lock(&ring->lock);
+
+    if (reserveBuffer(&slot->buffer, slot->buffer->size + size) < 0) {
+        ret = -1;
+    } else {
+        memcpy(slot->buffer->data + slot->buffer->size, data, size);
+        slot->buffer->size += size;
+    }
+
+    pthread_mutex_unlock(&ring->lock);
+
+    return ret;
+}
+
+/**
+ * Used to mark a segment as complete.
+ *
+ * @param MEMORY_RING *ring the ring.
+ * @param unsigned int sequence the segment sequence number.
+ */
+void ringCloseSegment(MEMORY_RING *ring, unsigned int sequence) {
+    pthread_mutex_lock(&ring->lock);
+    ring->slots[sequence % ring->count].complete = 1;
+    pthread_mutex_unlock(&ring->lock);
+}
+
+/**
+ * Used to replace the playlist.
+ *
+ * @param MEMORY_RING *ring the ring.
+ * @param const char *data the playlist.
+ * @param size_t size its size.
+ * @return int 0 on success, -1 on allocation failure.
+ */
+int ringPublishPlaylist(MEMORY_RING *ring, const char *data, size_t size) {
+    RING_BUFFER *buffer;
+    int ret = 0;
+
+    pthread_mutex_lock(&ring->lock);
+
+    if (ring->playlist->references == 1) {
+        ring->playlist->size = 0;
+    } else if ((buffer = createBuffer(ring->playlist->capacity))) {
+        dropBuffer(ring->playlist);
+        ring->playlist = buffer;
+    } else {
+        ret = -1;
+    }
+
+    if (!ret && reserveBuffer(&ring->playlist, size) < 0) {
+        ret = -1;
+    }
+
+    if (!ret) {
+        memcpy(ring->playlist->data, data, size);
+        ring->playlist->size = size;
+    }
+
+    pthread_mutex_unlock(&ring->lock);
+
+    return ret;
+}
+
+/**
+ * Used to take a reference to a segment buffer, for sending it.
+ *
+ * @param MEMORY_RING *ring the ring.
+ * @param unsigned int sequence the segment sequence number.
+ * @param int *complete receives whether the segment is complete.
+ * @return RING_BUFFER * the buffer, NULL when the segment is not in the ring.
+ */
+RING_BUFFER *ringAcquireSegment(MEMORY_RING *ring, unsigned int sequence, int *complete) {
+    RING_SLOT *slot = &ring->slots[sequence % ring->count];
+    RING_BUFFER *buffer = NULL;
+
+    pthread_mutex_lock(&ring->lock);
+
+    if (sequence && slot->sequence == sequence) {
+        buffer = slot->buffer;
+        ++buffer->references;
+        *complete = slot->complete;
+    }
+
+    pthread_mutex_unlock(&ring->lock);
+
+    return buffer;
+}
+
+/**
+ * Used to take a reference to the playlist, for sending it.
+ *
+ * @param MEMORY_RING *ring the ring.
+ * @return RING_BUFFER * the buffer, NULL before the first playlist.
+ */
+RING_BUFFER *ringAcquirePlaylist(MEMORY_RING *ring) {
+    RING_BUFFER *buffer = NULL;
+
+    pthread_mutex_lock(&ring->lock);
+
+    if (ring->playlist->size) {
+        buffer = ring->playlist;
+        ++buffer->references;
+    }
+
+    pthread_mutex_unlock(&ring->lock);
+
+    return buffer;
+}
+
+/**
+ * Used to give back a reference taken by ringAcquireSegment() or ringAcquirePlaylist().
+ *
+ * @param MEMORY_RING *ring the ring.
+ * @param RING_BUFFER *buffer the buffer.
+ */
+void ringRelease(MEMORY_RING *ring, RING_BUFFER *buffer) {
+    pthread_mutex_lock(&ring->lock);
+    dropBuffer(buffer);
+    pthread_mutex_unlock(&ring->lock);
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,66 @@
+/**
+ * @file
+ * In-memory segment ring prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * The ring keeps the last segments and the playlist in memory, for the origin
+ * to serve them without any disk I/O. Buffers are reference counted, so a
+ * buffer being sent is never overwritten: the writer reuses a slot buffer in
+ * place when nobody holds it, and takes a fresh one otherwise. It expects
+ * <pthread.h> and <stdint.h> to be included first.
+ */
+
+/**
+ * Slots kept beyond the playlist window, for clients still fetching segments
+ * that just left it.
+ */
+#define MEMORY_RING_SPARE_SLOTS 2
+#define MEMORY_RING_INITIAL_CAPACITY 262144
+
+typedef struct ring_buffer {
+    unsigned char *data;
+    size_t size,
+           capacity;
+    int references;
+} RING_BUFFER;
+
+typedef struct ring_slot {
+    unsigned int sequence;
+    int complete;
+    RING_BUFFER *buffer;
+} RING_SLOT;
+
+typedef struct memory_ring {
+    int count;
+    RING_SLOT *slots;
+    RING_BUFFER *playlist;
+    pthread_mutex_t lock;
+} MEMORY_RING;
+
+int ringInit(MEMORY_RING *, int);
+void ringDestroy(MEMORY_RING *);
+int ringOpenSegment(MEMORY_RING *, unsigned int);
+int ringWrite(MEMORY_RING *, unsigned int, const uint8_t *, int);
+void ringCloseSegment(MEMORY_RING *, unsigned int);
+int ringPublishPlaylist(MEMORY_RING *, const char *, size_t);
+RING_BUFFER *ringAcquireSegment(MEMORY_RING *, unsigned int, int *);
+RING_BUFFER *ringAcquirePlaylist(MEMORY_RING *);
+void ringRelease(MEMORY_RING *, RING_BUFFER *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,143 @@
+/**
+ * @file
+ * Hot path metrics implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "metrics.h"
+
+/**
+ * Nanoseconds the clock is compared with the tick counter over, while calibrating.
+ */
+#define METRICS_CALIBRATION 10000000
+
+uint64_t metricsMultiplier = 1 << METRICS_SHIFT;
+
+/**
+ * Used to read the monotonic clock, in nanoseconds.
+ */
+static uint64_t monotonicNanoseconds(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/**
+ * Used to measure the tick counter against the monotonic clock, once before
+ * any sample is taken.
+ */
+void metricsCalibrate(void) {
+    struct timespec pause = {0, METRICS_CALIBRATION};
+    uint64_t clockStart, tickStart, clockEnd, tickEnd;
+
+    clockStart = monotonicNanoseconds();
+    tickStart = metricsNow();
+    nanosleep(&pause, NULL);
+    clockEnd = monotonicNanoseconds();
+    tickEnd = metricsNow();
+
+    // Without a tick counter, ticks are already nanoseconds.
+    if (tickEnd > tickStart && clockEnd > clockStart) {
+        metricsMultiplier = ((clockEnd - clockStart) << METRICS_SHIFT) / (tickEnd - tickStart);
+    }
+    if (!metricsMultiplier) {
+        metricsMultiplier = 1;
+    }
+}
+
+/**
+ * Used to write the help and type lines of a metric family.
+ *
+ * @param FILE *fp the destination.
+ * @param const char *name the family name.
+ * @param const char *type "counter", "gauge" or "histogram".
+ * @param const char *help the description.
+ */
+void metricsFamily(FILE *fp, const char *name, const char *type, const char *help) {
+    fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/**
+ * Used to write a channel label value, escaped.
+ */
+static void writeLabel(FILE *fp, const char *channel) {
+    for (; *channel; channel++) {
+        if (*channel == '\\' || *channel == '"') {
+            fputc('\\', fp);
+            fputc(*channel, fp);
+        } else if (*channel == '\n') {
+            fputs("\\n", fp);
+        } else {
+            fputc(*channel, fp);
+        }
+    }
+}
+
+/**
+ * Used to write one sample of a counter or a gauge.
+ *
+ * @param FILE *fp the destination.
+ * @param const char *name the family name.
+ * @param const char *channel the channel the sample belongs to.
+ * @param double value the value, integers are written exactly up to 2^53.
+ */
+void metricsSample(FILE *fp, const char *name, const char *channel, double value) {
+    fprintf(fp, "%s{channel=\"", name);
+    writeLabel(fp, channel);
+    fprintf(fp, "\"} %.17g\n", value);
+}
+
+/**
+ * Used to write the cumulative buckets, sum and count of a histogram, in seconds.
+ *
+ * @param FILE *fp the destination.
+ * @param const char *name the family name.
+ * @param const char *channel the channel the histogram belongs to.
+ * @param const METRICS_HISTOGRAM *histogram the histogram.
+ */
+void metricsHistogram(FILE *fp, const char *name, const char *channel, const METRICS_HISTOGRAM *histogram) {
+    unsigned long long cumulative = 0;
+    int bucket;
+
+    for (bucket = 0; bucket < METRICS_BUCKETS; bucket++) {
+        cumulative += histogram->buckets[bucket];
+        if (bucket < METRICS_FIRST_EXPORTED) {
+            continue;
+        }
+
+        fprintf(fp, "%s_bucket{channel=\"", name);
+        writeLabel(fp, channel);
+        if (bucket == METRICS_BUCKETS - 1) {
+            fprintf(fp, "\",le=\"+Inf\"} %llu\n", cumulative);
+        } else {
+            fprintf(fp, "\",le=\"%.9g\"} %llu\n", (double) (1ULL << bucket) / 1e9, cumulative);
+        }
+    }
+
+    fprintf(fp, "%s_sum{channel=\"", name);
+    writeLabel(fp, channel);
+    fprintf(fp, "\"} %.9f\n%s_count{channel=\"", histogram->sum / 1e9, name);
+    writeLabel(fp, channel);
+    fprintf(fp, "\"} %llu\n", histogram->count);
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,178 @@
+/**
+ * @file
+ * Hot path metrics prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * Latency histograms cheap enough to stay on for every packet. A sample is the
+ * distance between two metricsNow() readings, on the time stamp counter where
+ * there is one, the monotonic clock otherwise, turned into nanoseconds with a
+ * multiply and a shift. Bucket n counts the samples below 2^n nanoseconds, the
+ * last one everything above. Each session accumulates into its own counters,
+ * only written by the worker running it, and read from the copy published
+ * after each turn, so samples take no lock nor atomic operation. They are
+ * exported in the Prometheus text format. It expects <stdio.h>, <stdint.h>
+ * and <time.h> to be included first.
+ */
+#define METRICS_BUCKETS 36
+#define METRICS_SHIFT 20
+
+/**
+ * Buckets below this one (1 µs) are folded into it when exported.
+ */
+#define METRICS_FIRST_EXPORTED 10
+
+enum Metrics_Timer {
+    METRICS_READ,
+    METRICS_WRITE,
+    METRICS_OPEN,
+    METRICS_CLOSE,
+    METRICS_INDEX,
+    METRICS_REMOVE,
+    METRICS_TIMERS
+};
+
+typedef struct metrics_histogram {
+    unsigned long long count,
+                       sum,
+                       buckets[METRICS_BUCKETS];
+} METRICS_HISTOGRAM;
+
+typedef struct metrics {
+    /**
+     * @var METRICS_HISTOGRAM timers the time spent in each hot path call, in nanoseconds.
+     * @var METRICS_HISTOGRAM lateness how far past the planned boundary segments are cut, in nanoseconds.
+     * @var METRICS_HISTOGRAM interleaveLatency the time packets were held by the interleaver, in nanoseconds.
+     */
+    METRICS_HISTOGRAM timers[METRICS_TIMERS],
+                      lateness,
+                      interleaveLatency;
+
+    /**
+     * Throughput over the last window of at least a second.
+     *
+     * @var double rateStart the time the window started at, in milliseconds, 0 before the first one.
+     */
+    double packetsPerSecond,
+           bytesPerSecond,
+           rateStart;
+    unsigned long long ratePackets,
+                       rateBytes;
+
+    /**
+     * Queue depths, as of the last update.
+     *
+     * @var long interleavePackets packets queued by the interleaver.
+     * @var long pendingCues cue points planned and not yet cut.
+     * @var long pendingSplices SCTE-35 splices read from the input and not yet planned.
+     * @var long pendingThumbnails key frames queued for the thumbnail workers.
+     */
+    long interleavePackets,
+         pendingCues,
+         pendingSplices,
+         pendingThumbnails;
+
+    /**
+     * @var double interleaveSpan the span of the timestamps queued by the interleaver, in seconds.
+     * @var unsigned long long interleaveForcedDelta packets written before their turn, past the maximum delta.
+     * @var unsigned long long interleaveForcedBytes packets written before their turn, out of arena or slots.
+     */
+    double interleaveSpan;
+    unsigned long long interleaveForcedDelta,
+                       interleaveForcedBytes;
+
+    /**
+     * @var unsigned long long thumbnails thumbnails tiled so far.
+     * @var unsigned long long thumbnailDrops key frames dropped because the thumbnail workers fell behind.
+     */
+    unsigned long long thumbnails,
+                       thumbnailDrops;
+
+    /**
+     * UDP and RTP input counters, and the datagrams held in the jitter buffer.
+     */
+    unsigned long long udpDatagrams,
+                       udpBatches,
+                       udpLost,
+                       udpLate,
+                       udpDiscarded,
+                       continuityErrors;
+    long jitterBuffered;
+
+    /**
+     * Standard input readahead, the bytes buffered, the most buffered so far,
+     * the times the ring filled up or was found empty, and the time it was full.
+     */
+    long readaheadBytes,
+         readaheadHighWater;
+    unsigned long long readaheadOverflows,
+                       readaheadUnderruns;
+    double readaheadFullSeconds;
+} METRICS;
+
+/**
+ * @var uint64_t metricsMultiplier nanoseconds per tick, shifted left by METRICS_SHIFT, set by metricsCalibrate().
+ */
+extern uint64_t metricsMultiplier;
+
+void metricsCalibrate(void);
+void metricsFamily(FILE *, const char *, const char *, const char *);
+void metricsSample(FILE *, const char *, const char *, double);
+void metricsHistogram(FILE *, const char *, const char *, const METRICS_HISTOGRAM *);
+
+/**
+ * Used to read the clock samples are timed with.
+ *
+ * @return uint64_t the current tick.
+ */
+static inline uint64_t metricsNow(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+/**
+ * Used to count a sample.
+ *
+ * @param METRICS_HISTOGRAM *histogram the histogram.
+ * @param uint64_t nanoseconds the sample.
+ */
+static inline void metricsRecord(METRICS_HISTOGRAM *histogram, uint64_t nanoseconds) {
+    int bucket = nanoseconds ? 64 - __builtin_clzll(nanoseconds) : 0;
+
+    ++histogram->count;
+    histogram->sum += nanoseconds;
+    ++histogram->buckets[bucket < METRICS_BUCKETS ? bucket : METRICS_BUCKETS - 1];
+}
+
+/**
+ * Used to count the time elapsed since a metricsNow() reading.
+ *
+ * @param METRICS_HISTOGRAM *histogram the histogram.
+ * @param uint64_t start the reading.
+ */
+static inline void metricsElapsed(METRICS_HISTOGRAM *histogram, uint64_t start) {
+    metricsRecord(histogram, ((metricsNow() - start) * metricsMultiplier) >> METRICS_SHIFT);
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
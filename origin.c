@@ -0,0 +1,765 @@
+/**
+ * @file
+ * Built-in HTTP origin implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+
+#include "memory_ring.h"
+#include "origin.h"
+
+/**
+ * Seconds an idle keep-alive connection is kept open.
+ */
+#define ORIGIN_IDLE_TIMEOUT 2
+
+/**
+ * Range start of a suffix range ("bytes=-N"), whose end is then its length.
+ */
+#define ORIGIN_SUFFIX_RANGE -2
+
+/**
+ * Milliseconds the accepting thread waits after accept() failed, out of
+ * descriptors or memory, before trying again.
+ */
+#define ORIGIN_ACCEPT_BACKOFF 100
+
+typedef struct connection {
+    ORIGIN *origin;
+    int fd;
+} CONNECTION;
+
+/**
+ * Used to strip the leading slashes and "./" of a request or file path.
+ *
+ * @param const char *path the path.
+ * @return const char * the path, relative to the working directory.
+ */
+static const char *relativePath(const char *path) {
+    for (;;) {
+        if (*path == '/') {
+            ++path;
+        } else if (path[0] == '.' && path[1] == '/') {
+            path += 2;
+        } else {
+            return path;
+        }
+    }
+}
+
+/**
+ * Used to send a whole buffer.
+ *
+ * @return int 0 on success, -1 otherwise.
+ */
+static int sendAll(int fd, const char *buffer, size_t length) {
+    ssize_t sent;
+
+    while (length) {
+        sent = send(fd, buffer, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return -1;
+        }
+        buffer += sent;
+        length -= sent;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to answer a request with an empty body.
+ *
+ * @return int 0 on success, -1 otherwise.
+ */
+static int sendStatus(int fd, int status, const char *reason, int keepAlive) {
+    char header[256];
+    int length;
+
+    length = snprintf(header, sizeof (header), "HTTP/1.1 %d %s\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+            status, reason, keepAlive ? "keep-alive" : "close");
+
+    return sendAll(fd, header, length);
+}
+
+/**
+ * Used to compute an absolute deadline, for condition waits.
+ *
+ * @param struct timespec *deadline receives the deadline.
+ * @param double seconds from now.
+ */
+static void deadlineIn(struct timespec *deadline, double seconds) {
+    clock_gettime(CLOCK_REALTIME, deadline);
+
+    deadline->tv_sec += (time_t) seconds;
+    deadline->tv_nsec += (long) ((seconds - (time_t) seconds) * 1e9);
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_nsec -= 1000000000L;
+        ++deadline->tv_sec;
+    }
+}
+
+/**
+ * Used to hold a playlist request until the playlist holds the requested
+ * segment and part, as low latency HLS blocking reloads require.
+ *
+ * @param ORIGIN *origin the origin.
+ * @param long msn the _HLS_msn value.
+ * @param long part the _HLS_part value, -1 when absent.
+ * @return int 200 when the playlist is ready, 400 for requests too far ahead, 503 on timeout.
+ */
+static int waitPlaylist(ORIGIN *origin, long msn, long part) {
+    struct timespec deadline;
+    int status = 200;
+
+    pthread_mutex_lock(&origin->lock);
+    deadlineIn(&deadline, 3 * (origin->targetDuration > 0 ? origin->targetDuration : 1));
+
+    if (msn > (long) origin->currentSequence + 1) {
+        status = 400;
+    }
+
+    while (status == 200 && !origin->stopping &&
+            !(msn <= (long) origin->completedSequence ||
+              (part >= 0 && msn == (long) origin->currentSequence && part < origin->currentParts))) {
+        if (pthread_cond_timedwait(&origin->changed, &origin->lock, &deadline) == ETIMEDOUT) {
+            status = 503;
+        }
+    }
+    pthread_mutex_unlock(&origin->lock);
+
+    return status;
+}
+
+/**
+ * Used to hold a range request on the segment being written, until the part
+ * starting at the requested offset is complete.
+ *
+ * @param ORIGIN *origin the origin.
+ * @param const char *path the requested path.
+ * @param long long start the first requested byte.
+ * @return long long bytes of the file that may be served, -1 for the whole file.
+ */
+static long long waitRange(ORIGIN *origin, const char *path, long long start) {
+    struct timespec deadline;
+    long long limit = -1;
+
+    pthread_mutex_lock(&origin->lock);
+    deadlineIn(&deadline, 3 * (origin->targetDuration > 0 ? origin->targetDuration : 1));
+
+    while (!origin->stopping && !strcmp(path, origin->current) && origin->committed <= start) {
+        if (pthread_cond_timedwait(&origin->changed, &origin->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+
+    if (!strcmp(path, origin->current)) {
+        limit = origin->committed;
+    }
+    pthread_mutex_unlock(&origin->lock);
+
+    return limit;
+}
+
+/**
+ * Used to send a header and a body from memory, with as few system calls as
+ * the socket allows.
+ *
+ * @return int 0 on success, -1 otherwise.
+ */
+static int sendVector(int fd, const char *header, size_t headerLength, const unsigned char *body, size_t bodyLength) {
+    struct iovec vector[2];
+    struct msghdr message;
+    ssize_t sent;
+
+    vector[0].iov_base = (void *) header;
+    vector[0].iov_len = headerLength;
+    vector[1].iov_base = (void *) body;
+    vector[1].iov_len = bodyLength;
+
+    memset(&message, 0, sizeof (message));
+    message.msg_iov = vector;
+    message.msg_iovlen = 2;
+
+    while (vector[0].iov_len || vector[1].iov_len) {
+        sent = sendmsg(fd, &message, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return -1;
+        }
+
+        if ((size_t) sent >= vector[0].iov_len) {
+            sent -= vector[0].iov_len;
+            vector[0].iov_len = 0;
+            vector[1].iov_base = (char *) vector[1].iov_base + sent;
+            vector[1].iov_len -= sent;
+        } else {
+            vector[0].iov_base = (char *) vector[0].iov_base + sent;
+            vector[0].iov_len -= sent;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Used to send a file or a memory buffer, or a range of it.
+ *
+ * @param int fd the connection.
+ * @param const char *path the request path, giving the content type.
+ * @param int file the file to send from, -1 to send from data.
+ * @param const unsigned char *data the bytes to send, when there is no file.
+ * @param long long available bytes that may be served.
+ * @param int growing whether more bytes are still to come.
+ * @param int head whether only the headers are sent.
+ * @param long long start the first byte of the range, -1 without a range, ORIGIN_SUFFIX_RANGE for the last bytes.
+ * @param long long end the last byte of the range, -1 for an open range, the length of a suffix range.
+ * @param int keepAlive whether the connection is kept open.
+ * @return int 0 on success, -1 when the connection has to be closed.
+ */
+static int sendContent(int fd, const char *path, int file, const unsigned char *data, long long available, int growing,
+        int head, long long start, long long end, int keepAlive) {
+    char header[512], total[32];
+    const char *extension = strrchr(path, '.'), *type = "application/octet-stream";
+    long long last;
+    off_t offset;
+    ssize_t sent;
+    int length;
+
+    if (extension && !strcmp(extension, ".m3u8")) {
+        type = "application/vnd.apple.mpegurl";
+    } else if (extension && !strcmp(extension, ".ts")) {
+        type = "video/mp2t";
+    } else if (!strcmp(path, ORIGIN_METRICS_PATH)) {
+        type = "text/plain; version=0.0.4";
+    }
+
+    if (growing) {
+        snprintf(total, sizeof (total), "*");
+    } else {
+        snprintf(total, sizeof (total), "%lld", available);
+    }
+
+    // A growing content has no last bytes yet, a suffix range longer than the content is the whole of it.
+    if (start == ORIGIN_SUFFIX_RANGE) {
+        start = growing || !end ? available : end < available ? available - end : 0;
+        end = -1;
+    }
+
+    if (start >= 0) {
+        if (start >= available) {
+            length = snprintf(header, sizeof (header), "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%s\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+                    total, keepAlive ? "keep-alive" : "close");
+            return sendAll(fd, header, length);
+        }
+        last = end < 0 || end >= available ? available - 1 : end;
+
+        length = snprintf(header, sizeof (header), "HTTP/1.1 206 Partial Content\r\nContent-Type: %s\r\nContent-Range: bytes %lld-%lld/%s\r\nContent-Length: %lld\r\nCache-Control: no-cache\r\nConnection: %s\r\n\r\n",
+                type, start, last, total, last - start + 1, keepAlive ? "keep-alive" : "close");
+    } else {
+        start = 0;
+        last = available - 1;
+
+        length = snprintf(header, sizeof (header), "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %lld\r\nCache-Control: no-cache\r\nConnection: %s\r\n\r\n",
+                type, available, keepAlive ? "keep-alive" : "close");
+    }
+
+    if (file < 0) {
+        return sendVector(fd, header, length, data + start, head ? 0 : last - start + 1);
+    }
+
+    if (sendAll(fd, header, length) < 0) {
+        return -1;
+    }
+
+    // The body goes from the page cache to the socket, without a copy through user space.
+    offset = start;
+    while (!head && offset <= last) {
+        sent = sendfile(fd, file, &offset, last - offset + 1);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent <= 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Used to send a file, or a range of it.
+ *
+ * @param int fd the connection.
+ * @param const char *path the file path.
+ * @param int head whether only the headers are sent.
+ * @param long long start the first byte of the range, -1 without a range, ORIGIN_SUFFIX_RANGE for the last bytes.
+ * @param long long end the last byte of the range, -1 for an open range, the length of a suffix range.
+ * @param long long limit bytes of the file that may be served, -1 for the whole file.
+ * @param int keepAlive whether the connection is kept open.
+ * @return int 0 on success, -1 when the connection has to be closed.
+ */
+static int sendFile(int fd, const char *path, int head, long long start, long long end, long long limit, int keepAlive) {
+    struct stat info;
+    int file, ret;
+
+    file = open(path, O_RDONLY);
+    if (file < 0 || fstat(file, &info) < 0 || !S_ISREG(info.st_mode)) {
+        if (file >= 0) {
+            close(file);
+        }
+        return sendStatus(fd, 404, "Not Found", keepAlive);
+    }
+
+    ret = sendContent(fd, path, file, NULL, limit >= 0 && limit < info.st_size ? limit : info.st_size, limit >= 0,
+            head, start, end, keepAlive);
+
+    close(file);
+    return ret;
+}
+
+/**
+ * Used to send the playlist or a segment from the memory ring, or a range of it.
+ * The buffer is referenced while it is sent, so the segmenter never overwrites it meanwhile.
+ *
+ * @param ORIGIN *origin the origin.
+ * @param int fd the connection.
+ * @param const char *path the request path.
+ * @param int head whether only the headers are sent.
+ * @param long long start the first byte of the range, -1 without a range, ORIGIN_SUFFIX_RANGE for the last bytes.
+ * @param long long end the last byte of the range, -1 for an open range, the length of a suffix range.
+ * @param long long limit bytes of the segment being written that may be served, -1 otherwise.
+ * @param int keepAlive whether the connection is kept open.
+ * @return int 0 on success, -1 when the connection has to be closed.
+ */
+static int sendRing(ORIGIN *origin, int fd, const char *path, int head, long long start, long long end, long long limit, int keepAlive) {
+    RING_BUFFER *buffer = NULL;
+    size_t length = strlen(origin->segments);
+    unsigned int sequence;
+    long long available;
+    char tail;
+    int complete = 1, ret;
+
+    if (!strcmp(path, origin->playlist)) {
+        buffer = ringAcquirePlaylist(origin->ring);
+    } else if (!strncmp(path, origin->segments, length) &&
+            sscanf(path + length, "-%u.t%c", &sequence, &tail) == 2 && tail == 's') {
+        buffer = ringAcquireSegment(origin->ring, sequence, &complete);
+    }
+
+    if (!buffer) {
+        return sendStatus(fd, 404, "Not Found", keepAlive);
+    }
+
+    // Segments being written are only served up to their complete parts.
+    available = buffer->size;
+    if (!complete) {
+        available = limit >= 0 && limit < available ? limit : -1;
+    }
+
+    if (available < 0) {
+        ret = sendStatus(fd, 404, "Not Found", keepAlive);
+    } else {
+        ret = sendContent(fd, path, -1, buffer->data, available, !complete, head, start, end, keepAlive);
+    }
+
+    ringRelease(origin->ring, buffer);
+
+    return ret;
+}
+
+/**
+ * Used to send the last metrics published, copied so the lock is not held while sending.
+ *
+ * @return int 0 on success, -1 when the connection has to be closed.
+ */
+static int sendMetrics(ORIGIN *origin, int fd, int head, int keepAlive) {
+    unsigned char *copy = NULL;
+    size_t length = 0;
+    int ret;
+
+    pthread_mutex_lock(&origin->lock);
+    if (origin->metrics && (copy = malloc(origin->metricsLength + 1))) {
+        length = origin->metricsLength;
+        memcpy(copy, origin->metrics, length);
+    }
+    pthread_mutex_unlock(&origin->lock);
+
+    if (!copy) {
+        return sendStatus(fd, 503, "Service Unavailable", keepAlive);
+    }
+
+    ret = sendContent(fd, ORIGIN_METRICS_PATH, -1, copy, length, 0, head, -1, -1, keepAlive);
+    free(copy);
+
+    return ret;
+}
+
+/**
+ * Used to answer one request.
+ *
+ * @param ORIGIN *origin the origin.
+ * @param int fd the connection.
+ * @param char *request the request headers, modified in place.
+ * @return int 0 to keep the connection open, -1 to close it.
+ */
+static int handleRequest(ORIGIN *origin, int fd, char *request) {
+    char *method, *target, *version, *query, *header, *save = NULL, *token;
+    const char *path;
+    long msn = -1, part = -1;
+    long long start = -1, end = -1, limit = -1;
+    int keepAlive, head, status;
+
+    method = strtok_r(request, " ", &save);
+    target = strtok_r(NULL, " ", &save);
+    version = strtok_r(NULL, "\r\n", &save);
+    header = save;
+
+    if (!method || !target || !version) {
+        sendStatus(fd, 400, "Bad Request", 0);
+        return -1;
+    }
+
+    keepAlive = !strcmp(version, "HTTP/1.1") && !(header && strcasestr(header, "\nConnection: close"));
+    head = !strcmp(method, "HEAD");
+
+    if (!head && strcmp(method, "GET")) {
+        return sendStatus(fd, 405, "Method Not Allowed", keepAlive) < 0 || !keepAlive ? -1 : 0;
+    }
+
+    query = strchr(target, '?');
+    if (query) {
+        *query++ = '\0';
+        for (token = strtok_r(query, "&", &save); token; token = strtok_r(NULL, "&", &save)) {
+            if (!strncmp(token, "_HLS_msn=", 9)) {
+                msn = strtol(token + 9, NULL, 10);
+            } else if (!strncmp(token, "_HLS_part=", 10)) {
+                part = strtol(token + 10, NULL, 10);
+            }
+        }
+    }
+
+    path = relativePath(target);
+    if (!*path || strstr(path, "..")) {
+        return sendStatus(fd, 404, "Not Found", keepAlive) < 0 || !keepAlive ? -1 : 0;
+    }
+
+    if (header && (token = strcasestr(header, "\nRange: bytes="))) {
+        token += 14;
+        if (*token == '-' && token[1] >= '0' && token[1] <= '9') {
+            start = ORIGIN_SUFFIX_RANGE;
+            end = strtoll(token + 1, NULL, 10);
+        } else if (*token >= '0' && *token <= '9') {
+            start = strtoll(token, &token, 10);
+            if (*token == '-' && token[1] >= '0' && token[1] <= '9') {
+                end = strtoll(token + 1, NULL, 10);
+            }
+        }
+    }
+
+    if (!strcmp(path, ORIGIN_METRICS_PATH)) {
+        return sendMetrics(origin, fd, head, keepAlive) < 0 || !keepAlive ? -1 : 0;
+    }
+
+    if (!strcmp(path, origin->playlist)) {
+        if (msn >= 0 && (status = waitPlaylist(origin, msn, part)) != 200) {
+            return sendStatus(fd, status, status == 400 ? "Bad Request" : "Service Unavailable", keepAlive) < 0 || !keepAlive ? -1 : 0;
+        }
+    } else if (start >= 0) {
+        limit = waitRange(origin, path, start);
+    }
+
+    if (origin->ring) {
+        return sendRing(origin, fd, path, head, start, end, limit, keepAlive) < 0 || !keepAlive ? -1 : 0;
+    }
+
+    return sendFile(fd, path, head, start, end, limit, keepAlive) < 0 || !keepAlive ? -1 : 0;
+}
+
+/**
+ * Connection thread, answers the requests of one connection in order.
+ */
+static void *connectionThread(void *opaque) {
+    CONNECTION *connection = opaque;
+    char buffer[ORIGIN_MAX_REQUEST + 1], *end;
+    int length = 0, consumed;
+    ssize_t received;
+
+    for (;;) {
+        buffer[length] = '\0';
+        end = strstr(buffer, "\r\n\r\n");
+
+        if (!end) {
+            if (length == ORIGIN_MAX_REQUEST) {
+                sendStatus(connection->fd, 431, "Request Header Fields Too Large", 0);
+                break;
+            }
+
+            received = recv(connection->fd, buffer + length, ORIGIN_MAX_REQUEST - length, 0);
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            if (received <= 0) {
+                break;
+            }
+            length += received;
+            continue;
+        }
+
+        end[2] = '\0';
+        consumed = end + 4 - buffer;
+
+        if (handleRequest(connection->origin, connection->fd, buffer) < 0) {
+            break;
+        }
+
+        // Keep whatever was pipelined after this request.
+        memmove(buffer, buffer + consumed, length - consumed);
+        length -= consumed;
+    }
+
+    close(connection->fd);
+
+    pthread_mutex_lock(&connection->origin->lock);
+    --connection->origin->connections;
+    pthread_cond_broadcast(&connection->origin->changed);
+    pthread_mutex_unlock(&connection->origin->lock);
+
+    free(connection);
+
+    return NULL;
+}
+
+/**
+ * Used to read whether the origin is stopping.
+ *
+ * @param ORIGIN *origin the origin.
+ * @return int 1 once it is stopping, 0 otherwise.
+ */
+static int isStopping(ORIGIN *origin) {
+    int stopping;
+
+    pthread_mutex_lock(&origin->lock);
+    stopping = origin->stopping;
+    pthread_mutex_unlock(&origin->lock);
+
+    return stopping;
+}
+
+/**
+ * Accepting thread, starts a thread per connection, as requests may block.
+ */
+static void *acceptThread(void *opaque) {
+    ORIGIN *origin = opaque;
+    CONNECTION *connection;
+    struct timeval timeout = {ORIGIN_IDLE_TIMEOUT, 0};
+    pthread_attr_t attributes;
+    pthread_t thread;
+    int fd;
+
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+
+    while (!isStopping(origin)) {
+        fd = accept(origin->listenFd, NULL, NULL);
+        if (fd < 0) {
+            // The connection stays queued when out of descriptors, trying again at once would spin.
+            if (errno != EINTR && errno != ECONNABORTED) {
+                usleep(ORIGIN_ACCEPT_BACKOFF * 1000);
+            }
+            continue;
+        }
+
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+
+        connection = malloc(sizeof (CONNECTION));
+        if (!connection) {
+            close(fd);
+            continue;
+        }
+        connection->origin = origin;
+        connection->fd = fd;
+
+        pthread_mutex_lock(&origin->lock);
+        ++origin->connections;
+        pthread_mutex_unlock(&origin->lock);
+
+        if (pthread_create(&thread, &attributes, connectionThread, connection)) {
+            close(fd);
+            free(connection);
+
+            pthread_mutex_lock(&origin->lock);
+            --origin->connections;
+            pthread_mutex_unlock(&origin->lock);
+        }
+    }
+
+    pthread_attr_destroy(&attributes);
+
+    return NULL;
+}
+
+/**
+ * Used to start listening, and serving the playlist and the segments.
+ *
+ * @param ORIGIN *origin the origin.
+ * @param int port the TCP port.
+ * @param const char *playlist the playlist path.
+ * @param MEMORY_RING *ring the ring to serve from, NULL to serve files.
+ * @param const char *segments the segments path prefix, when serving from the ring.
+ * @return int 0 on success, -1 otherwise.
+ */
+int originStart(ORIGIN *origin, int port, const char *playlist, MEMORY_RING *ring, const char *segments) {
+    struct sockaddr_in address;
+    int reuse = 1;
+
+    memset(origin, 0, sizeof (ORIGIN));
+    snprintf(origin->playlist, ORIGIN_MAX_PATH, "%s", relativePath(playlist));
+    if (ring) {
+        origin->ring = ring;
+        snprintf(origin->segments, ORIGIN_MAX_PATH, "%s", relativePath(segments));
+    }
+
+    origin->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (origin->listenFd < 0) {
+        return -1;
+    }
+    setsockopt(origin->listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof (reuse));
+
+    memset(&address, 0, sizeof (address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(port);
+
+    if (bind(origin->listenFd, (struct sockaddr *) &address, sizeof (address)) < 0 || listen(origin->listenFd, 128) < 0) {
+        close(origin->listenFd);
+        return -1;
+    }
+
+    // Clients going away must not kill the segmenter.
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_mutex_init(&origin->lock, NULL);
+    pthread_cond_init(&origin->changed, NULL);
+
+    if (pthread_create(&origin->thread, NULL, acceptThread, origin)) {
+        close(origin->listenFd);
+        pthread_cond_destroy(&origin->changed);
+        pthread_mutex_destroy(&origin->lock);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to publish a playlist update, and wake up the requests waiting for it.
+ *
+ * @param ORIGIN *origin the origin.
+ * @param unsigned int completedSequence the last complete segment, 0 for none.
+ * @param unsigned int currentSequence the segment being written.
+ * @param int currentParts complete parts of the segment being written.
+ * @param long long committed bytes of the segment being written, that belong to complete parts.
+ * @param const char *current the path of the segment being written.
+ * @param double targetDuration the playlist target duration.
+ */
+void originPublish(ORIGIN *origin, unsigned int completedSequence, unsigned int currentSequence, int currentParts, long long committed, const char *current, double targetDuration) {
+    pthread_mutex_lock(&origin->lock);
+
+    origin->completedSequence = completedSequence;
+    origin->currentSequence = currentSequence;
+    origin->currentParts = currentParts;
+    origin->committed = committed;
+    origin->targetDuration = targetDuration;
+    snprintf(origin->current, ORIGIN_MAX_PATH, "%s", relativePath(current));
+
+    pthread_cond_broadcast(&origin->changed);
+    pthread_mutex_unlock(&origin->lock);
+}
+
+/**
+ * Used to replace the metrics served.
+ *
+ * @param ORIGIN *origin the origin.
+ * @param char *metrics the metrics, in the Prometheus text format, allocated with malloc and owned by the origin from now on.
+ * @param size_t length the metrics length.
+ */
+void originPublishMetrics(ORIGIN *origin, char *metrics, size_t length) {
+    char *previous;
+
+    pthread_mutex_lock(&origin->lock);
+    previous = origin->metrics;
+    origin->metrics = metrics;
+    origin->metricsLength = length;
+    pthread_mutex_unlock(&origin->lock);
+
+    free(previous);
+}
+
+/**
+ * Used to stop listening, and wait for the open connections to end.
+ *
+ * @param ORIGIN *origin the origin.
+ */
+void originStop(ORIGIN *origin) {
+    pthread_mutex_lock(&origin->lock);
+    origin->stopping = 1;
+    pthread_cond_broadcast(&origin->changed);
+    pthread_mutex_unlock(&origin->lock);
+
+    shutdown(origin->listenFd, SHUT_RDWR);
+    close(origin->listenFd);
+    pthread_join(origin->thread, NULL);
+
+    // Idle connections time out on their own, blocked requests were woken up above.
+    pthread_mutex_lock(&origin->lock);
+    while (origin->connections) {
+        pthread_cond_wait(&origin->changed, &origin->lock);
+    }
+    pthread_mutex_unlock(&origin->lock);
+
+    pthread_cond_destroy(&origin->changed);
+    pthread_mutex_destroy(&origin->lock);
+
+    free(origin->metrics);
+    origin->metrics = NULL;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,83 @@
+/**
+ * @file
+ * Built-in HTTP origin prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * A minimal HTTP/1.1 origin, serving the playlist and segments of one session
+ * from the working directory. It honors the low latency HLS blocking playlist
+ * reloads (_HLS_msn and _HLS_part), and holds range requests for the part
+ * being written until it is complete. It serves either files, or the memory ring
+ * of a session written without disk I/O, and the session metrics on
+ * ORIGIN_METRICS_PATH. It expects <pthread.h> and "memory_ring.h" to be
+ * included first.
+ */
+#define ORIGIN_MAX_REQUEST 8192
+#define ORIGIN_MAX_PATH 1024
+#define ORIGIN_METRICS_PATH "metrics"
+
+typedef struct origin {
+    int listenFd,
+        stopping,
+        connections;
+    pthread_t thread;
+
+    /**
+     * @var char playlist the request path of the playlist, relative to the working directory.
+     */
+    char playlist[ORIGIN_MAX_PATH];
+
+    /**
+     * @var MEMORY_RING ring the ring to serve from, NULL to serve files.
+     * @var char segments the request path prefix of the segments in the ring.
+     */
+    MEMORY_RING *ring;
+    char segments[ORIGIN_MAX_PATH];
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    /**
+     * Publishing state, updated every time the playlist is rewritten.
+     *
+     * @var unsigned int completedSequence the last complete segment, 0 for none.
+     * @var unsigned int currentSequence the segment being written.
+     * @var int currentParts complete parts of the segment being written.
+     * @var long long committed bytes of the segment being written, that belong to complete parts.
+     * @var char current the request path of the segment being written.
+     */
+    unsigned int completedSequence,
+                 currentSequence;
+    int currentParts;
+    long long committed;
+    char current[ORIGIN_MAX_PATH];
+    double targetDuration;
+
+    /**
+     * @var char *metrics the last metrics published, in the Prometheus text format, NULL before the first ones.
+     */
+    char *metrics;
+    size_t metricsLength;
+} ORIGIN;
+
+int originStart(ORIGIN *, int, const char *, MEMORY_RING *, const char *);
+void originPublish(ORIGIN *, unsigned int, unsigned int, int, long long, const char *, double);
+void originPublishMetrics(ORIGIN *, char *, size_t);
+void originStop(ORIGIN *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
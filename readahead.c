@@ -0,0 +1,347 @@
+/**
+ * @file
+ * Input readahead implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "helpers.h"
+#include "readahead.h"
+
+/**
+ * Used to run the reader: each read goes straight into the free part of the
+ * ring, outside the lock, as the segmenter only touches the buffered part.
+ */
+static void *readerThread(void *data) {
+    READAHEAD *readahead = data;
+    struct pollfd fds;
+    size_t tail, room;
+    ssize_t size;
+    double fullSince;
+    int error = 0;
+
+    fds.fd = readahead->fd;
+    fds.events = POLLIN;
+
+    for (;;) {
+        pthread_mutex_lock(&readahead->lock);
+        if (readahead->count == readahead->size && !readahead->stopping) {
+            if (!readahead->overflowing) {
+                ++readahead->overflows;
+                readahead->overflowing = 1;
+            }
+            fullSince = getMonotonicMilliseconds();
+            while (readahead->count == readahead->size && !readahead->stopping) {
+                pthread_cond_wait(&readahead->drained, &readahead->lock);
+            }
+            readahead->fullMilliseconds += getMonotonicMilliseconds() - fullSince;
+        }
+        if (readahead->stopping) {
+            pthread_mutex_unlock(&readahead->lock);
+            break;
+        }
+        tail = (readahead->head + readahead->count) % readahead->size;
+        room = readahead->size - readahead->count;
+        if (room > readahead->size - tail) {
+            room = readahead->size - tail;
+        }
+        pthread_mutex_unlock(&readahead->lock);
+
+        // Polled, so a stop is noticed without input.
+        fds.revents = 0;
+        if (poll(&fds, 1, READAHEAD_POLL_TIMEOUT) == 0) {
+            continue;
+        }
+
+        do {
+            size = read(readahead->fd, readahead->ring + tail, room);
+        } while (size < 0 && errno == EINTR);
+
+        if (size < 0 && errno == EAGAIN) {
+            continue;
+        }
+        if (size < 0) {
+            error = errno;
+        }
+
+        pthread_mutex_lock(&readahead->lock);
+        if (size > 0) {
+            readahead->count += size;
+            readahead->fed += size;
+            if (readahead->count > readahead->highWater) {
+                readahead->highWater = readahead->count;
+            }
+        } else {
+            readahead->ended = 1;
+            readahead->error = error;
+        }
+        pthread_cond_signal(&readahead->filled);
+        pthread_mutex_unlock(&readahead->lock);
+
+        if (size <= 0) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Used to prepare a ring fed by its caller, with no thread of its own. The
+ * ring is allocated whole, and touched, so its pages are not faulted in while
+ * the producer waits.
+ *
+ * @param READAHEAD *readahead the readahead.
+ * @param size_t size the ring size, in bytes.
+ * @return int 0 on success, -1 otherwise.
+ */
+int readaheadInit(READAHEAD *readahead, size_t size) {
+    memset(readahead, 0, sizeof (READAHEAD));
+    readahead->fd = -1;
+    readahead->size = size;
+    readahead->marked = -1;
+
+    readahead->ring = malloc(size);
+    if (!readahead->ring) {
+        return -1;
+    }
+    memset(readahead->ring, 0, size);
+
+    pthread_mutex_init(&readahead->lock, NULL);
+    pthread_cond_init(&readahead->filled, NULL);
+    pthread_cond_init(&readahead->drained, NULL);
+
+    return 0;
+}
+
+/**
+ * Used to start reading ahead, on a thread of its own.
+ *
+ * @param READAHEAD *readahead the readahead.
+ * @param int fd the file descriptor read, owned by the readahead from now on.
+ * @param size_t size the ring size, in bytes.
+ * @return int 0 on success, -1 otherwise.
+ */
+int readaheadStart(READAHEAD *readahead, int fd, size_t size) {
+    if (readaheadInit(readahead, size) < 0) {
+        close(fd);
+        return -1;
+    }
+    readahead->fd = fd;
+
+    if (pthread_create(&readahead->thread, NULL, readerThread, readahead)) {
+        pthread_mutex_destroy(&readahead->lock);
+        pthread_cond_destroy(&readahead->filled);
+        pthread_cond_destroy(&readahead->drained);
+        free(readahead->ring);
+        readahead->ring = NULL;
+        close(fd);
+        readahead->fd = -1;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used by the caller feeding the ring to get the free part the next bytes go
+ * into, in one piece. Finding the ring full counts as an overflow, as the
+ * reader thread does.
+ *
+ * @param READAHEAD *readahead the readahead, fed by its caller.
+ * @param size_t *room receives the bytes that fit.
+ * @return uint8_t * where they go, NULL when the ring is full or the input ended.
+ */
+uint8_t *readaheadSpace(READAHEAD *readahead, size_t *room) {
+    size_t tail;
+
+    pthread_mutex_lock(&readahead->lock);
+    if (readahead->ended || readahead->count == readahead->size) {
+        if (!readahead->ended && !readahead->overflowing) {
+            ++readahead->overflows;
+            readahead->overflowing = 1;
+        }
+        if (!readahead->ended && !readahead->fullSince) {
+            readahead->fullSince = getMonotonicMilliseconds();
+        }
+        pthread_mutex_unlock(&readahead->lock);
+        return NULL;
+    }
+    tail = (readahead->head + readahead->count) % readahead->size;
+    *room = readahead->size - readahead->count;
+    if (*room > readahead->size - tail) {
+        *room = readahead->size - tail;
+    }
+    pthread_mutex_unlock(&readahead->lock);
+
+    return readahead->ring + tail;
+}
+
+/**
+ * Used by the caller feeding the ring to hand out the bytes it put where
+ * readaheadSpace() told, or to end the input.
+ *
+ * @param READAHEAD *readahead the readahead, fed by its caller.
+ * @param ssize_t size the bytes put, 0 or less to end the input.
+ * @param int error the errno of a failed read, 0 when none.
+ * @param int64_t mark the offset, counted as readahead.fed is, of the last mark in the bytes, -1 when they hold none.
+ */
+void readaheadFilled(READAHEAD *readahead, ssize_t size, int error, int64_t mark) {
+    pthread_mutex_lock(&readahead->lock);
+    if (size > 0) {
+        readahead->count += size;
+        readahead->fed += size;
+        if (readahead->count > readahead->highWater) {
+            readahead->highWater = readahead->count;
+        }
+        if (mark >= 0) {
+            readahead->marked = mark;
+        }
+    } else {
+        readahead->ended = 1;
+        readahead->error = error;
+    }
+    pthread_cond_signal(&readahead->filled);
+    pthread_mutex_unlock(&readahead->lock);
+}
+
+/**
+ * Used to read what is buffered, waiting only when nothing is.
+ *
+ * @param READAHEAD *readahead the readahead.
+ * @param uint8_t *buffer the destination.
+ * @param int size the destination size.
+ * @return int the bytes read, 0 at the end of the input, -1 with errno set on errors.
+ */
+int readaheadRead(READAHEAD *readahead, uint8_t *buffer, int size) {
+    size_t head, available, first;
+
+    pthread_mutex_lock(&readahead->lock);
+    if (!readahead->count && !readahead->ended) {
+        ++readahead->underruns;
+        while (!readahead->count && !readahead->ended) {
+            pthread_cond_wait(&readahead->filled, &readahead->lock);
+        }
+    }
+    if (!readahead->count) {
+        pthread_mutex_unlock(&readahead->lock);
+        if (readahead->error) {
+            errno = readahead->error;
+            return -1;
+        }
+        return 0;
+    }
+    head = readahead->head;
+    available = readahead->count < (size_t) size ? readahead->count : (size_t) size;
+    pthread_mutex_unlock(&readahead->lock);
+
+    // The buffered bytes are only handed out here, they can be copied without the lock.
+    first = readahead->size - head < available ? readahead->size - head : available;
+    memcpy(buffer, readahead->ring + head, first);
+    memcpy(buffer + first, readahead->ring, available - first);
+
+    pthread_mutex_lock(&readahead->lock);
+    readahead->head = (head + available) % readahead->size;
+    readahead->count -= available;
+    if (readahead->count < readahead->size / 2) {
+        readahead->overflowing = 0;
+    }
+    if (readahead->fullSince) {
+        readahead->fullMilliseconds += getMonotonicMilliseconds() - readahead->fullSince;
+        readahead->fullSince = 0;
+    }
+    pthread_cond_signal(&readahead->drained);
+    pthread_mutex_unlock(&readahead->lock);
+
+    return (int) available;
+}
+
+/**
+ * Used to tell whether the reader can go on without waiting: the input ended,
+ * the ring is full, it holds bytes enough, or a mark lies past what the reader
+ * got to.
+ *
+ * @param READAHEAD *readahead the readahead.
+ * @param size_t bytes the bytes enough.
+ * @param size_t unread the bytes handed out the reader did not get to yet, they count as buffered.
+ * @return int 1 when the reader does not wait, 0 otherwise.
+ */
+int readaheadPending(READAHEAD *readahead, size_t bytes, size_t unread) {
+    int pending;
+
+    pthread_mutex_lock(&readahead->lock);
+    pending = readahead->ended || readahead->count == readahead->size || readahead->count + unread >= bytes
+              || (readahead->marked >= 0 && readahead->marked >= readahead->fed - (int64_t) (readahead->count + unread));
+    pthread_mutex_unlock(&readahead->lock);
+
+    return pending;
+}
+
+/**
+ * Used to read the counters.
+ *
+ * @param READAHEAD *readahead the readahead.
+ * @param size_t *count receives the bytes buffered.
+ * @param size_t *highWater receives the most bytes buffered so far.
+ * @param unsigned long long *overflows receives the times the ring filled up.
+ * @param unsigned long long *underruns receives the times the ring was found empty.
+ * @param double *fullMilliseconds receives the time the ring was full.
+ */
+void readaheadCounts(READAHEAD *readahead, size_t *count, size_t *highWater, unsigned long long *overflows, unsigned long long *underruns,
+                     double *fullMilliseconds) {
+    pthread_mutex_lock(&readahead->lock);
+    *count = readahead->count;
+    *highWater = readahead->highWater;
+    *overflows = readahead->overflows;
+    *underruns = readahead->underruns;
+    *fullMilliseconds = readahead->fullMilliseconds;
+    pthread_mutex_unlock(&readahead->lock);
+}
+
+/**
+ * Used to stop reading ahead, what is still buffered is dropped.
+ *
+ * @param READAHEAD *readahead the readahead.
+ */
+void readaheadStop(READAHEAD *readahead) {
+    if (readahead->fd >= 0) {
+        pthread_mutex_lock(&readahead->lock);
+        readahead->stopping = 1;
+        pthread_cond_signal(&readahead->drained);
+        pthread_mutex_unlock(&readahead->lock);
+
+        pthread_join(readahead->thread, NULL);
+        close(readahead->fd);
+        readahead->fd = -1;
+    }
+
+    pthread_mutex_destroy(&readahead->lock);
+    pthread_cond_destroy(&readahead->filled);
+    pthread_cond_destroy(&readahead->drained);
+    free(readahead->ring);
+    readahead->ring = NULL;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,98 @@
+/**
+ * @file
+ * Input readahead prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * The readahead drains a file descriptor, the standard input, into a ring
+ * buffer on a thread of its own, so the producer keeps writing while the
+ * segmenter stalls (on a slow rename, for instance), up to the ring size, and
+ * the segmenter keeps reading what is buffered while the producer hiccups.
+ * The ring filling up is an overflow: the producer is then held back, as it
+ * would be by the pipe. The highest fill, overflows, time spent full and
+ * underruns (the segmenter waiting on an empty ring) tell which side
+ * stalled. A ring started without a thread of its own is fed by its caller
+ * instead, through readaheadSpace() and readaheadFilled(), which may also mark
+ * where in the input a frame can be handed out from what is buffered. It
+ * expects <stddef.h>, <stdint.h>, <sys/types.h> and <pthread.h> to be included
+ * first.
+ */
+
+/**
+ * Milliseconds the reader waits for input at most, before checking whether it
+ * was stopped.
+ */
+#define READAHEAD_POLL_TIMEOUT 200
+
+typedef struct readahead {
+    /**
+     * @var int fd the file descriptor read, -1 for a ring fed by its caller.
+     */
+    int fd;
+    pthread_t thread;
+
+    /**
+     * @var pthread_mutex_t lock guards everything below.
+     * @var pthread_cond_t filled signaled when bytes were read, or at the end of the input.
+     * @var pthread_cond_t drained signaled when bytes were handed out.
+     */
+    pthread_mutex_t lock;
+    pthread_cond_t filled,
+                   drained;
+
+    /**
+     * @var uint8_t *ring size bytes, count of them buffered from head.
+     * @var int error the errno of a failed read, 0 when none.
+     * @var int overflowing whether the ring filled up, and has not drained to half since.
+     * @var int64_t fed the bytes buffered so far, handed out or not.
+     * @var int64_t marked the offset of the last mark in the bytes fed, -1 before the first one.
+     */
+    uint8_t *ring;
+    size_t size,
+           head,
+           count,
+           highWater;
+    int ended,
+        error,
+        stopping,
+        overflowing;
+    int64_t fed,
+            marked;
+
+    /**
+     * @var unsigned long long overflows times the ring filled up, a fill counts once until it drains to half.
+     * @var unsigned long long underruns times the ring was found empty.
+     * @var double fullMilliseconds time the ring was full, the producer held back.
+     * @var double fullSince when a ring fed by its caller was found full, 0 while it is not.
+     */
+    unsigned long long overflows,
+                       underruns;
+    double fullMilliseconds,
+           fullSince;
+} READAHEAD;
+
+int readaheadInit(READAHEAD *, size_t);
+int readaheadStart(READAHEAD *, int, size_t);
+uint8_t *readaheadSpace(READAHEAD *, size_t *);
+void readaheadFilled(READAHEAD *, ssize_t, int, int64_t);
+int readaheadRead(READAHEAD *, uint8_t *, int);
+int readaheadPending(READAHEAD *, size_t, size_t);
+void readaheadCounts(READAHEAD *, size_t *, size_t *, unsigned long long *, unsigned long long *, double *);
+void readaheadStop(READAHEAD *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
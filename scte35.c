@@ -0,0 +1,401 @@
+/**
+ * @file
+ * SCTE-35 splice detection implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "scte35.h"
+
+#define SCTE35_TABLE_ID 0xFC
+#define SCTE35_SPLICE_INSERT 0x05
+#define SCTE35_TIME_SIGNAL 0x06
+
+/**
+ * Used to compute the MPEG-2 CRC of a section, splice sections are rare enough
+ * to go without a table. It is 0 over a whole section with a valid CRC.
+ *
+ * @return uint32_t the CRC.
+ */
+static uint32_t sectionCrc(const uint8_t *data, int size) {
+    uint32_t crc = 0xFFFFFFFF;
+    int i, bit;
+
+    for (i = 0; i < size; i++) {
+        crc ^= (uint32_t) data[i] << 24;
+        for (bit = 0; bit < 8; bit++) {
+            crc = crc & 0x80000000 ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+        }
+    }
+
+    return crc;
+}
+
+/**
+ * Used to read a 33 bits time, following 7 bits of flags.
+ */
+static long long readTime(const uint8_t *data) {
+    return ((long long) (data[0] & 0x01) << 32) | ((long long) data[1] << 24) | (data[2] << 16) | (data[3] << 8) | data[4];
+}
+
+/**
+ * Used to read a splice_time() structure.
+ *
+ * @param const uint8_t *data the structure.
+ * @param const uint8_t *end the end of the command.
+ * @param long long *time receives the time, -1 when it is not specified.
+ * @return int the structure size, -1 when it is truncated.
+ */
+static int readSpliceTime(const uint8_t *data, const uint8_t *end, long long *time) {
+    if (data >= end) {
+        return -1;
+    }
+
+    if (!(data[0] & 0x80)) {
+        *time = -1;
+        return 1;
+    }
+
+    if (end - data < 5) {
+        return -1;
+    }
+    *time = readTime(data);
+
+    return 5;
+}
+
+/**
+ * Used to queue a detected splice, the oldest one is dropped when the queue is full.
+ */
+static void queueSplice(SCTE35 *scte35, long long pts, long long duration) {
+    SCTE35_SPLICE *splice;
+
+    if (scte35->spliceCount == SCTE35_MAX_SPLICES) {
+        scte35->spliceHead = (scte35->spliceHead + 1) % SCTE35_MAX_SPLICES;
+        --scte35->spliceCount;
+        ++scte35->errors;
+    }
+
+    splice = &scte35->splices[(scte35->spliceHead + scte35->spliceCount++) % SCTE35_MAX_SPLICES];
+    splice->pts = pts;
+    splice->duration = duration;
+}
+
+/**
+ * Used to parse a complete splice_info_section.
+ *
+ * @param SCTE35 *scte35 the scanner.
+ * @param const uint8_t *section the section.
+ * @param int size the section size.
+ */
+static void parseSection(SCTE35 *scte35, const uint8_t *section, int size) {
+    const uint8_t *command, *end;
+    long long adjustment, time = -1, componentTime, duration = 0;
+    int commandLength, flags, used, count;
+
+    ++scte35->sections;
+
+    if (size < 20 || section[0] != SCTE35_TABLE_ID || sectionCrc(section, size)) {
+        ++scte35->errors;
+        return;
+    }
+
+    // Encrypted commands can not be read.
+    if (section[4] & 0x80) {
+        return;
+    }
+
+    adjustment = readTime(section + 4);
+    commandLength = ((section[11] & 0x0F) << 8) | section[12];
+    command = section + 14;
+    end = section + size - 4;
+    if (commandLength != 0xFFF && command + commandLength < end) {
+        end = command + commandLength;
+    }
+
+    switch (section[13]) {
+        case SCTE35_SPLICE_INSERT:
+            // Cancelled events do not splice.
+            if (end - command < 6 || (command[4] & 0x80)) {
+                return;
+            }
+            flags = command[5];
+            command += 6;
+
+            if (!(flags & 0x40)) {
+                // Component splice mode, one tag per component, with a time unless immediate, the first component gives the time.
+                if (command >= end) {
+                    ++scte35->errors;
+                    return;
+                }
+                count = *command++;
+                while (count--) {
+                    if (command >= end) {
+                        ++scte35->errors;
+                        return;
+                    }
+                    ++command;
+                    if (flags & 0x10) {
+                        continue;
+                    }
+                    if ((used = readSpliceTime(command, end, &componentTime)) < 0) {
+                        ++scte35->errors;
+                        return;
+                    }
+                    if (time < 0) {
+                        time = componentTime;
+                    }
+                    command += used;
+                }
+            } else if (!(flags & 0x10)) {
+                // Program splice mode.
+                if ((used = readSpliceTime(command, end, &time)) < 0) {
+                    ++scte35->errors;
+                    return;
+                }
+                command += used;
+            }
+
+            if ((flags & 0x20) && end - command >= 5) {
+                duration = readTime(command);
+            }
+            break;
+        case SCTE35_TIME_SIGNAL:
+            if (readSpliceTime(command, end, &time) < 0) {
+                ++scte35->errors;
+                return;
+            }
+            // A time signal without a time carries no splice.
+            if (time < 0) {
+                return;
+            }
+            break;
+        default:
+            return;
+    }
+
+    queueSplice(scte35, time < 0 ? -1 : (time + adjustment) & 0x1FFFFFFFFLL, duration);
+}
+
+/**
+ * Used to add payload bytes of the SCTE-35 PID to the sections being assembled.
+ */
+static void appendSection(SCTE35 *scte35, const uint8_t *data, int size) {
+    int copied;
+
+    while (size > 0) {
+        // Stuffing ends the sections of a packet.
+        if (!scte35->sectionFill && *data == 0xFF) {
+            return;
+        }
+
+        copied = SCTE35_MAX_SECTION - scte35->sectionFill;
+        if (scte35->sectionLength && scte35->sectionLength - scte35->sectionFill < copied) {
+            copied = scte35->sectionLength - scte35->sectionFill;
+        } else if (!scte35->sectionLength && scte35->sectionFill < 3) {
+            copied = 3 - scte35->sectionFill;
+        }
+        if (copied > size) {
+            copied = size;
+        }
+
+        memcpy(scte35->section + scte35->sectionFill, data, copied);
+        scte35->sectionFill += copied;
+        data += copied;
+        size -= copied;
+
+        if (!scte35->sectionLength && scte35->sectionFill >= 3) {
+            scte35->sectionLength = 3 + (((scte35->section[1] & 0x0F) << 8) | scte35->section[2]);
+        }
+
+        if (scte35->sectionLength && scte35->sectionFill >= scte35->sectionLength) {
+            parseSection(scte35, scte35->section, scte35->sectionLength);
+            scte35->sectionFill = scte35->sectionLength = 0;
+        } else if (scte35->sectionFill == SCTE35_MAX_SECTION) {
+            ++scte35->errors;
+            scte35->sectionFill = scte35->sectionLength = 0;
+        }
+    }
+}
+
+/**
+ * Used to find the PMT PID in a PAT, or the SCTE-35 PID in a PMT. Both are
+ * expected to fit in one packet, as they do in practice.
+ */
+static void parseTable(SCTE35 *scte35, const uint8_t *payload, const uint8_t *end, int pmt) {
+    const uint8_t *section, *entry, *entriesEnd;
+    int sectionLength;
+
+    section = payload + 1 + payload[0];
+    if (end - section < 12 || section[0] != (pmt ? 0x02 : 0x00)) {
+        return;
+    }
+
+    sectionLength = ((section[1] & 0x0F) << 8) | section[2];
+    entriesEnd = section + 3 + sectionLength - 4;
+    if (entriesEnd > end) {
+        return;
+    }
+
+    if (!pmt) {
+        for (entry = section + 8; entry + 4 <= entriesEnd; entry += 4) {
+            // The first program is the one segmented.
+            if ((entry[0] << 8 | entry[1]) != 0) {
+                scte35->pmtPid = ((entry[2] & 0x1F) << 8) | entry[3];
+                return;
+            }
+        }
+        return;
+    }
+
+    scte35->pid = -1;
+    for (entry = section + 12 + (((section[10] & 0x0F) << 8) | section[11]); entry + 5 <= entriesEnd;
+            entry += 5 + (((entry[3] & 0x0F) << 8) | entry[4])) {
+        if (entry[0] == SCTE35_STREAM_TYPE) {
+            scte35->pid = ((entry[1] & 0x1F) << 8) | entry[2];
+            return;
+        }
+    }
+}
+
+/**
+ * Used to handle one transport stream packet.
+ */
+static void scanPacket(SCTE35 *scte35, const uint8_t *packet) {
+    int pid = ((packet[1] & 0x1F) << 8) | packet[2],
+        start = packet[1] & 0x40;
+    const uint8_t *payload = packet + 4, *end = packet + SCTE35_TS_PACKET_SIZE;
+
+    if (pid != 0 && pid != scte35->pmtPid && pid != scte35->pid) {
+        return;
+    }
+
+    // No payload, or an adaptation field filling the packet.
+    if (!(packet[3] & 0x10)) {
+        return;
+    }
+    if (packet[3] & 0x20) {
+        payload += 1 + packet[4];
+    }
+    if (payload >= end) {
+        return;
+    }
+
+    if (pid == scte35->pid) {
+        if (start) {
+            if (scte35->sectionFill && payload + 1 + payload[0] <= end) {
+                appendSection(scte35, payload + 1, payload[0]);
+            }
+            scte35->sectionFill = scte35->sectionLength = 0;
+            payload += 1 + payload[0];
+            if (payload >= end) {
+                return;
+            }
+        } else if (!scte35->sectionFill) {
+            return;
+        }
+        appendSection(scte35, payload, end - payload);
+    } else if (start) {
+        parseTable(scte35, payload, end, pid != 0);
+    }
+}
+
+/**
+ * Used to prepare a scanner.
+ *
+ * @param SCTE35 *scte35 the scanner.
+ */
+void scte35Init(SCTE35 *scte35) {
+    memset(scte35, 0, sizeof (SCTE35));
+    scte35->pmtPid = -1;
+    scte35->pid = -1;
+}
+
+/**
+ * Used to scan input bytes, as they are read. Aligned packets are scanned in
+ * place, only the packets split between reads are copied.
+ *
+ * @param SCTE35 *scte35 the scanner.
+ * @param const uint8_t *data the bytes.
+ * @param int size the bytes count.
+ */
+void scte35Scan(SCTE35 *scte35, const uint8_t *data, int size) {
+    const uint8_t *sync;
+    int copied;
+
+    while (size > 0) {
+        if (scte35->packetFill) {
+            copied = SCTE35_TS_PACKET_SIZE - scte35->packetFill;
+            if (copied > size) {
+                copied = size;
+            }
+            memcpy(scte35->packet + scte35->packetFill, data, copied);
+            scte35->packetFill += copied;
+            data += copied;
+            size -= copied;
+
+            if (scte35->packetFill == SCTE35_TS_PACKET_SIZE) {
+                scanPacket(scte35, scte35->packet);
+                scte35->packetFill = 0;
+            }
+            continue;
+        }
+
+        // Resynchronize on the next sync byte.
+        if (*data != 0x47) {
+            sync = memchr(data, 0x47, size);
+            if (!sync) {
+                return;
+            }
+            size -= sync - data;
+            data = sync;
+        }
+
+        if (size < SCTE35_TS_PACKET_SIZE) {
+            memcpy(scte35->packet, data, size);
+            scte35->packetFill = size;
+            return;
+        }
+
+        scanPacket(scte35, data);
+        data += SCTE35_TS_PACKET_SIZE;
+        size -= SCTE35_TS_PACKET_SIZE;
+    }
+}
+
+/**
+ * Used to take the next detected splice.
+ *
+ * @param SCTE35 *scte35 the scanner.
+ * @param SCTE35_SPLICE *splice receives the splice.
+ * @return int 1 when a splice was taken, 0 otherwise.
+ */
+int scte35Receive(SCTE35 *scte35, SCTE35_SPLICE *splice) {
+    if (!scte35->spliceCount) {
+        return 0;
+    }
+
+    *splice = scte35->splices[scte35->spliceHead];
+    scte35->spliceHead = (scte35->spliceHead + 1) % SCTE35_MAX_SPLICES;
+    --scte35->spliceCount;
+
+    return 1;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,64 @@
+/**
+ * @file
+ * SCTE-35 splice detection prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * The scanner watches the raw transport stream as it is read: it follows the
+ * PAT and the PMT to the SCTE-35 PID (stream type 0x86), and parses the
+ * splice_insert and time_signal commands of its sections. Other packets only
+ * cost a PID comparison. It expects <stdint.h> to be included first.
+ */
+#define SCTE35_TS_PACKET_SIZE 188
+#define SCTE35_MAX_SECTION 4096
+#define SCTE35_MAX_SPLICES 16
+#define SCTE35_STREAM_TYPE 0x86
+
+typedef struct scte35_splice {
+    /**
+     * @var long long pts the splice time, 90 kHz with the PTS adjustment applied, -1 for an immediate splice.
+     * @var long long duration the break duration, 90 kHz, 0 when not given.
+     */
+    long long pts,
+              duration;
+} SCTE35_SPLICE;
+
+typedef struct scte35 {
+    int pmtPid,
+        pid;
+
+    uint8_t packet[SCTE35_TS_PACKET_SIZE];
+    int packetFill;
+
+    uint8_t section[SCTE35_MAX_SECTION];
+    int sectionFill,
+        sectionLength;
+
+    SCTE35_SPLICE splices[SCTE35_MAX_SPLICES];
+    int spliceHead,
+        spliceCount;
+
+    unsigned long long sections,
+                       errors;
+} SCTE35;
+
+void scte35Init(SCTE35 *);
+void scte35Scan(SCTE35 *, const uint8_t *, int);
+int scte35Receive(SCTE35 *, SCTE35_SPLICE *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -15,15 +15,49 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  * @modified by Ahmed Kamal (me.ahmed.kamal@gmail.com) - Added cue points support.
  */
+#define _GNU_SOURCE
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include <zlib.h>
 
 #include "libavformat/avformat.h"
 
 // Added by Ahmed Kamal
 #include "helpers.h"
 #include "linked_list.h"
+#include "cue_plan.h"
+#include "history.h"
+#include "cue_loader.h"
+#include "digest.h"
+#include "gzip_playlist.h"
+#include "aes.h"
+#include "thumbnails.h"
+#include "udp_input.h"
+#include "readahead.h"
+#include "input_feed.h"
+#include "manifest.h"
+#include "metrics.h"
+#include "interleaver.h"
+#include "control.h"
+#include "scte35.h"
+#include "stream_info.h"
+#include "session.h"
+#include "supervisor.h"
+#include "memory_ring.h"
+#include "origin.h"
 
 // Added to fix Libraries deprecates.
 #if LIBAVFORMAT_VERSION_MAJOR > 52 || (LIBAVFORMAT_VERSION_MAJOR == 52 && \
@@ -58,72 +92,173 @@
 #define PKT_FLAG_KEY    AV_PKT_FLAG_KEY
 #endif
 
+#if LIBAVFORMAT_VERSION_MAJOR > 52 || (LIBAVFORMAT_VERSION_MAJOR == 52 && \
+                                       LIBAVFORMAT_VERSION_MINOR >= 105)
+#define av_alloc_put_byte   avio_alloc_context
+#endif
+
 /**
- * Added by Ahmed Kamal.
- * Global variables.
- *
- * @var LIST *cuePoints holds cue points.
- * @var LIST *segments holds final segments.
+ * Size of the buffer of inputs opened on a pollable file descriptor.
  */
-LIST *cuePoints, *segments;
-unsigned int considerCuePoints = 0;
+#define SESSION_INPUT_BUFFER_SIZE 32768
 
 /**
- * Used to get a list of differnces between each segment and cuePoints
- * @param LIST *cuePoints pointer to cuePoints list.
- * @param int segmentationBase the segmentation base.
- * @return
+ * Size of the ring the standard input is read ahead into, by default, a few
+ * seconds of a high bitrate stream.
  */
-LIST *buildDifferences(LIST *cuePoints, int segmentationBase) {
-    if (cuePoints == NULL) {
-        return NULL;
-    }
-
-    char *buffer = malloc(sizeof (char) *1000);
+#define SESSION_READAHEAD_SIZE (16 * 1024 * 1024)
 
-    snprintf(buffer, 100, "Cue Point Differences on base %d.", segmentationBase);
-
-    LIST *returnList = createList(buffer, 1, 0);
-    NODE *link;
-
-    unsigned int differnce = cuePoints->head->id,
-            remainder = 0,
-            fullSegmentsCount = 0,
-            totalSegmentsTime = 0,
-            i = 0;
-
-    for (link = cuePoints->head; link; link = link->next) {
-
-        if (differnce > segmentationBase) {
-            remainder = differnce % segmentationBase;
-            fullSegmentsCount = (differnce - remainder) / segmentationBase;
-
-
-            for (i = 0; i < fullSegmentsCount; ++i) {
-                append(returnList, createNode(segmentationBase, NULL));
-                totalSegmentsTime += segmentationBase;
-            }
+/**
+ * Turns of input the ring of a supervised input holds, by default.
+ */
+#define SESSION_FEED_QUANTA 4
 
-            if (remainder > 0) {
-                append(returnList, createNode(remainder, NULL));
-                totalSegmentsTime += remainder;
-            }
+/**
+ * Size of the buffer segments are written through, when they are kept in memory.
+ */
+#define SESSION_OUTPUT_BUFFER_SIZE 32768
 
-        } else if (differnce) {
-            append(returnList, createNode(differnce, NULL));
-            totalSegmentsTime += differnce;
-        }
+/**
+ * Pool files kept beyond the playlist window and the segment being written, so
+ * a segment that just left the playlist is not rewritten under its readers.
+ */
+#define SESSION_POOL_SPARE_FILES 2
 
-        // Special case if the cue points number is one, and it has smaller value than the segmentation base, then we need to add another segment.
-        if (cuePoints->length == 1 && link->id < segmentationBase) {
+/**
+ * Thumbnails defaults, 16:9 tiles, and a queue a few segments deep.
+ */
+#define SESSION_THUMBNAIL_WIDTH 160
+#define SESSION_THUMBNAIL_HEIGHT 90
+#define SESSION_THUMBNAIL_WORKERS 2
+#define SESSION_THUMBNAIL_QUEUE 8
 
-            append(returnList, createNode(segmentationBase - (link->id % segmentationBase), NULL));
-        }
+/**
+ * Options accepted before the positional arguments.
+ */
+static struct option longOptions[] = {
+    {"probesize", required_argument, NULL, 'p'},
+    {"analyzeduration", required_argument, NULL, 'a'},
+    {"stream-info", required_argument, NULL, 's'},
+    {"memory-budget", required_argument, NULL, 'm'},
+    {"max-bytes", required_argument, NULL, 'B'},
+    {"supervisor", required_argument, NULL, 'S'},
+    {"workers", required_argument, NULL, 'w'},
+    {"quantum", required_argument, NULL, 'q'},
+    {"status", required_argument, NULL, 'T'},
+    {"part-duration", required_argument, NULL, 'P'},
+    {"origin", required_argument, NULL, 'O'},
+    {"memory-ring", no_argument, NULL, 'M'},
+    {"file-pool", no_argument, NULL, 'F'},
+    {"control", required_argument, NULL, 'C'},
+    {"cues", required_argument, NULL, 'L'},
+    {"manifest", required_argument, NULL, 'N'},
+    {"reuse", required_argument, NULL, 'R'},
+    {"checkpoint", required_argument, NULL, 'K'},
+    {"stats", required_argument, NULL, 'I'},
+    {"digests", required_argument, NULL, 'H'},
+    {"digest", required_argument, NULL, 'J'},
+    {"gzip", no_argument, NULL, 'Z'},
+    {"metrics", required_argument, NULL, 'X'},
+    {"resume", no_argument, NULL, 'U'},
+    {"scte35", no_argument, NULL, 'E'},
+    {"archive", required_argument, NULL, 'A'},
+    {"encrypt", no_argument, NULL, 'Y'},
+    {"key-rotation", required_argument, NULL, 'G'},
+    {"thumbnails", required_argument, NULL, 'V'},
+    {"thumbnail-interval", required_argument, NULL, 'W'},
+    {"thumbnail-size", required_argument, NULL, 'D'},
+    {"thumbnail-workers", required_argument, NULL, 'Q'},
+    {"thumbnail-queue", required_argument, NULL, 'e'},
+    {"thumbnail-drop", required_argument, NULL, 'd'},
+    {"udp-buffer", required_argument, NULL, 'b'},
+    {"jitter", required_argument, NULL, 'j'},
+    {"jitter-latency", required_argument, NULL, 'l'},
+    {"udp-timeout", required_argument, NULL, 'u'},
+    {"readahead", required_argument, NULL, 'r'},
+    {"interleave-delta", required_argument, NULL, 'i'},
+    {"interleave-bytes", required_argument, NULL, 'k'},
+    {"interleave-flush", required_argument, NULL, 'f'},
+    {NULL, 0, NULL, 0}
+};
 
-        // Check if we reached the last node, then we should go back one step for substraction.
-        differnce = link->next ? (link->next->id - link->id) : (cuePoints->length > 1 ? (link->id - link->prev->id) : link->id);
-    }
-    return returnList;
+/**
+ * Used to print the usage, and exit.
+ *
+ * @param const char *program the program name.
+ */
+static void usage(const char *program) {
+    fprintf(stderr, "Usage: %s [options] <input MPEG-TS file> <segment duration in seconds> <[cue points comma seperated], use [] to skip input> <output MPEG-TS file prefix> <output m3u8 index file> <http prefix> [<segment window size>]\n"
+            "       %s --supervisor=<channels file> [supervisor options]\n"
+            "Options:\n"
+            "  --probesize=<bytes>              maximum bytes read while probing the input streams\n"
+            "  --analyzeduration=<microseconds> maximum input duration analyzed while probing\n"
+            "  --stream-info=<file>             stream parameters cache, probing is skipped when it matches the input,\n"
+            "                                   otherwise it is written after probing\n"
+            "  --memory-budget=<bytes>          bytes a channel may hold for probing, input buffering and interleaving\n"
+            "  --max-bytes=<bytes>              cut segments on the next key frame once they are this large\n"
+            "  --part-duration=<seconds>        low latency HLS, publish partial segments of this duration\n"
+            "  --origin=<port>                  serve the playlist and segments over HTTP, with blocking playlist reloads\n"
+            "  --memory-ring                    keep the segments window and the playlist in memory, served by the origin,\n"
+            "                                   instead of writing them to disk\n"
+            "  --file-pool                      reuse a fixed pool of segment files in rotation, instead of creating\n"
+            "                                   and removing one file per segment\n"
+            "  --control=<fifo>                 read cue point commands while running: \"at <ms>\", \"pts <90 kHz ticks>\"\n"
+            "                                   or \"in <ms>\" from now, one per line\n"
+            "  --cues=<file>                    stream the cue points from a file, \"-\" for the standard input, instead of\n"
+            "                                   the cue points argument, which must be []; one time in seconds per line,\n"
+            "                                   with up to 3 decimals, or the binary format described in the README\n"
+            "  --manifest=<file>                write the segments manifest, the cuts and digests of the segments\n"
+            "  --reuse=<file>                   with --manifest, keep the segments of this previous manifest whose cuts\n"
+            "                                   are unchanged, instead of writing them again\n"
+            "  --checkpoint=<file>              save the session state to this file after each segment\n"
+            "  --resume                         with --checkpoint, continue the numbering and the playlist from it\n"
+            "  --stats=<file>                   append the statistics of each segment to this file, as JSON lines\n"
+            "  --digests=<file>                 append the size, digest and ETag of each segment to this file, as JSON lines\n"
+            "  --digest=<sha256|xxh64>          the digest written to the digests file, sha256 by default\n"
+            "  --gzip                           publish the playlist gzipped next to it, as <m3u8 index file>.gz, compressed\n"
+            "                                   incrementally while it only grows\n"
+            "  --metrics=<file>                 export the hot path latencies, throughput and queue depths to this file,\n"
+            "                                   in the Prometheus text format, also served by the origin on /metrics;\n"
+            "                                   on the supervisor command line, the metrics of every channel\n"
+            "  --scte35                         cut segments on the SCTE-35 splice_insert and time_signal commands of the input\n"
+            "  --archive=<file>                 with a segment window size, keep the segments leaving the window, and append\n"
+            "                                   them to this playlist, for DVR\n"
+            "  --encrypt                        encrypt the segments with AES-128 as they are written, the keys are written\n"
+            "                                   next to them, and listed in the playlist\n"
+            "  --key-rotation=<segments>        with --encrypt, change the key every this many segments\n"
+            "  --thumbnails=<prefix>            tile key frames into JPEG sprite sheets, <prefix>-<n>.jpg, listed by the\n"
+            "                                   WebVTT thumbnails track <prefix>.vtt, on worker threads\n"
+            "  --thumbnail-interval=<count>     with --thumbnails, one thumbnail every this many key frames, instead of\n"
+            "                                   one at the start of each segment\n"
+            "  --thumbnail-size=<W>x<H>         with --thumbnails, the size of each tile, defaults to %dx%d\n"
+            "  --thumbnail-workers=<count>      with --thumbnails, the decoding threads, defaults to %d\n"
+            "  --thumbnail-queue=<count>        with --thumbnails, the key frames waiting for a worker, defaults to %d\n"
+            "  --thumbnail-drop=<newest|oldest> with --thumbnails, the key frame dropped when the queue is full,\n"
+            "                                   newest by default\n"
+            "  --readahead=<bytes>              with the standard input, the ring it is read ahead into by its own thread,\n"
+            "                                   so stalls of either side are absorbed, defaults to %d, 0 to read it directly\n"
+            "  --udp-buffer=<bytes>             with a udp://[@]<host>:<port> or rtp://[@]<host>:<port> input, the socket\n"
+            "                                   receive buffer, defaults to %d\n"
+            "  --jitter=<datagrams>             with an rtp:// input, the datagrams put back in order, defaults to %d\n"
+            "  --jitter-latency=<ms>            with an rtp:// input, the longest wait for a missing datagram, defaults to %d\n"
+            "  --udp-timeout=<seconds>          with a udp:// or rtp:// input, end after this long without datagrams,\n"
+            "                                   instead of waiting forever\n"
+            "  --interleave-delta=<ms>          the widest span of timestamps queued to interleave the streams, packets\n"
+            "                                   are written before their turn past it, defaults to %d\n"
+            "  --interleave-bytes=<bytes>       the arena packets are queued in to interleave the streams, allocated up\n"
+            "                                   front, packets are written before their turn when it is full, defaults to %d\n"
+            "  --interleave-flush=<lowest|all>  how packets are written before their turn, the lowest timestamp until the\n"
+            "                                   queue is within its budgets, or the whole queue, lowest by default\n"
+            "Supervisor options:\n"
+            "  --supervisor=<channels file>     host every channel of the file in this process, one channel per line:\n"
+            "                                   <name> [options] <positional arguments>\n"
+            "  --workers=<count>                worker threads shared by the channels, defaults to the processors count\n"
+            "  --quantum=<bytes>                input bytes a channel consumes per turn, defaults to %d\n"
+            "  --status=<file>                  file rewritten every second with the counters of each channel\n", program, program,
+            SESSION_THUMBNAIL_WIDTH, SESSION_THUMBNAIL_HEIGHT, SESSION_THUMBNAIL_WORKERS, SESSION_THUMBNAIL_QUEUE, SESSION_READAHEAD_SIZE,
+            UDP_INPUT_DEFAULT_BUFFER, UDP_INPUT_DEFAULT_DEPTH, UDP_INPUT_DEFAULT_LATENCY, INTERLEAVER_DEFAULT_DELTA,
+            INTERLEAVER_DEFAULT_BYTES, SUPERVISOR_DEFAULT_QUANTUM);
+    exit(1);
 }
 
 static AVStream *add_output_stream(AVFormatContext *output_format_context, AVStream *input_stream) {
@@ -134,7 +269,7 @@ static AVStream *add_output_stream(AVFormatContext *output_format_context, AVStr
     output_stream = av_new_stream(output_format_context, 0);
     if (!output_stream) {
         fprintf(stderr, "Could not allocate stream\n");
-        exit(1);
+        return NULL;
     }
 
     input_codec_context = input_stream->codec;
@@ -183,511 +318,3728 @@ static AVStream *add_output_stream(AVFormatContext *output_format_context, AVStr
     return output_stream;
 }
 
-int write_index_file(const char index[], const char tmp_index[], const unsigned int segment_duration, const char output_prefix[], const char http_prefix[], const unsigned int first_segment, const unsigned int last_segment, const int end, const int window) {
-    FILE *index_fp;
-    char *write_buf;
-    unsigned int segmentsIndex = 0, i;
+/**
+ * Used to start a file over in a memory stream kept open from one rewrite to
+ * the next, so its buffer is reused, and only grows past its largest content.
+ *
+ * @param FILE **fp the stream, opened on first use.
+ * @param char **buffer the stream buffer.
+ * @param size_t *size the stream size.
+ * @return FILE * the stream, NULL on allocation failure.
+ */
+static FILE *rewind_stream(FILE **fp, char **buffer, size_t *size) {
+    if (*fp) {
+        rewind(*fp);
+    } else {
+        *fp = open_memstream(buffer, size);
+    }
 
-    index_fp = fopen(tmp_index, "w");
-    if (!index_fp) {
-        fprintf(stderr, "Could not open temporary m3u8 index file (%s), no index file will be created\n", tmp_index);
-        return -1;
+    return *fp;
+}
+
+/**
+ * Used to write a whole buffer at an offset of a file, whatever the writes it takes.
+ *
+ * @param int fd the file.
+ * @param const char *data the buffer.
+ * @param size_t size the buffer size.
+ * @param off_t offset where the buffer is written.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int write_at(int fd, const char *data, size_t size, off_t offset) {
+    ssize_t written;
+
+    for (; size; data += written, size -= written, offset += written) {
+        written = pwrite(fd, data, size, offset);
+        if (written < 0 && errno == EINTR) {
+            written = 0;
+        } else if (written <= 0) {
+            return -1;
+        }
     }
 
-    write_buf = malloc(sizeof (char) * 1024);
-    if (!write_buf) {
-        fprintf(stderr, "Could not allocate write buffer for index file, index file will be invalid\n");
-        fclose(index_fp);
+    return 0;
+}
+
+/**
+ * Used to replace a file with the content of a buffer, written aside then
+ * renamed over it, so readers get one or the other.
+ *
+ * @param const char *tmpPath the temporary file.
+ * @param const char *path the file.
+ * @param const char *data the buffer.
+ * @param size_t size the buffer size.
+ * @param int sync whether the content reaches the disk before the rename.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int publish_file(const char *tmpPath, const char *path, const char *data, size_t size, int sync) {
+    int fd, ret;
+
+    fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
         return -1;
     }
 
-    if (window) {
-        snprintf(write_buf, 1024, "#EXTM3U\n#EXT-X-TARGETDURATION:%u\n#EXT-X-MEDIA-SEQUENCE:%u\n", segment_duration, first_segment);
-    } else {
-        snprintf(write_buf, 1024, "#EXTM3U\n#EXT-X-TARGETDURATION:%u\n", segment_duration);
+    ret = write_at(fd, data, size, 0);
+    if (!ret && sync && fdatasync(fd) < 0) {
+        ret = -1;
     }
-    if (fwrite(write_buf, strlen(write_buf), 1, index_fp) != 1) {
-        fprintf(stderr, "Could not write to m3u8 index file, will not continue writing to index file\n");
-        free(write_buf);
-        fclose(index_fp);
+    if (close(fd) < 0 || ret < 0 || rename(tmpPath, path) < 0) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to replace a file with the content of a memory stream, written aside
+ * then renamed over it, so readers get one or the other.
+ *
+ * @param const char *tmpPath the temporary file.
+ * @param const char *path the file.
+ * @param FILE *fp the stream.
+ * @param char *const *buffer the stream buffer, read once the stream is flushed.
+ * @param const size_t *size the stream size.
+ * @param int sync whether the content reaches the disk before the rename.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int write_file(const char *tmpPath, const char *path, FILE *fp, char *const *buffer, const size_t *size, int sync) {
+    if (fflush(fp) || ferror(fp)) {
         return -1;
     }
 
-    // Modified by Ahmed Kamal.
-    if (considerCuePoints && segments->length > 0) {
+    return publish_file(tmpPath, path, *buffer, *size, sync);
+}
 
-        NODE *traverseNode = segments->head, *cuePointTime = cuePoints->head;
+/**
+ * Used to write the partial segments of a segment, while they are recent
+ * enough to be kept in the low latency playlist.
+ *
+ * @param SESSION *session the session.
+ * @param FILE *index_fp the index file.
+ * @param char *write_buf the write buffer.
+ * @param unsigned int sequence the segment sequence number.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int write_parts(SESSION *session, FILE *index_fp, char *write_buf, const unsigned int sequence) {
+    PART_SEGMENT *segment = &session->partSegments[sequence % SESSION_PART_SEGMENTS];
+    PART *part;
+    int i;
 
-        unsigned int totalDuration = 0;
+    if (!session->options.partDuration || segment->sequence != sequence) {
+        return 0;
+    }
 
-        while (traverseNode != NULL) /* continue whilst there are nodes left */ {
-            ++segmentsIndex;
+    for (i = 0; i < segment->count; i++) {
+        part = &segment->parts[i];
 
-            snprintf(write_buf, 1024, "#EXTINF:%d,\n%s%s-%u.ts\n", (int) traverseNode->id, http_prefix, output_prefix, segmentsIndex);
+        snprintf(write_buf, 1024, "#EXT-X-PART:DURATION=%.5f,URI=\"%s%s-%u.ts\",BYTERANGE=\"%lld@%lld\"%s\n",
+                part->duration, session->options.httpPrefix, session->options.outputPrefix, sequence,
+                part->size, part->offset, part->independent ? ",INDEPENDENT=YES" : "");
+        if (fwrite(write_buf, strlen(write_buf), 1, index_fp) != 1) {
+            return -1;
+        }
+    }
 
-            /* print out the current node           */
-            if (fwrite(write_buf, strlen(write_buf), 1, index_fp) != 1) {
-                fprintf(stderr, "Could not write to m3u8 index file, will not continue writing to index file\n");
-                free(write_buf);
-                fclose(index_fp);
-                return -1;
-            }
+    return 0;
+}
 
-            // Adding place holder to the file.
-            totalDuration += traverseNode->id;
-            if (totalDuration == cuePointTime->id) {
+/**
+ * Used to format the wall clock date of an output time, as ISO 8601 with milliseconds.
+ *
+ * @param SESSION *session the session.
+ * @param double time the output time, in milliseconds.
+ * @param char *date receives the date, 32 bytes at least.
+ */
+static void format_date(SESSION *session, double time, char *date) {
+    double milliseconds = session->wallClockOrigin + time;
+    time_t seconds = (time_t) (milliseconds / 1000);
+    struct tm tm;
+    size_t length;
+
+    gmtime_r(&seconds, &tm);
+    length = strftime(date, 32, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(date + length, 32 - length, ".%03dZ", (int) (milliseconds - seconds * 1000.0));
+}
 
-                snprintf(write_buf, 1024, "#Ad-Place-Holder\n");
-                 /* print out the current node           */
-                if (fwrite(write_buf, strlen(write_buf), 1, index_fp) != 1) {
-                    fprintf(stderr, "Could not write place holders to m3u8 index file, will not continue writing to index file\n");
-                    free(write_buf);
-                    fclose(index_fp);
-                    return -1;
-                }
+/**
+ * Used to get the key a segment is encrypted with.
+ *
+ * @param SESSION *session the session.
+ * @param unsigned int sequence the segment sequence number.
+ * @return unsigned int the key index.
+ */
+static unsigned int key_index(SESSION *session, unsigned int sequence) {
+    return session->options.keyRotation ? (sequence - 1) / session->options.keyRotation : 0;
+}
 
-                if (cuePointTime->next != NULL) {
-                    cuePointTime = cuePointTime->next;
-                }
-            }
+/**
+ * Used to name the file of a key, after the output prefix already in the filename.
+ *
+ * @param SESSION *session the session.
+ * @param unsigned int index the key index.
+ */
+static void key_filename(SESSION *session, unsigned int index) {
+    snprintf(session->key_filename + session->prefixLength, 20, "-%u.key", index);
+}
+
+/**
+ * Used to load the key of a segment, from its file when a previous run wrote
+ * it, or drawn from /dev/urandom and written before any playlist lists it.
+ *
+ * @param SESSION *session the session.
+ * @param unsigned int sequence the segment sequence number.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int load_key(SESSION *session, unsigned int sequence) {
+    unsigned int index = key_index(session, sequence);
+    ssize_t got;
+    int fd;
 
-            traverseNode = traverseNode->next; /* goto the next node in the list  */
+    if (index == session->keyIndex) {
+        return 0;
+    }
+    session->keyIndex = UINT_MAX;
+    key_filename(session, index);
+
+    fd = open(session->key_filename, O_RDONLY);
+    if (fd >= 0) {
+        got = read(fd, session->key, AES_KEY_SIZE);
+        close(fd);
+        if (got != AES_KEY_SIZE) {
+            return -1;
         }
     } else {
-        for (i = first_segment; i <= last_segment; i++) {
-            snprintf(write_buf, 1024, "#EXTINF:%u,\n%s%s-%u.ts\n", segment_duration, http_prefix, output_prefix, i);
-            if (fwrite(write_buf, strlen(write_buf), 1, index_fp) != 1) {
-                fprintf(stderr, "Could not write to m3u8 index file, will not continue writing to index file\n");
-                free(write_buf);
-                fclose(index_fp);
-                return -1;
-            }
+        fd = open("/dev/urandom", O_RDONLY);
+        if (fd < 0) {
+            return -1;
         }
-    }
+        got = read(fd, session->key, AES_KEY_SIZE);
+        close(fd);
 
-    if (end) {
-        snprintf(write_buf, 1024, "#EXT-X-ENDLIST\n");
-        if (fwrite(write_buf, strlen(write_buf), 1, index_fp) != 1) {
-            fprintf(stderr, "Could not write last file and endlist tag to m3u8 index file\n");
-            free(write_buf);
-            fclose(index_fp);
+        fd = open(session->key_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (got != AES_KEY_SIZE || fd < 0) {
+            if (fd >= 0) {
+                close(fd);
+            }
+            return -1;
+        }
+        got = write_at(fd, (const char *) session->key, AES_KEY_SIZE, 0);
+        if (close(fd) < 0 || got < 0) {
             return -1;
         }
     }
+    session->keyIndex = index;
 
-    free(write_buf);
-    fclose(index_fp);
-
-    return rename(tmp_index, index);
+    return 0;
 }
 
-int main(int argc, char **argv) {
-    const char *input;
-    const char *output_prefix;
-    double segment_duration;
-    char *segment_duration_check;
-    const char *index;
-    char *tmp_index;
-    const char *http_prefix;
-    long max_tsfiles = 0;
-    char *max_tsfiles_check;
-    double prev_segment_time = 0;
-    unsigned int output_index = 1;
-    AVInputFormat *ifmt;
-    AVOutputFormat *ofmt;
-    AVFormatContext *ic = NULL;
-    AVFormatContext *oc;
-    AVStream *video_st;
-    AVStream *audio_st;
-    AVCodec *codec;
-    char *output_filename;
-    char *remove_filename;
-    int video_index;
-    int audio_index;
-    unsigned int first_segment = 1;
-    unsigned int last_segment = 0;
-    int write_index = 1;
-    int decode_done;
-    char *dot;
-    int ret;
-    int i;
-    int remove_file;
-
-    // Added by Ahmed Kamal
-    char *cuePointsInput, *cuePointsIterator;
-    /**
-     * @param int cuePointNumber holds the current value of the segmentation point.
-     */
-    // This value must be a double.
-    double minSegmentDuration = 0;
-    /**
-     * @var cuePointNumber will carry the integer value of the user's input and should be signed, in case of negative values.
-     */
-    int cuePointNumber = 0;
-
-    unsigned int pathLength,
-            segmentsIndex = 0,
-            currentDuration = 0,
-            /**
-             * @var flag used to skip conditional check at segments times.
-             */
-            skipThisTime = 0;
-    /**
-     * @var LIST *cuePointsDiffernces holds the difference between each cue point and its successor.
-     */
-    LIST *cuePointsDiffernces;
-    NODE *cuePoint, *segmentNode;
-
-    // Initialize the global segments list.
-    segments = createList((void *) "Segments", 1, 0);
+/**
+ * Used to write the key line of a segment, when its key is not the one of the
+ * segment before it. Without an IV attribute, the sequence number is the IV.
+ *
+ * @param SESSION *session the session.
+ * @param char *write_buf the write buffer, 1024 bytes.
+ * @param unsigned int sequence the segment sequence number.
+ * @param unsigned int *current the key of the segment before, updated.
+ * @return int the length of the line written, 0 for none.
+ */
+static int key_line(SESSION *session, char *write_buf, unsigned int sequence, unsigned int *current) {
+    unsigned int index = key_index(session, sequence);
 
-    // Modified by Ahmed Kamal
-    if (argc < 6 || argc > 8) {
-        fprintf(stderr, "Usage: %s <input MPEG-TS file> <segment duration in seconds> <[cue points comma seperated], use [] to skip input> <output MPEG-TS file prefix> <output m3u8 index file> <http prefix> [<segment window size>]\n", argv[0]);
-        exit(1);
+    if (!session->options.encrypt || index == *current) {
+        write_buf[0] = '\0';
+        return 0;
     }
+    *current = index;
 
-    av_register_all();
+    return snprintf(write_buf, 1024, "#EXT-X-KEY:METHOD=AES-128,URI=\"%s%s-%u.key\"\n",
+            session->options.httpPrefix, session->options.outputPrefix, index);
+}
 
-    input = argv[1];
-    if (!strcmp(input, "-")) {
-        input = "pipe:";
+int write_index_file(SESSION *session, const unsigned int segment_duration, const unsigned int first_segment, const unsigned int last_segment, const int end) {
+    const char *index = session->options.index,
+            *tmp_index = session->tmp_index,
+            *output_prefix = session->options.outputPrefix,
+            *http_prefix = session->options.httpPrefix;
+    const int window = session->options.maxTsFiles;
+    FILE *index_fp, *breaks_fp = NULL;
+    char write_buf[1024], date[32];
+    HISTORY_ENTRY *entry;
+    NODE *discontinuity = NULL;
+    unsigned int segmentsIndex, i, key = UINT_MAX;
+    long offset;
+    unsigned int target = segment_duration;
+
+    // Never below a listed segment, cuts wait for key frames.
+    if (session->targetDuration > target) {
+        target = session->targetDuration;
     }
-    segment_duration = strtod(argv[2], &segment_duration_check);
-    if (segment_duration_check == argv[2] || segment_duration == HUGE_VAL || segment_duration == -HUGE_VAL) {
-        fprintf(stderr, "Segment duration time (%s) invalid\n", argv[2]);
-        exit(1);
+
+    // Built in memory, then written at once, or copied into the ring as the rename would do.
+    index_fp = rewind_stream(&session->playlistFp, &session->playlistBuffer, &session->playlistSize);
+    if (!index_fp) {
+        fprintf(stderr, "Could not open temporary m3u8 index file (%s), no index file will be created\n", tmp_index);
+        return -1;
     }
-    // Added by Ahmed Kamal
-    cuePointsInput = argv[3];
-    minSegmentDuration = segment_duration;
 
-    // Check if the user wants to skip cue points.
-    if (!findString(cuePointsInput, "[]") > 0) {
-        cuePointsIterator = strtok(replaceString("]", "", replaceString("[", "", cuePointsInput)), ",");
+    // The ad markers positions, so they are found without parsing the playlist.
+    if (session->breaks_filename) {
+        breaks_fp = rewind_stream(&session->breaksFp, &session->breaksBuffer, &session->breaksSize);
+        if (!breaks_fp) {
+            fprintf(stderr, "Could not open temporary breaks index file (%s), no index file will be created\n", session->tmp_breaks);
+            return -1;
+        }
+        fprintf(breaks_fp, "%u\n", session->history.count ? last_segment - session->history.count + 1 : first_segment);
+    }
 
-        cuePoints = createList((void *) "Cue Points", 1, 0);
+    if (session->options.partDuration) {
+        // Low latency playlists are always live, and address segments by their sequence number.
+        snprintf(write_buf, 1024, "#EXTM3U\n#EXT-X-VERSION:6\n#EXT-X-TARGETDURATION:%u\n#EXT-X-PART-INF:PART-TARGET=%.5f\n"
+                "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=%.5f\n#EXT-X-MEDIA-SEQUENCE:%u\n",
+                target, session->options.partDuration, 3 * session->options.partDuration, first_segment);
+    } else if (window || session->options.encrypt) {
+        // Encrypted segments take their IV from their sequence number, which always has to be given.
+        snprintf(write_buf, 1024, "#EXTM3U\n%s#EXT-X-TARGETDURATION:%u\n#EXT-X-MEDIA-SEQUENCE:%u\n",
+                session->options.maxBytes ? "#EXT-X-VERSION:3\n" : "", target, first_segment);
+    } else {
+        // Size capped segments are listed with fractional durations, which need version 3.
+        snprintf(write_buf, 1024, "#EXTM3U\n%s#EXT-X-TARGETDURATION:%u\n", session->options.maxBytes ? "#EXT-X-VERSION:3\n" : "", target);
+    }
+    if (fwrite(write_buf, strlen(write_buf), 1, index_fp) != 1) {
+        fprintf(stderr, "Could not write to m3u8 index file, will not continue writing to index file\n");
+        return -1;
+    }
 
-        while (cuePointsIterator != NULL) {
-            // Converting a string to an integer value
-            cuePointNumber = atoi(cuePointsIterator);
+    // Restarts that left the window are counted, the others are marked on the segment following them.
+    if (session->discontinuities) {
+        while (session->discontinuities->head && session->discontinuities->head->id < first_segment) {
+            removeNode(session->discontinuities, session->discontinuities->head);
+            ++session->discontinuitySequence;
+        }
+        discontinuity = session->discontinuities->head;
 
-            if (cuePointNumber == HUGE_VAL || cuePointNumber == -HUGE_VAL) {
+        if (session->discontinuitySequence && fprintf(index_fp, "#EXT-X-DISCONTINUITY-SEQUENCE:%u\n", session->discontinuitySequence) < 0) {
+            fprintf(stderr, "Could not write to m3u8 index file, will not continue writing to index file\n");
+            return -1;
+        }
+    }
 
-                fprintf(stderr, "{\"error\" : \"Invalid cue points time %s, please check value (%i)\"}", cuePointsInput, cuePointNumber);
-                exit(EXIT_FAILURE);
-            } else if (cuePointNumber < 0) {
+    // Segments cut on cue points are listed with their own durations.
+    if (session->considerCuePoints && session->history.count > 0) {
+        // The history holds the segments of the window, the last one being last_segment.
+        segmentsIndex = last_segment - session->history.count;
 
-                fprintf(stderr, "{\"error\" : \"Invalid cue points value %s, cue point value must be positive, please check value (%i)\"}", cuePointsInput, cuePointNumber);
-                exit(EXIT_FAILURE);
-            } else if (cuePointNumber && listFindById(cuePoints, cuePointNumber) != NULL) {
+        // Dates the window, which the ad markers dates are relative to.
+        format_date(session, session->windowStart * 1000, date);
+        snprintf(write_buf, 1024, "#EXT-X-PROGRAM-DATE-TIME:%s\n", date);
+        if (fwrite(write_buf, strlen(write_buf), 1, index_fp) != 1) {
+            fprintf(stderr, "Could not write to m3u8 index file, will not continue writing to index file\n");
+            return -1;
+        }
 
-                fprintf(stderr, "{\"error\" : \"Duplicate value for cue points %s, check the value (%i)\"}", cuePointsInput, cuePointNumber);
-                exit(EXIT_FAILURE);
+        for (i = 0; (entry = historyAt(&session->history, i)); i++) {
+            ++segmentsIndex;
 
-            } else if (cuePointNumber) {
+            if (discontinuity && discontinuity->id == segmentsIndex) {
+                fputs("#EXT-X-DISCONTINUITY\n", index_fp);
+                discontinuity = discontinuity->next;
+            }
 
-                // Appending node to the list.
-                cuePoint = createNode(cuePointNumber, NULL);
+            if (write_parts(session, index_fp, write_buf, segmentsIndex) < 0
+                    || (key_line(session, write_buf, segmentsIndex, &key) && fputs(write_buf, index_fp) < 0)) {
+                fprintf(stderr, "Could not write to m3u8 index file, will not continue writing to index file\n");
+                return -1;
+            }
 
-                append(cuePoints, cuePoint);
+            // Low latency segments are listed as long as their parts add up to, size capped ones may be well under a second.
+            if (session->options.partDuration || session->options.maxBytes) {
+                snprintf(write_buf, 1024, "#EXTINF:%.3f,\n%s%s-%u.ts\n", entry->duration / 1000.0, http_prefix, output_prefix, segmentsIndex);
+            } else {
+                snprintf(write_buf, 1024, "#EXTINF:%d,\n%s%s-%u.ts\n", (int) ((entry->duration + 500) / 1000), http_prefix, output_prefix, segmentsIndex);
             }
-            // Pointing to the next "token".
-            cuePointsIterator = strtok(NULL, ",");
-        }
 
-        // Sorting the cue points order, to have correct segments calculation.
-        sortById(cuePoints, ASC);
+            /* print out the current node           */
+            if (fwrite(write_buf, strlen(write_buf), 1, index_fp) != 1) {
+                fprintf(stderr, "Could not write to m3u8 index file, will not continue writing to index file\n");
+                return -1;
+            }
 
-        cuePointsDiffernces = buildDifferences(cuePoints, (int) segment_duration);
+            // Adding the ad markers, precomputed when the segment was cut, after the segments ending on a cue point.
+            if (entry->marked) {
+                offset = ftell(index_fp);
 
-        if (cuePointsDiffernces != NULL && cuePointsDiffernces->length > 0) {
+                if (fwrite(entry->markers, strlen(entry->markers), 1, index_fp) != 1
+                        || (breaks_fp && fprintf(breaks_fp, "%u %ld %zu\n", segmentsIndex, offset, strlen(entry->markers)) < 0)) {
+                    fprintf(stderr, "Could not write ad markers to m3u8 index file, will not continue writing to index file\n");
+                    return -1;
+                }
+            }
+        }
+    } else {
+        for (i = first_segment; i <= last_segment; i++) {
+            if (discontinuity && discontinuity->id == i) {
+                fputs("#EXT-X-DISCONTINUITY\n", index_fp);
+                discontinuity = discontinuity->next;
+            }
 
-            currentDuration = cuePointsDiffernces->head->id;
+            if (write_parts(session, index_fp, write_buf, i) < 0
+                    || (key_line(session, write_buf, i, &key) && fputs(write_buf, index_fp) < 0)) {
+                fprintf(stderr, "Could not write to m3u8 index file, will not continue writing to index file\n");
+                return -1;
+            }
 
-            // Enable cue points processing.
-            considerCuePoints = 1;
-        } else {
-            fprintf(stderr, "{\"error\" : \"Can not build differences list.\"}");
-            exit(EXIT_FAILURE);
+            snprintf(write_buf, 1024, "#EXTINF:%u,\n%s%s-%u.ts\n", segment_duration, http_prefix, output_prefix, i);
+            if (fwrite(write_buf, strlen(write_buf), 1, index_fp) != 1) {
+                fprintf(stderr, "Could not write to m3u8 index file, will not continue writing to index file\n");
+                return -1;
+            }
         }
     }
 
-    // Modified by Ahmed Kamal
-    output_prefix = argv[4];
-    index = argv[5];
-
-    // Added by Ahmed Kamal
-    char path[PATH_MAX];
-    // Checking output prefix path length.
-    pathLength = snprintf (path, PATH_MAX, "%s", output_prefix);
-    if(pathLength > PATH_MAX){
-        fprintf(stderr, "{\"error\" : \"Current output prefix length (%i) is larger than the allowed path maximum length (%i).\"}", pathLength, PATH_MAX);
-        exit(EXIT_FAILURE);
-    }
+    // The parts of the segment being written, and a hint of the next one.
+    if (session->options.partDuration && !end && session->output_index - 1 > last_segment) {
+        if (discontinuity && discontinuity->id == session->output_index - 1) {
+            fputs("#EXT-X-DISCONTINUITY\n", index_fp);
+        }
 
-    // Checking index prefix path length.
-    pathLength = snprintf (path, PATH_MAX, "%s", index) > PATH_MAX;
-    if(pathLength > PATH_MAX){
-        fprintf(stderr, "{\"error\" : \"Current index prefix length (%i) is larger than the allowed path maximum length (%i).\"}", pathLength, PATH_MAX);
-        exit(EXIT_FAILURE);
-    }
+        if (write_parts(session, index_fp, write_buf, session->output_index - 1) < 0) {
+            fprintf(stderr, "Could not write to m3u8 index file, will not continue writing to index file\n");
+            return -1;
+        }
 
-    http_prefix = argv[6];
-    if (argc == 8) {
-        max_tsfiles = strtol(argv[7], &max_tsfiles_check, 10);
-        if (max_tsfiles_check == argv[7] || max_tsfiles < 0 || max_tsfiles >= INT_MAX) {
-            fprintf(stderr, "Maximum number of ts files (%s) invalid\n", argv[7]);
-            exit(1);
+        snprintf(write_buf, 1024, "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%s%s-%u.ts\",BYTERANGE-START=%lld\n",
+                http_prefix, output_prefix, session->output_index - 1, session->partStartOffset);
+        if (fwrite(write_buf, strlen(write_buf), 1, index_fp) != 1) {
+            fprintf(stderr, "Could not write to m3u8 index file, will not continue writing to index file\n");
+            return -1;
         }
     }
 
-    remove_filename = malloc(sizeof (char) * (strlen(output_prefix) + 15));
-    if (!remove_filename) {
-        fprintf(stderr, "Could not allocate space for remove filenames\n");
-        exit(1);
+    if (end) {
+        snprintf(write_buf, 1024, "#EXT-X-ENDLIST\n");
+        if (fwrite(write_buf, strlen(write_buf), 1, index_fp) != 1) {
+            fprintf(stderr, "Could not write last file and endlist tag to m3u8 index file\n");
+            return -1;
+        }
     }
 
-    output_filename = malloc(sizeof (char) * (strlen(output_prefix) + 15));
-    if (!output_filename) {
-        fprintf(stderr, "Could not allocate space for output filenames\n");
-        exit(1);
+    if (session->ring) {
+        return fflush(index_fp) || ferror(index_fp) ? -1 : ringPublishPlaylist(session->ring, session->playlistBuffer, session->playlistSize);
     }
 
-    tmp_index = malloc(strlen(index) + 2);
-    if (!tmp_index) {
-        fprintf(stderr, "Could not allocate space for temporary index filename\n");
-        exit(1);
+    if (write_file(tmp_index, index, index_fp, &session->playlistBuffer, &session->playlistSize, 0) < 0) {
+        return -1;
     }
 
-    strncpy(tmp_index, index, strlen(index) + 2);
-    dot = strrchr(tmp_index, '/');
-    dot = dot ? dot + 1 : tmp_index;
-    for (i = strlen(tmp_index) + 1; i > dot - tmp_index; i--) {
-        tmp_index[i] = tmp_index[i - 1];
+    // Published after the playlist, from the same version.
+    if (session->gzip && (gzipPlaylistUpdate(session->gzip, session->playlistBuffer, session->playlistSize) < 0
+            || publish_file(session->tmp_gzip, session->gzip_filename, (const char *) session->gzip->data, session->gzip->published, 0) < 0)) {
+        fprintf(stderr, "Could not write gzipped index file (%s)\n", session->gzip_filename);
+        return -1;
     }
-    *dot = '.';
 
-    ifmt = av_find_input_format("mpegts");
-    if (!ifmt) {
-        fprintf(stderr, "Could not find MPEG-TS demuxer\n");
-        exit(1);
+    // Published after the playlist, readers tell a stale one by its first media sequence.
+    if (breaks_fp && write_file(session->tmp_breaks, session->breaks_filename, breaks_fp, &session->breaksBuffer, &session->breaksSize, 0) < 0) {
+        fprintf(stderr, "Could not write breaks index file (%s)\n", session->breaks_filename);
+        return -1;
     }
 
-    ret = av_open_input_file(&ic, input, ifmt, 0, NULL);
-    if (ret != 0) {
-        fprintf(stderr, "Could not open input file, make sure it is an mpegts file: %d\n", ret);
-        exit(1);
-    }
+    return 0;
+}
 
-    if (av_find_stream_info(ic) < 0) {
-        fprintf(stderr, "Could not read stream information\n");
-        exit(1);
-    }
+/**
+ * Used to tell whether an input is read by the UDP and RTP input, instead of libavformat.
+ *
+ * @param const char *input the input.
+ * @return int 1 when it is, 0 otherwise.
+ */
+static int is_udp_input(const char *input) {
+    return !strncmp(input, "udp://", 6) || !strncmp(input, "rtp://", 6);
+}
+
+/**
+ * Used to parse the options and positional arguments of a session.
+ *
+ * @param int argc the arguments count.
+ * @param char **argv the arguments, argv[0] is the program or channel name.
+ * @param SESSION_OPTIONS *options receives the session options.
+ * @param SUPERVISOR_OPTIONS *supervisor receives the supervisor options, NULL when they are not allowed.
+ * @return int 0 on success, -1 on invalid arguments.
+ */
+int parseSessionArguments(int argc, char **argv, SESSION_OPTIONS *options, SUPERVISOR_OPTIONS *supervisor) {
+    char *option_check;
+    int opt;
+
+    memset(options, 0, sizeof (SESSION_OPTIONS));
+    options->name = argv[0];
+    options->analyzeduration = -1;
+    options->readahead = -1;
+
+    // Reinitialize the scanning, as it is done once per channel in supervisor mode.
+    optind = 0;
+
+    while ((opt = getopt_long(argc, argv, "", longOptions, NULL)) != -1) {
+        switch (opt) {
+            case 'p':
+                options->probesize = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || options->probesize < 32 || options->probesize >= INT_MAX) {
+                    fprintf(stderr, "Probe size (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'a':
+                options->analyzeduration = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || options->analyzeduration < 0 || options->analyzeduration >= INT_MAX) {
+                    fprintf(stderr, "Analyze duration (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 's':
+                options->streamInfoPath = optarg;
+                break;
+            case 'm':
+                options->memoryBudget = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || options->memoryBudget < 0) {
+                    fprintf(stderr, "Memory budget (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'B':
+                options->maxBytes = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || options->maxBytes < 188) {
+                    fprintf(stderr, "Maximum segment size (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'P':
+                options->partDuration = strtod(optarg, &option_check);
+                if (option_check == optarg || *option_check || options->partDuration < 0.05) {
+                    fprintf(stderr, "Part duration (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'O':
+                options->originPort = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || options->originPort < 1 || options->originPort > 65535) {
+                    fprintf(stderr, "Origin port (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'M':
+                options->memoryRing = 1;
+                break;
+            case 'F':
+                options->filePool = 1;
+                break;
+            case 'C':
+                options->controlPath = optarg;
+                break;
+            case 'E':
+                options->scte35 = 1;
+                break;
+            case 'A':
+                options->archivePath = optarg;
+                break;
+            case 'Y':
+                options->encrypt = 1;
+                break;
+            case 'Z':
+                options->gzip = 1;
+                break;
+            case 'G':
+                options->keyRotation = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || options->keyRotation < 1 || options->keyRotation >= INT_MAX) {
+                    fprintf(stderr, "Key rotation (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'V':
+                options->thumbnailsPrefix = optarg;
+                break;
+            case 'W':
+                options->thumbnailInterval = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || options->thumbnailInterval < 1) {
+                    fprintf(stderr, "Thumbnail interval (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'D':
+                options->thumbnailWidth = strtol(optarg, &option_check, 10);
+                if (option_check != optarg && *option_check == 'x') {
+                    optarg = option_check + 1;
+                    options->thumbnailHeight = strtol(optarg, &option_check, 10);
+                }
+                if (option_check == optarg || *option_check || options->thumbnailWidth < 16 || options->thumbnailWidth > 1920
+                        || options->thumbnailHeight < 16 || options->thumbnailHeight > 1080) {
+                    fprintf(stderr, "Thumbnail size (%s) invalid, <width>x<height>\n", argv[optind - 1]);
+                    return -1;
+                }
+                break;
+            case 'Q':
+                options->thumbnailWorkers = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || options->thumbnailWorkers < 1 || options->thumbnailWorkers > THUMBNAILS_MAX_WORKERS) {
+                    fprintf(stderr, "Thumbnail workers count (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'e':
+                options->thumbnailQueue = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || options->thumbnailQueue < 1 || options->thumbnailQueue > 1024) {
+                    fprintf(stderr, "Thumbnail queue size (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'd':
+                if (strcmp(optarg, "newest") && strcmp(optarg, "oldest")) {
+                    fprintf(stderr, "Thumbnail drop policy (%s) invalid, newest or oldest\n", optarg);
+                    return -1;
+                }
+                options->thumbnailDrop = !strcmp(optarg, "newest") ? THUMBNAILS_DROP_NEWEST : THUMBNAILS_DROP_OLDEST;
+                break;
+            case 'r':
+                options->readahead = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || (options->readahead && options->readahead < 65536) || options->readahead >= INT_MAX) {
+                    fprintf(stderr, "Readahead size (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'i':
+                options->interleaveDelta = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || options->interleaveDelta < 1 || options->interleaveDelta > 600000) {
+                    fprintf(stderr, "Interleave delta (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'k':
+                options->interleaveBytes = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || options->interleaveBytes < INTERLEAVER_MIN_BYTES || options->interleaveBytes >= INT_MAX) {
+                    fprintf(stderr, "Interleave bytes (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'f':
+                if (strcmp(optarg, "lowest") && strcmp(optarg, "all")) {
+                    fprintf(stderr, "Interleave flush policy (%s) invalid, lowest or all\n", optarg);
+                    return -1;
+                }
+                options->interleaveFlush = !strcmp(optarg, "lowest") ? INTERLEAVER_FLUSH_LOWEST : INTERLEAVER_FLUSH_ALL;
+                break;
+            case 'b':
+                options->udpBuffer = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || options->udpBuffer < 65536) {
+                    fprintf(stderr, "UDP receive buffer (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'j':
+                options->jitterDepth = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || options->jitterDepth < 1 || options->jitterDepth >= UDP_INPUT_RESYNC) {
+                    fprintf(stderr, "Jitter buffer depth (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'l':
+                options->jitterLatency = strtol(optarg, &option_check, 10);
+                if (option_check == optarg || *option_check || options->jitterLatency < 1 || options->jitterLatency > 10000) {
+                    fprintf(stderr, "Jitter latency (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'u':
+                options->udpTimeout = strtod(optarg, &option_check);
+                if (option_check == optarg || *option_check || options->udpTimeout <= 0) {
+                    fprintf(stderr, "UDP timeout (%s) invalid\n", optarg);
+                    return -1;
+                }
+                break;
+            case 'L':
+                options->cuesPath = optarg;
+                break;
+            case 'N':
+                options->manifestPath = optarg;
+                break;
+            case 'R':
+                options->reusePath = optarg;
+                break;
+            case 'K':
+                options->checkpointPath = optarg;
+                break;
+            case 'U':
+                options->resume = 1;
+                break;
+            case 'I':
+                options->statsPath = optarg;
+                break;
+            case 'H':
+                options->digestsPath = optarg;
+                break;
+            case 'J':
+                if (strcmp(optarg, "sha256") && strcmp(optarg, "xxh64")) {
+                    fprintf(stderr, "Digest (%s) invalid, sha256 or xxh64\n", optarg);
+                    return -1;
+                }
+                options->digestAlgorithm = !strcmp(optarg, "sha256") ? "sha256" : "xxh64";
+                break;
+            case 'X':
+                options->metricsPath = optarg;
+                break;
+            case 'S':
+            case 'w':
+            case 'q':
+            case 'T':
+                if (!supervisor) {
+                    fprintf(stderr, "Option (%s) is only allowed on the command line\n", argv[optind - 1]);
+                    return -1;
+                }
+                if (opt == 'S') {
+                    supervisor->channelsPath = optarg;
+                } else if (opt == 'T') {
+                    supervisor->statusPath = optarg;
+                } else if (opt == 'w') {
+                    supervisor->workers = strtol(optarg, &option_check, 10);
+                    if (option_check == optarg || *option_check || supervisor->workers < 1 || supervisor->workers > SUPERVISOR_MAX_WORKERS) {
+                        fprintf(stderr, "Workers count (%s) invalid\n", optarg);
+                        return -1;
+                    }
+                } else {
+                    supervisor->quantum = strtol(optarg, &option_check, 10);
+                    if (option_check == optarg || *option_check || supervisor->quantum < 188) {
+                        fprintf(stderr, "Scheduling quantum (%s) invalid\n", optarg);
+                        return -1;
+                    }
+                }
+                break;
+            default:
+                return -1;
+        }
+    }
+
+    // A supervisor takes its channels from the configuration, instead of the positional arguments.
+    if (supervisor && supervisor->channelsPath) {
+        if (optind != argc) {
+            fprintf(stderr, "Positional arguments are not allowed in supervisor mode\n");
+            return -1;
+        }
+        return 0;
+    }
+
+    // Shift the positional arguments, so they keep their original indexes.
+    argv[optind - 1] = argv[0];
+    argv += optind - 1;
+    argc -= optind - 1;
+
+    if (argc < 7 || argc > 8) {
+        fprintf(stderr, "Wrong number of arguments for (%s)\n", options->name);
+        return -1;
+    }
+
+    options->input = argv[1];
+    if (!strcmp(options->input, "-")) {
+        options->input = "pipe:";
+    }
+    options->segmentDuration = strtod(argv[2], &option_check);
+    if (option_check == argv[2] || options->segmentDuration == HUGE_VAL || options->segmentDuration == -HUGE_VAL) {
+        fprintf(stderr, "Segment duration time (%s) invalid\n", argv[2]);
+        return -1;
+    }
+
+    options->cuePointsInput = argv[3];
+    options->outputPrefix = argv[4];
+    options->index = argv[5];
+    options->httpPrefix = argv[6];
+
+    if (argc == 8) {
+        options->maxTsFiles = strtol(argv[7], &option_check, 10);
+        if (option_check == argv[7] || options->maxTsFiles < 0 || options->maxTsFiles >= INT_MAX) {
+            fprintf(stderr, "Maximum number of ts files (%s) invalid\n", argv[7]);
+            return -1;
+        }
+    }
+
+    if (options->cuesPath && strcmp(options->cuePointsInput, "[]")) {
+        fprintf(stderr, "Cue points are given either by the cue points argument or by a cue points file\n");
+        return -1;
+    }
+
+    if (options->cuesPath && !strcmp(options->cuesPath, "-") && !strcmp(options->input, "pipe:")) {
+        fprintf(stderr, "Cue points file and input can not both be the standard input\n");
+        return -1;
+    }
+
+    // Segments leaving the window are removed, a manifest lists them all.
+    if (options->manifestPath && options->maxTsFiles) {
+        fprintf(stderr, "Segments manifest is not used with a segment window size\n");
+        return -1;
+    }
+
+    // Kept segments are only the same when cut in the same places, which live cue points and parts do not guarantee.
+    if (options->reusePath && (!options->manifestPath || options->partDuration || options->controlPath || options->scte35)) {
+        fprintf(stderr, "Reusing segments requires a segments manifest, and is not used with parts, a control FIFO or SCTE-35\n");
+        return -1;
+    }
+
+    // The ring content does not survive the process.
+    if (options->resume && (!options->checkpointPath || options->memoryRing)) {
+        fprintf(stderr, "Resuming requires a checkpoint, and is not used with the memory ring\n");
+        return -1;
+    }
+
+    // Nothing but the origin reads the ring, and it only holds a window of segments.
+    if (options->memoryRing && (!options->originPort || !options->maxTsFiles)) {
+        fprintf(stderr, "Memory ring requires an origin port and a segment window size\n");
+        return -1;
+    }
+
+    // Parts are byte ranges of the segment being written, which is only published once complete.
+    if (options->filePool && (!options->maxTsFiles || options->memoryRing || options->partDuration)) {
+        fprintf(stderr, "File pool requires a segment window size, and is not used with the memory ring or part durations\n");
+        return -1;
+    }
+
+    // Archived segments stay on disk under their own names.
+    if (options->archivePath && (!options->maxTsFiles || options->memoryRing || options->filePool)) {
+        fprintf(stderr, "Archive requires a segment window size, and is not used with the memory ring or the file pool\n");
+        return -1;
+    }
+
+    // Keys are files next to the segments, and parts would be byte ranges of the encrypted segment.
+    if (options->encrypt && (options->memoryRing || options->partDuration || options->reusePath)) {
+        fprintf(stderr, "Encryption is not used with the memory ring, parts or reused segments\n");
+        return -1;
+    }
+    if (options->keyRotation && !options->encrypt) {
+        fprintf(stderr, "Key rotation requires encryption\n");
+        return -1;
+    }
+
+    if (options->gzip && options->memoryRing) {
+        fprintf(stderr, "Gzipped playlist is not used with the memory ring\n");
+        return -1;
+    }
+
+    if (!options->digestAlgorithm) {
+        options->digestAlgorithm = "sha256";
+    }
+
+    if (!options->thumbnailsPrefix && (options->thumbnailInterval || options->thumbnailWidth || options->thumbnailWorkers || options->thumbnailQueue)) {
+        fprintf(stderr, "Thumbnail options require --thumbnails\n");
+        return -1;
+    }
+    if (options->readahead < 0) {
+        options->readahead = strcmp(options->input, "pipe:") ? 0 : SESSION_READAHEAD_SIZE;
+    } else if (options->readahead && strcmp(options->input, "pipe:")) {
+        fprintf(stderr, "Readahead requires the standard input\n");
+        return -1;
+    }
+
+    if (!is_udp_input(options->input) && (options->udpBuffer || options->jitterDepth || options->jitterLatency || options->udpTimeout)) {
+        fprintf(stderr, "UDP options require a udp:// or rtp:// input\n");
+        return -1;
+    }
+    if (!options->udpBuffer) {
+        options->udpBuffer = UDP_INPUT_DEFAULT_BUFFER;
+    }
+    if (!options->jitterDepth) {
+        options->jitterDepth = UDP_INPUT_DEFAULT_DEPTH;
+    }
+    if (!options->jitterLatency) {
+        options->jitterLatency = UDP_INPUT_DEFAULT_LATENCY;
+    }
+    if (!options->interleaveDelta) {
+        options->interleaveDelta = INTERLEAVER_DEFAULT_DELTA;
+    }
+    if (!options->interleaveBytes) {
+        options->interleaveBytes = INTERLEAVER_DEFAULT_BYTES;
+    }
+
+    if (!options->thumbnailWidth) {
+        options->thumbnailWidth = SESSION_THUMBNAIL_WIDTH;
+        options->thumbnailHeight = SESSION_THUMBNAIL_HEIGHT;
+    }
+    if (!options->thumbnailWorkers) {
+        options->thumbnailWorkers = SESSION_THUMBNAIL_WORKERS;
+    }
+    if (!options->thumbnailQueue) {
+        options->thumbnailQueue = SESSION_THUMBNAIL_QUEUE;
+    }
+
+    // Parts are kept per segment, leaving room for segments cut late on their key frame.
+    if (options->partDuration && options->segmentDuration / options->partDuration > SESSION_MAX_PARTS / 2) {
+        fprintf(stderr, "Part duration (%f) is too short for segments of %f seconds\n", options->partDuration, options->segmentDuration);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to start the statistics of a segment, the last timestamps of each stream
+ * are kept, as interleaving delays span segments.
+ *
+ * @param SEGMENT_STATS *stats the statistics.
+ */
+static void reset_stats(SEGMENT_STATS *stats) {
+    int64_t lastDts[2] = {stats->lastDts[0], stats->lastDts[1]};
+
+    memset(stats, 0, sizeof (SEGMENT_STATS));
+    stats->firstPts[0] = stats->firstPts[1] = stats->lastPts[0] = stats->lastPts[1] = AV_NOPTS_VALUE;
+    stats->lastDts[0] = lastDts[0];
+    stats->lastDts[1] = lastDts[1];
+}
+
+/**
+ * Used to add a packet to the statistics of the segment being written. The
+ * interleaving delay is how far apart the streams timestamps are, as the
+ * muxer holds packets until every stream caught up.
+ *
+ * @param SESSION *session the session.
+ * @param AVPacket *packet the packet handed to the muxer.
+ */
+static void track_stats(SESSION *session, AVPacket *packet) {
+    SEGMENT_STATS *stats = &session->stats;
+    AVRational time_base = session->ic->streams[packet->stream_index]->time_base;
+    int slot = packet->stream_index == session->video_index ? 0 : 1;
+    int64_t time, delay;
+
+    ++stats->packets[slot];
+    stats->bytes[slot] += packet->size;
+    if (slot == 0 && (packet->flags & PKT_FLAG_KEY)) {
+        ++stats->keyFrames;
+    }
+
+    if (packet->pts != AV_NOPTS_VALUE) {
+        time = av_rescale_q(packet->pts, time_base, AV_TIME_BASE_Q);
+        if (stats->firstPts[slot] == AV_NOPTS_VALUE) {
+            stats->firstPts[slot] = time;
+        }
+        stats->lastPts[slot] = time;
+    }
+
+    if (packet->dts != AV_NOPTS_VALUE) {
+        time = stats->lastDts[slot] = av_rescale_q(packet->dts, time_base, AV_TIME_BASE_Q);
+        if (session->video_index >= 0 && session->audio_index >= 0 && stats->lastDts[!slot] != AV_NOPTS_VALUE) {
+            delay = time > stats->lastDts[!slot] ? time - stats->lastDts[!slot] : stats->lastDts[!slot] - time;
+            if (delay > stats->maxInterleaveDelay) {
+                stats->maxInterleaveDelay = delay;
+            }
+        }
+    }
+}
+
+/**
+ * Used to write the statistics of one stream of a segment.
+ */
+static void write_stream_stats(FILE *fp, const char *name, const SEGMENT_STATS *stats, int slot) {
+    fprintf(fp, ", \"%s\" : {\"packets\" : %llu, \"bytes\" : %llu", name, stats->packets[slot], stats->bytes[slot]);
+    if (stats->firstPts[slot] != AV_NOPTS_VALUE) {
+        fprintf(fp, ", \"first_pts\" : %.6f, \"last_pts\" : %.6f", stats->firstPts[slot] / 1000000.0, stats->lastPts[slot] / 1000000.0);
+    }
+    fputc('}', fp);
+}
+
+/**
+ * Used to append the statistics of the segment just closed, one JSON line, and
+ * start those of the next one.
+ *
+ * @param SESSION *session the session.
+ * @param double end_time the time the segment ends at.
+ */
+static void write_stats(SESSION *session, double end_time) {
+    const SESSION_OPTIONS *options = &session->options;
+    SEGMENT_STATS *stats = &session->stats;
+    FILE *fp = session->statsFp;
+
+    fprintf(fp, "{\"channel\" : \"%s\", \"sequence\" : %u, \"start\" : %.3f, \"duration\" : %.3f, \"planned\" : %.3f, \"target\" : %.3f,"
+            " \"bytes\" : %lld, \"key_frames\" : %u, \"max_interleave_delay\" : %.3f",
+            options->name, session->output_index - 1, session->prev_segment_time, end_time - session->prev_segment_time,
+            (session->segmentEnd - session->segmentStart) / 1000.0, session->minSegmentDuration, session->segmentSize,
+            stats->keyFrames, stats->maxInterleaveDelay / 1000000.0);
+
+    if (session->video_index >= 0) {
+        write_stream_stats(fp, "video", stats, 0);
+    }
+    if (session->audio_index >= 0) {
+        write_stream_stats(fp, "audio", stats, 1);
+    }
+
+    // Flushed at each boundary, so the file is current while the session runs.
+    if (fputs("}\n", fp) < 0 || fflush(fp)) {
+        ++session->counters.writeErrors;
+    }
+
+    reset_stats(stats);
+}
+
+/**
+ * Used to top the plan up from the cue points file, so it holds a few pending
+ * cue points, and no more, however long the file is. The file is closed once
+ * read, or on its first invalid entry.
+ *
+ * @param SESSION *session the session.
+ * @return int 0 on success, -1 on invalid entries or allocation failure.
+ */
+static int load_cues(SESSION *session) {
+    unsigned int time;
+    int ret = 0;
+
+    while (session->plan.cues->length < SESSION_CUE_LOOKAHEAD && (ret = cueLoaderNext(session->cueLoader, &time)) > 0) {
+        // Cue points already cut are skipped.
+        if (cuePlanInsert(&session->plan, time) < 0) {
+            fprintf(stderr, "{\"error\" : \"Can not build the cue points plan.\", \"channel\" : \"%s\"}\n", session->options.name);
+            ret = -1;
+            break;
+        }
+    }
+
+    if (ret <= 0) {
+        cueLoaderClose(session->cueLoader);
+        free(session->cueLoader);
+        session->cueLoader = NULL;
+    }
+
+    return ret < 0 ? -1 : 0;
+}
+
+/**
+ * Used to save what a restarted session needs to continue the playlist: the
+ * sequence numbers, the segments of the playlist with their ad markers, and
+ * the cue points still to come. Written aside, then renamed over the previous
+ * checkpoint, so a crash leaves one or the other.
+ *
+ * @param SESSION *session the session.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int write_checkpoint(SESSION *session) {
+    FILE *fp;
+    NODE *node;
+    AD_BREAK *adBreak;
+    HISTORY_ENTRY *entry;
+    unsigned int i;
+
+    fp = rewind_stream(&session->scratchFp, &session->scratchBuffer, &session->scratchSize);
+    if (!fp) {
+        return -1;
+    }
+
+    fprintf(fp, "%s\nsequence %u %u %u\nclock %.3f %.3f\ntime %.3f %.3f\n", SESSION_CHECKPOINT_VERSION, session->first_segment,
+            session->last_segment, session->discontinuitySequence, session->wallClockOrigin, session->windowStart,
+            session->prev_segment_time, session->timeOffset);
+
+    for (node = session->discontinuities->head; node; node = node->next) {
+        fprintf(fp, "discontinuity %u\n", node->id);
+    }
+
+    if (session->considerCuePoints) {
+        for (node = session->plan.cues->head; node; node = node->next) {
+            fprintf(fp, "cue %u\n", node->id);
+        }
+
+        for (node = session->breaks->head; node; node = node->next) {
+            adBreak = node->data;
+            fprintf(fp, "break %u %u\n", adBreak->out, adBreak->in);
+        }
+
+        if (session->cueLoader) {
+            fprintf(fp, "loaded %llu\n", session->cueLoader->count);
+        }
+
+        // The ad markers follow their length, as they span lines.
+        for (i = 0; (entry = historyAt(&session->history, i)); i++) {
+            fprintf(fp, "segment %u %zu\n", entry->duration, entry->marked ? strlen(entry->markers) : 0);
+            if (entry->marked) {
+                fputs(entry->markers, fp);
+            }
+        }
+    }
+
+    if (session->archiveFd >= 0) {
+        fprintf(fp, "archive %lld %u\n", session->archiveOffset, session->archiveTarget);
+    }
+
+    return write_file(session->tmp_checkpoint, session->options.checkpointPath, fp, &session->scratchBuffer, &session->scratchSize, 1);
+}
+
+/**
+ * Used to restore a session from its checkpoint. The segment being written when
+ * it stopped is written again, after a discontinuity, as the input restarts
+ * elsewhere; the output time is anchored on the first key frame read. Every
+ * allocation is checked, a session resumed without part of its state would
+ * publish a playlist that does not follow on.
+ *
+ * @param SESSION *session the session, once created.
+ * @return int 0 on success, or when there is no checkpoint yet, -1 otherwise.
+ */
+static int read_checkpoint(SESSION *session) {
+    const SESSION_OPTIONS *options = &session->options;
+    char keyword[16], version[64], *markers;
+    HISTORY_ENTRY *entry;
+    unsigned int first, last, value, in;
+    unsigned long long loaded = 0;
+    size_t length;
+    AD_BREAK *adBreak;
+    FILE *fp;
+    int ret = 0;
+
+    session->resumeTime = -1;
+
+    fp = fopen(options->checkpointPath, "r");
+    if (!fp) {
+        if (errno != ENOENT) {
+            fprintf(stderr, "{\"error\" : \"Could not open the checkpoint (%s).\", \"channel\" : \"%s\"}\n", options->checkpointPath, options->name);
+            return -1;
+        }
+        fprintf(stderr, "{\"info\" : \"No checkpoint (%s), starting afresh.\", \"channel\" : \"%s\"}\n", options->checkpointPath, options->name);
+        return 0;
+    }
+
+    if (!fgets(version, sizeof (version), fp) || strncmp(version, SESSION_CHECKPOINT_VERSION, strlen(SESSION_CHECKPOINT_VERSION))
+            || fscanf(fp, " sequence %u %u %u clock %lf %lf", &first, &last, &session->discontinuitySequence,
+                &session->wallClockOrigin, &session->windowStart) != 5 || !last || first > last + 1) {
+        fprintf(stderr, "{\"error\" : \"Checkpoint (%s) is invalid.\", \"channel\" : \"%s\"}\n", options->checkpointPath, options->name);
+        fclose(fp);
+        return -1;
+    }
+
+    while (!ret && fscanf(fp, " %15s", keyword) == 1) {
+        if (!strcmp(keyword, "discontinuity") && fscanf(fp, "%u", &value) == 1) {
+            ret = append(session->discontinuities, createNode(value, NULL)) ? 0 : -2;
+        } else if (!strcmp(keyword, "cue") && fscanf(fp, "%u", &value) == 1 && session->considerCuePoints) {
+            ret = cuePlanInsert(&session->plan, value) < 0 ? -2 : 0;
+        } else if (!strcmp(keyword, "break") && fscanf(fp, "%u %u", &value, &in) == 2 && session->considerCuePoints) {
+            adBreak = malloc(sizeof (AD_BREAK));
+            if (!adBreak) {
+                ret = -2;
+                break;
+            }
+            adBreak->out = value;
+            adBreak->in = in;
+            if (!append(session->breaks, createNode(value, adBreak))) {
+                free(adBreak);
+                ret = -2;
+            }
+        } else if (!strcmp(keyword, "loaded") && fscanf(fp, "%llu", &loaded) == 1) {
+            // Skipped below, once the whole checkpoint is read.
+        } else if (!strcmp(keyword, "segment") && fscanf(fp, "%u %zu", &value, &length) == 2 && fgetc(fp) == '\n'
+                && session->considerCuePoints && length < HISTORY_MARKERS_SIZE) {
+            // A smaller window keeps the last segments.
+            if (!(entry = historyAppend(&session->history))) {
+                historyDropOldest(&session->history);
+                entry = historyAppend(&session->history);
+            }
+            if (!entry) {
+                ret = -2;
+                break;
+            }
+            entry->duration = value;
+            if (length) {
+                markers = historyMarkers(entry);
+                if (!markers || fread(markers, 1, length, fp) != length) {
+                    ret = -1;
+                    break;
+                }
+                markers[length] = '\0';
+                entry->marked = 1;
+            }
+        } else if (!strcmp(keyword, "archive") && fscanf(fp, "%lld %u", &session->archiveOffset, &session->archiveTarget) == 2) {
+            // Reopened once the checkpoint is read.
+        } else if (!strcmp(keyword, "time") && fscanf(fp, "%lf %lf", &session->resumeTime, &session->timeOffset) == 2) {
+            // Checked on the first key frame read.
+        } else {
+            ret = -1;
+        }
+    }
+    fclose(fp);
+
+    if (ret == -2) {
+        fprintf(stderr, "{\"error\" : \"Could not allocate the state of the checkpoint (%s).\", \"channel\" : \"%s\"}\n", options->checkpointPath, options->name);
+        return -1;
+    }
+    if (ret < 0) {
+        fprintf(stderr, "{\"error\" : \"Checkpoint (%s) is invalid.\", \"channel\" : \"%s\"}\n", options->checkpointPath, options->name);
+        return -1;
+    }
+
+    // The cue points file resumes after the cue points already planned.
+    while (session->cueLoader && session->cueLoader->count < loaded) {
+        if (cueLoaderNext(session->cueLoader, &value) <= 0) {
+            cueLoaderClose(session->cueLoader);
+            free(session->cueLoader);
+            session->cueLoader = NULL;
+        }
+    }
+    if (session->cueLoader && load_cues(session) < 0) {
+        return -1;
+    }
+
+    session->first_segment = first;
+    session->last_segment = last;
+    session->output_index = last + 1;
+    if (!append(session->discontinuities, createNode(last + 1, NULL))) {
+        fprintf(stderr, "{\"error\" : \"Could not allocate the state of the checkpoint (%s).\", \"channel\" : \"%s\"}\n", options->checkpointPath, options->name);
+        return -1;
+    }
+    session->resuming = 1;
+
+    fprintf(stderr, "{\"info\" : \"Resuming at segment %u.\", \"channel\" : \"%s\"}\n", last + 1, options->name);
+
+    return 0;
+}
+
+/**
+ * Used to anchor a resumed session on the first key frame read, the cue points
+ * already past are dropped. An input behind the last cut of the checkpoint
+ * was restarted by its encoder, its times are rebased on that cut, so the
+ * cue points, the dates and the cuts go on from where they stopped.
+ *
+ * @param SESSION *session the session.
+ * @param double segment_time the time of the key frame.
+ * @return double the time of the key frame, once rebased.
+ */
+static double resume_at(SESSION *session, double segment_time) {
+    if (session->resumeTime >= 0 && segment_time < session->resumeTime) {
+        fprintf(stderr, "{\"info\" : \"Input restarted %.3f s behind the checkpoint, its times are rebased on it.\", \"channel\" : \"%s\"}\n",
+                session->resumeTime - segment_time, session->options.name);
+        session->timeOffset += session->resumeTime - segment_time;
+        segment_time = session->resumeTime;
+    }
+
+    session->prev_segment_time = segment_time;
+    session->resuming = 0;
+
+    if (session->considerCuePoints) {
+        NODE *cue = cuePlanAdvance(&session->plan, (unsigned int) (segment_time * 1000));
+
+        if (cue) {
+            cuePlanRecycle(&session->plan, cue);
+        }
+
+        if (session->cueLoader && load_cues(session) < 0) {
+            fprintf(stderr, "{\"error\" : \"Cue points file stopped being read.\", \"channel\" : \"%s\"}\n", session->options.name);
+        }
+    }
+
+    return segment_time;
+}
+
+/**
+ * Used to open the archive playlist, at the end of the segments archived by
+ * the checkpoint, or afresh with its header.
+ *
+ * @param SESSION *session the session.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int open_archive(SESSION *session) {
+    char header[256];
+
+    session->archiveFd = open(session->options.archivePath, O_WRONLY | O_CREAT, 0644);
+    if (session->archiveFd < 0) {
+        return -1;
+    }
+
+    if (!session->archiveOffset) {
+        if (!session->archiveTarget) {
+            session->archiveTarget = (unsigned int) (session->options.segmentDuration + 0.5);
+        }
+        session->archiveOffset = snprintf(header, sizeof (header), "%s%0*u\n#EXT-X-MEDIA-SEQUENCE:%u\n", SESSION_ARCHIVE_HEADER,
+                SESSION_ARCHIVE_TARGET_DIGITS, session->archiveTarget, session->first_segment);
+        if (write_at(session->archiveFd, header, session->archiveOffset, 0) < 0) {
+            return -1;
+        }
+    }
+
+    // Segments archived after the checkpoint are archived again.
+    return ftruncate(session->archiveFd, session->archiveOffset);
+}
+
+/**
+ * Used to append a segment leaving the window to the archive playlist. The
+ * playlist is never rewritten, only its target duration is updated in place
+ * when a longer segment is archived.
+ *
+ * @param SESSION *session the session.
+ * @param unsigned int sequence the segment sequence number.
+ * @param HISTORY_ENTRY *entry the segment, NULL when segments are listed on the segmentation base.
+ * @param double start the segment start, dating it when there is an entry.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int archive_segment(SESSION *session, unsigned int sequence, HISTORY_ENTRY *entry, double start) {
+    char write_buf[1024 + HISTORY_MARKERS_SIZE], date[32], target[SESSION_ARCHIVE_TARGET_DIGITS + 1];
+    unsigned int duration = entry ? (entry->duration + 500) / 1000 : session->minSegmentDuration;
+    size_t length = 0;
+    NODE *node;
+
+    if (session->discontinuities) {
+        for (node = session->discontinuities->head; node && node->id <= sequence; node = node->next) {
+            if (node->id == sequence) {
+                length += snprintf(write_buf, sizeof (write_buf), "#EXT-X-DISCONTINUITY\n");
+            }
+        }
+    }
+
+    length += key_line(session, write_buf + length, sequence, &session->archiveKey);
+
+    if (entry) {
+        format_date(session, start * 1000, date);
+        length += snprintf(write_buf + length, sizeof (write_buf) - length, "#EXT-X-PROGRAM-DATE-TIME:%s\n", date);
+    }
+
+    length += snprintf(write_buf + length, sizeof (write_buf) - length, "#EXTINF:%u,\n%s%s-%u.ts\n%s", duration,
+            session->options.httpPrefix, session->options.outputPrefix, sequence, entry && entry->marked ? entry->markers : "");
+    if (length >= sizeof (write_buf) || write_at(session->archiveFd, write_buf, length, session->archiveOffset) < 0) {
+        return -1;
+    }
+    session->archiveOffset += length;
+
+    if (duration > session->archiveTarget) {
+        session->archiveTarget = duration;
+        snprintf(target, sizeof (target), "%0*u", SESSION_ARCHIVE_TARGET_DIGITS, duration);
+        if (write_at(session->archiveFd, target, SESSION_ARCHIVE_TARGET_DIGITS, strlen(SESSION_ARCHIVE_HEADER)) < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * Used to prepare a session, the cue points are parsed and the buffers are
+ * allocated, and the cue points file is opened, but the input and outputs are not yet.
+ *
+ * @param SESSION *session the session to prepare.
+ * @param const SESSION_OPTIONS *options the session options.
+ * @return int 0 on success, -1 otherwise.
+ */
+int sessionCreate(SESSION *session, const SESSION_OPTIONS *options) {
+    char *cuePointsIterator, *cuePointsCopy, *cuePointsState, *dot;
+    /**
+     * @var cuePointNumber will carry the integer value of the user's input and should be signed, in case of negative values.
+     */
+    int cuePointNumber = 0, i;
+    unsigned int pathLength;
+    LIST *cuePoints;
+    NODE *cuePoint;
+
+    memset(session, 0, sizeof (SESSION));
+    session->options = *options;
+    session->state = SESSION_CREATED;
+    session->inputFd = -1;
+    session->outputFd = -1;
+    session->output_index = 1;
+    session->first_segment = 1;
+    session->write_index = 1;
+    session->video_index = -1;
+    session->audio_index = -1;
+    session->stats.lastDts[0] = session->stats.lastDts[1] = AV_NOPTS_VALUE;
+    reset_stats(&session->stats);
+
+    // The history is sized to the window, and does not grow with it.
+    session->archiveFd = -1;
+    if (historyInit(&session->history, options->maxTsFiles > 0 ? options->maxTsFiles : 0) < 0) {
+        fprintf(stderr, "{\"error\" : \"Can not allocate the segments history.\"}");
+        return -1;
+    }
+
+    session->minSegmentDuration = options->segmentDuration;
+
+    // Live cue points may come later, even without any at startup, and size capped segments, as well as segments
+    // split in parts, whose durations they have to add up to, are listed with their own durations.
+    if (!findString((void *) options->cuePointsInput, "[]") || options->controlPath || options->scte35 || options->cuesPath || options->maxBytes
+            || options->partDuration) {
+        if (cuePlanInit(&session->plan, (unsigned int) (options->segmentDuration * 1000)) < 0) {
+            fprintf(stderr, "{\"error\" : \"Can not allocate the cue points plan.\"}");
+            return -1;
+        }
+
+        // Enable cue points processing.
+        session->considerCuePoints = 1;
+    }
+
+    // Check if the user wants to skip cue points.
+    if (!findString((void *) options->cuePointsInput, "[]")) {
+        // Brackets become separators on a copy, as the whole list is tokenized in place.
+        cuePointsCopy = strdup(options->cuePointsInput);
+        if (!cuePointsCopy) {
+            fprintf(stderr, "{\"error\" : \"Can not allocate the cue points.\"}");
+            return -1;
+        }
+        for (dot = cuePointsCopy; *dot; dot++) {
+            if (*dot == '[' || *dot == ']') {
+                *dot = ',';
+            }
+        }
+
+        cuePoints = createList((void *) "Cue Points", 1, 0);
+
+        for (cuePointsIterator = strtok_r(cuePointsCopy, ",", &cuePointsState); cuePointsIterator != NULL;
+                cuePointsIterator = strtok_r(NULL, ",", &cuePointsState)) {
+            // Converting a string to an integer value
+            cuePointNumber = atoi(cuePointsIterator);
+
+            if (cuePointNumber < 0) {
+
+                fprintf(stderr, "{\"error\" : \"Invalid cue points value %s, cue point value must be positive, please check value (%i)\"}", options->cuePointsInput, cuePointNumber);
+                deleteList(cuePoints);
+                free(cuePoints);
+                free(cuePointsCopy);
+                return -1;
+            } else if ((unsigned int) cuePointNumber > UINT_MAX / 1000) {
+                // The plan counts milliseconds on 32 bits.
+                fprintf(stderr, "{\"error\" : \"Invalid cue points value %s, cue point value is too large, please check value (%i)\"}", options->cuePointsInput, cuePointNumber);
+                deleteList(cuePoints);
+                free(cuePoints);
+                free(cuePointsCopy);
+                return -1;
+            } else if (cuePointNumber) {
+
+                // Appending node to the list.
+                cuePoint = createNode(cuePointNumber, NULL);
+
+                append(cuePoints, cuePoint);
+            }
+        }
+        free(cuePointsCopy);
+
+        // Sorting the cue points order, so each of them extends the plan, and duplicates are neighbours.
+        sortById(cuePoints, ASC);
+
+        for (cuePoint = cuePoints->head; cuePoint; cuePoint = cuePoint->next) {
+            if (cuePoint->next && cuePoint->next->id == cuePoint->id) {
+                fprintf(stderr, "{\"error\" : \"Duplicate value for cue points %s, check the value (%i)\"}", options->cuePointsInput, cuePoint->id);
+                deleteList(cuePoints);
+                free(cuePoints);
+                return -1;
+            }
+
+            if (cuePlanInsert(&session->plan, cuePoint->id * 1000) < 0) {
+                fprintf(stderr, "{\"error\" : \"Can not build the cue points plan.\"}");
+                deleteList(cuePoints);
+                free(cuePoints);
+                return -1;
+            }
+        }
+
+        deleteList(cuePoints);
+        free(cuePoints);
+    }
+
+    if (options->cuesPath) {
+        session->cueLoader = malloc(sizeof (CUE_LOADER));
+        if (!session->cueLoader || cueLoaderOpen(session->cueLoader, options->cuesPath) < 0) {
+            free(session->cueLoader);
+            session->cueLoader = NULL;
+            return -1;
+        }
+
+        if (load_cues(session) < 0) {
+            return -1;
+        }
+    }
+
+    char path[PATH_MAX];
+    // Checking output prefix path length.
+    pathLength = snprintf (path, PATH_MAX, "%s", options->outputPrefix);
+    if(pathLength > PATH_MAX){
+        fprintf(stderr, "{\"error\" : \"Current output prefix length (%i) is larger than the allowed path maximum length (%i).\"}", pathLength, PATH_MAX);
+        return -1;
+    }
+
+    // Checking index prefix path length.
+    pathLength = snprintf (path, PATH_MAX, "%s", options->index);
+    if(pathLength > PATH_MAX){
+        fprintf(stderr, "{\"error\" : \"Current index prefix length (%i) is larger than the allowed path maximum length (%i).\"}", pathLength, PATH_MAX);
+        return -1;
+    }
+
+    session->prefixLength = strlen(options->outputPrefix);
+    session->remove_filename = malloc(sizeof (char) * (strlen(options->outputPrefix) + 15));
+    if (!session->remove_filename) {
+        fprintf(stderr, "Could not allocate space for remove filenames\n");
+        return -1;
+    }
+
+    session->output_filename = malloc(sizeof (char) * (strlen(options->outputPrefix) + 15));
+    if (!session->output_filename) {
+        fprintf(stderr, "Could not allocate space for output filenames\n");
+        return -1;
+    }
+    strcpy(session->remove_filename, options->outputPrefix);
+    strcpy(session->output_filename, options->outputPrefix);
+
+    if (options->filePool) {
+        session->pool_filename = malloc(sizeof (char) * (strlen(options->outputPrefix) + 20));
+        if (!session->pool_filename) {
+            fprintf(stderr, "Could not allocate space for pool filenames\n");
+            return -1;
+        }
+        strcpy(session->pool_filename, options->outputPrefix);
+    }
+
+    // Bytes are encrypted in the chunks the output context flushes, with a block held over.
+    session->keyIndex = session->archiveKey = UINT_MAX;
+    if (options->encrypt) {
+        session->cipher = malloc(sizeof (AES_CBC));
+        session->cipherBuffer = malloc(SESSION_OUTPUT_BUFFER_SIZE + AES_BLOCK_SIZE);
+        session->key_filename = malloc(strlen(options->outputPrefix) + 20);
+        if (!session->cipher || !session->cipherBuffer || !session->key_filename) {
+            fprintf(stderr, "Could not allocate space for segment encryption\n");
+            return -1;
+        }
+        strcpy(session->key_filename, options->outputPrefix);
+        fprintf(stderr, "{\"info\" : \"Segments encrypted with %s.\", \"channel\" : \"%s\"}\n",
+                aesHardware() ? "AES-NI" : "lookup tables", options->name);
+    }
+
+    session->tmp_index = malloc(strlen(options->index) + 2);
+    if (!session->tmp_index) {
+        fprintf(stderr, "Could not allocate space for temporary index filename\n");
+        return -1;
+    }
+
+    strncpy(session->tmp_index, options->index, strlen(options->index) + 2);
+    dot = strrchr(session->tmp_index, '/');
+    dot = dot ? dot + 1 : session->tmp_index;
+    for (i = strlen(session->tmp_index) + 1; i > dot - session->tmp_index; i--) {
+        session->tmp_index[i] = session->tmp_index[i - 1];
+    }
+    *dot = '.';
+
+    if (session->considerCuePoints) {
+        session->breaks = createList((void *) "Breaks", 1, 0);
+        if (!session->breaks) {
+            fprintf(stderr, "Could not allocate the breaks list\n");
+            return -1;
+        }
+    }
+
+    // Not with the memory ring, whose playlist never reaches the disk.
+    if (session->considerCuePoints && !options->memoryRing) {
+        session->breaks_filename = malloc(strlen(options->index) + 8);
+        session->tmp_breaks = malloc(strlen(session->tmp_index) + 8);
+        if (!session->breaks_filename || !session->tmp_breaks) {
+            fprintf(stderr, "Could not allocate space for breaks index filenames\n");
+            return -1;
+        }
+        sprintf(session->breaks_filename, "%s.breaks", options->index);
+        sprintf(session->tmp_breaks, "%s.breaks", session->tmp_index);
+    }
+
+    if (options->gzip) {
+        session->gzip = malloc(sizeof (GZIP_PLAYLIST));
+        session->gzip_filename = malloc(strlen(options->index) + 4);
+        session->tmp_gzip = malloc(strlen(session->tmp_index) + 4);
+        if (!session->gzip || !session->gzip_filename || !session->tmp_gzip || gzipPlaylistInit(session->gzip) < 0) {
+            free(session->gzip);
+            session->gzip = NULL;
+            fprintf(stderr, "Could not allocate the gzipped playlist\n");
+            return -1;
+        }
+        sprintf(session->gzip_filename, "%s.gz", options->index);
+        sprintf(session->tmp_gzip, "%s.gz", session->tmp_index);
+    }
+
+    // Read before the new manifest is started, which may replace it.
+    if (options->reusePath) {
+        session->previous = malloc(sizeof (MANIFEST));
+        session->reuse_filename = malloc(strlen(options->outputPrefix) + 20);
+        if (!session->previous || !session->reuse_filename || manifestLoad(session->previous, options->reusePath) < 0) {
+            free(session->previous);
+            session->previous = NULL;
+            return -1;
+        }
+        session->lastKept = SESSION_NO_SEGMENT;
+    }
+
+    // Restarts, and the joins around kept segments, are marked in the playlist.
+    if (options->checkpointPath || options->reusePath) {
+        session->discontinuities = createList((void *) "Discontinuities", 1, 0);
+        if (!session->discontinuities) {
+            fprintf(stderr, "Could not allocate space for discontinuities\n");
+            return -1;
+        }
+    }
+
+    if (options->manifestPath) {
+        session->tmp_manifest = malloc(strlen(options->manifestPath) + 5);
+        if (!session->tmp_manifest) {
+            fprintf(stderr, "Could not allocate space for temporary manifest filename\n");
+            return -1;
+        }
+        sprintf(session->tmp_manifest, "%s.tmp", options->manifestPath);
+
+        session->manifestFp = fopen(session->tmp_manifest, "w");
+        if (!session->manifestFp || fprintf(session->manifestFp, "%s\n", MANIFEST_VERSION) < 0) {
+            fprintf(stderr, "Could not open temporary segments manifest (%s)\n", session->tmp_manifest);
+            return -1;
+        }
+    }
+
+    // Appended to, so a resumed session adds to the statistics of the run.
+    if (options->statsPath) {
+        session->statsFp = fopen(options->statsPath, "a");
+        if (!session->statsFp) {
+            fprintf(stderr, "Could not open segment statistics file (%s)\n", options->statsPath);
+            return -1;
+        }
+    }
+
+    // Segments are hashed as they are written, with the digests needed only.
+    if (options->manifestPath || (options->digestsPath && !strcmp(options->digestAlgorithm, "xxh64"))) {
+        session->segmentXxh = malloc(sizeof (XXH64));
+        if (!session->segmentXxh) {
+            fprintf(stderr, "Could not allocate space for segment digests\n");
+            return -1;
+        }
+    }
+    if (options->digestsPath) {
+        if (!strcmp(options->digestAlgorithm, "sha256")) {
+            session->segmentSha = malloc(sizeof (SHA256));
+            if (!session->segmentSha) {
+                fprintf(stderr, "Could not allocate space for segment digests\n");
+                return -1;
+            }
+            fprintf(stderr, "{\"info\" : \"Segments hashed with %s.\", \"channel\" : \"%s\"}\n",
+                    sha256Hardware() ? "SHA-NI" : "plain SHA-256", options->name);
+        }
+
+        session->digestsFp = fopen(options->digestsPath, "a");
+        if (!session->digestsFp) {
+            fprintf(stderr, "Could not open segment digests file (%s)\n", options->digestsPath);
+            return -1;
+        }
+    }
+
+    if (options->checkpointPath) {
+        session->tmp_checkpoint = malloc(strlen(options->checkpointPath) + 5);
+        if (!session->tmp_checkpoint) {
+            fprintf(stderr, "Could not allocate space for temporary checkpoint filename\n");
+            return -1;
+        }
+        sprintf(session->tmp_checkpoint, "%s.tmp", options->checkpointPath);
+
+        if (options->resume && read_checkpoint(session) < 0) {
+            return -1;
+        }
+    }
+
+    if (options->archivePath && open_archive(session) < 0) {
+        fprintf(stderr, "Could not open archive playlist (%s)\n", options->archivePath);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Read callback of inputs opened on a pollable file descriptor.
+ */
+static int readInput(void *opaque, uint8_t *buf, int buf_size) {
+    SESSION *session = opaque;
+    ssize_t size;
+
+    // The UDP input and the readahead do not always leave errno set, their failures are reported as I/O errors.
+    // Once a supervised input is fed into its ring, it is only read from the ring.
+    if (session->readahead) {
+        size = readaheadRead(session->readahead, buf, buf_size);
+        if (size < 0) {
+            return AVERROR(EIO);
+        }
+    } else if (session->udp) {
+        size = udpInputRead(session->udp, buf, buf_size);
+        if (size < 0) {
+            return AVERROR(EIO);
+        }
+    } else {
+        do {
+            size = read(session->inputFd, buf, buf_size);
+        } while (size < 0 && errno == EINTR);
+        if (size < 0) {
+            return AVERROR(errno);
+        }
+    }
+
+    // Splice commands are picked up from the raw stream, as the demuxer drops them.
+    if (session->scte35 && size > 0) {
+        scte35Scan(session->scte35, buf, size);
+    }
+
+    return (int) size;
+}
+
+/**
+ * Seek callback of inputs opened on a pollable file descriptor. Inputs read
+ * through a ring do not seek, the file descriptor is ahead of the demuxer.
+ */
+static int64_t seekInput(void *opaque, int64_t offset, int whence) {
+    SESSION *session = opaque;
+    struct stat info;
+
+    if (session->readahead) {
+        return -1;
+    }
+    if (whence == AVSEEK_SIZE) {
+        return fstat(session->inputFd, &info) < 0 || !S_ISREG(info.st_mode) ? -1 : info.st_size;
+    }
+
+    return lseek(session->inputFd, offset, whence);
+}
+
+/**
+ * Used to tell whether a supervised session can demux its input without
+ * waiting: the input ended, its ring is full, holds a turn of input, or a
+ * mark of the feed lies past what the demuxer got to, so the PES in progress
+ * is complete. Bytes left in the demuxer buffer count as buffered. Inputs not
+ * read through a ring always can.
+ *
+ * @param SESSION *session the opened session.
+ * @return int 1 when the input can be demuxed without waiting, 0 otherwise.
+ */
+int sessionInputReady(SESSION *session) {
+    if (!session->inputPb || session->inputPb->eof_reached || !session->feed) {
+        return 1;
+    }
+
+    return readaheadPending(session->readahead, session->options.inputQuantum, session->inputPb->buf_end - session->inputPb->buf_ptr);
+}
+
+/**
+ * Used to tell the file descriptor the supervisor poller waits on before
+ * feeding the ring of a session.
+ *
+ * @param SESSION *session the opened session.
+ * @return int the file descriptor, -1 when the ring is full, the input ended, or it is not fed.
+ */
+int sessionFeedDescriptor(SESSION *session) {
+    size_t room;
+
+    if (!session->feed || !readaheadSpace(session->readahead, &room)) {
+        return -1;
+    }
+
+    return session->inputFd;
+}
+
+/**
+ * Used by the supervisor poller to feed the ring of a session with what its
+ * input holds, without waiting: once its file descriptor polled readable, or,
+ * for a UDP input, whenever a gap or its timeout is due as well. The bytes are
+ * scanned for marks as they are fed.
+ *
+ * @param SESSION *session the opened session.
+ * @param int readable whether the file descriptor polled readable, hung up or failed.
+ */
+void sessionFeedInput(SESSION *session, int readable) {
+    INPUT_FEED *feed = session->feed;
+    uint8_t *space;
+    size_t room;
+    ssize_t size;
+    int error = 0;
+
+    if (!feed || !(space = readaheadSpace(session->readahead, &room))) {
+        return;
+    }
+    if (room > INT_MAX) {
+        room = INT_MAX;
+    }
+
+    if (session->udp) {
+        // The lock keeps the counters whole for the metrics, read by the worker.
+        pthread_mutex_lock(&feed->lock);
+        if (!readable && !udpInputPending(session->udp)) {
+            pthread_mutex_unlock(&feed->lock);
+            return;
+        }
+        size = udpInputRead(session->udp, space, (int) room);
+        if (size < 0 && errno == EAGAIN) {
+            pthread_mutex_unlock(&feed->lock);
+            return;
+        }
+        pthread_mutex_unlock(&feed->lock);
+        if (size < 0) {
+            error = EIO;
+        }
+    } else if (readable) {
+        do {
+            size = read(session->inputFd, space, room);
+        } while (size < 0 && errno == EINTR);
+        if (size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (size < 0) {
+            error = errno;
+        }
+    } else {
+        return;
+    }
+
+    readaheadFilled(session->readahead, size, error, size > 0 ? inputFeedMark(feed, space, (int) size) : -1);
+}
+
+/**
+ * Used to put the input of a supervised session behind a ring the supervisor
+ * poller feeds, once it is probed, so a worker does not wait on the input. The
+ * ring holds a few turns of input, or the readahead size given; with a memory
+ * budget it is capped to a quarter of it, and counted in it.
+ *
+ * @param SESSION *session the session, its input opened on a file descriptor.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int start_feed(SESSION *session) {
+    const SESSION_OPTIONS *options = &session->options;
+    long size = options->readahead > 0 ? options->readahead : SESSION_FEED_QUANTA * options->inputQuantum;
+
+    if (options->memoryBudget && size > options->memoryBudget / 4) {
+        size = options->memoryBudget / 4;
+    }
+    if (size < SESSION_INPUT_BUFFER_SIZE) {
+        size = SESSION_INPUT_BUFFER_SIZE;
+    }
+
+    session->feed = malloc(sizeof (INPUT_FEED));
+    session->readahead = malloc(sizeof (READAHEAD));
+    if (!session->feed || !session->readahead || readaheadInit(session->readahead, size) < 0) {
+        fprintf(stderr, "{\"error\" : \"Could not allocate the input ring (%ld bytes).\", \"channel\" : \"%s\"}\n", size, options->name);
+        free(session->feed);
+        free(session->readahead);
+        session->feed = NULL;
+        session->readahead = NULL;
+        return -1;
+    }
+    inputFeedInit(session->feed);
+    session->baseMemory += size;
+
+    // The poller only reads what is there.
+    if (session->udp) {
+        session->udp->nonblocking = 1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to open the input of a session on a file descriptor of its own, so the
+ * supervisor can poll it. Only local files, fifos, the standard input, and UDP
+ * and RTP inputs (which are always opened here) qualify. The standard input
+ * read ahead is not polled, the readahead thread waits on it instead; a
+ * supervised one is put behind the ring the supervisor feeds, as every other
+ * polled input, once it is probed.
+ *
+ * @param SESSION *session the session.
+ * @param AVInputFormat *ifmt the input format.
+ * @param AVFormatParameters *ap the input parameters.
+ * @return int 0 on success, 1 when the input does not qualify, a negative value on errors.
+ */
+static int openPollableInput(SESSION *session, AVInputFormat *ifmt, AVFormatParameters *ap) {
+    const SESSION_OPTIONS *options = &session->options;
+    const char *input = options->input;
+    unsigned char *buffer;
+    long size = options->readahead;
+    int fd;
+
+    if (is_udp_input(input)) {
+        session->udp = malloc(sizeof (UDP_INPUT));
+        if (!session->udp || udpInputOpen(session->udp, input, session->options.udpBuffer, session->options.jitterDepth,
+                    session->options.jitterLatency, session->options.udpTimeout) < 0) {
+            free(session->udp);
+            session->udp = NULL;
+            return AVERROR(EIO);
+        }
+        session->inputFd = session->udp->fd;
+    } else if (!strcmp(input, "pipe:") && size && !options->pollInput) {
+        // The ring is held whole, so it has to fit within the budget.
+        if (options->memoryBudget && size > options->memoryBudget / 4) {
+            size = options->memoryBudget / 4;
+        }
+        session->baseMemory += size;
+
+        fd = dup(STDIN_FILENO);
+        session->readahead = malloc(sizeof (READAHEAD));
+        if (fd < 0 || !session->readahead || readaheadStart(session->readahead, fd, size) < 0) {
+            if (fd >= 0 && !session->readahead) {
+                close(fd);
+            }
+            free(session->readahead);
+            session->readahead = NULL;
+            return AVERROR(ENOMEM);
+        }
+    } else if (!strcmp(input, "pipe:")) {
+        session->inputFd = dup(STDIN_FILENO);
+    } else if (!strstr(input, ":")) {
+        session->inputFd = open(input, O_RDONLY);
+    } else {
+        return 1;
+    }
+
+    if (session->inputFd < 0) {
+        return AVERROR(errno);
+    }
+
+    buffer = av_malloc(SESSION_INPUT_BUFFER_SIZE);
+    session->inputPb = buffer ? av_alloc_put_byte(buffer, SESSION_INPUT_BUFFER_SIZE, 0, session, readInput, NULL, seekInput) : NULL;
+    if (!session->inputPb) {
+        av_free(buffer);
+        return AVERROR(ENOMEM);
+    }
+
+    return av_open_input_stream(&session->ic, session->inputPb, input, ifmt, ap);
+}
+
+/**
+ * Used to write bytes of the current segment, into the ring or at the end of its file.
+ *
+ * @return int 0 on success, a negative error code otherwise.
+ */
+static int write_output(SESSION *session, const uint8_t *buf, int size) {
+    int ret;
+
+    if (session->segmentXxh) {
+        xxh64Update(session->segmentXxh, buf, size);
+    }
+    if (session->segmentSha) {
+        sha256Update(session->segmentSha, buf, size);
+    }
+
+    if (session->ring) {
+        ret = ringWrite(session->ring, session->output_index - 1, (uint8_t *) buf, size);
+        return ret < 0 ? ret : 0;
+    }
+
+    if (write_at(session->outputFd, (const char *) buf, size, session->outputOffset) < 0) {
+        return AVERROR(EIO);
+    }
+    session->outputOffset += size;
+
+    return 0;
+}
+
+/**
+ * Write callback of segments, kept in memory or written to their file, once
+ * encrypted when they are.
+ */
+static int writeSegment(void *opaque, uint8_t *buf, int buf_size) {
+    SESSION *session = opaque;
+    int size, chunk, ret;
+
+    // The previous run's file stands for the segment, it is muxed only to keep the muxer state, and hashed.
+    if (session->reused) {
+        xxh64Update(session->segmentXxh, buf, buf_size);
+        return buf_size;
+    }
+
+    if (!session->cipher) {
+        ret = write_output(session, buf, buf_size);
+        return ret < 0 ? ret : buf_size;
+    }
+
+    for (size = 0; size < buf_size; size += chunk) {
+        chunk = buf_size - size < SESSION_OUTPUT_BUFFER_SIZE ? buf_size - size : SESSION_OUTPUT_BUFFER_SIZE;
+        ret = write_output(session, session->cipherBuffer, aesCbcUpdate(session->cipher, buf + size, chunk, session->cipherBuffer));
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    return buf_size;
+}
+
+/**
+ * Used to name the file of a segment, after the output prefix already in the
+ * filename.
+ *
+ * @param SESSION *session the session.
+ * @param char *filename the filename, starting with the output prefix.
+ * @param unsigned int sequence the segment sequence number.
+ */
+static void segment_filename(SESSION *session, char *filename, unsigned int sequence) {
+    snprintf(filename + session->prefixLength, 15, "-%u.ts", sequence);
+}
+
+/**
+ * Used to name the pool file of a segment, pool files are used in rotation
+ * by sequence number.
+ *
+ * @param SESSION *session the session.
+ * @param unsigned int sequence the segment sequence number.
+ */
+static void pool_filename(SESSION *session, unsigned int sequence) {
+    const SESSION_OPTIONS *options = &session->options;
+
+    snprintf(session->pool_filename + session->prefixLength, 20, ".pool-%u",
+            sequence % (unsigned int) (options->maxTsFiles + 1 + SESSION_POOL_SPARE_FILES));
+}
+
+/**
+ * Used to take the pool file of the current segment. The file is overwritten
+ * in place, under its pool name, so its blocks are reused from one segment to
+ * the next, and only published under the segment name by close_segment(), once
+ * truncated to its final size.
+ *
+ * @param SESSION *session the session.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int open_pool_segment(SESSION *session) {
+    pool_filename(session, session->output_index - 1);
+
+    // The pool file does not exist yet during the first rotation.
+    session->outputFd = open(session->pool_filename, O_WRONLY | O_CREAT, 0644);
+    if (session->outputFd < 0) {
+        return -1;
+    }
+    session->outputOffset = 0;
+
+    // Reserve room for the largest segment so far, where the file system allows it.
+    if (session->poolReserve) {
+        fallocate(session->outputFd, FALLOC_FL_KEEP_SIZE, 0, session->poolReserve);
+    }
+
+    return 0;
+}
+
+/**
+ * Used to give the file of a segment that left the playlist back to the pool,
+ * or to remove it without a pool.
+ *
+ * @param SESSION *session the session.
+ * @param unsigned int sequence the segment sequence number.
+ */
+static void recycle_segment(SESSION *session, unsigned int sequence) {
+    segment_filename(session, session->remove_filename, sequence);
+
+    if (session->options.filePool) {
+        pool_filename(session, sequence);
+        if (rename(session->remove_filename, session->pool_filename) < 0) {
+            remove(session->remove_filename);
+        }
+    } else {
+        remove(session->remove_filename);
+    }
+
+    // A rotated key goes with the last segment it encrypted.
+    if (session->options.keyRotation && !(sequence % session->options.keyRotation)) {
+        key_filename(session, key_index(session, sequence));
+        remove(session->key_filename);
+    }
+}
+
+/**
+ * Used to get the time the current segment is planned to end at.
+ *
+ * @param SESSION *session the session, with prev_segment_time the segment start.
+ * @return unsigned int the time, in milliseconds.
+ */
+static unsigned int planned_end(SESSION *session) {
+    if (session->considerCuePoints && session->plan.boundaries->head) {
+        return session->plan.start + session->plan.boundaries->head->id;
+    }
+
+    return (unsigned int) ((session->prev_segment_time + session->options.segmentDuration) * 1000 + 0.5);
+}
+
+/**
+ * Used to name the file of a previous segment, moved aside when its name is
+ * taken by a new segment before it is reused.
+ *
+ * @param SESSION *session the session.
+ * @param MANIFEST_ENTRY *entry the previous segment.
+ */
+static void previous_filename(SESSION *session, MANIFEST_ENTRY *entry) {
+    snprintf(session->reuse_filename, strlen(session->options.outputPrefix) + 20, entry->state == MANIFEST_STASHED ? "%s-%u.ts.prev" : "%s-%u.ts",
+            session->options.outputPrefix, entry->sequence);
+}
+
+/**
+ * Used to move a previous segment aside, before its name is taken, when a later
+ * segment may still reuse it.
+ *
+ * @param SESSION *session the session.
+ * @param unsigned int sequence the sequence number about to be written.
+ */
+static void stash_previous(SESSION *session, unsigned int sequence) {
+    MANIFEST_ENTRY *entry = manifestEntry(session->previous, sequence);
+    char *name;
+
+    if (!entry || entry->state != MANIFEST_UNCLAIMED || entry->start <= session->segmentStart) {
+        return;
+    }
+
+    previous_filename(session, entry);
+    name = strdup(session->reuse_filename);
+    entry->state = MANIFEST_STASHED;
+    previous_filename(session, entry);
+
+    if (!name || rename(name, session->reuse_filename) < 0) {
+        entry->state = MANIFEST_CLAIMED;
+    }
+    free(name);
+}
+
+/**
+ * Used to keep the previous segment cut in the same place as the current one,
+ * once its digest is checked, under the current segment name.
+ *
+ * @param SESSION *session the session.
+ * @return int 1 when it is kept, 0 when the segment is to be written.
+ */
+static int reuse_segment(SESSION *session) {
+    MANIFEST_ENTRY *entry = manifestMatch(session->previous, session->segmentStart, session->segmentEnd);
+    enum Manifest_State state;
+    long long size;
+    uint64_t digest;
+    char *source;
+    int moved;
+
+    if (!entry || entry->state == MANIFEST_CLAIMED) {
+        return 0;
+    }
+
+    previous_filename(session, entry);
+    if (xxh64File(session->reuse_filename, &size, &digest) < 0 || size != entry->size || digest != entry->digest) {
+        fprintf(stderr, "{\"info\" : \"Previous segment (%s) changed, it is written again.\", \"channel\" : \"%s\"}\n",
+                session->reuse_filename, session->options.name);
+        return 0;
+    }
+
+    if (strcmp(session->reuse_filename, session->output_filename)) {
+        // Claimed first, so it is not moved aside from under itself.
+        source = strdup(session->reuse_filename);
+        state = entry->state;
+        entry->state = MANIFEST_CLAIMED;
+        stash_previous(session, session->output_index - 1);
+
+        moved = source && !rename(source, session->output_filename);
+        free(source);
+        if (!moved) {
+            entry->state = state;
+            return 0;
+        }
+    }
+
+    entry->state = MANIFEST_CLAIMED;
+    session->reused = entry;
+    ++session->reusedSegments;
+
+    return 1;
+}
+
+/**
+ * Used to mark a discontinuity where the segment just closed joins the previous
+ * one, when their timestamps or continuity counters break there. A kept
+ * segment holds those of the previous run, they follow on from the segments
+ * of this run only when it is byte for byte what this run muxed in its place,
+ * and otherwise only from its predecessor in the previous run.
+ *
+ * @param SESSION *session the session.
+ */
+static void mark_kept_join(SESSION *session) {
+    long long kept = session->reused ? session->reused->sequence : -1;
+    int muxed = !session->reused || (session->segmentXxh->length == (uint64_t) session->reused->size
+            && xxh64Digest(session->segmentXxh) == session->reused->digest);
+    unsigned int sequence = session->output_index - 1;
+    NODE *node;
+
+    if (session->lastKept != SESSION_NO_SEGMENT && !(muxed && session->lastMuxed) && !(kept >= 0 && kept == session->lastKept + 1)
+            && (!session->discontinuities->tail || session->discontinuities->tail->id != sequence)) {
+        node = createNode(sequence, NULL);
+        if (node) {
+            append(session->discontinuities, node);
+        }
+    }
+    session->lastKept = kept;
+    session->lastMuxed = muxed;
+}
+
+/**
+ * Used to add the segment just closed to the manifest.
+ *
+ * @param SESSION *session the session.
+ */
+static void write_manifest_entry(SESSION *session) {
+    MANIFEST_ENTRY entry;
+
+    memset(&entry, 0, sizeof (MANIFEST_ENTRY));
+    entry.sequence = session->output_index - 1;
+    entry.start = session->segmentStart;
+    entry.end = session->segmentEnd;
+
+    if (session->reused) {
+        entry.size = session->reused->size;
+        entry.digest = session->reused->digest;
+    } else {
+        entry.size = session->segmentXxh->length;
+        entry.digest = xxh64Digest(session->segmentXxh);
+    }
+
+    if (manifestWrite(session->manifestFp, &entry) < 0) {
+        ++session->counters.writeErrors;
+    }
+}
+
+/**
+ * Used to append the digest of the segment just closed, one JSON line, with
+ * the strong ETag a CDN may serve it with. A kept segment is hashed from its
+ * file, unless its manifest digest is the one asked for.
+ *
+ * @param SESSION *session the session.
+ */
+static void write_digest(SESSION *session) {
+    const SESSION_OPTIONS *options = &session->options;
+    unsigned char sha[SHA256_SIZE];
+    char hex[2 * SHA256_SIZE + 1];
+    unsigned int sequence = session->output_index - 1;
+    long long size;
+    int i;
+
+    if (session->segmentSha) {
+        if (!session->reused) {
+            size = session->segmentSha->length;
+            sha256Final(session->segmentSha, sha);
+        } else if (sha256File(session->output_filename, &size, sha) < 0) {
+            ++session->counters.writeErrors;
+            return;
+        }
+        for (i = 0; i < SHA256_SIZE; i++) {
+            snprintf(hex + 2 * i, 3, "%02x", sha[i]);
+        }
+    } else if (session->reused) {
+        size = session->reused->size;
+        snprintf(hex, sizeof (hex), "%016llx", (unsigned long long) session->reused->digest);
+    } else {
+        size = session->segmentXxh->length;
+        snprintf(hex, sizeof (hex), "%016llx", (unsigned long long) xxh64Digest(session->segmentXxh));
+    }
+
+    // Flushed at each boundary, as the statistics are.
+    if (fprintf(session->digestsFp, "{\"channel\" : \"%s\", \"sequence\" : %u, \"uri\" : \"%s%s-%u.ts\", \"size\" : %lld, \"%s\" : \"%s\", \"etag\" : \"\\\"%s\\\"\"}\n",
+            options->name, sequence, options->httpPrefix, options->outputPrefix, sequence, size, options->digestAlgorithm, hex, hex) < 0
+            || fflush(session->digestsFp)) {
+        ++session->counters.writeErrors;
+    }
+}
+
+/**
+ * Used to open the output of the current segment, a file named output_filename,
+ * a pool file published under that name, or its slot of the memory ring. A
+ * segment kept from the previous run gets an output discarding what is muxed.
+ * They are all written through the same context, so no segment allocates.
+ *
+ * @param SESSION *session the session.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int open_segment(SESSION *session) {
+    AVFormatContext *oc = session->oc;
+    unsigned char *buffer;
+    int reused = 0;
+
+    session->segmentStart = (unsigned int) (session->prev_segment_time * 1000 + 0.5);
+    session->segmentEnd = planned_end(session);
+
+    if (session->previous && !(reused = reuse_segment(session))) {
+        stash_previous(session, session->output_index - 1);
+    }
+
+    if (reused) {
+        // Nothing is written.
+    } else if (session->ring) {
+        if (ringOpenSegment(session->ring, session->output_index - 1) < 0) {
+            return -1;
+        }
+    } else if (session->options.filePool) {
+        if (open_pool_segment(session) < 0) {
+            return -1;
+        }
+    } else {
+        session->outputFd = open(session->output_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (session->outputFd < 0) {
+            return -1;
+        }
+        session->outputOffset = 0;
+    }
+
+    // A kept segment is hashed too, as what this run muxed, to tell whether it joins the segments around it.
+    if (session->segmentXxh) {
+        xxh64Init(session->segmentXxh, 0);
+    }
+    if (!reused && session->segmentSha) {
+        sha256Init(session->segmentSha);
+    }
+
+    // The sequence number is the IV, as players assume without an IV attribute.
+    if (session->cipher && !reused) {
+        unsigned char iv[AES_BLOCK_SIZE] = {0};
+        unsigned int sequence = session->output_index - 1;
+
+        if (load_key(session, sequence) < 0) {
+            fprintf(stderr, "{\"error\" : \"Could not load the key (%s).\", \"channel\" : \"%s\"}\n", session->key_filename, session->options.name);
+            return -1;
+        }
+        iv[12] = sequence >> 24;
+        iv[13] = sequence >> 16;
+        iv[14] = sequence >> 8;
+        iv[15] = sequence;
+        aesCbcInit(session->cipher, session->key, iv);
+    }
+
+    // The same context writes every segment, its position restarts with each of them.
+    if (!session->outputPb) {
+        buffer = av_malloc(SESSION_OUTPUT_BUFFER_SIZE);
+        session->outputPb = buffer ? av_alloc_put_byte(buffer, SESSION_OUTPUT_BUFFER_SIZE, 1, session, writeSegment, NULL, NULL) : NULL;
+        if (!session->outputPb) {
+            av_free(buffer);
+            return -1;
+        }
+    }
+    session->outputPb->pos = 0;
+    oc->pb = session->outputPb;
+
+    return 0;
+}
+
+/**
+ * Used to close the output of the current segment.
+ *
+ * @param SESSION *session the session.
+ */
+static void close_segment(SESSION *session) {
+    AVFormatContext *oc = session->oc;
+    long long size;
+    int bucket;
+
+    put_flush_packet(oc->pb);
+
+    // The padding ends the encrypted segment, it is not counted in its size.
+    if (session->cipher && !session->reused
+            && write_output(session, session->cipherBuffer, aesCbcFinal(session->cipher, session->cipherBuffer)) < 0) {
+        ++session->counters.writeErrors;
+    }
+
+    size = session->segmentSize = url_ftell(oc->pb);
+    for (bucket = 0; bucket < SESSION_SIZE_BUCKETS - 1 && size >= 1LL << bucket; bucket++);
+    ++session->sizeHistogram[bucket];
+    if (size > session->counters.largestSegment) {
+        session->counters.largestSegment = size;
+    }
+
+    if (session->reused) {
+        // Nothing was written.
+    } else if (session->ring) {
+        ringCloseSegment(session->ring, session->output_index - 1);
+    } else if (session->options.filePool) {
+        // Drops whatever an older, longer segment left past the end, before the segment name serves it.
+        if (ftruncate(session->outputFd, session->outputOffset) < 0) {
+            ++session->counters.writeErrors;
+        }
+        close(session->outputFd);
+        session->outputFd = -1;
+        if (rename(session->pool_filename, session->output_filename) < 0) {
+            ++session->counters.writeErrors;
+        }
+
+        if (session->outputOffset > session->poolReserve) {
+            session->poolReserve = session->outputOffset + session->outputOffset / 8;
+        }
+    } else if (session->outputFd >= 0) {
+        close(session->outputFd);
+        session->outputFd = -1;
+    }
+    oc->pb = NULL;
+
+    if (session->previous) {
+        mark_kept_join(session);
+    }
+    if (session->manifestFp) {
+        write_manifest_entry(session);
+    }
+    if (session->digestsFp) {
+        write_digest(session);
+    }
+    session->reused = NULL;
+}
+
+/**
+ * Used to close the current partial segment, at the current end of the segment file.
+ *
+ * @param SESSION *session the session.
+ * @param double now the output time the part ends at.
+ */
+static void close_part(SESSION *session, double now) {
+    unsigned int sequence = session->output_index - 1;
+    PART_SEGMENT *segment = &session->partSegments[sequence % SESSION_PART_SEGMENTS];
+    long long offset;
+    PART *part;
+
+    put_flush_packet(session->oc->pb);
+    offset = url_ftell(session->oc->pb);
+
+    if (segment->sequence != sequence) {
+        segment->sequence = sequence;
+        segment->count = 0;
+    }
+
+    if (offset <= session->partStartOffset || segment->count == SESSION_MAX_PARTS) {
+        return;
+    }
+
+    part = &segment->parts[segment->count++];
+    part->duration = now - session->partStartTime;
+    part->offset = session->partStartOffset;
+    part->size = offset - session->partStartOffset;
+    part->independent = session->partIndependent == 1 || session->video_index < 0;
+
+    session->partStartTime = now;
+    session->partStartOffset = offset;
+    session->partIndependent = -1;
+}
+
+/**
+ * Used to rewrite the low latency playlist, and wake up the blocked reloads.
+ *
+ * @param SESSION *session the session.
+ */
+static void publish_parts(SESSION *session) {
+    unsigned int sequence = session->output_index - 1;
+    PART_SEGMENT *segment = &session->partSegments[sequence % SESSION_PART_SEGMENTS];
+    uint64_t tick;
+
+    if (session->write_index) {
+        tick = metricsNow();
+        session->write_index = !write_index_file(session, session->minSegmentDuration, session->first_segment, session->last_segment, 0);
+        metricsElapsed(&session->counters.metrics.timers[METRICS_INDEX], tick);
+    }
+
+    if (session->origin) {
+        originPublish(session->origin, session->last_segment, sequence, segment->sequence == sequence ? segment->count : 0,
+                session->partStartOffset, session->output_filename, session->options.segmentDuration);
+    }
+}
+
+/**
+ * Used to start the built-in origin, serving the memory ring when there is one.
+ *
+ * @param SESSION *session the session.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int start_origin(SESSION *session) {
+    const SESSION_OPTIONS *options = &session->options;
+
+    if (options->memoryRing) {
+        session->ring = malloc(sizeof (MEMORY_RING));
+        // The window, the segment being written, and the spare slots for late downloads.
+        if (!session->ring || ringInit(session->ring, options->maxTsFiles + 1 + MEMORY_RING_SPARE_SLOTS) < 0) {
+            fprintf(stderr, "{\"error\" : \"Could not allocate the memory ring.\", \"channel\" : \"%s\"}\n", options->name);
+            free(session->ring);
+            session->ring = NULL;
+            return -1;
+        }
+    }
+
+    session->origin = malloc(sizeof (ORIGIN));
+    if (!session->origin || originStart(session->origin, options->originPort, options->index, session->ring, options->outputPrefix) < 0) {
+        fprintf(stderr, "{\"error\" : \"Could not start the origin on port %d.\", \"channel\" : \"%s\"}\n", options->originPort, options->name);
+        free(session->origin);
+        session->origin = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to open the input and the first output of a session.
+ *
+ * @param SESSION *session the prepared session.
+ * @return int 0 on success, -1 otherwise.
+ */
+int sessionOpen(SESSION *session) {
+    const SESSION_OPTIONS *options = &session->options;
+    AVInputFormat *ifmt;
+    AVOutputFormat *ofmt;
+    AVFormatParameters ap;
+    AVFormatContext *ic, *oc;
+    AVCodec *codec;
+    AVStream *st;
+    int ret = 1, streams, slot;
+    unsigned int i;
+    long size;
+
+    session->state = SESSION_FAILED;
+    session->startTime = getMonotonicMilliseconds();
+
+    ifmt = av_find_input_format("mpegts");
+    if (!ifmt) {
+        fprintf(stderr, "Could not find MPEG-TS demuxer\n");
+        return -1;
+    }
+
+    // The context is allocated up front, so the probing limits apply to the opening as well.
+    ic = session->ic = avformat_alloc_context();
+    if (!ic) {
+        fprintf(stderr, "Could not allocate input context\n");
+        return -1;
+    }
+    if (options->probesize) {
+        ic->probesize = options->probesize;
+    }
+    if (options->analyzeduration >= 0) {
+        ic->max_analyze_duration = options->analyzeduration;
+    }
+    // Probing buffers the input in memory, on the stack of the supervisor opener, so both have to fit within the budget.
+    if (options->memoryBudget && ic->probesize > options->memoryBudget / 2 - options->openerMemory) {
+        if (options->memoryBudget / 2 <= options->openerMemory) {
+            fprintf(stderr, "{\"error\" : \"Memory budget of %ld bytes leaves too little to probe.\", \"channel\" : \"%s\"}\n", options->memoryBudget, options->name);
+            return -1;
+        }
+        ic->probesize = options->memoryBudget / 2 - options->openerMemory;
+    }
+    session->baseMemory = ic->probesize + SESSION_INPUT_BUFFER_SIZE;
+    memset(&ap, 0, sizeof (ap));
+    ap.prealloced_context = 1;
+
+    if (options->scte35) {
+        session->scte35 = malloc(sizeof (SCTE35));
+        if (!session->scte35) {
+            fprintf(stderr, "Could not allocate the SCTE-35 scanner\n");
+            return -1;
+        }
+        scte35Init(session->scte35);
+    }
+
+    if (options->pollInput || options->scte35 || options->readahead || is_udp_input(options->input)) {
+        ret = openPollableInput(session, ifmt, &ap);
+    }
+    if (ret > 0) {
+        if (options->scte35) {
+            fprintf(stderr, "{\"error\" : \"SCTE-35 detection needs a local file or the standard input.\", \"channel\" : \"%s\"}\n", options->name);
+        }
+        ret = av_open_input_file(&session->ic, options->input, ifmt, 0, &ap);
+    }
+    ic = session->ic;
+    if (ret != 0) {
+        fprintf(stderr, "Could not open input file, make sure it is an mpegts file: %d\n", ret);
+        session->ic = NULL;
+        return -1;
+    }
+
+    // Skip probing when the cached stream parameters match the input.
+    if (!options->streamInfoPath || loadStreamInfo(ic, options->streamInfoPath) < 0) {
+        if (av_find_stream_info(ic) < 0) {
+            fprintf(stderr, "Could not read stream information\n");
+            return -1;
+        }
+
+        if (options->streamInfoPath && saveStreamInfo(ic, options->streamInfoPath) < 0) {
+            fprintf(stderr, "{\"error\" : \"Could not write stream info cache (%s).\"}\n", options->streamInfoPath);
+        }
+    }
+
+    // From here on, the supervisor reads the input, into the ring.
+    if (options->pollInput && session->inputPb && start_feed(session) < 0) {
+        return -1;
+    }
+
+    session->counters.openMilliseconds = getMonotonicMilliseconds() - session->startTime;
+    fprintf(stderr, "{\"info\" : \"Stream information ready after %.3f ms.\", \"channel\" : \"%s\"}\n", session->counters.openMilliseconds, options->name);
+
+    ofmt = guess_format("mpegts", NULL, NULL);
+    if (!ofmt) {
+        fprintf(stderr, "Could not find MPEG-TS muxer\n");
+        return -1;
+    }
+
+    oc = session->oc = avformat_alloc_context();
+    if (!oc) {
+        fprintf(stderr, "Could not allocated output context");
+        return -1;
+    }
+    oc->oformat = ofmt;
+
+    for (i = 0; i < ic->nb_streams && (session->video_index < 0 || session->audio_index < 0); i++) {
+        switch (ic->streams[i]->codec->codec_type) {
+            case CODEC_TYPE_VIDEO:
+                session->video_index = i;
+                ic->streams[i]->discard = AVDISCARD_NONE;
+                session->video_st = add_output_stream(oc, ic->streams[i]);
+                break;
+            case CODEC_TYPE_AUDIO:
+                session->audio_index = i;
+                ic->streams[i]->discard = AVDISCARD_NONE;
+                session->audio_st = add_output_stream(oc, ic->streams[i]);
+                break;
+            default:
+                ic->streams[i]->discard = AVDISCARD_ALL;
+                break;
+        }
+    }
+
+    if ((session->video_index >= 0 && !session->video_st) || (session->audio_index >= 0 && !session->audio_st)) {
+        return -1;
+    }
+
+    if (av_set_parameters(oc, NULL) < 0) {
+        fprintf(stderr, "Invalid output format parameters\n");
+        return -1;
+    }
+
+    dump_format(oc, 0, options->outputPrefix, 1);
+
+    if (session->video_st) {
+        codec = avcodec_find_decoder(session->video_st->codec->codec_id);
+        if (!codec) {
+            fprintf(stderr, "Could not find video decoder, key frames will not be honored\n");
+        }
+
+        if (avcodec_open(session->video_st->codec, codec) < 0) {
+            fprintf(stderr, "Could not open video decoder, key frames will not be honored\n");
+        }
+    }
+
+    // Thumbnails are made from the video key frames, on their own threads.
+    if (options->thumbnailsPrefix && session->video_st) {
+        session->thumbnails = malloc(sizeof (THUMBNAILS));
+        if (!session->thumbnails || thumbnailsStart(session->thumbnails, session->video_st->codec, options->thumbnailsPrefix,
+                    options->thumbnailWidth, options->thumbnailHeight, options->thumbnailWorkers, options->thumbnailQueue,
+                    options->thumbnailDrop) < 0) {
+            fprintf(stderr, "{\"error\" : \"Could not start the thumbnail workers (%s).\", \"channel\" : \"%s\"}\n", options->thumbnailsPrefix, options->name);
+            free(session->thumbnails);
+            session->thumbnails = NULL;
+            return -1;
+        }
+    } else if (options->thumbnailsPrefix) {
+        fprintf(stderr, "{\"info\" : \"No video stream, no thumbnails.\", \"channel\" : \"%s\"}\n", options->name);
+    }
+
+    if (options->controlPath) {
+        session->control = malloc(sizeof (CONTROL));
+        if (!session->control || controlStart(session->control, options->controlPath) < 0) {
+            fprintf(stderr, "{\"error\" : \"Could not open the control FIFO (%s).\", \"channel\" : \"%s\"}\n", options->controlPath, options->name);
+            free(session->control);
+            session->control = NULL;
+            return -1;
+        }
+    }
+
+    // The origin comes first, as it owns the memory ring segments may be written to.
+    if (options->originPort && start_origin(session) < 0) {
+        return -1;
+    }
+
+    segment_filename(session, session->output_filename, session->output_index++);
+    if (open_segment(session) < 0) {
+        fprintf(stderr, "Could not open '%s'\n", session->output_filename);
+        return -1;
+    }
+
+    if (av_write_header(oc)) {
+        fprintf(stderr, "Could not write mpegts header to first output file\n");
+        return -1;
+    }
+
+    // The interleaving arena and slots are allocated up front, within what the budget leaves.
+    streams = (session->video_st != NULL) + (session->audio_st != NULL);
+    size = options->interleaveBytes;
+    if (streams > 1 && options->memoryBudget && session->baseMemory + size + size / INTERLEAVER_SLOT_BYTES * (long) sizeof (INTERLEAVER_SLOT) > options->memoryBudget) {
+        size = (options->memoryBudget - session->baseMemory) / (long) (INTERLEAVER_SLOT_BYTES + sizeof (INTERLEAVER_SLOT)) * INTERLEAVER_SLOT_BYTES;
+        if (size < INTERLEAVER_MIN_BYTES) {
+            fprintf(stderr, "{\"error\" : \"Memory budget of %ld bytes leaves too little to interleave.\", \"channel\" : \"%s\"}\n", options->memoryBudget, options->name);
+            return -1;
+        }
+    }
+
+    session->interleaver = malloc(sizeof (INTERLEAVER));
+    if (!session->interleaver || interleaverInit(session->interleaver, oc, streams, size, options->interleaveDelta, options->interleaveFlush) < 0) {
+        fprintf(stderr, "{\"error\" : \"Could not allocate the interleaver (%ld bytes).\", \"channel\" : \"%s\"}\n", size, options->name);
+        free(session->interleaver);
+        session->interleaver = NULL;
+        return -1;
+    }
+    session->baseMemory += session->interleaver->size + session->interleaver->capacity * sizeof (INTERLEAVER_SLOT);
+
+    // Streams are interleaved as in write_packet(), the video first when there is one.
+    for (slot = 0; slot < streams; slot++) {
+        st = ic->streams[slot || session->video_index < 0 ? session->audio_index : session->video_index];
+        if (st->pts_wrap_bits > 0 && st->pts_wrap_bits < 63) {
+            interleaverWrap(session->interleaver, slot, av_rescale_q(1LL << st->pts_wrap_bits, st->time_base, AV_TIME_BASE_Q));
+        }
+    }
+
+    // The index is written once before the first cut.
+    session->write_index = !write_index_file(session, session->minSegmentDuration, session->first_segment, session->last_segment, 0);
+
+    if (options->partDuration) {
+        session->partIndependent = -1;
+        publish_parts(session);
+    }
+
+    session->state = SESSION_RUNNING;
+    return 0;
+}
+
+/**
+ * Used to hand a packet to the interleaver, and keep where its output stream
+ * stands: the muxer sets the stream pts to the packet timestamp, plus a frame
+ * duration, once it is written, which may be later.
+ *
+ * @param SESSION *session the session.
+ * @param AVPacket *packet the packet.
+ * @return int the interleaverWrite() result.
+ */
+static int write_packet(SESSION *session, AVPacket *packet) {
+    int slot = packet->stream_index == session->video_index ? 0 : 1;
+    AVStream *st = slot ? session->audio_st : session->video_st;
+    int64_t dts = packet->dts != AV_NOPTS_VALUE ? packet->dts : packet->pts;
+
+    if (st && packet->stream_index == (slot ? session->audio_index : session->video_index)) {
+        if (dts != AV_NOPTS_VALUE) {
+            session->streamPts[slot] = dts;
+        }
+        if (!slot && st->codec->time_base.den) {
+            session->streamPts[slot] += av_rescale_q(1, st->codec->time_base, st->time_base);
+        } else if (st->codec->frame_size && st->codec->sample_rate) {
+            session->streamPts[slot] += av_rescale(st->codec->frame_size, st->time_base.den, (int64_t) st->time_base.num * st->codec->sample_rate);
+        }
+    }
+
+    dts = packet->dts == AV_NOPTS_VALUE ? AV_NOPTS_VALUE
+        : av_rescale_q(packet->dts, session->ic->streams[packet->stream_index]->time_base, AV_TIME_BASE_Q);
+
+    return interleaverWrite(session->interleaver, packet, session->video_index >= 0 ? slot : 0, dts);
+}
+
+/**
+ * Used to get where an output stream stands, in seconds.
+ *
+ * @param SESSION *session the session.
+ * @param AVStream *st the video or audio output stream.
+ * @return double the time.
+ */
+static double stream_time(SESSION *session, AVStream *st) {
+    return (double) session->streamPts[st == session->video_st ? 0 : 1] * st->time_base.num / st->time_base.den + session->timeOffset;
+}
+
+/**
+ * Used to add a cue point to the plan, and report it.
+ *
+ * @param SESSION *session the session.
+ * @param long long time the cue point time, in milliseconds.
+ * @param const char *source what the cue point comes from.
+ * @return int 0 when added, -1 when ignored.
+ */
+static int add_cue(SESSION *session, long long time, const char *source) {
+    if (time < 0 || time > UINT_MAX || cuePlanInsert(&session->plan, (unsigned int) time) != 0) {
+        fprintf(stderr, "{\"error\" : \"Cue point at %lld ms from %s ignored, it is already cut or planned.\", \"channel\" : \"%s\"}\n", time, source, session->options.name);
+        return -1;
+    }
+
+    fprintf(stderr, "{\"info\" : \"Cue point added at %lld ms from %s.\", \"channel\" : \"%s\"}\n", time, source, session->options.name);
+
+    return 0;
+}
+
+/**
+ * Used to get the current output time, in milliseconds.
+ *
+ * @param SESSION *session the session.
+ * @return long long the time.
+ */
+static long long output_time(SESSION *session) {
+    AVStream *st = session->video_st ? session->video_st : session->audio_st;
+
+    return (long long) (stream_time(session, st) * 1000);
+}
+
+/**
+ * Used to turn the detected SCTE-35 splices into cue points, a break with a
+ * duration gets its return point as well.
+ *
+ * @param SESSION *session the session.
+ */
+static void receive_splices(SESSION *session) {
+    SCTE35_SPLICE splice;
+    AD_BREAK *adBreak;
+    long long time;
+    int added;
+
+    while (scte35Receive(session->scte35, &splice)) {
+        time = splice.pts < 0 ? output_time(session) : splice.pts / 90 + (long long) (session->timeOffset * 1000);
+        added = add_cue(session, time, "SCTE-35");
+
+        // Both ends are kept, so they are marked as one break.
+        if (splice.duration && add_cue(session, time + splice.duration / 90, "SCTE-35") == 0 && added == 0
+                && (adBreak = malloc(sizeof (AD_BREAK)))) {
+            adBreak->out = (unsigned int) time;
+            adBreak->in = (unsigned int) (time + splice.duration / 90);
+            if (!append(session->breaks, createNode(adBreak->out, adBreak))) {
+                free(adBreak);
+            }
+        }
+    }
+}
+
+/**
+ * Used to build the ad markers of a cue point, once, when the segment ending
+ * on it is cut: the start of a break announced with a duration, its end, or
+ * an ad opportunity of no set duration for other cue points. Both ends of a
+ * break share the date range identifier.
+ *
+ * @param SESSION *session the session.
+ * @param NODE *cue the cue point.
+ * @param char *markers receives the markers, HISTORY_MARKERS_SIZE bytes.
+ */
+static void cue_markers(SESSION *session, NODE *cue, char *markers) {
+    char start[32], end[32];
+    AD_BREAK *adBreak;
+    NODE *node;
+
+    format_date(session, cue->id, start);
+
+    for (node = session->breaks->head; node; node = node->next) {
+        adBreak = node->data;
+
+        if (adBreak->out == cue->id) {
+            snprintf(markers, HISTORY_MARKERS_SIZE, "#EXT-X-DATERANGE:ID=\"break-%u\",START-DATE=\"%s\",PLANNED-DURATION=%.3f\n"
+                    "#EXT-X-CUE-OUT:DURATION=%.3f\n", adBreak->out, start, (adBreak->in - adBreak->out) / 1000.0, (adBreak->in - adBreak->out) / 1000.0);
+
+            return;
+        }
+
+        if (adBreak->in == cue->id) {
+            format_date(session, adBreak->out, end);
+            snprintf(markers, HISTORY_MARKERS_SIZE, "#EXT-X-DATERANGE:ID=\"break-%u\",START-DATE=\"%s\",END-DATE=\"%s\"\n#EXT-X-CUE-IN\n",
+                    adBreak->out, end, start);
+            free(adBreak);
+            removeNode(session->breaks, node);
+
+            return;
+        }
+    }
+
+    snprintf(markers, HISTORY_MARKERS_SIZE, "#EXT-X-DATERANGE:ID=\"break-%u\",START-DATE=\"%s\",DURATION=0.000\n#EXT-X-CUE-OUT:DURATION=0\n#EXT-X-CUE-IN\n",
+            cue->id, start);
+}
+
+/**
+ * Used to get the oldest segment of a full window, the one leaving it next.
+ *
+ * @param SESSION *session the session.
+ * @return HISTORY_ENTRY * the segment, NULL when segments are not recorded, or the window is not full.
+ */
+static HISTORY_ENTRY *oldest_segment(SESSION *session) {
+    if (!session->considerCuePoints || session->history.count < session->history.capacity) {
+        return NULL;
+    }
+
+    return historyAt(&session->history, 0);
+}
+
+/**
+ * Used to archive the segments still in the window once the input ends, and
+ * close the archive playlist.
+ *
+ * @param SESSION *session the session.
+ */
+static void finish_archive(SESSION *session) {
+    HISTORY_ENTRY *entry = NULL;
+    double start = session->windowStart;
+    unsigned int sequence = session->first_segment, i = 0;
+    int ret = 0;
+
+    // The history ends on the last segment.
+    if (session->considerCuePoints) {
+        sequence = session->last_segment - session->history.count + 1;
+    }
+
+    for (; !ret && sequence <= session->last_segment; sequence++) {
+        if (session->considerCuePoints && !(entry = historyAt(&session->history, i++))) {
+            break;
+        }
+        ret = archive_segment(session, sequence, entry, start);
+        if (entry) {
+            start += entry->duration / 1000.0;
+        }
+    }
+
+    if (ret < 0 || write_at(session->archiveFd, "#EXT-X-ENDLIST\n", 15, session->archiveOffset) < 0) {
+        fprintf(stderr, "{\"error\" : \"Could not write the archive playlist (%s).\", \"channel\" : \"%s\"}\n",
+                session->options.archivePath, session->options.name);
+        return;
+    }
+    session->archiveOffset += 15;
+}
+
+/**
+ * Used to record a complete segment for the cue points index, keeping the
+ * segments of the window only.
+ *
+ * @param SESSION *session the session.
+ * @param double segment_time the time the segment ends at.
+ * @param NODE *cue the cue point the segment ends on, released here, NULL when none.
+ */
+static void record_segment(SESSION *session, double segment_time, NODE *cue) {
+    HISTORY_ENTRY *entry;
+    char *markers;
+
+    // Output times are dated from the first cut on.
+    if (!session->wallClockOrigin) {
+        session->wallClockOrigin = getWallClockMilliseconds() - segment_time * 1000;
+        session->windowStart = session->prev_segment_time;
+    }
 
-    ofmt = guess_format("mpegts", NULL, NULL);
-    if (!ofmt) {
-        fprintf(stderr, "Could not find MPEG-TS muxer\n");
-        exit(1);
+    // The segment leaving the window gives its slot, and markers buffer, to the one entering it.
+    if (session->history.bounded && session->history.count == session->history.capacity) {
+        session->windowStart += historyAt(&session->history, 0)->duration / 1000.0;
+        historyDropOldest(&session->history);
     }
 
-    oc = avformat_alloc_context();
-    if (!oc) {
-        fprintf(stderr, "Could not allocated output context");
-        exit(1);
+    entry = historyAppend(&session->history);
+    if (!entry) {
+        if (cue) {
+            cuePlanRecycle(&session->plan, cue);
+        }
+        return;
     }
-    oc->oformat = ofmt;
+    entry->duration = (int) ((segment_time - session->prev_segment_time) * 1000 + 0.5);
 
-    video_index = -1;
-    audio_index = -1;
+    if (cue) {
+        markers = historyMarkers(entry);
+        if (markers) {
+            cue_markers(session, cue, markers);
+            entry->marked = 1;
+        }
+        cuePlanRecycle(&session->plan, cue);
+    }
 
-    for (i = 0; i < ic->nb_streams && (video_index < 0 || audio_index < 0); i++) {
-        switch (ic->streams[i]->codec->codec_type) {
-            case CODEC_TYPE_VIDEO:
-                video_index = i;
-                ic->streams[i]->discard = AVDISCARD_NONE;
-                video_st = add_output_stream(oc, ic->streams[i]);
-                break;
-            case CODEC_TYPE_AUDIO:
-                audio_index = i;
-                ic->streams[i]->discard = AVDISCARD_NONE;
-                audio_st = add_output_stream(oc, ic->streams[i]);
-                break;
-            default:
-                ic->streams[i]->discard = AVDISCARD_ALL;
-                break;
+    // Segments are listed rounded to the second.
+    if ((entry->duration + 500) / 1000 > session->targetDuration) {
+        session->targetDuration = (entry->duration + 500) / 1000;
+    }
+}
+
+/**
+ * Used to merge the cue points received on the control channel into the plan.
+ *
+ * @param SESSION *session the session.
+ */
+static void receive_cues(SESSION *session) {
+    CUE_COMMAND command;
+
+    while (controlReceive(session->control, &command)) {
+        add_cue(session, command.relative ? output_time(session) + command.time
+                : command.time + (command.input ? (long long) (session->timeOffset * 1000) : 0), "the control channel");
+    }
+}
+
+/**
+ * Used to write the metrics of sessions in the Prometheus text format, the
+ * samples of every session grouped by family.
+ *
+ * @param FILE *fp the destination.
+ * @param const char *const *names the channel names.
+ * @param const SESSION_COUNTERS *const *counters their counters.
+ * @param int count the number of sessions.
+ */
+void sessionWriteMetrics(FILE *fp, const char *const *names, const SESSION_COUNTERS *const *counters, int count) {
+    static const char *timers[METRICS_TIMERS][2] = {
+        {"segmenter_read_seconds", "Time spent reading a packet from the input."},
+        {"segmenter_write_seconds", "Time spent handing a packet to the muxer."},
+        {"segmenter_segment_open_seconds", "Time spent opening the output of a segment."},
+        {"segmenter_segment_close_seconds", "Time spent flushing and closing the output of a segment."},
+        {"segmenter_index_write_seconds", "Time spent rewriting the playlist."},
+        {"segmenter_remove_seconds", "Time spent removing a segment leaving the window, or giving it back to the pool."}
+    };
+    int i, timer;
+
+#define WRITE_FAMILY(name, type, help, value) \
+    metricsFamily(fp, name, type, help); \
+    for (i = 0; i < count; i++) { \
+        metricsSample(fp, name, names[i], (double) (value)); \
+    }
+
+    WRITE_FAMILY("segmenter_packets_total", "counter", "Packets read from the input.", counters[i]->packets);
+    WRITE_FAMILY("segmenter_bytes_total", "counter", "Bytes read from the input.", counters[i]->bytes);
+    WRITE_FAMILY("segmenter_segments_total", "counter", "Segments cut.", counters[i]->segments);
+    WRITE_FAMILY("segmenter_write_errors_total", "counter", "Packets, parts or checkpoints that could not be written.", counters[i]->writeErrors);
+    WRITE_FAMILY("segmenter_packets_per_second", "gauge", "Packets read per second, over the last second or more.", counters[i]->metrics.packetsPerSecond);
+    WRITE_FAMILY("segmenter_bytes_per_second", "gauge", "Bytes read per second, over the last second or more.", counters[i]->metrics.bytesPerSecond);
+    WRITE_FAMILY("segmenter_interleave_packets", "gauge", "Packets queued by the interleaver.", counters[i]->metrics.interleavePackets);
+    WRITE_FAMILY("segmenter_interleave_bytes", "gauge", "Arena bytes held by the interleaver.", counters[i]->interleaveBytes);
+    WRITE_FAMILY("segmenter_interleave_span_seconds", "gauge", "Span of the timestamps queued by the interleaver, the latency it adds.", counters[i]->metrics.interleaveSpan);
+    WRITE_FAMILY("segmenter_interleave_forced_delta_total", "counter", "Packets written before their turn, past the interleave delta.", counters[i]->metrics.interleaveForcedDelta);
+    WRITE_FAMILY("segmenter_interleave_forced_bytes_total", "counter", "Packets written before their turn, out of interleaving arena or slots.", counters[i]->metrics.interleaveForcedBytes);
+    WRITE_FAMILY("segmenter_pending_cues", "gauge", "Cue points planned and not yet cut.", counters[i]->metrics.pendingCues);
+    WRITE_FAMILY("segmenter_pending_splices", "gauge", "SCTE-35 splices read and not yet planned.", counters[i]->metrics.pendingSplices);
+    WRITE_FAMILY("segmenter_thumbnails_total", "counter", "Thumbnails tiled into sprite sheets.", counters[i]->metrics.thumbnails);
+    WRITE_FAMILY("segmenter_thumbnail_drops_total", "counter", "Key frames dropped because the thumbnail workers fell behind.", counters[i]->metrics.thumbnailDrops);
+    WRITE_FAMILY("segmenter_pending_thumbnails", "gauge", "Key frames queued for the thumbnail workers.", counters[i]->metrics.pendingThumbnails);
+    WRITE_FAMILY("segmenter_readahead_bytes", "gauge", "Standard input bytes read ahead and not yet demuxed.", counters[i]->metrics.readaheadBytes);
+    WRITE_FAMILY("segmenter_readahead_high_water_bytes", "gauge", "Most standard input bytes read ahead at once.", counters[i]->metrics.readaheadHighWater);
+    WRITE_FAMILY("segmenter_readahead_overflows_total", "counter", "Times the readahead ring filled up, holding the producer back.", counters[i]->metrics.readaheadOverflows);
+    WRITE_FAMILY("segmenter_readahead_full_seconds_total", "counter", "Time the readahead ring was full.", counters[i]->metrics.readaheadFullSeconds);
+    WRITE_FAMILY("segmenter_readahead_underruns_total", "counter", "Times the segmenter waited on an empty readahead ring.", counters[i]->metrics.readaheadUnderruns);
+    WRITE_FAMILY("segmenter_udp_datagrams_total", "counter", "Datagrams received by the UDP or RTP input.", counters[i]->metrics.udpDatagrams);
+    WRITE_FAMILY("segmenter_udp_batches_total", "counter", "recvmmsg() calls of the UDP or RTP input that returned datagrams.", counters[i]->metrics.udpBatches);
+    WRITE_FAMILY("segmenter_udp_lost_total", "counter", "RTP datagrams never received, or given up on by the jitter buffer.", counters[i]->metrics.udpLost);
+    WRITE_FAMILY("segmenter_udp_late_total", "counter", "RTP datagrams received after they were given up on, or twice.", counters[i]->metrics.udpLate);
+    WRITE_FAMILY("segmenter_udp_discarded_total", "counter", "Datagrams truncated, or not RTP on an RTP input.", counters[i]->metrics.udpDiscarded);
+    WRITE_FAMILY("segmenter_continuity_errors_total", "counter", "TS continuity counter errors of the UDP or RTP input.", counters[i]->metrics.continuityErrors);
+    WRITE_FAMILY("segmenter_jitter_buffered", "gauge", "RTP datagrams held in the jitter buffer.", counters[i]->metrics.jitterBuffered);
+
+#undef WRITE_FAMILY
+
+    for (timer = 0; timer < METRICS_TIMERS; timer++) {
+        metricsFamily(fp, timers[timer][0], "histogram", timers[timer][1]);
+        for (i = 0; i < count; i++) {
+            metricsHistogram(fp, timers[timer][0], names[i], &counters[i]->metrics.timers[timer]);
         }
     }
 
-    if (av_set_parameters(oc, NULL) < 0) {
-        fprintf(stderr, "Invalid output format parameters\n");
-        exit(1);
+    metricsFamily(fp, "segmenter_boundary_lateness_seconds", "histogram", "How far past their planned boundary segments are cut, waiting for a key frame.");
+    for (i = 0; i < count; i++) {
+        metricsHistogram(fp, "segmenter_boundary_lateness_seconds", names[i], &counters[i]->metrics.lateness);
+    }
+
+    metricsFamily(fp, "segmenter_interleave_latency_seconds", "histogram", "Time packets were held by the interleaver.");
+    for (i = 0; i < count; i++) {
+        metricsHistogram(fp, "segmenter_interleave_latency_seconds", names[i], &counters[i]->metrics.interleaveLatency);
     }
+}
 
-    dump_format(oc, 0, output_prefix, 1);
+/**
+ * Used to export the metrics of a session, to its metrics file through a
+ * temporary file, and to its origin.
+ *
+ * @param SESSION *session the session.
+ */
+static void export_metrics(SESSION *session) {
+    const SESSION_COUNTERS *counters = &session->counters;
+    const char *path = session->options.metricsPath, *name = session->options.name;
+    char tmpPath[PATH_MAX], *buffer;
+    size_t size;
+    FILE *fp;
+
+    if (path && snprintf(tmpPath, PATH_MAX, "%s.tmp", path) < PATH_MAX
+            && (fp = rewind_stream(&session->scratchFp, &session->scratchBuffer, &session->scratchSize))) {
+        sessionWriteMetrics(fp, &name, &counters, 1);
+        write_file(tmpPath, path, fp, &session->scratchBuffer, &session->scratchSize, 0);
+    }
 
-    codec = avcodec_find_decoder(video_st->codec->codec_id);
-    if (!codec) {
-        fprintf(stderr, "Could not find video decoder, key frames will not be honored\n");
+    if (session->origin && (fp = open_memstream(&buffer, &size))) {
+        sessionWriteMetrics(fp, &name, &counters, 1);
+        if (fclose(fp) == 0) {
+            originPublishMetrics(session->origin, buffer, size);
+        } else {
+            free(buffer);
+        }
     }
+}
 
-    if (avcodec_open(video_st->codec, codec) < 0) {
-        fprintf(stderr, "Could not open video decoder, key frames will not be honored\n");
+/**
+ * Used to refresh the throughput and the queue depths, and to export the
+ * metrics at most once per second.
+ *
+ * @param SESSION *session the session.
+ * @param double now the current monotonic time, in milliseconds.
+ */
+static void update_metrics(SESSION *session, double now) {
+    METRICS *metrics = &session->counters.metrics;
+    double elapsed = now - metrics->rateStart;
+
+    if (elapsed >= 1000) {
+        if (metrics->rateStart) {
+            metrics->packetsPerSecond = (session->counters.packets - metrics->ratePackets) * 1000 / elapsed;
+            metrics->bytesPerSecond = (session->counters.bytes - metrics->rateBytes) * 1000 / elapsed;
+        }
+        metrics->rateStart = now;
+        metrics->ratePackets = session->counters.packets;
+        metrics->rateBytes = session->counters.bytes;
     }
 
-    snprintf(output_filename, strlen(output_prefix) + 15, "%s-%u.ts", output_prefix, output_index++);
-    if (url_fopen(&oc->pb, output_filename, URL_WRONLY) < 0) {
-        fprintf(stderr, "Could not open '%s'\n", output_filename);
-        exit(1);
+    if (session->interleaver) {
+        metrics->interleavePackets = session->interleaver->packets;
+        metrics->interleaveSpan = interleaverSpan(session->interleaver) / (double) AV_TIME_BASE;
+        metrics->interleaveForcedDelta = session->interleaver->forcedDelta;
+        metrics->interleaveForcedBytes = session->interleaver->forcedBytes;
+        metrics->interleaveLatency = session->interleaver->latency;
+        session->counters.interleaveBytes = interleaverBytes(session->interleaver);
+        session->counters.peakInterleaveBytes = session->interleaver->peakBytes;
+    }
+    metrics->pendingCues = session->considerCuePoints && session->plan.cues ? session->plan.cues->length : 0;
+    metrics->pendingSplices = session->scte35 ? session->scte35->spliceCount : 0;
+    if (session->udp) {
+        if (session->feed) {
+            pthread_mutex_lock(&session->feed->lock);
+        }
+        metrics->udpDatagrams = session->udp->datagrams;
+        metrics->udpBatches = session->udp->batches;
+        metrics->udpLost = session->udp->lost;
+        metrics->udpLate = session->udp->late;
+        metrics->udpDiscarded = session->udp->discarded;
+        metrics->continuityErrors = session->udp->continuityErrors;
+        metrics->jitterBuffered = session->udp->buffered;
+        if (session->feed) {
+            pthread_mutex_unlock(&session->feed->lock);
+        }
+    }
+    if (session->readahead) {
+        size_t buffered, highWater;
+
+        readaheadCounts(session->readahead, &buffered, &highWater, &metrics->readaheadOverflows, &metrics->readaheadUnderruns,
+                        &metrics->readaheadFullSeconds);
+        metrics->readaheadBytes = buffered;
+        metrics->readaheadHighWater = highWater;
+        metrics->readaheadFullSeconds /= 1000;
+    }
+    if (session->thumbnails) {
+        thumbnailsCounts(session->thumbnails, &metrics->thumbnails, &metrics->thumbnailDrops, &metrics->pendingThumbnails);
     }
 
-    if (av_write_header(oc)) {
-        fprintf(stderr, "Could not write mpegts header to first output file\n");
-        exit(1);
+    if ((session->options.metricsPath || session->origin) && now - session->metricsWritten >= 1000) {
+        session->metricsWritten = now;
+        export_metrics(session);
     }
+}
+
+/**
+ * Used to hand a video key frame to the thumbnail workers, when it starts a
+ * segment, or every thumbnailInterval key frames. The packet is copied, the
+ * workers never hold the remux back.
+ *
+ * @param SESSION *session the session.
+ * @param AVPacket *packet the key frame.
+ * @param int cut whether the key frame starts a segment.
+ * @param double time the key frame time, in seconds.
+ */
+static void submit_thumbnail(SESSION *session, AVPacket *packet, int cut, double time) {
+    const SESSION_OPTIONS *options = &session->options;
+    int due = options->thumbnailInterval ? !(session->thumbnailKeyFrames % options->thumbnailInterval)
+                                         : cut || !session->thumbnailKeyFrames;
+
+    ++session->thumbnailKeyFrames;
+
+    if (due && thumbnailsSubmit(session->thumbnails, packet->data, packet->size, time) < 0) {
+        fprintf(stderr, "{\"error\" : \"Could not queue a thumbnail.\", \"channel\" : \"%s\"}\n", options->name);
+    }
+}
 
-    // Added by Ahmed Kamal.
-    write_index = !write_index_file(index, tmp_index, minSegmentDuration, output_prefix, http_prefix, first_segment, last_segment, 0, max_tsfiles);
-//    write_index = !write_index_file(index, tmp_index, segment_duration, output_prefix, http_prefix, first_segment, last_segment, 0, max_tsfiles);
+/**
+ * Used to segment the input of a session, until it ends, or until the given
+ * quantum of input bytes is consumed, so several sessions can share a thread.
+ * A polled input also gives the thread up once its ring holds too little to
+ * demux the next packet without waiting, as sessionInputReady() tells. The
+ * demuxer takes no short read back, so a step only ends between packets.
+ *
+ * @param SESSION *session the opened session.
+ * @param long quantum input bytes to consume before returning.
+ * @return enum Session_State the state of the session.
+ */
+enum Session_State sessionStep(SESSION *session, long quantum) {
+    const SESSION_OPTIONS *options = &session->options;
+    AVFormatContext *ic = session->ic, *oc = session->oc;
+    AVStream *video_st = session->video_st, *audio_st = session->audio_st;
+    METRICS *metrics = &session->counters.metrics;
+    double stepStart = getMonotonicMilliseconds(), stepMilliseconds;
+    int decode_done, ret, remove_file, cut, size_cut;
+    uint64_t tick;
+    NODE *cue = NULL;
+
+    if (session->state != SESSION_RUNNING) {
+        return session->state;
+    }
 
     do {
         double segment_time;
         AVPacket packet;
 
+        tick = metricsNow();
         decode_done = av_read_frame(ic, &packet);
+        metricsElapsed(&metrics->timers[METRICS_READ], tick);
         if (decode_done < 0) {
+            session->state = SESSION_DONE;
             break;
         }
 
-        if (av_dup_packet(&packet) < 0) {
-            fprintf(stderr, "Could not duplicate packet");
-            av_free_packet(&packet);
-            break;
+        // Not duplicated, the demuxer's packet is valid until the next read, and the interleaver copies what it queues.
+        if (packet.stream_index == session->video_index && (packet.flags & PKT_FLAG_KEY)) {
+            segment_time = stream_time(session, video_st);
+        } else if (session->video_index < 0) {
+            segment_time = stream_time(session, audio_st);
+        } else {
+            segment_time = session->prev_segment_time;
         }
 
-        if (packet.stream_index == video_index && (packet.flags & PKT_FLAG_KEY)) {
-            segment_time = (double) video_st->pts.val * video_st->time_base.num / video_st->time_base.den;
-        } else if (video_index < 0) {
-            segment_time = (double) audio_st->pts.val * audio_st->time_base.num / audio_st->time_base.den;
-        } else {
-            segment_time = prev_segment_time;
+        // Only times of key frames, or of audio alone, are cut on.
+        if (session->resuming && (packet.stream_index == session->video_index || session->video_index < 0) && segment_time != session->prev_segment_time) {
+            segment_time = resume_at(session, segment_time);
         }
 
         // Added by Ahmed Kamal.
-        if (considerCuePoints && (segment_time - prev_segment_time >= minSegmentDuration) && segment_time >= currentDuration && segmentsIndex < cuePointsDiffernces->length) {
-            segmentNode = getNth(cuePointsDiffernces, segmentsIndex);
-            ++segmentsIndex;
+        if (session->control) {
+            receive_cues(session);
+        }
+        if (session->scte35 && session->scte35->spliceCount) {
+            receive_splices(session);
+        }
 
-            skipThisTime = 1;
+        // Modified by Ahmed Kamal.
+        // Cuts follow the plan, then the segmentation base once it is consumed.
+        cut = session->considerCuePoints ? cuePlanDue(&session->plan, (unsigned int) (segment_time * 1000)) : -1;
+        if (cut < 0) {
+            cut = segment_time - session->prev_segment_time >= options->segmentDuration;
+        }
 
-            minSegmentDuration = (double) segmentNode->id;
+        // Only times of key frames, or of audio alone, differ from the segment start.
+        size_cut = !cut && options->maxBytes && segment_time != session->prev_segment_time && url_ftell(oc->pb) >= options->maxBytes;
+        if (size_cut) {
+            cut = 1;
+            ++session->counters.sizeCuts;
+        }
 
-            // Please note that currentDuration is previously initialized with the value of the first segment.
-            if (segmentsIndex > 0) {
-                currentDuration += segmentNode->id;
+        if (cut) {
+            // Cuts on key frames land at or after the planned boundary, size cuts before it.
+            if (!size_cut && segment_time * 1000 >= session->segmentEnd) {
+                metricsRecord(&metrics->lateness, (uint64_t) ((segment_time * 1000 - session->segmentEnd) * 1000000));
             }
-        } else {
 
-            minSegmentDuration = segment_duration;
-        }
+            if (session->considerCuePoints) {
+                cue = cuePlanAdvance(&session->plan, (unsigned int) (segment_time * 1000));
 
-        // Modified by Ahmed Kamal.
-        if ((considerCuePoints && ((segment_time - prev_segment_time >= minSegmentDuration) || skipThisTime))
-                || ((!considerCuePoints) && (segment_time - prev_segment_time >= segment_duration))) {
+                // Cutting goes on with the cue points already planned.
+                if (session->cueLoader && load_cues(session) < 0) {
+                    fprintf(stderr, "{\"error\" : \"Cue points file stopped being read.\", \"channel\" : \"%s\"}\n", options->name);
+                }
+            }
 
-//        if (segment_time - prev_segment_time >= segment_duration) {
+            if (options->partDuration) {
+                close_part(session, segment_time);
+            }
+
+            tick = metricsNow();
+            close_segment(session);
+            metricsElapsed(&metrics->timers[METRICS_CLOSE], tick);
+            ++session->counters.segments;
+
+            if (session->statsFp) {
+                write_stats(session, segment_time);
+            }
 
-            put_flush_packet(oc->pb);
-            url_fclose(oc->pb);
+            if (!session->firstSegmentReported) {
+                session->counters.firstSegmentMilliseconds = getMonotonicMilliseconds() - session->startTime;
+                fprintf(stderr, "{\"info\" : \"Time to first segment %.3f ms.\", \"channel\" : \"%s\"}\n", session->counters.firstSegmentMilliseconds, options->name);
+                session->firstSegmentReported = 1;
+            }
 
-            if (max_tsfiles && (int) (last_segment - first_segment) >= max_tsfiles - 1) {
+            if (options->maxTsFiles && (int) (session->last_segment - session->first_segment) >= options->maxTsFiles - 1) {
                 remove_file = 1;
-                first_segment++;
+                session->first_segment++;
             } else {
                 remove_file = 0;
             }
 
-            if (write_index) {
-                // Added by Ahmed Kamal.
-                write_index = !write_index_file(index, tmp_index, minSegmentDuration, output_prefix, http_prefix, first_segment, ++last_segment, 0, max_tsfiles);
+            // Archived before the history drops it.
+            if (remove_file && session->archiveFd >= 0 && archive_segment(session, session->first_segment - 1, oldest_segment(session), session->windowStart) < 0) {
+                fprintf(stderr, "{\"error\" : \"Could not write the archive playlist (%s).\", \"channel\" : \"%s\"}\n", options->archivePath, options->name);
+                ++session->counters.writeErrors;
+            }
 
-                if (considerCuePoints) {
+            if (session->considerCuePoints) {
+                // Recorded before writing, so the index lists the segment as soon as it is complete.
+                record_segment(session, segment_time, cue);
+            }
 
-                    append(segments, createNode(minSegmentDuration, NULL)); // Changing data, and flags after writing the segment.
+            if (session->write_index) {
+                tick = metricsNow();
+                session->write_index = !write_index_file(session, session->minSegmentDuration, session->first_segment, ++session->last_segment, 0);
+                metricsElapsed(&metrics->timers[METRICS_INDEX], tick);
+            }
 
-                    minSegmentDuration = segment_duration;
-                    skipThisTime = 0;
-                }
+            // Ring slots are recycled as the window moves, archived segments are kept.
+            if (remove_file && !session->ring && !options->archivePath) {
+                tick = metricsNow();
+                recycle_segment(session, session->first_segment - 1);
+                metricsElapsed(&metrics->timers[METRICS_REMOVE], tick);
+            }
 
-//                write_index = !write_index_file(index, tmp_index, segment_duration, output_prefix, http_prefix, first_segment, ++last_segment, 0, max_tsfiles);
+            // Set first, the segment opened starts there.
+            session->prev_segment_time = segment_time;
+
+            segment_filename(session, session->output_filename, session->output_index++);
+            tick = metricsNow();
+            ret = open_segment(session);
+            metricsElapsed(&metrics->timers[METRICS_OPEN], tick);
+            if (ret < 0) {
+                fprintf(stderr, "Could not open '%s'\n", session->output_filename);
+                av_free_packet(&packet);
+                session->state = SESSION_FAILED;
+                break;
             }
 
-            if (remove_file) {
-                snprintf(remove_filename, strlen(output_prefix) + 15, "%s-%u.ts", output_prefix, first_segment - 1);
-                remove(remove_filename);
+            if (options->partDuration) {
+                session->partStartTime = segment_time;
+                session->partStartOffset = 0;
+                session->partIndependent = -1;
+                publish_parts(session);
+            } else if (session->origin) {
+                originPublish(session->origin, session->last_segment, session->output_index - 1, 0, 0,
+                        session->output_filename, options->segmentDuration);
             }
 
-            snprintf(output_filename, strlen(output_prefix) + 15, "%s-%u.ts", output_prefix, output_index++);
-            if (url_fopen(&oc->pb, output_filename, URL_WRONLY) < 0) {
-                fprintf(stderr, "Could not open '%s'\n", output_filename);
-                break;
+            if (options->checkpointPath && write_checkpoint(session) < 0) {
+                fprintf(stderr, "{\"error\" : \"Could not write the checkpoint (%s).\", \"channel\" : \"%s\"}\n", options->checkpointPath, options->name);
+                ++session->counters.writeErrors;
             }
 
-            prev_segment_time = segment_time;
+            // A single session reads its whole input in one step, so metrics are also refreshed on cuts.
+            update_metrics(session, getMonotonicMilliseconds());
+        } else if (options->partDuration) {
+            AVStream *part_st = video_st ? video_st : audio_st;
+            double part_time = stream_time(session, part_st);
+
+            if (part_time - session->partStartTime >= options->partDuration) {
+                close_part(session, part_time);
+                publish_parts(session);
+            }
+        }
+
+        if (session->partIndependent < 0 && packet.stream_index == session->video_index) {
+            session->partIndependent = (packet.flags & PKT_FLAG_KEY) != 0;
+        }
+
+        ++session->counters.packets;
+        session->counters.bytes += packet.size;
+        quantum -= packet.size;
+
+        if (session->statsFp) {
+            track_stats(session, &packet);
+        }
+
+        if (session->thumbnails && packet.stream_index == session->video_index && (packet.flags & PKT_FLAG_KEY)) {
+            submit_thumbnail(session, &packet, cut, segment_time);
         }
 
-        ret = av_interleaved_write_frame(oc, &packet);
+        tick = metricsNow();
+        ret = write_packet(session, &packet);
+        metricsElapsed(&metrics->timers[METRICS_WRITE], tick);
         if (ret < 0) {
             fprintf(stderr, "Warning: Could not write frame of stream\n");
+            ++session->counters.writeErrors;
         } else if (ret > 0) {
             fprintf(stderr, "End of stream requested\n");
             av_free_packet(&packet);
+            session->state = SESSION_DONE;
             break;
         }
 
         av_free_packet(&packet);
-    } while (!decode_done);
+    } while (quantum > 0 && (!options->pollInput || sessionInputReady(session)));
+
+    session->counters.lastPacketTime = getMonotonicMilliseconds();
+    stepMilliseconds = session->counters.lastPacketTime - stepStart;
+    ++session->counters.steps;
+    session->counters.totalStepMilliseconds += stepMilliseconds;
+    if (stepMilliseconds > session->counters.maxStepMilliseconds) {
+        session->counters.maxStepMilliseconds = stepMilliseconds;
+    }
+    update_metrics(session, session->counters.lastPacketTime);
+
+    return session->state;
+}
 
-    av_write_trailer(oc);
+/**
+ * Used to release the output context of a session.
+ *
+ * @param SESSION *session the session.
+ */
+static void closeOutput(SESSION *session) {
+    AVFormatContext *oc = session->oc;
+    unsigned int i;
 
-    avcodec_close(video_st->codec);
+    if (session->video_st) {
+        avcodec_close(session->video_st->codec);
+    }
 
     for (i = 0; i < oc->nb_streams; i++) {
         av_freep(&oc->streams[i]->codec);
         av_freep(&oc->streams[i]);
     }
 
-    url_fclose(oc->pb);
+    if (oc->pb) {
+        close_segment(session);
+    }
     av_free(oc);
+    session->oc = NULL;
+}
+
+/**
+ * Used to publish the segments manifest, and remove the previous segments
+ * that were not kept, under names no new segment took.
+ *
+ * @param SESSION *session the session.
+ */
+static void finish_manifest(SESSION *session) {
+    const SESSION_OPTIONS *options = &session->options;
+    MANIFEST_ENTRY *entry;
+    unsigned int i;
+
+    if (session->previous) {
+        for (i = 0; i < session->previous->count; i++) {
+            entry = &session->previous->entries[i];
+
+            if (entry->state == MANIFEST_STASHED || (entry->state == MANIFEST_UNCLAIMED && entry->sequence >= session->output_index)) {
+                previous_filename(session, entry);
+                remove(session->reuse_filename);
+            }
+        }
 
-    if (max_tsfiles && (int) (last_segment - first_segment) >= max_tsfiles - 1) {
+        fprintf(stderr, "{\"info\" : \"Kept %u of %u segments from the previous run.\", \"channel\" : \"%s\"}\n",
+                session->reusedSegments, session->output_index - 1, options->name);
+    }
+
+    if (fclose(session->manifestFp) || rename(session->tmp_manifest, options->manifestPath) < 0) {
+        fprintf(stderr, "{\"error\" : \"Could not write the segments manifest (%s).\", \"channel\" : \"%s\"}\n", options->manifestPath, options->name);
+    }
+    session->manifestFp = NULL;
+}
+
+/**
+ * Used to report the segment sizes of the run, counted by powers of two, each
+ * key being the bound the sizes counted are below.
+ *
+ * @param SESSION *session the session.
+ */
+static void report_sizes(SESSION *session) {
+    char histogram[SESSION_SIZE_BUCKETS * 40], *position = histogram;
+    int bucket;
+
+    for (bucket = 0; bucket < SESSION_SIZE_BUCKETS; bucket++) {
+        if (!session->sizeHistogram[bucket]) {
+            continue;
+        }
+
+        if (bucket == SESSION_SIZE_BUCKETS - 1) {
+            position += sprintf(position, "%s\"more\" : %llu", position == histogram ? "" : ", ", session->sizeHistogram[bucket]);
+        } else {
+            position += sprintf(position, "%s\"%lld\" : %llu", position == histogram ? "" : ", ", 1LL << bucket, session->sizeHistogram[bucket]);
+        }
+    }
+    *position = '\0';
+
+    fprintf(stderr, "{\"info\" : \"Segment sizes.\", \"sizes\" : {%s}, \"largest\" : %lld, \"size_cuts\" : %llu, \"channel\" : \"%s\"}\n",
+            histogram, session->counters.largestSegment, session->counters.sizeCuts, session->options.name);
+}
+
+/**
+ * Used to write the trailer and the final index of a session, once its input ended.
+ *
+ * @param SESSION *session the session.
+ */
+void sessionFinish(SESSION *session) {
+    const SESSION_OPTIONS *options = &session->options;
+    AVFormatContext *oc = session->oc;
+    AVStream *part_st = session->video_st ? session->video_st : session->audio_st;
+    double end_time;
+    int remove_file;
+
+    // Nothing was written, when the session could not be opened.
+    if (!oc) {
+        return;
+    }
+
+    end_time = stream_time(session, part_st);
+
+    // The last sheet is written, and the last thumbnail lasts until the end.
+    if (session->thumbnails) {
+        thumbnailsStop(session->thumbnails, end_time);
+        free(session->thumbnails);
+        session->thumbnails = NULL;
+    }
+
+    if (oc->pb) {
+        if (session->interleaver && interleaverFlush(session->interleaver) < 0) {
+            fprintf(stderr, "Warning: Could not write frame of stream\n");
+            ++session->counters.writeErrors;
+        }
+        av_write_trailer(oc);
+
+        if (options->partDuration) {
+            close_part(session, end_time);
+        }
+    }
+
+    closeOutput(session);
+
+    if (session->statsFp) {
+        write_stats(session, end_time);
+    }
+
+    if (!session->firstSegmentReported) {
+        session->counters.firstSegmentMilliseconds = getMonotonicMilliseconds() - session->startTime;
+        fprintf(stderr, "{\"info\" : \"Time to first segment %.3f ms.\", \"channel\" : \"%s\"}\n", session->counters.firstSegmentMilliseconds, options->name);
+        session->firstSegmentReported = 1;
+    }
+
+    if (options->maxTsFiles && (int) (session->last_segment - session->first_segment) >= options->maxTsFiles - 1) {
         remove_file = 1;
-        first_segment++;
+        session->first_segment++;
     } else {
         remove_file = 0;
     }
 
-    if (write_index) {
+    if (remove_file && session->archiveFd >= 0) {
+        archive_segment(session, session->first_segment - 1, oldest_segment(session), session->windowStart);
+    }
+
+    if (session->write_index) {
         // Added by Ahmed Kamal.
-        if (considerCuePoints) {
-            append(segments, createNode(minSegmentDuration, NULL));
+        if (session->considerCuePoints) {
+            record_segment(session, end_time, NULL);
+        }
+        write_index_file(session, session->minSegmentDuration, session->first_segment, ++session->last_segment, 1);
+    }
+
+    if (session->archiveFd >= 0) {
+        finish_archive(session);
+    }
+
+    if (session->origin) {
+        originPublish(session->origin, session->last_segment, session->last_segment, 0, 0, "", options->segmentDuration);
+    }
+
+    if (remove_file && !session->ring && !options->archivePath) {
+        recycle_segment(session, session->first_segment - 1);
+    }
+
+    if (session->manifestFp) {
+        finish_manifest(session);
+    }
+
+    report_sizes(session);
+
+    // The last metrics are exported, however recent the previous ones are.
+    session->metricsWritten = 0;
+    update_metrics(session, getMonotonicMilliseconds());
+}
+
+/**
+ * Used to release everything held by a session.
+ *
+ * @param SESSION *session the session.
+ */
+void sessionDestroy(SESSION *session) {
+    if (session->thumbnails) {
+        thumbnailsStop(session->thumbnails, session->prev_segment_time);
+        free(session->thumbnails);
+        session->thumbnails = NULL;
+    }
+
+    if (session->interleaver) {
+        interleaverDestroy(session->interleaver);
+        free(session->interleaver);
+        session->interleaver = NULL;
+    }
+
+    if (session->control) {
+        controlStop(session->control);
+        free(session->control);
+        session->control = NULL;
+    }
+
+    if (session->oc) {
+        closeOutput(session);
+    }
+
+    if (session->origin) {
+        originStop(session->origin);
+        free(session->origin);
+        session->origin = NULL;
+    }
+
+    // Only once the origin is stopped, as its connections read from the ring.
+    if (session->ring) {
+        ringDestroy(session->ring);
+        free(session->ring);
+        session->ring = NULL;
+    }
+
+    if (session->outputPb) {
+        av_free(session->outputPb->buffer);
+        av_freep(&session->outputPb);
+    }
+    // Closed first, the streams update their buffers as they close.
+    if (session->playlistFp) {
+        fclose(session->playlistFp);
+        session->playlistFp = NULL;
+    }
+    if (session->breaksFp) {
+        fclose(session->breaksFp);
+        session->breaksFp = NULL;
+    }
+    if (session->scratchFp) {
+        fclose(session->scratchFp);
+        session->scratchFp = NULL;
+    }
+    free(session->playlistBuffer);
+    free(session->breaksBuffer);
+    free(session->scratchBuffer);
+    session->playlistBuffer = session->breaksBuffer = session->scratchBuffer = NULL;
+
+    if (session->ic) {
+        if (session->inputPb) {
+            av_close_input_stream(session->ic);
+        } else {
+            av_close_input_file(session->ic);
         }
-        write_index_file(index, tmp_index, minSegmentDuration, output_prefix, http_prefix, first_segment, ++last_segment, 1, max_tsfiles);
-//        write_index_file(index, tmp_index, segment_duration, output_prefix, http_prefix, first_segment, ++last_segment, 1, max_tsfiles);
+        session->ic = NULL;
+    }
+
+    if (session->inputPb) {
+        av_free(session->inputPb->buffer);
+        av_freep(&session->inputPb);
+    }
+
+    if (session->readahead) {
+        readaheadStop(session->readahead);
+        free(session->readahead);
+        session->readahead = NULL;
+    }
+
+    if (session->feed) {
+        inputFeedDestroy(session->feed);
+        free(session->feed);
+        session->feed = NULL;
+    }
+
+    // The socket is the input file descriptor.
+    if (session->udp) {
+        udpInputClose(session->udp);
+        free(session->udp);
+        session->udp = NULL;
+        session->inputFd = -1;
+    }
+
+    if (session->inputFd >= 0) {
+        close(session->inputFd);
+        session->inputFd = -1;
     }
 
-    if (remove_file) {
-        snprintf(remove_filename, strlen(output_prefix) + 15, "%s-%u.ts", output_prefix, first_segment - 1);
-        remove(remove_filename);
+    free(session->scte35);
+    session->scte35 = NULL;
+
+    if (session->cueLoader) {
+        cueLoaderClose(session->cueLoader);
+        free(session->cueLoader);
+        session->cueLoader = NULL;
     }
 
     // Added by Ahmed Kamal
-    if (considerCuePoints) {
-        // Free up cue points list, as we don't need it.
-        deleteList(cuePoints);
-        deleteList(cuePointsDiffernces);
+    if (session->considerCuePoints) {
+        // Free up cue points plan, as we don't need it.
+        cuePlanDestroy(&session->plan);
     }
-    return 0;
+
+    historyDestroy(&session->history);
+
+    free(session->cipher);
+    free(session->cipherBuffer);
+    free(session->key_filename);
+
+    if (session->archiveFd >= 0) {
+        close(session->archiveFd);
+        session->archiveFd = -1;
+    }
+
+    if (session->breaks) {
+        NODE *adBreak;
+
+        for (adBreak = session->breaks->head; adBreak; adBreak = adBreak->next) {
+            free(adBreak->data);
+        }
+        deleteList(session->breaks);
+        free(session->breaks);
+    }
+
+    free(session->output_filename);
+    free(session->remove_filename);
+    free(session->pool_filename);
+    free(session->tmp_index);
+    // An unfinished manifest would not tell which segments are complete.
+    if (session->manifestFp) {
+        fclose(session->manifestFp);
+        remove(session->tmp_manifest);
+        session->manifestFp = NULL;
+    }
+
+    if (session->previous) {
+        manifestDestroy(session->previous);
+        free(session->previous);
+        session->previous = NULL;
+    }
+
+    free(session->breaks_filename);
+    free(session->tmp_breaks);
+    if (session->gzip) {
+        gzipPlaylistDestroy(session->gzip);
+        free(session->gzip);
+        session->gzip = NULL;
+    }
+    free(session->gzip_filename);
+    free(session->tmp_gzip);
+    if (session->discontinuities) {
+        deleteList(session->discontinuities);
+        free(session->discontinuities);
+    }
+
+    if (session->statsFp) {
+        fclose(session->statsFp);
+        session->statsFp = NULL;
+    }
+
+    if (session->digestsFp) {
+        fclose(session->digestsFp);
+        session->digestsFp = NULL;
+    }
+    free(session->segmentXxh);
+    free(session->segmentSha);
+
+    free(session->tmp_manifest);
+    free(session->reuse_filename);
+    free(session->tmp_checkpoint);
+}
+
+int main(int argc, char **argv) {
+    SESSION_OPTIONS options;
+    SUPERVISOR_OPTIONS supervisor;
+    SESSION session;
+
+    memset(&supervisor, 0, sizeof (supervisor));
+
+    if (parseSessionArguments(argc, argv, &options, &supervisor) < 0) {
+        usage(argv[0]);
+    }
+
+    av_register_all();
+    metricsCalibrate();
+
+    if (supervisor.channelsPath) {
+        // Channels inherit the command line budget, unless they set their own.
+        supervisor.memoryBudget = options.memoryBudget;
+        supervisor.metricsPath = options.metricsPath;
+        return runSupervisor(&supervisor) < 0 ? EXIT_FAILURE : 0;
+    }
+
+    if (sessionCreate(&session, &options) < 0) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (sessionOpen(&session) < 0) {
+        exit(1);
+    }
+
+    while (sessionStep(&session, LONG_MAX) == SESSION_RUNNING) {
+        // Keep segmenting while the input lasts.
+    }
+
+    sessionFinish(&session);
+    sessionDestroy(&session);
+
+    return session.state == SESSION_FAILED ? 1 : 0;
 }
 
 // vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,545 @@
+/**
+ * @file
+ * Segmenting session prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * A session holds everything needed to segment one channel, so many of them
+ * can be hosted by the same process. It expects "libavformat/avformat.h",
+ * "linked_list.h", "cue_plan.h", "history.h" and "metrics.h" to be included first.
+ */
+
+struct supervisor_options;
+struct origin;
+struct memory_ring;
+struct control;
+struct cue_loader;
+struct manifest;
+struct manifest_entry;
+struct scte35;
+struct aes_cbc;
+struct xxh64;
+struct sha256;
+struct gzip_playlist;
+struct thumbnails;
+struct udp_input;
+struct readahead;
+struct input_feed;
+struct interleaver;
+
+/**
+ * Partial segments kept per segment, and segments whose parts are kept for
+ * the low latency playlist, including the one being written.
+ */
+#define SESSION_MAX_PARTS 64
+#define SESSION_PART_SEGMENTS 4
+
+/**
+ * Cue points of a cue points file kept pending in the plan, the next ones are
+ * read as segments are cut.
+ */
+#define SESSION_CUE_LOOKAHEAD 16
+
+/**
+ * The archive playlist header, its target duration is rewritten in place, on
+ * this many digits, as longer segments are archived.
+ */
+#define SESSION_ARCHIVE_HEADER "#EXTM3U\n#EXT-X-PLAYLIST-TYPE:EVENT\n#EXT-X-TARGETDURATION:"
+#define SESSION_ARCHIVE_TARGET_DIGITS 5
+
+/**
+ * Segment sizes are counted by powers of two, up to 2^(buckets - 1) bytes and above.
+ */
+#define SESSION_SIZE_BUCKETS 32
+
+/**
+ * The last kept segment before any segment is opened, so the first one joins nothing.
+ */
+#define SESSION_NO_SEGMENT -2
+
+#define SESSION_CHECKPOINT_VERSION "#SEGMENTER-CHECKPOINT:1"
+
+enum Session_State {
+    SESSION_CREATED,
+    SESSION_RUNNING,
+    SESSION_DONE,
+    SESSION_FAILED
+};
+
+/**
+ * Options of one session, as given on the command line, or on a channel line
+ * of the supervisor configuration.
+ */
+typedef struct session_options {
+    const char *name,
+            *input,
+            *cuePointsInput,
+            *outputPrefix,
+            *index,
+            *httpPrefix,
+            *streamInfoPath,
+            /**
+             * @var const char *controlPath the FIFO cue points are read from while running, NULL for none.
+             * @var const char *cuesPath the file cue points are streamed from, "-" for the standard input, NULL for none.
+             */
+            *controlPath,
+            *cuesPath,
+            /**
+             * @var const char *manifestPath the segments manifest written for a later run, NULL for none.
+             * @var const char *reusePath the manifest of a previous run, whose unchanged segments are kept.
+             */
+            *manifestPath,
+            *reusePath,
+            /**
+             * @var const char *checkpointPath the file the session state is saved to after each segment, NULL for none.
+             */
+            *checkpointPath,
+            /**
+             * @var const char *statsPath the file the statistics of each segment are appended to, NULL for none.
+             */
+            *statsPath,
+            /**
+             * @var const char *metricsPath the file the metrics are exported to, in the Prometheus text format, NULL for none.
+             */
+            *metricsPath,
+            /**
+             * @var const char *archivePath the playlist the segments leaving the window are appended to, NULL for none.
+             */
+            *archivePath,
+            /**
+             * @var const char *digestsPath the file the digest of each segment is appended to, NULL for none.
+             * @var const char *digestAlgorithm "sha256" or "xxh64", the digests written to it.
+             */
+            *digestsPath,
+            *digestAlgorithm,
+            /**
+             * @var const char *thumbnailsPrefix the sprite sheets and thumbnails track path prefix, NULL for none.
+             */
+            *thumbnailsPrefix;
+
+    double segmentDuration,
+           /**
+            * @var double partDuration the partial segments target duration, 0 disables low latency HLS.
+            */
+           partDuration,
+           /**
+            * @var double udpTimeout seconds without datagrams before a UDP or RTP input ends, 0 to wait forever.
+            */
+           udpTimeout;
+
+    long maxTsFiles,
+         /**
+          * @var long keyRotation the segments encrypted with the same key, 0 for one key for the run.
+          */
+         keyRotation,
+         probesize,
+         analyzeduration,
+         /**
+          * @var long memoryBudget bytes the session may hold for probing, input buffering
+          * and interleaving, 0 for unlimited.
+          */
+         memoryBudget,
+         /**
+          * @var long maxBytes the segment size past which it is cut on the next key frame, 0 for none.
+          */
+         maxBytes,
+         /**
+          * @var long readahead the ring the standard input is read ahead into, in bytes, 0 to read it directly.
+          */
+         readahead,
+         /**
+          * @var long inputQuantum with pollInput, the input bytes the supervisor runs the session by each turn.
+          * @var long openerMemory with pollInput, the stack of the thread the supervisor opens the session on,
+          * counted in the memory budget along with probing.
+          */
+         inputQuantum,
+         openerMemory,
+         /**
+          * @var long interleaveBytes the arena packets are queued in for interleaving, in bytes.
+          * @var long interleaveDelta the widest span of timestamps queued for interleaving, in milliseconds.
+          */
+         interleaveBytes,
+         interleaveDelta;
+
+    /**
+     * @var int pollInput used to open local inputs on a file descriptor the supervisor can poll, to read
+     * them into a ring the supervisor feeds once they are probed, and to end each step once the ring holds
+     * too little to demux without waiting.
+     */
+    int pollInput,
+        /**
+         * @var int originPort the port of the built-in origin, 0 for none.
+         */
+        originPort,
+        /**
+         * @var int memoryRing used to keep the segments window and the playlist in memory,
+         * served by the origin, instead of writing them to disk.
+         */
+        memoryRing,
+        /**
+         * @var int filePool used to overwrite a fixed pool of segment files in rotation,
+         * instead of creating and removing one file per segment.
+         */
+        filePool,
+        /**
+         * @var int scte35 used to turn the SCTE-35 splices of the input into cue points.
+         */
+        scte35,
+        /**
+         * @var int encrypt used to encrypt the segments with AES-128, as they are written.
+         */
+        encrypt,
+        /**
+         * @var int gzip used to publish the gzip variant of the playlist next to it.
+         */
+        gzip,
+        /**
+         * @var int resume used to continue from the checkpoint, when there is one.
+         */
+        resume,
+        /**
+         * @var int thumbnailInterval key frames between thumbnails, 0 for one at the start of each segment.
+         * @var int thumbnailDrop the key frame dropped when the thumbnails queue is full, an enum Thumbnails_Drop.
+         */
+        thumbnailInterval,
+        thumbnailWidth,
+        thumbnailHeight,
+        thumbnailWorkers,
+        thumbnailQueue,
+        thumbnailDrop,
+        /**
+         * @var int udpBuffer the receive buffer of UDP and RTP inputs, in bytes.
+         * @var int jitterDepth the datagrams RTP inputs put back in order.
+         * @var int jitterLatency the longest wait for a missing RTP datagram, in milliseconds.
+         */
+        udpBuffer,
+        jitterDepth,
+        jitterLatency,
+        /**
+         * @var int interleaveFlush how packets are written before their turn, an enum Interleaver_Flush.
+         */
+        interleaveFlush;
+} SESSION_OPTIONS;
+
+/**
+ * Health and latency counters of a session.
+ */
+typedef struct session_counters {
+    unsigned long long packets,
+                       bytes,
+                       segments,
+                       writeErrors,
+                       steps,
+                       sizeCuts;
+
+    long interleaveBytes,
+         peakInterleaveBytes;
+    long long largestSegment;
+
+    double openMilliseconds,
+           firstSegmentMilliseconds,
+           lastPacketTime,
+           totalStepMilliseconds,
+           maxStepMilliseconds;
+
+    METRICS metrics;
+} SESSION_COUNTERS;
+
+/**
+ * A partial segment, addressed as a byte range of its segment.
+ */
+typedef struct part {
+    double duration;
+    long long offset,
+              size;
+    int independent;
+} PART;
+
+typedef struct part_segment {
+    unsigned int sequence;
+    int count;
+    PART parts[SESSION_MAX_PARTS];
+} PART_SEGMENT;
+
+/**
+ * An ad break announced with its duration, kept until its return is cut, so
+ * both ends are marked as one break. Times are in milliseconds.
+ */
+typedef struct ad_break {
+    unsigned int out,
+                 in;
+} AD_BREAK;
+
+/**
+ * Statistics of the segment being written, gathered as its packets are muxed,
+ * slot 0 is the video stream, slot 1 the audio one. Times are in microseconds.
+ */
+typedef struct segment_stats {
+    unsigned long long packets[2],
+                       bytes[2];
+    unsigned int keyFrames;
+    int64_t firstPts[2],
+            lastPts[2],
+            lastDts[2],
+            maxInterleaveDelay;
+} SEGMENT_STATS;
+
+typedef struct session {
+    SESSION_OPTIONS options;
+    enum Session_State state;
+
+    AVFormatContext *ic,
+                    *oc;
+    AVStream *video_st,
+             *audio_st;
+    AVIOContext *inputPb;
+    int inputFd;
+
+    /**
+     * @var struct udp_input *udp the UDP or RTP input, its socket is inputFd, NULL for other inputs.
+     */
+    struct udp_input *udp;
+
+    /**
+     * @var struct readahead *readahead the standard input read ahead, on its own thread, or the ring the
+     * supervisor feeds a polled input into, NULL when the input is read directly.
+     * @var struct input_feed *feed what the supervisor feeds the ring with, NULL when it does not.
+     */
+    struct readahead *readahead;
+    struct input_feed *feed;
+
+    int video_index,
+        audio_index,
+        write_index;
+
+    /**
+     * @var size_t prefixLength the output prefix length, segment filenames keep the
+     * prefix and only have their sequence number rewritten.
+     */
+    char *output_filename,
+         *remove_filename,
+         *tmp_index,
+         /**
+          * @var char *breaks_filename the ad markers index written next to the playlist.
+          */
+         *breaks_filename,
+         *tmp_breaks,
+         *tmp_manifest,
+         *reuse_filename,
+         *tmp_checkpoint,
+         *gzip_filename,
+         *tmp_gzip;
+    size_t prefixLength;
+
+    unsigned int output_index,
+                 first_segment,
+                 last_segment;
+
+    double prev_segment_time,
+           minSegmentDuration;
+
+    /**
+     * @var HISTORY history the final segments of the window, with their durations and ad markers.
+     * @var CUE_PLAN plan the segment boundaries still to come.
+     * @var struct control *control the live cue points channel.
+     * @var struct cue_loader *cueLoader the cue points file being streamed, NULL once read.
+     */
+    HISTORY history;
+    CUE_PLAN plan;
+    struct control *control;
+    struct cue_loader *cueLoader;
+    struct scte35 *scte35;
+
+    /**
+     * @var LIST *breaks the ad breaks with a pending end, the id is the time they start at,
+     * and the data their AD_BREAK.
+     * @var double wallClockOrigin the wall clock time of the output time 0, in milliseconds,
+     * set once the first segment is cut.
+     * @var double windowStart the time the first segment of the window starts at.
+     */
+    LIST *breaks;
+    double wallClockOrigin,
+           windowStart;
+
+    /**
+     * @var FILE *manifestFp the segments manifest being written.
+     * @var struct manifest *previous the manifest of the previous run.
+     * @var struct manifest_entry *reused the previous segment kept in place of the current one, whose
+     * output is discarded, NULL when it is written.
+     * @var unsigned int segmentStart the time the current segment starts at, in milliseconds.
+     * @var unsigned int segmentEnd the time it is planned to end at.
+     * @var long long lastKept the previous sequence of the last segment closed when it was kept, -1
+     * when it was written, SESSION_NO_SEGMENT before the first one.
+     * @var int lastMuxed whether the last segment closed holds the bytes this run muxed for it.
+     */
+    FILE *manifestFp;
+    struct manifest *previous;
+    struct manifest_entry *reused;
+    unsigned int segmentStart,
+                 segmentEnd,
+                 reusedSegments;
+    long long lastKept;
+    int lastMuxed;
+
+    /**
+     * @var LIST *discontinuities the segments of the playlist following a restart, the id is the sequence.
+     * @var unsigned int discontinuitySequence the discontinuities that left the playlist.
+     * @var int resuming set from a resume until the first cut, anchored on the input where it restarted.
+     * @var double resumeTime the time of the last cut of the checkpoint resumed from, in seconds, -1 when unknown.
+     * @var double timeOffset added to the input times, in seconds, once it restarted behind the checkpoint.
+     */
+    LIST *discontinuities;
+    unsigned int discontinuitySequence;
+    int resuming;
+    double resumeTime,
+           timeOffset;
+
+    /**
+     * @var unsigned int targetDuration the longest segment so far, rounded as listed, in seconds.
+     * @var unsigned long long sizeHistogram segments counts by size, bucket n counts sizes below 2^n bytes.
+     */
+    unsigned int targetDuration;
+    unsigned long long sizeHistogram[SESSION_SIZE_BUCKETS];
+
+    /**
+     * @var FILE *statsFp the segment statistics being written.
+     * @var long long segmentSize the size of the last segment closed.
+     */
+    FILE *statsFp;
+    SEGMENT_STATS stats;
+    long long segmentSize;
+
+    unsigned int considerCuePoints;
+
+    double startTime;
+    int firstSegmentReported;
+
+    /**
+     * @var struct interleaver *interleaver the queue packets are put in timestamp order in, before the muxer.
+     * @var int64_t streamPts where the video and audio output streams stand, in their time base, once the
+     * packets handed to the interleaver are written, as the muxer sets their pts then.
+     * @var long baseMemory the bytes held for probing, input buffering and interleaving, with a memory budget.
+     */
+    struct interleaver *interleaver;
+    int64_t streamPts[2];
+    long baseMemory;
+
+    /**
+     * Low latency HLS state.
+     *
+     * @var PART_SEGMENT partSegments the parts of the recent segments, indexed by sequence number.
+     * @var int partIndependent whether the current part starts on a key frame, -1 until its first video packet.
+     */
+    PART_SEGMENT partSegments[SESSION_PART_SEGMENTS];
+    double partStartTime;
+    long long partStartOffset;
+    int partIndependent;
+    struct origin *origin;
+
+    /**
+     * Segments are all written through outputPb, at outputOffset of outputFd, a
+     * segment file or a pool file, or into the ring slots for in-memory output.
+     *
+     * @var long long poolReserve bytes reserved in each pool file, from the largest segment so far.
+     */
+    struct memory_ring *ring;
+    AVIOContext *outputPb;
+    char *pool_filename;
+    int outputFd;
+    long long outputOffset,
+              poolReserve;
+
+    /**
+     * Files rewritten whole are built in memory streams kept open, so their
+     * buffers are reused from one rewrite to the next.
+     *
+     * @var FILE *playlistFp the playlist, also what is copied into the ring for in-memory output.
+     * @var FILE *breaksFp the ad markers index.
+     * @var FILE *scratchFp the checkpoint and the metrics, built one at a time.
+     * @var struct gzip_playlist *gzip the gzip variant of the playlist, compressed from playlistBuffer.
+     */
+    FILE *playlistFp,
+         *breaksFp,
+         *scratchFp;
+    struct gzip_playlist *gzip;
+    char *playlistBuffer,
+         *breaksBuffer,
+         *scratchBuffer;
+    size_t playlistSize,
+           breaksSize,
+           scratchSize;
+
+    /**
+     * Archive playlist, written at archiveOffset of archiveFd.
+     *
+     * @var unsigned int archiveTarget the target duration of the archive, the longest segment archived.
+     */
+    int archiveFd;
+    long long archiveOffset;
+    unsigned int archiveTarget,
+                 archiveKey;
+
+    /**
+     * Segment encryption, the bytes flushed by outputPb are encrypted into
+     * cipherBuffer before they are written.
+     *
+     * @var unsigned int keyIndex the key held in key, UINT_MAX for none.
+     * @var char *key_filename the key files, named as the segments, after the output prefix.
+     */
+    struct aes_cbc *cipher;
+    unsigned char *cipherBuffer,
+                  key[16];
+    unsigned int keyIndex;
+    char *key_filename;
+
+    /**
+     * Digests of the segment being written, of the bytes as they are written,
+     * so segments are never read back. The xxh64 one is kept for the manifest,
+     * either for the digests file.
+     */
+    struct xxh64 *segmentXxh;
+    struct sha256 *segmentSha;
+    FILE *digestsFp;
+
+    /**
+     * @var struct thumbnails *thumbnails the pool the key frames are handed to, NULL without thumbnails.
+     * @var unsigned long long thumbnailKeyFrames the video key frames read so far, to pick every Nth one.
+     */
+    struct thumbnails *thumbnails;
+    unsigned long long thumbnailKeyFrames;
+
+    SESSION_COUNTERS counters;
+
+    /**
+     * @var double metricsWritten the time the metrics were last exported, in milliseconds.
+     */
+    double metricsWritten;
+} SESSION;
+
+int parseSessionArguments(int, char **, SESSION_OPTIONS *, struct supervisor_options *);
+int sessionCreate(SESSION *, const SESSION_OPTIONS *);
+int sessionOpen(SESSION *);
+enum Session_State sessionStep(SESSION *, long);
+int sessionInputReady(SESSION *);
+int sessionFeedDescriptor(SESSION *);
+void sessionFeedInput(SESSION *, int);
+void sessionFinish(SESSION *);
+void sessionDestroy(SESSION *);
+void sessionWriteMetrics(FILE *, const char *const *, const SESSION_COUNTERS *const *, int);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
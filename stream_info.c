@@ -0,0 +1,319 @@
+/**
+ * @file
+ * Stream parameters cache implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+
+#include "libavformat/avformat.h"
+
+#include "stream_info.h"
+
+#define STREAM_INFO_MAX_STREAMS 32
+
+/**
+ * Parameters of one cached stream, as read back from the cache file.
+ */
+typedef struct stream_info {
+    int index,
+        type,
+        codec,
+        bitRate,
+        timeBaseNum,
+        timeBaseDen,
+        ticksPerFrame,
+        width,
+        height,
+        pixelFormat,
+        hasBFrames,
+        sampleRate,
+        channels,
+        frameSize,
+        blockAlign,
+        extradataSize;
+    unsigned int tag;
+    uint64_t channelLayout;
+    uint8_t *extradata;
+} STREAM_INFO;
+
+/**
+ * Used to decode a hex string into a freshly allocated, padded buffer.
+ *
+ * @param const char *hex the hex digits.
+ * @param int *size receives the decoded size.
+ * @return uint8_t * the buffer, or NULL on malformed input.
+ */
+static uint8_t *decodeHex(const char *hex, int *size) {
+    int length = strlen(hex), i;
+    unsigned int byte;
+    uint8_t *buffer;
+
+    if (length % 2) {
+        return NULL;
+    }
+
+    buffer = av_mallocz(length / 2 + FF_INPUT_BUFFER_PADDING_SIZE);
+    if (!buffer) {
+        return NULL;
+    }
+
+    for (i = 0; i < length / 2; i++) {
+        if (sscanf(hex + 2 * i, "%2x", &byte) != 1) {
+            av_free(buffer);
+            return NULL;
+        }
+        buffer[i] = byte;
+    }
+
+    *size = length / 2;
+    return buffer;
+}
+
+/**
+ * Used to parse one "stream=..." line of the cache file.
+ *
+ * @param char *line the line, it will be tokenized in place.
+ * @param STREAM_INFO *info receives the parsed values.
+ * @return int 0 on success, -1 on a malformed line.
+ */
+static int parseStreamLine(char *line, STREAM_INFO *info) {
+    char *token, *value, *save = NULL;
+
+    memset(info, 0, sizeof (STREAM_INFO));
+    info->index = -1;
+    info->timeBaseDen = 1;
+    info->ticksPerFrame = 1;
+    info->pixelFormat = PIX_FMT_NONE;
+
+    for (token = strtok_r(line, " \t\r\n", &save); token; token = strtok_r(NULL, " \t\r\n", &save)) {
+        value = strchr(token, '=');
+        if (!value) {
+            return -1;
+        }
+        *value++ = '\0';
+
+        if (!strcmp(token, "stream")) {
+            info->index = atoi(value);
+        } else if (!strcmp(token, "type")) {
+            info->type = atoi(value);
+        } else if (!strcmp(token, "codec")) {
+            info->codec = atoi(value);
+        } else if (!strcmp(token, "tag")) {
+            info->tag = strtoul(value, NULL, 10);
+        } else if (!strcmp(token, "bit_rate")) {
+            info->bitRate = atoi(value);
+        } else if (!strcmp(token, "tb")) {
+            if (sscanf(value, "%d/%d", &info->timeBaseNum, &info->timeBaseDen) != 2 || info->timeBaseDen <= 0) {
+                return -1;
+            }
+        } else if (!strcmp(token, "ticks")) {
+            info->ticksPerFrame = atoi(value);
+        } else if (!strcmp(token, "width")) {
+            info->width = atoi(value);
+        } else if (!strcmp(token, "height")) {
+            info->height = atoi(value);
+        } else if (!strcmp(token, "pix_fmt")) {
+            info->pixelFormat = atoi(value);
+        } else if (!strcmp(token, "has_b_frames")) {
+            info->hasBFrames = atoi(value);
+        } else if (!strcmp(token, "sample_rate")) {
+            info->sampleRate = atoi(value);
+        } else if (!strcmp(token, "channels")) {
+            info->channels = atoi(value);
+        } else if (!strcmp(token, "frame_size")) {
+            info->frameSize = atoi(value);
+        } else if (!strcmp(token, "block_align")) {
+            info->blockAlign = atoi(value);
+        } else if (!strcmp(token, "channel_layout")) {
+            info->channelLayout = strtoull(value, NULL, 10);
+        } else if (!strcmp(token, "extradata")) {
+            if (!(info->extradata = decodeHex(value, &info->extradataSize))) {
+                return -1;
+            }
+        }
+        // Unknown keys are ignored, so newer cache files stay readable.
+    }
+
+    return info->index < 0 ? -1 : 0;
+}
+
+/**
+ * Used to write the probed parameters of every input stream to a cache file.
+ * The file is written to a temporary name first and renamed, so a reader
+ * never sees a partial cache.
+ *
+ * @param AVFormatContext *ic the probed input context.
+ * @param const char *path the cache file path.
+ * @return int 0 on success, -1 otherwise.
+ */
+int saveStreamInfo(AVFormatContext *ic, const char *path) {
+    char tmpPath[PATH_MAX];
+    FILE *fp;
+    AVCodecContext *codec;
+    unsigned int i;
+    int j;
+
+    if (snprintf(tmpPath, PATH_MAX, "%s.tmp", path) >= PATH_MAX) {
+        return -1;
+    }
+
+    fp = fopen(tmpPath, "w");
+    if (!fp) {
+        fprintf(stderr, "{\"error\" : \"Could not open stream info cache (%s) for writing.\"}", tmpPath);
+        return -1;
+    }
+
+    for (i = 0; i < ic->nb_streams; i++) {
+        codec = ic->streams[i]->codec;
+
+        // The line would not be read back.
+        if (codec->extradata_size > STREAM_INFO_MAX_EXTRADATA) {
+            fprintf(stderr, "{\"error\" : \"Stream %u extradata is too large (%d bytes) to be cached (%s).\"}", i, codec->extradata_size, path);
+            fclose(fp);
+            remove(tmpPath);
+            return -1;
+        }
+
+        fprintf(fp, "stream=%u type=%d codec=%d tag=%u bit_rate=%d tb=%d/%d ticks=%d",
+                i, codec->codec_type, codec->codec_id, codec->codec_tag, codec->bit_rate,
+                codec->time_base.num, codec->time_base.den, codec->ticks_per_frame);
+
+        switch (codec->codec_type) {
+            case AVMEDIA_TYPE_VIDEO:
+                fprintf(fp, " width=%d height=%d pix_fmt=%d has_b_frames=%d",
+                        codec->width, codec->height, codec->pix_fmt, codec->has_b_frames);
+                break;
+            case AVMEDIA_TYPE_AUDIO:
+                fprintf(fp, " sample_rate=%d channels=%d frame_size=%d block_align=%d channel_layout=%" PRIu64,
+                        codec->sample_rate, codec->channels, codec->frame_size, codec->block_align, (uint64_t) codec->channel_layout);
+                break;
+            default:
+                break;
+        }
+
+        if (codec->extradata_size > 0) {
+            fprintf(fp, " extradata=");
+            for (j = 0; j < codec->extradata_size; j++) {
+                fprintf(fp, "%02x", codec->extradata[j]);
+            }
+        }
+        fprintf(fp, "\n");
+    }
+
+    if (fclose(fp) != 0) {
+        remove(tmpPath);
+        return -1;
+    }
+
+    return rename(tmpPath, path);
+}
+
+/**
+ * Used to apply a stream parameters cache to an opened, but not probed,
+ * input context. Nothing is applied unless every stream of the input has a
+ * matching entry, in which case the caller should fall back to probing.
+ *
+ * @param AVFormatContext *ic the opened input context.
+ * @param const char *path the cache file path.
+ * @return int 0 when the cache was applied, -1 otherwise.
+ */
+int loadStreamInfo(AVFormatContext *ic, const char *path) {
+    STREAM_INFO infos[STREAM_INFO_MAX_STREAMS];
+    char line[STREAM_INFO_MAX_LINE], seen[STREAM_INFO_MAX_STREAMS] = {0};
+    AVCodecContext *codec;
+    FILE *fp;
+    int count = 0, ret = -1, i;
+
+    fp = fopen(path, "r");
+    if (!fp) {
+        return -1;
+    }
+    memset(infos, 0, sizeof (infos));
+
+    while (fgets(line, sizeof (line), fp)) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        if (count == STREAM_INFO_MAX_STREAMS || (!strchr(line, '\n') && !feof(fp)) || parseStreamLine(line, &infos[count]) < 0) {
+            if (count < STREAM_INFO_MAX_STREAMS) {
+                av_free(infos[count].extradata);
+            }
+            fprintf(stderr, "{\"error\" : \"Invalid stream info cache (%s), stream information will be probed.\"}", path);
+            goto end;
+        }
+        ++count;
+    }
+
+    if (count != (int) ic->nb_streams) {
+        fprintf(stderr, "{\"error\" : \"Stream info cache (%s) has %d streams, input has %u, stream information will be probed.\"}", path, count, ic->nb_streams);
+        goto end;
+    }
+
+    // Validate everything before touching the input context, each stream must be configured once.
+    for (i = 0; i < count; i++) {
+        if (infos[i].index >= count || seen[infos[i].index]++ || infos[i].timeBaseNum <= 0 ||
+                (ic->streams[infos[i].index]->codec->codec_id != CODEC_ID_NONE &&
+                 ic->streams[infos[i].index]->codec->codec_id != (enum CodecID) infos[i].codec)) {
+            fprintf(stderr, "{\"error\" : \"Stream info cache (%s) does not match the input, stream information will be probed.\"}", path);
+            goto end;
+        }
+    }
+
+    for (i = 0; i < count; i++) {
+        codec = ic->streams[infos[i].index]->codec;
+
+        codec->codec_type = infos[i].type;
+        codec->codec_id = infos[i].codec;
+        codec->codec_tag = infos[i].tag;
+        codec->bit_rate = infos[i].bitRate;
+        codec->time_base.num = infos[i].timeBaseNum;
+        codec->time_base.den = infos[i].timeBaseDen;
+        codec->ticks_per_frame = infos[i].ticksPerFrame;
+        codec->width = infos[i].width;
+        codec->height = infos[i].height;
+        codec->pix_fmt = infos[i].pixelFormat;
+        codec->has_b_frames = infos[i].hasBFrames;
+        codec->sample_rate = infos[i].sampleRate;
+        codec->channels = infos[i].channels;
+        codec->frame_size = infos[i].frameSize;
+        codec->block_align = infos[i].blockAlign;
+        codec->channel_layout = infos[i].channelLayout;
+
+        if (infos[i].extradata) {
+            av_freep(&codec->extradata);
+            codec->extradata = infos[i].extradata;
+            codec->extradata_size = infos[i].extradataSize;
+            infos[i].extradata = NULL;
+        }
+    }
+    ret = 0;
+
+end:
+    for (i = 0; i < count; i++) {
+        av_free(infos[i].extradata);
+    }
+    fclose(fp);
+
+    return ret;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
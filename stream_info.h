@@ -0,0 +1,41 @@
+/**
+ * @file
+ * Stream parameters cache prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * The stream parameters cache holds, one line per input stream, the codec
+ * parameters that av_find_stream_info() would otherwise have to probe for,
+ * so a channel whose layout does not change can skip probing on start up.
+ *
+ * The file is plain text, and can be written by hand:
+ *
+ *     stream=0 type=0 codec=28 width=1280 height=720 pix_fmt=0 tb=1/50 ticks=2
+ *     stream=1 type=1 codec=86018 sample_rate=48000 channels=2 frame_size=1024
+ */
+/**
+ * The largest extradata cached, a stream with more is not cached at all. A
+ * line holds it hex encoded, after the other parameters.
+ */
+#define STREAM_INFO_MAX_EXTRADATA 16384
+#define STREAM_INFO_MAX_LINE (512 + 2 * STREAM_INFO_MAX_EXTRADATA)
+
+int saveStreamInfo(AVFormatContext *, const char *);
+int loadStreamInfo(AVFormatContext *, const char *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
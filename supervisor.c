@@ -0,0 +1,693 @@
+/**
+ * @file
+ * Multi-channel supervisor implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * The supervisor hosts many channel sessions on a small pool of worker threads.
+ *
+ * Channels ready to run wait in a FIFO run queue. A worker takes the head,
+ * lets it consume at most one quantum of input bytes, and puts it back at the
+ * tail, so a high bitrate channel gets the same share of bytes per round as
+ * every other channel, and can not starve them. Workers do not read the
+ * inputs: once probed, each input is read by a poller thread, without
+ * waiting, into a ring of its channel, which also marks where the demuxer can
+ * hand a frame out. A channel is only queued, and a turn only goes on, while
+ * its ring holds a quantum, or the rest of a PES past what was demuxed (or the
+ * input ended), so a worker never waits on the input. The others are parked
+ * until the poller fed them enough; the poller also hands out UDP gaps and
+ * timeouts as they are due. Inputs are opened and probed, which reads for as
+ * long as the input takes, by a small pool of opener threads taking the
+ * channels in order from an open queue.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "libavformat/avformat.h"
+
+#include "helpers.h"
+#include "linked_list.h"
+#include "cue_plan.h"
+#include "history.h"
+#include "metrics.h"
+#include "session.h"
+#include "supervisor.h"
+
+/**
+ * Milliseconds the poller waits for inputs, before looking for new parked channels.
+ */
+#define SUPERVISOR_POLL_TIMEOUT 20
+
+/**
+ * Threads opening and probing the inputs, and the stack each one probes on,
+ * counted in the memory budget of the channel it opens.
+ */
+#define SUPERVISOR_OPENERS 4
+#define SUPERVISOR_OPENER_STACK (2 * 1024 * 1024)
+
+typedef struct channel {
+    SESSION session;
+
+    char *line,
+         *argv[SUPERVISOR_MAX_ARGUMENTS];
+
+    /**
+     * @var SESSION_COUNTERS published a copy of the session counters, taken after each turn.
+     */
+    SESSION_COUNTERS published;
+    enum Session_State publishedState;
+
+    /**
+     * @var int polled whether the poller feeds its input, from its opening until it ended.
+     * @var int feeding whether the poller is at it, its session is not closed meanwhile.
+     */
+    int polled,
+        feeding;
+
+    struct channel *next;
+} CHANNEL;
+
+typedef struct supervisor {
+    const SUPERVISOR_OPTIONS *options;
+
+    CHANNEL **channels;
+    int channelsCount,
+        remaining;
+
+    /**
+     * @var int opened the open queue: the channels from this one on are left to open, in order.
+     */
+    int opened;
+
+    /**
+     * @var CHANNEL *runHead the run queue, linked through CHANNEL.next.
+     * @var CHANNEL **parked channels waiting on the poller for input.
+     */
+    CHANNEL *runHead,
+            *runTail,
+            **parked;
+    int parkedCount;
+
+    /**
+     * @var int wakePipe used to interrupt the poller when a channel gets parked.
+     */
+    int wakePipe[2];
+
+    /**
+     * @var pthread_cond_t fed signaled when the poller is done feeding the inputs.
+     */
+    pthread_mutex_t lock;
+    pthread_cond_t ready,
+                   finished,
+                   fed;
+} SUPERVISOR;
+
+/**
+ * Lock manager registered with libav, codecs are opened from several workers.
+ */
+static int lockManager(void **mutex, enum AVLockOp op) {
+    switch (op) {
+        case AV_LOCK_CREATE:
+            *mutex = malloc(sizeof (pthread_mutex_t));
+            return !*mutex || pthread_mutex_init(*mutex, NULL);
+        case AV_LOCK_OBTAIN:
+            return pthread_mutex_lock(*mutex);
+        case AV_LOCK_RELEASE:
+            return pthread_mutex_unlock(*mutex);
+        case AV_LOCK_DESTROY:
+            pthread_mutex_destroy(*mutex);
+            free(*mutex);
+            *mutex = NULL;
+            return 0;
+    }
+    return 1;
+}
+
+/**
+ * Used to append a channel to the run queue, the lock must be held.
+ *
+ * @param SUPERVISOR *supervisor the supervisor.
+ * @param CHANNEL *channel the channel.
+ */
+static void enqueue(SUPERVISOR *supervisor, CHANNEL *channel) {
+    channel->next = NULL;
+
+    if (supervisor->runTail) {
+        supervisor->runTail->next = channel;
+    } else {
+        supervisor->runHead = channel;
+    }
+    supervisor->runTail = channel;
+
+    pthread_cond_signal(&supervisor->ready);
+}
+
+/**
+ * Used to interrupt the poller, so it looks at the channels again.
+ *
+ * @param SUPERVISOR *supervisor the supervisor.
+ */
+static void wake(SUPERVISOR *supervisor) {
+    if (write(supervisor->wakePipe[1], "", 1) < 0) {
+        // The poller wakes up on its own timeout anyway.
+    }
+}
+
+/**
+ * Used to publish the counters of a channel after its turn, and queue it for
+ * the next one, at once while its input can be demuxed without waiting, on the
+ * poller otherwise. Either way the poller is woken up, as the turn made room
+ * in the ring. The lock must be held.
+ *
+ * @param SUPERVISOR *supervisor the supervisor.
+ * @param CHANNEL *channel the channel.
+ * @param enum Session_State state the state the turn left it in.
+ */
+static void schedule(SUPERVISOR *supervisor, CHANNEL *channel, enum Session_State state) {
+    channel->published = channel->session.counters;
+    channel->publishedState = state;
+
+    if (state != SESSION_RUNNING) {
+        if (!--supervisor->remaining) {
+            pthread_cond_broadcast(&supervisor->ready);
+            pthread_cond_signal(&supervisor->finished);
+        }
+        return;
+    }
+
+    if (sessionInputReady(&channel->session)) {
+        enqueue(supervisor, channel);
+    } else {
+        supervisor->parked[supervisor->parkedCount++] = channel;
+    }
+    wake(supervisor);
+}
+
+/**
+ * Used to take a channel off the poller before its session is closed, waiting
+ * for the poller to be done feeding it. The lock must be held.
+ *
+ * @param SUPERVISOR *supervisor the supervisor.
+ * @param CHANNEL *channel the channel.
+ */
+static void unpoll(SUPERVISOR *supervisor, CHANNEL *channel) {
+    channel->polled = 0;
+    wake(supervisor);
+
+    while (channel->feeding) {
+        pthread_cond_wait(&supervisor->fed, &supervisor->lock);
+    }
+}
+
+/**
+ * Used to load the channels configuration, one channel per line, and prepare their sessions.
+ *
+ * @param SUPERVISOR *supervisor the supervisor.
+ * @return int 0 on success, -1 otherwise.
+ */
+static int loadChannels(SUPERVISOR *supervisor) {
+    char buffer[SUPERVISOR_MAX_LINE], *token, *save;
+    SESSION_OPTIONS options;
+    CHANNEL *channel, **channels;
+    FILE *fp;
+    int argc, lineNumber = 0;
+
+    fp = fopen(supervisor->options->channelsPath, "r");
+    if (!fp) {
+        fprintf(stderr, "{\"error\" : \"Could not open channels file (%s).\"}\n", supervisor->options->channelsPath);
+        return -1;
+    }
+
+    while (fgets(buffer, sizeof (buffer), fp)) {
+        ++lineNumber;
+
+        token = buffer + strspn(buffer, " \t\r\n");
+        if (!*token || *token == '#') {
+            continue;
+        }
+
+        channel = calloc(1, sizeof (CHANNEL));
+        channels = realloc(supervisor->channels, sizeof (CHANNEL *) * (supervisor->channelsCount + 1));
+        if (!channel || !channels || !(channel->line = strdup(token))) {
+            fprintf(stderr, "{\"error\" : \"Could not allocate channel of line %d.\"}\n", lineNumber);
+            free(channel);
+            fclose(fp);
+            return -1;
+        }
+        supervisor->channels = channels;
+        supervisor->channels[supervisor->channelsCount++] = channel;
+
+        // The channel name takes the place of the program name.
+        argc = 0;
+        for (token = strtok_r(channel->line, " \t\r\n", &save); token; token = strtok_r(NULL, " \t\r\n", &save)) {
+            if (argc == SUPERVISOR_MAX_ARGUMENTS - 1) {
+                fprintf(stderr, "{\"error\" : \"Too many arguments on channels line %d.\"}\n", lineNumber);
+                fclose(fp);
+                return -1;
+            }
+            channel->argv[argc++] = token;
+        }
+
+        if (parseSessionArguments(argc, channel->argv, &options, NULL) < 0) {
+            fprintf(stderr, "{\"error\" : \"Invalid channel on line %d.\"}\n", lineNumber);
+            fclose(fp);
+            return -1;
+        }
+
+        if (!options.memoryBudget) {
+            options.memoryBudget = supervisor->options->memoryBudget;
+        }
+        options.pollInput = 1;
+        options.inputQuantum = supervisor->options->quantum;
+        options.openerMemory = SUPERVISOR_OPENER_STACK;
+
+        if (sessionCreate(&channel->session, &options) < 0) {
+            fprintf(stderr, "{\"error\" : \"Could not create channel (%s).\"}\n", options.name);
+            fclose(fp);
+            return -1;
+        }
+    }
+
+    fclose(fp);
+
+    if (!supervisor->channelsCount) {
+        fprintf(stderr, "{\"error\" : \"No channels in (%s).\"}\n", supervisor->options->channelsPath);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Poller thread, feeds the rings of the opened channels with what their inputs
+ * hold, and queues parked channels again once they can demux without waiting.
+ */
+static void *pollerThread(void *opaque) {
+    SUPERVISOR *supervisor = opaque;
+    struct pollfd *fds;
+    CHANNEL **polled;
+    char drain[64];
+    int count, i, j;
+
+    fds = malloc(sizeof (struct pollfd) * (supervisor->channelsCount + 1));
+    polled = malloc(sizeof (CHANNEL *) * supervisor->channelsCount);
+    if (!fds || !polled) {
+        fprintf(stderr, "{\"error\" : \"Could not allocate the poller.\"}\n");
+        abort();
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&supervisor->lock);
+        if (!supervisor->remaining) {
+            pthread_mutex_unlock(&supervisor->lock);
+            break;
+        }
+
+        // The sessions fed are not closed until the poller is done with them.
+        count = 0;
+        for (i = 0; i < supervisor->channelsCount; i++) {
+            if (supervisor->channels[i]->polled) {
+                supervisor->channels[i]->feeding = 1;
+                polled[count++] = supervisor->channels[i];
+            }
+        }
+        pthread_mutex_unlock(&supervisor->lock);
+
+        // Full rings and ended inputs get a negative descriptor, which is skipped.
+        fds[0].fd = supervisor->wakePipe[0];
+        fds[0].events = POLLIN;
+        for (i = 0; i < count; i++) {
+            fds[i + 1].fd = sessionFeedDescriptor(&polled[i]->session);
+            fds[i + 1].events = POLLIN;
+            fds[i + 1].revents = 0;
+        }
+
+        if (poll(fds, count + 1, SUPERVISOR_POLL_TIMEOUT) < 0 && errno != EINTR) {
+            fprintf(stderr, "{\"error\" : \"Polling the inputs failed (%d).\"}\n", errno);
+            abort();
+        }
+
+        if (fds[0].revents & POLLIN) {
+            while (read(supervisor->wakePipe[0], drain, sizeof (drain)) > 0) {
+                // Drain every pending wake up.
+            }
+        }
+
+        // Hang ups and errors are fed as well, the read sees them.
+        for (i = 0; i < count; i++) {
+            if (fds[i + 1].fd >= 0) {
+                sessionFeedInput(&polled[i]->session, fds[i + 1].revents != 0);
+            }
+        }
+
+        pthread_mutex_lock(&supervisor->lock);
+        for (i = 0; i < count; i++) {
+            polled[i]->feeding = 0;
+        }
+        pthread_cond_broadcast(&supervisor->fed);
+
+        for (j = 0; j < supervisor->parkedCount;) {
+            if (sessionInputReady(&supervisor->parked[j]->session)) {
+                enqueue(supervisor, supervisor->parked[j]);
+                supervisor->parked[j] = supervisor->parked[--supervisor->parkedCount];
+            } else {
+                ++j;
+            }
+        }
+        pthread_mutex_unlock(&supervisor->lock);
+    }
+
+    free(fds);
+    free(polled);
+
+    return NULL;
+}
+
+/**
+ * Opener thread, takes the channels left to open from the open queue, opens
+ * their input and probes it, apart from the workers, then schedules their
+ * first turn, with the poller feeding them from then on.
+ */
+static void *openerThread(void *opaque) {
+    SUPERVISOR *supervisor = opaque;
+    CHANNEL *channel;
+    SESSION *session;
+
+    for (;;) {
+        pthread_mutex_lock(&supervisor->lock);
+        if (supervisor->opened == supervisor->channelsCount) {
+            pthread_mutex_unlock(&supervisor->lock);
+            break;
+        }
+        channel = supervisor->channels[supervisor->opened++];
+        pthread_mutex_unlock(&supervisor->lock);
+
+        session = &channel->session;
+        if (sessionOpen(session) < 0) {
+            fprintf(stderr, "{\"error\" : \"Could not open channel.\", \"channel\" : \"%s\"}\n", session->options.name);
+            sessionDestroy(session);
+        }
+
+        pthread_mutex_lock(&supervisor->lock);
+        channel->polled = session->state == SESSION_RUNNING;
+        schedule(supervisor, channel, session->state);
+        pthread_mutex_unlock(&supervisor->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * Worker thread, runs one quantum of the channel at the head of the run queue at a time.
+ */
+static void *workerThread(void *opaque) {
+    SUPERVISOR *supervisor = opaque;
+    CHANNEL *channel;
+    SESSION *session;
+    enum Session_State state;
+
+    for (;;) {
+        pthread_mutex_lock(&supervisor->lock);
+        while (!supervisor->runHead && supervisor->remaining) {
+            pthread_cond_wait(&supervisor->ready, &supervisor->lock);
+        }
+
+        if (!supervisor->runHead) {
+            pthread_mutex_unlock(&supervisor->lock);
+            break;
+        }
+
+        channel = supervisor->runHead;
+        supervisor->runHead = channel->next;
+        if (!supervisor->runHead) {
+            supervisor->runTail = NULL;
+        }
+        pthread_mutex_unlock(&supervisor->lock);
+
+        session = &channel->session;
+
+        state = sessionStep(session, supervisor->options->quantum);
+        if (state != SESSION_RUNNING) {
+            pthread_mutex_lock(&supervisor->lock);
+            unpoll(supervisor, channel);
+            pthread_mutex_unlock(&supervisor->lock);
+
+            sessionFinish(session);
+            sessionDestroy(session);
+        }
+
+        pthread_mutex_lock(&supervisor->lock);
+        schedule(supervisor, channel, state);
+        pthread_mutex_unlock(&supervisor->lock);
+    }
+
+    return NULL;
+}
+
+/**
+ * Used to write the health and latency counters of every channel, one line per channel.
+ *
+ * @param SUPERVISOR *supervisor the supervisor, its lock must be held.
+ * @param FILE *fp the destination.
+ */
+static void writeStatus(SUPERVISOR *supervisor, FILE *fp) {
+    static const char *states[] = {"starting", "running", "done", "failed"};
+    double now = getMonotonicMilliseconds();
+    SESSION_COUNTERS *counters;
+    CHANNEL *channel;
+    int i;
+
+    for (i = 0; i < supervisor->channelsCount; i++) {
+        channel = supervisor->channels[i];
+        counters = &channel->published;
+
+        fprintf(fp, "channel=%s state=%s packets=%llu bytes=%llu segments=%llu write_errors=%llu"
+                " open_ms=%.3f first_segment_ms=%.3f idle_ms=%.3f step_avg_ms=%.3f step_max_ms=%.3f"
+                " interleave_bytes=%ld interleave_peak_bytes=%ld size_cuts=%llu largest_segment_bytes=%lld\n",
+                channel->session.options.name, states[channel->publishedState],
+                counters->packets, counters->bytes, counters->segments, counters->writeErrors,
+                counters->openMilliseconds, counters->firstSegmentMilliseconds,
+                counters->lastPacketTime ? now - counters->lastPacketTime : 0,
+                counters->steps ? counters->totalStepMilliseconds / counters->steps : 0,
+                counters->maxStepMilliseconds,
+                counters->interleaveBytes, counters->peakInterleaveBytes, counters->sizeCuts, counters->largestSegment);
+    }
+}
+
+/**
+ * Used to rewrite the status file, through a temporary file.
+ *
+ * @param SUPERVISOR *supervisor the supervisor, its lock must be held.
+ */
+static void publishStatus(SUPERVISOR *supervisor) {
+    char tmpPath[PATH_MAX];
+    FILE *fp;
+
+    if (snprintf(tmpPath, PATH_MAX, "%s.tmp", supervisor->options->statusPath) >= PATH_MAX) {
+        return;
+    }
+
+    fp = fopen(tmpPath, "w");
+    if (!fp) {
+        return;
+    }
+
+    writeStatus(supervisor, fp);
+
+    if (fclose(fp) == 0) {
+        rename(tmpPath, supervisor->options->statusPath);
+    }
+}
+
+/**
+ * Used to rewrite the metrics file with every channel, through a temporary file.
+ *
+ * @param SUPERVISOR *supervisor the supervisor, its lock must be held.
+ */
+static void publishMetrics(SUPERVISOR *supervisor) {
+    const char **names;
+    const SESSION_COUNTERS **counters;
+    char tmpPath[PATH_MAX];
+    FILE *fp;
+    int i;
+
+    if (snprintf(tmpPath, PATH_MAX, "%s.tmp", supervisor->options->metricsPath) >= PATH_MAX) {
+        return;
+    }
+
+    names = malloc(sizeof (char *) * supervisor->channelsCount);
+    counters = malloc(sizeof (SESSION_COUNTERS *) * supervisor->channelsCount);
+    fp = names && counters ? fopen(tmpPath, "w") : NULL;
+
+    if (fp) {
+        for (i = 0; i < supervisor->channelsCount; i++) {
+            names[i] = supervisor->channels[i]->session.options.name;
+            counters[i] = &supervisor->channels[i]->published;
+        }
+        sessionWriteMetrics(fp, names, counters, supervisor->channelsCount);
+
+        if (fclose(fp) == 0) {
+            rename(tmpPath, supervisor->options->metricsPath);
+        }
+    }
+
+    free(names);
+    free(counters);
+}
+
+/**
+ * Used to host every channel of the configuration, until all of them ended.
+ *
+ * @param const SUPERVISOR_OPTIONS *options the supervisor options.
+ * @return int 0 when every channel ended normally, -1 otherwise.
+ */
+int runSupervisor(const SUPERVISOR_OPTIONS *options) {
+    SUPERVISOR_OPTIONS defaults = *options;
+    SUPERVISOR supervisor;
+    pthread_t poller, workers[SUPERVISOR_MAX_WORKERS], openers[SUPERVISOR_OPENERS];
+    pthread_attr_t openerAttributes;
+    struct timespec deadline;
+    int failed = 0, openersCount, i;
+
+    if (!defaults.workers) {
+        defaults.workers = sysconf(_SC_NPROCESSORS_ONLN);
+        if (defaults.workers < 1) {
+            defaults.workers = 1;
+        } else if (defaults.workers > SUPERVISOR_MAX_WORKERS) {
+            defaults.workers = SUPERVISOR_MAX_WORKERS;
+        }
+    }
+    if (!defaults.quantum) {
+        defaults.quantum = SUPERVISOR_DEFAULT_QUANTUM;
+    }
+
+    memset(&supervisor, 0, sizeof (supervisor));
+    supervisor.options = &defaults;
+
+    if (loadChannels(&supervisor) < 0) {
+        return -1;
+    }
+
+    supervisor.parked = malloc(sizeof (CHANNEL *) * supervisor.channelsCount);
+    if (!supervisor.parked || pipe(supervisor.wakePipe) < 0 ||
+            fcntl(supervisor.wakePipe[0], F_SETFL, O_NONBLOCK) < 0 || fcntl(supervisor.wakePipe[1], F_SETFL, O_NONBLOCK) < 0) {
+        fprintf(stderr, "{\"error\" : \"Could not prepare the supervisor.\"}\n");
+        return -1;
+    }
+
+    if (av_lockmgr_register(lockManager)) {
+        fprintf(stderr, "{\"error\" : \"Could not register the codecs lock manager.\"}\n");
+        return -1;
+    }
+
+    pthread_mutex_init(&supervisor.lock, NULL);
+    pthread_cond_init(&supervisor.ready, NULL);
+    pthread_cond_init(&supervisor.finished, NULL);
+    pthread_cond_init(&supervisor.fed, NULL);
+
+    supervisor.remaining = supervisor.channelsCount;
+
+    if (pthread_create(&poller, NULL, pollerThread, &supervisor)) {
+        fprintf(stderr, "{\"error\" : \"Could not start the poller.\"}\n");
+        return -1;
+    }
+
+    for (i = 0; i < defaults.workers; i++) {
+        if (pthread_create(&workers[i], NULL, workerThread, &supervisor)) {
+            fprintf(stderr, "{\"error\" : \"Could not start worker %d.\"}\n", i);
+            return -1;
+        }
+    }
+
+    // Every channel is queued once an opener is done with it, the stack the openers probe on is counted in the budgets.
+    openersCount = supervisor.channelsCount < SUPERVISOR_OPENERS ? supervisor.channelsCount : SUPERVISOR_OPENERS;
+    if (pthread_attr_init(&openerAttributes) || pthread_attr_setstacksize(&openerAttributes, SUPERVISOR_OPENER_STACK)) {
+        fprintf(stderr, "{\"error\" : \"Could not prepare the openers.\"}\n");
+        return -1;
+    }
+    for (i = 0; i < openersCount; i++) {
+        if (pthread_create(&openers[i], &openerAttributes, openerThread, &supervisor)) {
+            fprintf(stderr, "{\"error\" : \"Could not start opener %d.\"}\n", i);
+            return -1;
+        }
+    }
+    pthread_attr_destroy(&openerAttributes);
+
+    fprintf(stderr, "{\"info\" : \"Supervising %d channels on %ld workers and %d openers.\"}\n", supervisor.channelsCount, defaults.workers,
+            openersCount);
+
+    pthread_mutex_lock(&supervisor.lock);
+    while (supervisor.remaining) {
+        if (defaults.statusPath) {
+            publishStatus(&supervisor);
+        }
+        if (defaults.metricsPath) {
+            publishMetrics(&supervisor);
+        }
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        ++deadline.tv_sec;
+        pthread_cond_timedwait(&supervisor.finished, &supervisor.lock, &deadline);
+    }
+
+    if (defaults.statusPath) {
+        publishStatus(&supervisor);
+    }
+    if (defaults.metricsPath) {
+        publishMetrics(&supervisor);
+    }
+    writeStatus(&supervisor, stderr);
+    pthread_mutex_unlock(&supervisor.lock);
+
+    for (i = 0; i < defaults.workers; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    for (i = 0; i < openersCount; i++) {
+        pthread_join(openers[i], NULL);
+    }
+    pthread_join(poller, NULL);
+
+    for (i = 0; i < supervisor.channelsCount; i++) {
+        failed |= supervisor.channels[i]->publishedState == SESSION_FAILED;
+        free(supervisor.channels[i]->line);
+        free(supervisor.channels[i]);
+    }
+    free(supervisor.channels);
+    free(supervisor.parked);
+    close(supervisor.wakePipe[0]);
+    close(supervisor.wakePipe[1]);
+
+    pthread_cond_destroy(&supervisor.ready);
+    pthread_cond_destroy(&supervisor.finished);
+    pthread_cond_destroy(&supervisor.fed);
+    pthread_mutex_destroy(&supervisor.lock);
+
+    return failed ? -1 : 0;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
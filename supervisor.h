@@ -0,0 +1,48 @@
+/**
+ * @file
+ * Multi-channel supervisor prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#define SUPERVISOR_MAX_WORKERS 256
+#define SUPERVISOR_MAX_ARGUMENTS 64
+#define SUPERVISOR_MAX_LINE 4096
+
+/**
+ * Input bytes a channel consumes per turn, before giving the worker up.
+ */
+#define SUPERVISOR_DEFAULT_QUANTUM 262144
+
+typedef struct supervisor_options {
+    const char *channelsPath,
+            *statusPath,
+            /**
+             * @var const char *metricsPath the file rewritten every second with the metrics of every channel.
+             */
+            *metricsPath;
+
+    long workers,
+         quantum,
+         /**
+          * @var long memoryBudget the budget of channels that do not set their own.
+          */
+         memoryBudget;
+} SUPERVISOR_OPTIONS;
+
+int runSupervisor(const SUPERVISOR_OPTIONS *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,650 @@
+/**
+ * @file
+ * Thumbnails and sprite sheets implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "libavformat/avformat.h"
+#include "libswscale/swscale.h"
+
+#include "thumbnails.h"
+
+#if LIBAVCODEC_VERSION_INT > AV_VERSION_INT(52, 64, 0)
+#define CODEC_TYPE_VIDEO      AVMEDIA_TYPE_VIDEO
+#endif
+
+#ifndef PKT_FLAG_KEY
+#define PKT_FLAG_KEY    AV_PKT_FLAG_KEY
+#endif
+
+/**
+ * Opening and closing codecs is not thread safe without a lock manager, the
+ * workers take turns.
+ */
+static pthread_mutex_t codecsLock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * What each worker owns, so decoding, scaling and encoding take no lock.
+ */
+typedef struct thumbnails_worker {
+    AVCodecContext *decoder,
+                   *encoder;
+    AVFrame *picture;
+    struct SwsContext *scaler;
+    THUMBNAIL_FRAME frame;
+    uint8_t *jpeg;
+    int jpegSize;
+    char *filename,
+         *tmpFilename;
+} THUMBNAILS_WORKER;
+
+/**
+ * Used to open a codec, under the codecs lock.
+ *
+ * @return int 0 on success, -1 otherwise.
+ */
+static int open_codec(AVCodecContext *context, AVCodec *codec) {
+    int ret;
+
+    if (!codec) {
+        return -1;
+    }
+
+    pthread_mutex_lock(&codecsLock);
+    ret = avcodec_open(context, codec);
+    pthread_mutex_unlock(&codecsLock);
+
+    return ret < 0 ? -1 : 0;
+}
+
+/**
+ * Used to close and free a codec context, under the codecs lock.
+ */
+static void close_codec(AVCodecContext *context) {
+    if (!context) {
+        return;
+    }
+
+    pthread_mutex_lock(&codecsLock);
+    if (context->codec) {
+        avcodec_close(context);
+    }
+    pthread_mutex_unlock(&codecsLock);
+
+    av_free(context);
+}
+
+/**
+ * Used to prepare a worker: a decoder with the video stream parameters, and
+ * the sheet file names. The encoder is opened with the first sheet.
+ *
+ * @return int 0 on success, -1 otherwise.
+ */
+static int open_worker(THUMBNAILS *pool, THUMBNAILS_WORKER *worker) {
+    memset(worker, 0, sizeof (THUMBNAILS_WORKER));
+
+    worker->filename = malloc(strlen(pool->prefix) + 16);
+    worker->tmpFilename = malloc(strlen(pool->prefix) + 20);
+    worker->decoder = avcodec_alloc_context();
+    worker->picture = avcodec_alloc_frame();
+    if (!worker->filename || !worker->tmpFilename || !worker->decoder || !worker->picture) {
+        return -1;
+    }
+
+    // The extradata stays owned by the video stream, which outlives the pool.
+    worker->decoder->codec_type = CODEC_TYPE_VIDEO;
+    worker->decoder->codec_id = pool->video->codec_id;
+    worker->decoder->width = pool->video->width;
+    worker->decoder->height = pool->video->height;
+    worker->decoder->extradata = pool->video->extradata;
+    worker->decoder->extradata_size = pool->video->extradata_size;
+
+    return open_codec(worker->decoder, avcodec_find_decoder(pool->video->codec_id));
+}
+
+/**
+ * Used to release what a worker owns.
+ */
+static void close_worker(THUMBNAILS_WORKER *worker) {
+    if (worker->decoder) {
+        worker->decoder->extradata = NULL;
+        worker->decoder->extradata_size = 0;
+    }
+    close_codec(worker->decoder);
+    close_codec(worker->encoder);
+    av_free(worker->picture);
+    if (worker->scaler) {
+        sws_freeContext(worker->scaler);
+    }
+    free(worker->frame.data);
+    free(worker->jpeg);
+    free(worker->filename);
+    free(worker->tmpFilename);
+}
+
+/**
+ * Used to decode a key frame, and scale it into its tile. The decoder is
+ * drained and flushed, so each key frame is decoded on its own.
+ *
+ * @return int 0 on success, -1 when the frame could not be decoded.
+ */
+static int decode_tile(THUMBNAILS *pool, THUMBNAILS_WORKER *worker, THUMBNAIL_SHEET *sheet, int tile) {
+    AVPacket packet;
+    AVPicture *picture = &sheet->picture;
+    uint8_t *destination[4] = {NULL};
+    int destinationStride[4] = {0},
+        x = tile % THUMBNAILS_COLUMNS * pool->width,
+        y = tile / THUMBNAILS_COLUMNS * pool->height,
+        got = 0, i;
+
+    av_init_packet(&packet);
+    packet.data = worker->frame.data;
+    packet.size = worker->frame.size;
+    packet.flags |= PKT_FLAG_KEY;
+
+    if (avcodec_decode_video2(worker->decoder, worker->picture, &got, &packet) < 0) {
+        got = 0;
+    }
+
+    // Decoders with a delay give the picture back once drained.
+    if (!got) {
+        packet.data = NULL;
+        packet.size = 0;
+        if (avcodec_decode_video2(worker->decoder, worker->picture, &got, &packet) < 0) {
+            got = 0;
+        }
+    }
+    avcodec_flush_buffers(worker->decoder);
+
+    if (!got || worker->decoder->width <= 0 || worker->decoder->height <= 0) {
+        return -1;
+    }
+
+    worker->scaler = sws_getCachedContext(worker->scaler, worker->decoder->width, worker->decoder->height, worker->decoder->pix_fmt,
+                                          pool->width, pool->height, PIX_FMT_YUVJ420P, SWS_BILINEAR, NULL, NULL, NULL);
+    if (!worker->scaler) {
+        return -1;
+    }
+
+    // Tiles start on even lines and columns, so each one owns its chroma samples.
+    for (i = 0; i < 3; i++) {
+        destination[i] = picture->data[i] + (i ? y / 2 : y) * picture->linesize[i] + (i ? x / 2 : x);
+        destinationStride[i] = picture->linesize[i];
+    }
+
+    sws_scale(worker->scaler, (const uint8_t * const *) worker->picture->data, worker->picture->linesize, 0, worker->decoder->height,
+              destination, destinationStride);
+
+    return 0;
+}
+
+/**
+ * Used to encode a sheet as JPEG, and write it through a temporary file, so
+ * players never read a partial one.
+ *
+ * @return int 0 on success, -1 otherwise.
+ */
+static int encode_sheet(THUMBNAILS *pool, THUMBNAILS_WORKER *worker, THUMBNAIL_SHEET *sheet) {
+    AVFrame *frame;
+    FILE *file;
+    int size;
+
+    if (!worker->encoder) {
+        worker->encoder = avcodec_alloc_context();
+        if (!worker->encoder) {
+            return -1;
+        }
+
+        worker->encoder->codec_type = CODEC_TYPE_VIDEO;
+        worker->encoder->codec_id = CODEC_ID_MJPEG;
+        worker->encoder->width = pool->width * THUMBNAILS_COLUMNS;
+        worker->encoder->height = pool->height * THUMBNAILS_ROWS;
+        worker->encoder->pix_fmt = PIX_FMT_YUVJ420P;
+        worker->encoder->time_base.num = 1;
+        worker->encoder->time_base.den = 25;
+        worker->encoder->flags |= CODEC_FLAG_QSCALE;
+        worker->encoder->global_quality = FF_QP2LAMBDA * THUMBNAILS_QUALITY;
+
+        if (open_codec(worker->encoder, avcodec_find_encoder(CODEC_ID_MJPEG)) < 0) {
+            return -1;
+        }
+
+        // Raw pictures are an upper bound for JPEG ones, headers included.
+        worker->jpegSize = worker->encoder->width * worker->encoder->height * 3 + 4096;
+        worker->jpeg = malloc(worker->jpegSize);
+        if (!worker->jpeg) {
+            return -1;
+        }
+    }
+
+    frame = avcodec_alloc_frame();
+    if (!frame) {
+        return -1;
+    }
+    memcpy(frame->data, sheet->picture.data, sizeof (frame->data));
+    memcpy(frame->linesize, sheet->picture.linesize, sizeof (frame->linesize));
+    frame->quality = worker->encoder->global_quality;
+    frame->pts = sheet->index;
+
+    size = avcodec_encode_video(worker->encoder, worker->jpeg, worker->jpegSize, frame);
+    av_free(frame);
+    if (size <= 0) {
+        return -1;
+    }
+
+    sprintf(worker->filename, "%s-%u.jpg", pool->prefix, sheet->index);
+    sprintf(worker->tmpFilename, "%s.tmp", worker->filename);
+
+    file = fopen(worker->tmpFilename, "wb");
+    if (!file) {
+        return -1;
+    }
+    if (fwrite(worker->jpeg, 1, size, file) != size) {
+        fclose(file);
+        unlink(worker->tmpFilename);
+        return -1;
+    }
+    if (fclose(file) || rename(worker->tmpFilename, worker->filename)) {
+        unlink(worker->tmpFilename);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to write a WebVTT time stamp.
+ */
+static void write_time(FILE *track, double time) {
+    unsigned long long milliseconds = time > 0 ? (unsigned long long) (time * 1000 + 0.5) : 0;
+
+    fprintf(track, "%02llu:%02llu:%02llu.%03llu", milliseconds / 3600000, milliseconds / 60000 % 60, milliseconds / 1000 % 60,
+            milliseconds % 1000);
+}
+
+/**
+ * Used to write the cue held back, now its end is known.
+ */
+static void write_cue(THUMBNAILS *pool, double end) {
+    int tile = pool->cueTile;
+
+    if (!pool->cuePending) {
+        return;
+    }
+
+    write_time(pool->track, pool->cueStart);
+    fprintf(pool->track, " --> ");
+    write_time(pool->track, end > pool->cueStart ? end : pool->cueStart);
+    fprintf(pool->track, "\n%s-%u.jpg#xywh=%d,%d,%d,%d\n\n", pool->uri, pool->cueSheet, tile % THUMBNAILS_COLUMNS * pool->width,
+            tile / THUMBNAILS_COLUMNS * pool->height, pool->width, pool->height);
+    pool->cuePending = 0;
+}
+
+/**
+ * Used to write the cues of the encoded sheets, in order, and give their slots
+ * back. Each cue ends where the next one starts, so the last one is held back
+ * until then. It is called with the lock held.
+ */
+static void write_cues(THUMBNAILS *pool) {
+    THUMBNAIL_SHEET *sheet;
+    int tile, wrote = 0;
+
+    for (sheet = &pool->sheets[pool->written % THUMBNAILS_SHEETS];
+            sheet->state == THUMBNAILS_SHEET_ENCODED && sheet->index == pool->written;
+            sheet = &pool->sheets[pool->written % THUMBNAILS_SHEETS]) {
+        for (tile = 0; tile < sheet->tiles; tile++) {
+            write_cue(pool, sheet->times[tile]);
+            pool->cuePending = 1;
+            pool->cueSheet = sheet->index;
+            pool->cueTile = tile;
+            pool->cueStart = sheet->times[tile];
+        }
+
+        sheet->state = THUMBNAILS_SHEET_FREE;
+        ++pool->written;
+        wrote = 1;
+    }
+
+    if (wrote) {
+        fflush(pool->track);
+        pthread_cond_broadcast(&pool->freed);
+    }
+}
+
+/**
+ * Used to take the sheet a thumbnail goes in, waiting for its slot to be
+ * written when the previous sheet in it is still pending. It is called with
+ * the lock held.
+ */
+static THUMBNAIL_SHEET *take_sheet(THUMBNAILS *pool, unsigned int number) {
+    unsigned int index = number / THUMBNAILS_TILES;
+    THUMBNAIL_SHEET *sheet = &pool->sheets[index % THUMBNAILS_SHEETS];
+    int size = pool->width * THUMBNAILS_COLUMNS * pool->height * THUMBNAILS_ROWS;
+
+    while (sheet->state != THUMBNAILS_SHEET_FREE && sheet->index != index) {
+        pthread_cond_wait(&pool->freed, &pool->lock);
+    }
+
+    if (sheet->state == THUMBNAILS_SHEET_FREE) {
+        // Black, in full range, for tiles that could not be decoded.
+        memset(sheet->picture.data[0], 0, size);
+        memset(sheet->picture.data[1], 128, size / 4);
+        memset(sheet->picture.data[2], 128, size / 4);
+        sheet->state = THUMBNAILS_SHEET_FILLING;
+        sheet->index = index;
+        sheet->tiles = sheet->done = 0;
+    }
+
+    return sheet;
+}
+
+/**
+ * Used to run a worker, until the pool stops and the queue is drained.
+ */
+static void *workerThread(void *data) {
+    THUMBNAILS *pool = data;
+    THUMBNAILS_WORKER worker;
+    THUMBNAIL_FRAME swap;
+    THUMBNAIL_SHEET *sheet;
+    int ready, tile, failed;
+
+    ready = open_worker(pool, &worker) == 0;
+    if (!ready) {
+        fprintf(stderr, "{\"error\" : \"Could not open a thumbnails decoder.\"}\n");
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->count && !pool->stopping) {
+            pthread_cond_wait(&pool->queued, &pool->lock);
+        }
+        if (!pool->count) {
+            break;
+        }
+
+        // The buffers are swapped, so the queue slot can be refilled while decoding.
+        swap = pool->queue[pool->head];
+        pool->queue[pool->head] = worker.frame;
+        worker.frame = swap;
+        pool->head = (pool->head + 1) % pool->capacity;
+        --pool->count;
+
+        sheet = take_sheet(pool, pool->next++);
+        tile = sheet->tiles++;
+        sheet->times[tile] = worker.frame.time;
+        pthread_mutex_unlock(&pool->lock);
+
+        failed = !ready || decode_tile(pool, &worker, sheet, tile) < 0;
+
+        pthread_mutex_lock(&pool->lock);
+        if (failed) {
+            ++pool->failed;
+        } else {
+            ++pool->made;
+        }
+
+        if (++sheet->done == THUMBNAILS_TILES) {
+            pthread_mutex_unlock(&pool->lock);
+            failed = encode_sheet(pool, &worker, sheet) < 0;
+            pthread_mutex_lock(&pool->lock);
+
+            if (failed) {
+                fprintf(stderr, "{\"error\" : \"Could not write the thumbnails sheet %u (%s).\"}\n", sheet->index, pool->prefix);
+            }
+            sheet->state = THUMBNAILS_SHEET_ENCODED;
+            write_cues(pool);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    close_worker(&worker);
+
+    return NULL;
+}
+
+/**
+ * Used to release what the pool allocated.
+ */
+static void release(THUMBNAILS *pool) {
+    int i;
+
+    for (i = 0; pool->queue && i < pool->capacity; i++) {
+        free(pool->queue[i].data);
+    }
+    free(pool->queue);
+    pool->queue = NULL;
+
+    for (i = 0; i < THUMBNAILS_SHEETS; i++) {
+        if (pool->sheets[i].picture.data[0]) {
+            avpicture_free(&pool->sheets[i].picture);
+            pool->sheets[i].picture.data[0] = NULL;
+        }
+    }
+
+    if (pool->track) {
+        fclose(pool->track);
+        pool->track = NULL;
+    }
+}
+
+/**
+ * Used to start the pool: the queue slots and the sheets are allocated once,
+ * the track is started over, and the workers are started.
+ *
+ * @param THUMBNAILS *pool the pool.
+ * @param AVCodecContext *video the video stream codec.
+ * @param const char *prefix the sheets and track path prefix.
+ * @param int width the tile width, made even.
+ * @param int height the tile height, made even.
+ * @param int workers the number of workers, up to THUMBNAILS_MAX_WORKERS.
+ * @param int capacity the number of key frames queued at most.
+ * @param enum Thumbnails_Drop drop which key frame is dropped when the queue is full.
+ * @return int 0 on success, -1 otherwise.
+ */
+int thumbnailsStart(THUMBNAILS *pool, AVCodecContext *video, const char *prefix, int width, int height, int workers, int capacity,
+                    enum Thumbnails_Drop drop) {
+    char *filename;
+    const char *slash;
+    int i;
+
+    memset(pool, 0, sizeof (THUMBNAILS));
+    pool->video = video;
+    pool->prefix = prefix;
+    pool->width = (width + 1) & ~1;
+    pool->height = (height + 1) & ~1;
+    pool->drop = drop;
+    pool->capacity = capacity > 0 ? capacity : 1;
+    workers = workers < 1 ? 1 : workers > THUMBNAILS_MAX_WORKERS ? THUMBNAILS_MAX_WORKERS : workers;
+
+    // The track sits next to the sheets.
+    slash = strrchr(prefix, '/');
+    pool->uri = slash ? slash + 1 : prefix;
+
+    pool->queue = calloc(pool->capacity, sizeof (THUMBNAIL_FRAME));
+    if (!pool->queue) {
+        return -1;
+    }
+
+    for (i = 0; i < THUMBNAILS_SHEETS; i++) {
+        if (avpicture_alloc(&pool->sheets[i].picture, PIX_FMT_YUVJ420P, pool->width * THUMBNAILS_COLUMNS,
+                            pool->height * THUMBNAILS_ROWS) < 0) {
+            release(pool);
+            return -1;
+        }
+    }
+
+    filename = malloc(strlen(prefix) + 5);
+    if (!filename) {
+        release(pool);
+        return -1;
+    }
+    sprintf(filename, "%s.vtt", prefix);
+    pool->track = fopen(filename, "w");
+    free(filename);
+    if (!pool->track) {
+        release(pool);
+        return -1;
+    }
+    fprintf(pool->track, "WEBVTT\n\n");
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->queued, NULL);
+    pthread_cond_init(&pool->freed, NULL);
+
+    for (i = 0; i < workers; i++) {
+        if (pthread_create(&pool->workers[i], NULL, workerThread, pool)) {
+            break;
+        }
+        ++pool->workersCount;
+    }
+
+    if (!pool->workersCount) {
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->queued);
+        pthread_cond_destroy(&pool->freed);
+        release(pool);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Used to queue a key frame, without waiting. When the queue is full, the
+ * drop policy picks the key frame given up.
+ *
+ * @param THUMBNAILS *pool the pool.
+ * @param const uint8_t *data the key frame packet.
+ * @param int size the packet size.
+ * @param double time the key frame time, in seconds of the output timeline.
+ * @return int 0 when queued, 1 when a key frame was dropped, -1 on allocation failure.
+ */
+int thumbnailsSubmit(THUMBNAILS *pool, const uint8_t *data, int size, double time) {
+    THUMBNAIL_FRAME *frame;
+    uint8_t *grown;
+    int dropped = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (pool->count == pool->capacity) {
+        ++pool->dropped;
+        if (pool->drop == THUMBNAILS_DROP_NEWEST) {
+            pthread_mutex_unlock(&pool->lock);
+            return 1;
+        }
+
+        // The oldest slot is reused for the new key frame, at the tail.
+        pool->head = (pool->head + 1) % pool->capacity;
+        --pool->count;
+        dropped = 1;
+    }
+
+    frame = &pool->queue[(pool->head + pool->count) % pool->capacity];
+    if (frame->capacity < size) {
+        grown = realloc(frame->data, size + FF_INPUT_BUFFER_PADDING_SIZE);
+        if (!grown) {
+            pthread_mutex_unlock(&pool->lock);
+            return -1;
+        }
+        frame->data = grown;
+        frame->capacity = size;
+    }
+
+    memcpy(frame->data, data, size);
+    memset(frame->data + size, 0, FF_INPUT_BUFFER_PADDING_SIZE);
+    frame->size = size;
+    frame->time = time;
+    ++pool->count;
+
+    pthread_cond_signal(&pool->queued);
+    pthread_mutex_unlock(&pool->lock);
+
+    return dropped;
+}
+
+/**
+ * Used to read the pool counters.
+ *
+ * @param THUMBNAILS *pool the pool.
+ * @param unsigned long long *made receives the thumbnails tiled so far.
+ * @param unsigned long long *dropped receives the key frames dropped so far.
+ * @param long *pending receives the key frames queued.
+ */
+void thumbnailsCounts(THUMBNAILS *pool, unsigned long long *made, unsigned long long *dropped, long *pending) {
+    pthread_mutex_lock(&pool->lock);
+    *made = pool->made;
+    *dropped = pool->dropped;
+    *pending = pool->count;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Used to stop the pool: the queued key frames are still tiled, the last,
+ * partial, sheet is written, and the last cue ends at the end of the stream.
+ *
+ * @param THUMBNAILS *pool the pool.
+ * @param double end the end of the stream, in seconds of the output timeline.
+ */
+void thumbnailsStop(THUMBNAILS *pool, double end) {
+    THUMBNAILS_WORKER worker;
+    THUMBNAIL_SHEET *sheet;
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->queued);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->workersCount; i++) {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    // The workers are gone, what is left needs no lock.
+    memset(&worker, 0, sizeof (THUMBNAILS_WORKER));
+    worker.filename = malloc(strlen(pool->prefix) + 16);
+    worker.tmpFilename = malloc(strlen(pool->prefix) + 20);
+
+    for (i = 0; i < THUMBNAILS_SHEETS; i++) {
+        sheet = &pool->sheets[pool->written % THUMBNAILS_SHEETS];
+        if (sheet->state != THUMBNAILS_SHEET_FILLING || sheet->index != pool->written) {
+            break;
+        }
+
+        if (!worker.filename || !worker.tmpFilename || encode_sheet(pool, &worker, sheet) < 0) {
+            fprintf(stderr, "{\"error\" : \"Could not write the thumbnails sheet %u (%s).\"}\n", sheet->index, pool->prefix);
+        }
+        sheet->state = THUMBNAILS_SHEET_ENCODED;
+        write_cues(pool);
+    }
+    close_worker(&worker);
+
+    write_cue(pool, end);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->queued);
+    pthread_cond_destroy(&pool->freed);
+    release(pool);
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
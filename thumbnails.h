@@ -0,0 +1,153 @@
+/**
+ * @file
+ * Thumbnails and sprite sheets prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * Thumbnails are made off the remux thread: key frames are copied into a
+ * bounded queue, and a pool of workers, each with its own decoder, decodes,
+ * scales and tiles them into sprite sheets of THUMBNAILS_COLUMNS by
+ * THUMBNAILS_ROWS, written as JPEG, "<prefix>-<n>.jpg", once full. A WebVTT
+ * track, "<prefix>.vtt", points each time range at its tile. Submitting never
+ * waits: when the queue is full, either the new key frame or the oldest
+ * queued one is dropped, and counted. Tiles are given out as frames are
+ * dequeued, so dropped frames leave no hole in the sheets. It expects
+ * <stdio.h>, <stdint.h>, <pthread.h> and "libavformat/avformat.h" to be
+ * included first.
+ */
+#define THUMBNAILS_COLUMNS 5
+#define THUMBNAILS_ROWS 5
+#define THUMBNAILS_TILES (THUMBNAILS_COLUMNS * THUMBNAILS_ROWS)
+#define THUMBNAILS_MAX_WORKERS 16
+
+/**
+ * Sheets filled at the same time, workers move on to the next one while the
+ * last tiles of the previous one are still being decoded.
+ */
+#define THUMBNAILS_SHEETS 2
+
+/**
+ * The JPEG quantizer scale, from 2 (best) to 31.
+ */
+#define THUMBNAILS_QUALITY 5
+
+enum Thumbnails_Drop {
+    THUMBNAILS_DROP_NEWEST,
+    THUMBNAILS_DROP_OLDEST
+};
+
+enum Thumbnails_Sheet_State {
+    THUMBNAILS_SHEET_FREE,
+    THUMBNAILS_SHEET_FILLING,
+    THUMBNAILS_SHEET_ENCODED
+};
+
+typedef struct thumbnail_frame {
+    /**
+     * @var uint8_t *data a copy of the key frame packet, followed by the decoder padding.
+     * @var double time the key frame time, in seconds of the output timeline.
+     */
+    uint8_t *data;
+    int size,
+        capacity;
+    double time;
+} THUMBNAIL_FRAME;
+
+typedef struct thumbnail_sheet {
+    AVPicture picture;
+    enum Thumbnails_Sheet_State state;
+
+    /**
+     * @var unsigned int index the sheet number, in the file name.
+     * @var int tiles the tiles given out so far.
+     * @var int done the tiles decoded, or given up, so far.
+     * @var double times the time of each tile.
+     */
+    unsigned int index;
+    int tiles,
+        done;
+    double times[THUMBNAILS_TILES];
+} THUMBNAIL_SHEET;
+
+typedef struct thumbnails {
+    /**
+     * @var const char *prefix the sheets and track path prefix.
+     * @var const char *uri the prefix as written in the track, relative to it.
+     * @var AVCodecContext *video the video stream codec, its parameters are copied by each worker.
+     */
+    const char *prefix,
+               *uri;
+    AVCodecContext *video;
+    int width,
+        height;
+    enum Thumbnails_Drop drop;
+
+    pthread_t workers[THUMBNAILS_MAX_WORKERS];
+    int workersCount;
+
+    /**
+     * @var pthread_mutex_t lock guards everything below.
+     * @var pthread_cond_t queued signaled when a frame is queued, or when stopping.
+     * @var pthread_cond_t freed signaled when a sheet is written and can be reused.
+     */
+    pthread_mutex_t lock;
+    pthread_cond_t queued,
+                   freed;
+
+    /**
+     * @var THUMBNAIL_FRAME *queue the queued key frames, capacity slots allocated once.
+     * @var unsigned int next the thumbnail number given to the next dequeued frame.
+     * @var unsigned int written the next sheet whose cues go to the track.
+     */
+    THUMBNAIL_FRAME *queue;
+    int capacity,
+        head,
+        count,
+        stopping;
+    unsigned int next,
+                 written;
+
+    THUMBNAIL_SHEET sheets[THUMBNAILS_SHEETS];
+    FILE *track;
+
+    /**
+     * The cue written last is held back, its end is the start of the next one.
+     *
+     * @var int cuePending whether there is one.
+     */
+    int cuePending,
+        cueTile;
+    unsigned int cueSheet;
+    double cueStart;
+
+    /**
+     * @var unsigned long long made the thumbnails tiled so far.
+     * @var unsigned long long dropped the key frames dropped because the queue was full.
+     * @var unsigned long long failed the key frames which could not be decoded.
+     */
+    unsigned long long made,
+                       dropped,
+                       failed;
+} THUMBNAILS;
+
+int thumbnailsStart(THUMBNAILS *, AVCodecContext *, const char *, int, int, int, int, enum Thumbnails_Drop);
+int thumbnailsSubmit(THUMBNAILS *, const uint8_t *, int, double);
+void thumbnailsCounts(THUMBNAILS *, unsigned long long *, unsigned long long *, long *);
+void thumbnailsStop(THUMBNAILS *, double);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,478 @@
+/**
+ * @file
+ * UDP and RTP input implementation.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "helpers.h"
+#include "udp_input.h"
+
+#define TS_PACKET_SIZE 188
+#define TS_NULL_PID 0x1FFF
+
+/**
+ * Used to split an input URL, "udp://[@]<host>:<port>" or "rtp://...", the
+ * host may be left out to receive on every address.
+ *
+ * @return int 0 on success, -1 when it is not one.
+ */
+static int parse_url(const char *url, int *rtp, char *host, size_t hostSize, char *port, size_t portSize) {
+    const char *start, *colon, *end;
+
+    if (!strncmp(url, "udp://", 6)) {
+        *rtp = 0;
+    } else if (!strncmp(url, "rtp://", 6)) {
+        *rtp = 1;
+    } else {
+        return -1;
+    }
+
+    start = url + 6;
+    if (*start == '@') {
+        ++start;
+    }
+    end = start + strcspn(start, "?/");
+    for (colon = end; colon > start && colon[-1] != ':'; colon--);
+    if (colon == start || colon == end || colon - start > hostSize || end - colon >= portSize) {
+        return -1;
+    }
+
+    snprintf(host, hostSize, "%.*s", (int) (colon - 1 - start), start);
+    snprintf(port, portSize, "%.*s", (int) (end - colon), colon);
+
+    return 0;
+}
+
+/**
+ * Used to open the socket: bound to the address, joined to the group when it
+ * is a multicast one, with a receive buffer as large as the host allows, and
+ * a receive timeout, so gaps are given up on without traffic.
+ *
+ * @return int the socket, -1 on errors.
+ */
+static int open_socket(UDP_INPUT *input, const char *url, int bufferSize) {
+    struct addrinfo hints, *address = NULL;
+    struct sockaddr_in *bound;
+    struct ip_mreq membership;
+    struct timeval timeout;
+    char host[256], port[16];
+    int fd, reuse = 1, size;
+    socklen_t length = sizeof (size);
+
+    if (parse_url(url, &input->rtp, host, sizeof (host), port, sizeof (port)) < 0) {
+        fprintf(stderr, "{\"error\" : \"Input (%s) is not udp://[@]<host>:<port> nor rtp://[@]<host>:<port>.\"}\n", url);
+        return -1;
+    }
+
+    memset(&hints, 0, sizeof (hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = AI_PASSIVE;
+    if (getaddrinfo(*host ? host : NULL, port, &hints, &address) || !address) {
+        fprintf(stderr, "{\"error\" : \"Could not resolve the input address (%s).\"}\n", url);
+        return -1;
+    }
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        freeaddrinfo(address);
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof (reuse));
+
+    // Forcing it goes past net.core.rmem_max, when the process may.
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &bufferSize, sizeof (bufferSize)) < 0) {
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof (bufferSize));
+    }
+    if (!getsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, &length) && size < bufferSize) {
+        fprintf(stderr, "{\"info\" : \"UDP receive buffer is %d bytes, %d asked, raise net.core.rmem_max.\"}\n", size, bufferSize);
+    }
+
+    timeout.tv_sec = input->latency / 1000;
+    timeout.tv_usec = input->latency % 1000 * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+
+    bound = (struct sockaddr_in *) address->ai_addr;
+    if (bind(fd, address->ai_addr, address->ai_addrlen) < 0) {
+        fprintf(stderr, "{\"error\" : \"Could not bind the input address (%s).\"}\n", url);
+        freeaddrinfo(address);
+        close(fd);
+        return -1;
+    }
+
+    if (IN_MULTICAST(ntohl(bound->sin_addr.s_addr))) {
+        membership.imr_multiaddr = bound->sin_addr;
+        membership.imr_interface.s_addr = htonl(INADDR_ANY);
+        if (setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof (membership)) < 0) {
+            fprintf(stderr, "{\"error\" : \"Could not join the input group (%s).\"}\n", url);
+            freeaddrinfo(address);
+            close(fd);
+            return -1;
+        }
+    }
+    freeaddrinfo(address);
+
+    return fd;
+}
+
+/**
+ * Used to open an input.
+ *
+ * @param UDP_INPUT *input the input.
+ * @param const char *url "udp://[@]<host>:<port>" or "rtp://[@]<host>:<port>".
+ * @param int bufferSize the socket receive buffer size, in bytes.
+ * @param int depth the jitter buffer depth, in datagrams, RTP only.
+ * @param int latency the longest wait for a missing datagram, in milliseconds.
+ * @param double timeout seconds without datagrams before the input ends, 0 to wait forever.
+ * @return int 0 on success, -1 otherwise.
+ */
+int udpInputOpen(UDP_INPUT *input, const char *url, int bufferSize, int depth, int latency, double timeout) {
+    int i, count;
+
+    memset(input, 0, sizeof (UDP_INPUT));
+    memset(input->continuity, -1, sizeof (input->continuity));
+    input->latency = latency;
+    input->timeout = timeout * 1000;
+
+    input->fd = open_socket(input, url, bufferSize);
+    if (input->fd < 0) {
+        return -1;
+    }
+
+    // Plain UDP has no sequence numbers, datagrams are handed out as they arrive.
+    input->depth = input->rtp ? depth : 1;
+
+    // Enough buffers for a full jitter buffer, a full batch and the one handed out.
+    count = input->depth + UDP_INPUT_BATCH + 1;
+    input->messages = calloc(UDP_INPUT_BATCH, sizeof (struct mmsghdr));
+    input->vectors = calloc(UDP_INPUT_BATCH, sizeof (struct iovec));
+    input->slots = calloc(input->depth, sizeof (UDP_DATAGRAM));
+    input->spare = malloc(count * sizeof (uint8_t *));
+    input->buffers = malloc((size_t) count * UDP_INPUT_DATAGRAM_SIZE);
+    if (!input->messages || !input->vectors || !input->slots || !input->spare || !input->buffers) {
+        udpInputClose(input);
+        return -1;
+    }
+
+    for (i = 0; i < count; i++) {
+        input->spare[input->spareCount++] = input->buffers + (size_t) i * UDP_INPUT_DATAGRAM_SIZE;
+    }
+    for (i = 0; i < UDP_INPUT_BATCH; i++) {
+        input->vectors[i].iov_base = input->spare[--input->spareCount];
+        input->vectors[i].iov_len = UDP_INPUT_DATAGRAM_SIZE;
+        input->messages[i].msg_hdr.msg_iov = &input->vectors[i];
+        input->messages[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    input->lastDatagram = getMonotonicMilliseconds();
+
+    return 0;
+}
+
+/**
+ * Used to find the payload of an RTP datagram, past the CSRCs, the header
+ * extension, and before the padding.
+ *
+ * @return int the payload offset, -1 when it is not RTP.
+ */
+static int rtp_payload(const uint8_t *data, int *size, uint16_t *sequence) {
+    int offset = 12 + (data[0] & 0x0F) * 4;
+
+    if (*size < 12 || data[0] >> 6 != 2) {
+        return -1;
+    }
+
+    if (data[0] & 0x10) {
+        if (*size < offset + 4) {
+            return -1;
+        }
+        offset += 4 + ((data[offset + 2] << 8) | data[offset + 3]) * 4;
+    }
+
+    if (data[0] & 0x20) {
+        *size -= data[*size - 1];
+    }
+
+    if (offset > *size) {
+        return -1;
+    }
+
+    *sequence = (data[2] << 8) | data[3];
+
+    return offset;
+}
+
+/**
+ * Used to sort the next received datagram into the jitter buffer, at the slot
+ * of its sequence number. A datagram too far ahead waits in the batch, while
+ * the reader gives up on the missing ones before it.
+ */
+static void sort_datagram(UDP_INPUT *input) {
+    struct mmsghdr *message = &input->messages[input->next];
+    uint8_t *data = input->vectors[input->next].iov_base;
+    UDP_DATAGRAM *slot;
+    int size = message->msg_len, offset = 0, delta;
+    uint16_t sequence = input->arrivals;
+
+    if (message->msg_hdr.msg_flags & MSG_TRUNC || (input->rtp && (offset = rtp_payload(data, &size, &sequence)) < 0)) {
+        ++input->discarded;
+        ++input->next;
+        return;
+    }
+
+    if (!input->started) {
+        input->expected = sequence;
+        input->started = 1;
+    }
+
+    delta = (int16_t) (uint16_t) (sequence - input->expected);
+    if (delta >= UDP_INPUT_RESYNC || delta <= -UDP_INPUT_RESYNC) {
+        if (input->buffered) {
+            input->skipping = input->resyncing = 1;
+            return;
+        }
+        input->expected = sequence;
+        delta = 0;
+    } else if (delta >= input->depth) {
+        if (input->buffered) {
+            input->skipping = 1;
+            return;
+        }
+        input->lost += delta;
+        input->expected = sequence;
+        delta = 0;
+    } else if (delta < 0) {
+        ++input->late;
+        ++input->next;
+        return;
+    }
+
+    slot = &input->slots[(input->head + delta) % input->depth];
+    if (slot->data) {
+        ++input->late;
+        ++input->next;
+        return;
+    }
+
+    slot->data = data;
+    slot->size = size;
+    slot->offset = offset;
+    ++input->buffered;
+    ++input->arrivals;
+    ++input->datagrams;
+    input->bytes += size - offset;
+
+    input->vectors[input->next].iov_base = input->spare[--input->spareCount];
+    ++input->next;
+}
+
+/**
+ * Used to check the continuity counters of the TS packets of a datagram. A
+ * repeated counter is allowed once, packets without payload do not count, and
+ * discontinuities flagged in the adaptation field start over.
+ */
+static void check_continuity(UDP_INPUT *input, const uint8_t *data, int size) {
+    int pid, counter, last;
+
+    for (; size >= TS_PACKET_SIZE; data += TS_PACKET_SIZE, size -= TS_PACKET_SIZE) {
+        pid = ((data[1] & 0x1F) << 8) | data[2];
+        if (data[0] != 0x47 || pid == TS_NULL_PID || !(data[3] & 0x10)) {
+            continue;
+        }
+
+        counter = data[3] & 0x0F;
+        last = input->continuity[pid];
+        input->continuity[pid] = counter;
+
+        if (last < 0 || ((data[3] & 0x20) && data[4] && (data[5] & 0x80))) {
+            continue;
+        }
+        if (counter != last && counter != ((last + 1) & 0x0F)) {
+            ++input->continuityErrors;
+        }
+    }
+}
+
+/**
+ * Used to receive the next batch, waiting for one datagram at most the
+ * receive timeout, or not at all for a nonblocking input.
+ *
+ * @return int the datagrams received, 0 on timeout or when none is there, -1 on errors.
+ */
+static int receive_batch(UDP_INPUT *input) {
+    int count;
+
+    count = recvmmsg(input->fd, input->messages, UDP_INPUT_BATCH, input->nonblocking ? MSG_DONTWAIT : MSG_WAITFORONE, NULL);
+    if (count < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1;
+    }
+
+    input->received = count;
+    input->next = 0;
+    if (count) {
+        ++input->batches;
+        input->lastDatagram = getMonotonicMilliseconds();
+    }
+
+    return count;
+}
+
+/**
+ * Used to read the stream, in order. It only waits when nothing at all can be
+ * handed out.
+ *
+ * @param UDP_INPUT *input the input.
+ * @param uint8_t *buffer the destination.
+ * @param int size the destination size.
+ * @return int the bytes read, 0 once the input timed out, -1 on errors, or with errno EAGAIN when a
+ * nonblocking input has nothing to hand out yet.
+ */
+int udpInputRead(UDP_INPUT *input, uint8_t *buffer, int size) {
+    UDP_DATAGRAM *slot;
+    double now;
+    int copied = 0, chunk, count;
+
+    while (copied < size) {
+        if (input->current.data) {
+            if (input->current.offset < input->current.size) {
+                chunk = input->current.size - input->current.offset;
+                chunk = chunk < size - copied ? chunk : size - copied;
+                memcpy(buffer + copied, input->current.data + input->current.offset, chunk);
+                input->current.offset += chunk;
+                copied += chunk;
+                continue;
+            }
+            input->spare[input->spareCount++] = input->current.data;
+            input->current.data = NULL;
+        }
+
+        slot = &input->slots[input->head];
+        if (slot->data || (input->skipping && input->buffered)) {
+            if (slot->data) {
+                input->current = *slot;
+                slot->data = NULL;
+                --input->buffered;
+                input->skipping = 0;
+                input->gapSince = 0;
+                check_continuity(input, input->current.data + input->current.offset, input->current.size - input->current.offset);
+            } else if (!input->resyncing) {
+                ++input->lost;
+            }
+            input->head = (input->head + 1) % input->depth;
+            ++input->expected;
+            continue;
+        }
+        input->skipping = input->resyncing = 0;
+
+        if (input->next < input->received) {
+            sort_datagram(input);
+            continue;
+        }
+
+        if (copied) {
+            break;
+        }
+
+        // A missing datagram is waited for latency milliseconds at most.
+        now = getMonotonicMilliseconds();
+        if (input->buffered) {
+            if (!input->gapSince) {
+                input->gapSince = now;
+            } else if (now - input->gapSince >= input->latency) {
+                input->skipping = 1;
+                continue;
+            }
+        } else if (input->timeout && now - input->lastDatagram >= input->timeout) {
+            return 0;
+        }
+
+        if ((count = receive_batch(input)) < 0) {
+            return -1;
+        }
+        if (!count && input->nonblocking) {
+            errno = EAGAIN;
+            return -1;
+        }
+    }
+
+    return copied;
+}
+
+/**
+ * Used to tell whether a read would hand something out, or end the input,
+ * without waiting on the socket, whose readiness is polled apart. A gap at the
+ * head starts being waited for here, so it is given up on in time even when
+ * nothing else arrives.
+ *
+ * @param UDP_INPUT *input the input.
+ * @return int 1 when a read does not wait, 0 otherwise.
+ */
+int udpInputPending(UDP_INPUT *input) {
+    double now;
+
+    if ((input->current.data && input->current.offset < input->current.size) || input->slots[input->head].data
+            || (input->skipping && input->buffered) || input->next < input->received) {
+        return 1;
+    }
+
+    now = getMonotonicMilliseconds();
+    if (input->buffered) {
+        if (!input->gapSince) {
+            input->gapSince = now;
+        }
+        return now - input->gapSince >= input->latency;
+    }
+
+    return input->timeout && now - input->lastDatagram >= input->timeout;
+}
+
+/**
+ * Used to close an input.
+ *
+ * @param UDP_INPUT *input the input.
+ */
+void udpInputClose(UDP_INPUT *input) {
+    if (input->fd >= 0) {
+        close(input->fd);
+        input->fd = -1;
+    }
+
+    free(input->messages);
+    free(input->vectors);
+    free(input->slots);
+    free(input->spare);
+    free(input->buffers);
+    input->messages = NULL;
+    input->vectors = NULL;
+    input->slots = NULL;
+    input->spare = NULL;
+    input->buffers = NULL;
+}
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab
@@ -0,0 +1,134 @@
+/**
+ * @file
+ * UDP and RTP input prototypes.
+ *
+ * Copyright © 2015, Ahmed Kamal. (https://github.com/ahmedkamals)
+ *
+ * This file is part of Ahmed Kamal's segmenter configurations.
+ * ® Redistributions of files must retain the above copyright notice.
+ *
+ * @copyright     Ahmed Kamal (https://github.com/ahmedkamals)
+ * @link          https://github.com/ahmedkamals/dev-environment
+ * @package       AK
+ * @subpackage    Segmenter
+ * @version       1.0
+ * @since         2015-01-25 Happy day :)
+ * @license
+ * @author        Ahmed Kamal <me.ahmed.kamal@gmail.com>
+ * @modified      2015-01-25
+ */
+
+/**
+ * The input reads MPEG-TS from UDP datagrams, unicast or multicast, either as
+ * is ("udp://") or in RTP ("rtp://"), with no receiver process in between.
+ * Datagrams are received in batches, with one recvmmsg() call, into buffers
+ * allocated once, and handed out by pointer: the only copy is the one into the
+ * demuxer buffer, or into the ring of a supervised channel. RTP datagrams are put back in order in a jitter buffer of
+ * depth datagrams; a missing one is given up once the buffer is full, or once
+ * it has been waited for latency milliseconds, and counted as lost. The
+ * continuity counters of the TS packets are checked as they are handed out.
+ * It expects <stdint.h> to be included first.
+ */
+#define UDP_INPUT_BATCH 64
+
+/**
+ * Largest datagram kept, longer ones are counted as discarded.
+ */
+#define UDP_INPUT_DATAGRAM_SIZE 2048
+
+#define UDP_INPUT_DEFAULT_BUFFER (8 * 1024 * 1024)
+#define UDP_INPUT_DEFAULT_DEPTH 64
+#define UDP_INPUT_DEFAULT_LATENCY 50
+
+/**
+ * RTP sequence numbers jumping further than this, either way, mean the sender
+ * restarted: the numbering starts over, instead of counting losses.
+ */
+#define UDP_INPUT_RESYNC 3000
+
+#define UDP_INPUT_TS_PIDS 8192
+
+typedef struct udp_datagram {
+    /**
+     * @var uint8_t *data the datagram, NULL for an empty slot.
+     * @var int size the end of the payload.
+     * @var int offset the next byte handed out, the payload start at first.
+     */
+    uint8_t *data;
+    int size,
+        offset;
+} UDP_DATAGRAM;
+
+typedef struct udp_input {
+    int fd,
+        rtp;
+
+    /**
+     * The batch being received into, and the next datagram of it to sort.
+     */
+    struct mmsghdr *messages;
+    struct iovec *vectors;
+    int received,
+        next;
+
+    /**
+     * @var UDP_DATAGRAM *slots the jitter buffer, slot head holds the expected sequence number.
+     * @var uint8_t **spare the buffers free for the batch.
+     * @var UDP_DATAGRAM current the datagram being handed out.
+     */
+    UDP_DATAGRAM *slots,
+                 current;
+    uint8_t **spare,
+            *buffers;
+    int depth,
+        head,
+        buffered,
+        spareCount;
+    uint16_t expected,
+             arrivals;
+
+    /**
+     * @var int skipping used to give up on the missing datagrams at the head, until one is there.
+     * @var int resyncing used to deliver the buffered datagrams before the numbering starts over.
+     * @var double gapSince when the reader started waiting for a missing datagram, 0 when it is not.
+     */
+    int started,
+        skipping,
+        resyncing,
+        latency;
+
+    /**
+     * @var int nonblocking used when the caller polls the socket itself: a read finding nothing to hand out
+     * fails with EAGAIN, instead of waiting for a datagram.
+     */
+    int nonblocking;
+    double gapSince,
+           lastDatagram,
+           timeout;
+
+    /**
+     * @var signed char continuity the last continuity counter of each PID, -1 before the first one.
+     */
+    signed char continuity[UDP_INPUT_TS_PIDS];
+
+    /**
+     * @var unsigned long long batches the recvmmsg() calls that returned datagrams.
+     * @var unsigned long long lost the RTP datagrams never received, or given up on.
+     * @var unsigned long long late the RTP datagrams received after they were given up on, or twice.
+     * @var unsigned long long discarded the datagrams truncated, or not RTP on an RTP input.
+     */
+    unsigned long long datagrams,
+                       bytes,
+                       batches,
+                       lost,
+                       late,
+                       discarded,
+                       continuityErrors;
+} UDP_INPUT;
+
+int udpInputOpen(UDP_INPUT *, const char *, int, int, int, double);
+int udpInputRead(UDP_INPUT *, uint8_t *, int);
+int udpInputPending(UDP_INPUT *);
+void udpInputClose(UDP_INPUT *);
+
+// vim:sw=4:tw=4:ts=4:ai:expandtab